@@ -0,0 +1,715 @@
+// ============================================================================
+// NEXUS File Manager - Warm JVM
+// ============================================================================
+//
+// A spare JVM for one Java or Kotlin step of the "file_manager --jvm" client
+// (jvm.c), so the step skips JVM and compiler startup. The server keeps a few
+// spares started:
+//
+//   java ... NexusJvm <dir> <server-pid> <slot> <idle-seconds> <kotlin-home>
+//
+// A spare loads the compilers, then advertises itself in <dir>/spare.<slot>.
+// The client that claims it moves it into its job's cgroup and under its CPU
+// limit before sending the step, so the job's limits, counters, timeout and
+// cancelling all cover the program. The spare runs that one step and exits.
+// It exits at once when the client goes away or the server is gone, and
+// after <idle-seconds> when nobody claims it.
+//
+// System.exit() calls are pointed at Exit when a class is loaded, so the
+// exit status and the last output reach the client before the JVM exits.
+
+import java.io.BufferedInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.DataInputStream;
+import java.io.EOFException;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.InterruptedIOException;
+import java.io.OutputStream;
+import java.io.PrintStream;
+import java.io.UnsupportedEncodingException;
+import java.lang.reflect.InvocationTargetException;
+import java.lang.reflect.Method;
+import java.lang.reflect.Modifier;
+import java.net.InetAddress;
+import java.net.ServerSocket;
+import java.net.Socket;
+import java.net.URL;
+import java.net.URLClassLoader;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.nio.file.StandardCopyOption;
+import java.security.SecureRandom;
+import java.util.ArrayDeque;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.jar.JarFile;
+import java.util.jar.Manifest;
+import javax.tools.JavaCompiler;
+import javax.tools.ToolProvider;
+
+public final class NexusJvm {
+    // Frames both ways: type, 4-byte big-endian length, payload (jvm.h)
+    static final int FRAME_OUT = 'o';
+    static final int FRAME_ERR = 'e';
+    static final int FRAME_EXIT = 'x';
+    static final int FRAME_FALLBACK = 'f';
+    static final int FRAME_IN = 'i';
+    static final int FRAME_MAX = 64 * 1024;
+
+    static final int FALLBACK = Integer.MIN_VALUE;     // Step status: run it cold
+    static final int HEADER_TIMEOUT_MS = 5000;         // A client sends its step right away
+    static final long FLUSH_MS = 50;                   // Output of a busy program goes out this often
+    static final long INPUT_MAX = 64L << 20;           // stdin queued ahead of the program
+
+    static final String[] KOTLIN_JARS = {
+        "kotlin-compiler.jar", "kotlin-stdlib.jar", "kotlin-reflect.jar", "kotlin-script-runtime.jar",
+        "trove4j.jar", "kotlinx-coroutines-core-jvm.jar", "annotations-13.0.jar",
+    };
+
+    static final PrintStream LOG = System.err;         // The spare's own log
+    static final long STARTED = System.currentTimeMillis();
+
+    static Path dir;
+    static long serverPid;
+    static long slot;
+    static long idleMs;
+    static String kotlinHome;                          // null without kotlinc
+    static String token;
+    static volatile boolean claimed;
+    static volatile Run run;                           // The step, once claimed
+    static ClassLoader kotlinLoader;
+
+    public static void main(String[] args) throws Exception {
+        dir = Paths.get(args[0]);
+        serverPid = Long.parseLong(args[1]);
+        slot = Long.parseLong(args[2]);
+        idleMs = Long.parseLong(args[3]) * 1000;
+        kotlinHome = args.length > 4 && !args[4].isEmpty() ? args[4] : null;
+
+        byte[] secret = new byte[16];
+        new SecureRandom().nextBytes(secret);
+        StringBuilder hex = new StringBuilder();
+        for (byte b : secret) hex.append(String.format("%02x", b & 0xff));
+        token = hex.toString();
+
+        ServerSocket server = new ServerSocket(0, 8, InetAddress.getLoopbackAddress());
+        background(NexusJvm::watch, "nexus-watch");
+        warmUp();
+
+        // Written aside and renamed, so a client never reads half of it
+        String name = "spare." + slot;
+        Path tmp = dir.resolve(name + ".tmp");
+        String spare = server.getLocalPort() + " " + token + " " + ProcessHandle.current().pid() + "\n";
+        Files.write(tmp, spare.getBytes(StandardCharsets.US_ASCII));
+        Files.move(tmp, dir.resolve(name), StandardCopyOption.ATOMIC_MOVE);
+        LOG.println("nexus-jvm: spare " + slot + " ready after "
+                    + (System.currentTimeMillis() - STARTED) + " ms");
+
+        // Only a client with the token counts; the first one is served
+        for (;;) {
+            Socket socket = server.accept();
+            if (serve(socket)) break;
+        }
+        LOG.println("nexus-jvm: spare " + slot + " done");
+        LOG.flush();
+        Runtime.getRuntime().halt(0);
+    }
+
+    static void background(Runnable r, String name) {
+        Thread t = new Thread(r, name);
+        t.setDaemon(true);
+        t.start();
+    }
+
+    static void sleep(long ms) {
+        try {
+            Thread.sleep(ms);
+        } catch (InterruptedException e) {
+            Thread.currentThread().interrupt();
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Housekeeping
+    // ------------------------------------------------------------------------
+
+    static void watch() {
+        for (;;) {
+            sleep(1000);
+            if (!ProcessHandle.of(serverPid).isPresent()) {
+                LOG.println("nexus-jvm: server " + serverPid + " is gone");
+                Runtime.getRuntime().halt(0);
+            }
+            if (!claimed && System.currentTimeMillis() - STARTED > idleMs) {
+                LOG.println("nexus-jvm: spare " + slot + " was not claimed, exiting");
+                Runtime.getRuntime().halt(0);
+            }
+        }
+    }
+
+    static void flusher() {
+        for (;;) {
+            sleep(FLUSH_MS);
+            Run r = run;
+            if (r != null) r.frames.flush();
+        }
+    }
+
+    // Load and JIT the compilers before the step needs them
+    static void warmUp() {
+        try {
+            Path warm = Files.createDirectories(dir.resolve("warm-" + slot));
+            Path src = warm.resolve("Warm.java");
+            Files.write(src, "public class Warm { public static void main(String[] a) {} }\n"
+                    .getBytes(StandardCharsets.US_ASCII));
+            JavaCompiler javac = ToolProvider.getSystemJavaCompiler();
+            if (javac != null) javac.run(null, NULL_OUT, NULL_OUT, "-d", warm.toString(), src.toString());
+            Files.deleteIfExists(warm.resolve("Warm.class"));
+            Files.deleteIfExists(src);
+            Files.deleteIfExists(warm);
+            if (kotlinHome != null) {
+                kotlin().loadClass("org.jetbrains.kotlin.cli.jvm.K2JVMCompiler");
+            }
+        } catch (Exception | LinkageError e) {
+            LOG.println("nexus-jvm: warm-up: " + e);
+        }
+    }
+
+    static Thread[] threadsOf(ThreadGroup g) {
+        Thread[] threads = new Thread[g.activeCount() + 8];
+        return Arrays.copyOf(threads, g.enumerate(threads, true));
+    }
+
+    static ClassLoader kotlin() throws IOException {
+        synchronized (NexusJvm.class) {
+            if (kotlinLoader == null) {
+                List<URL> jars = new ArrayList<>();
+                for (String name : KOTLIN_JARS) {
+                    Path jar = Paths.get(kotlinHome, "lib", name);
+                    if (Files.exists(jar)) jars.add(jar.toUri().toURL());
+                }
+                kotlinLoader = new URLClassLoader(jars.toArray(new URL[0]),
+                                                  ClassLoader.getPlatformClassLoader());
+            }
+            return kotlinLoader;
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // The client
+    // ------------------------------------------------------------------------
+
+    // One line of the header
+    static String line(InputStream in) throws IOException {
+        ByteArrayOutputStream line = new ByteArrayOutputStream();
+        for (int c; (c = in.read()) != '\n'; ) {
+            if (c < 0) throw new EOFException();
+            if (line.size() > FRAME_MAX) throw new IOException("header line too long");
+            line.write(c);
+        }
+        return new String(line.toByteArray(), StandardCharsets.UTF_8);
+    }
+
+    // Run the client's step; false if it was not our client after all
+    static boolean serve(Socket socket) {
+        String step;
+        String[] args;
+        InputStream in;
+        try {
+            socket.setTcpNoDelay(true);
+            socket.setSoTimeout(HEADER_TIMEOUT_MS);
+            in = new BufferedInputStream(socket.getInputStream());
+            if (!("NEXUS1 " + token).equals(line(in))) throw new IOException("bad token");
+            claimed = true;
+            step = line(in);
+            args = new String[Integer.parseInt(line(in))];
+            for (int i = 0; i < args.length; i++) args[i] = line(in);
+            socket.setSoTimeout(0);
+        } catch (IOException | RuntimeException e) {
+            LOG.println("nexus-jvm: client: " + e);
+            try {
+                socket.close();
+            } catch (IOException ignored) {
+                // Gone already
+            }
+            return claimed;
+        }
+
+        try {
+            Run r = new Run(new Frames(socket.getOutputStream()));
+            System.setOut(r.out);
+            System.setErr(r.err);
+            System.setIn(r.input);
+            run = r;
+            final DataInputStream frames = new DataInputStream(in);
+            background(() -> pump(frames, r), "nexus-stdin");
+            background(NexusJvm::flusher, "nexus-flush");
+
+            int status = execute(r, step, args);
+            if (status == FALLBACK) {
+                r.frames.send(FRAME_FALLBACK, new byte[0]);
+            } else {
+                r.frames.send(FRAME_EXIT, new byte[] {
+                    (byte) (status >>> 24), (byte) (status >>> 16), (byte) (status >>> 8), (byte) status,
+                });
+            }
+        } catch (Exception e) {
+            LOG.println("nexus-jvm: step: " + e);
+        }
+        return true;
+    }
+
+    // The client's stdin. The client closing the connection before the step
+    // is over means the job was stopped: so is the program.
+    static void pump(DataInputStream in, Run run) {
+        try {
+            for (;;) {
+                int type = in.readUnsignedByte();
+                int len = in.readInt();
+                if (type != FRAME_IN || len < 0 || len > FRAME_MAX) throw new IOException("bad frame");
+                byte[] data = new byte[len];
+                in.readFully(data);
+                run.input.feed(len > 0 ? data : null);
+            }
+        } catch (IOException e) {
+            LOG.println("nexus-jvm: client gone, stopping");
+            LOG.flush();
+            Runtime.getRuntime().halt(1);
+        }
+    }
+
+    static int execute(Run run, String step, String[] args) throws Exception {
+        switch (step) {
+            case "javac": {
+                JavaCompiler javac = ToolProvider.getSystemJavaCompiler();
+                if (javac == null || args.length < 2) return FALLBACK;
+                return javac.run(EMPTY_IN, run.out, run.err, "-d", args[0], args[1]);
+            }
+            case "kotlinc": {
+                if (kotlinHome == null || args.length < 2) return FALLBACK;
+                Method exec;
+                Object compiler;
+                try {
+                    Class<?> k = kotlin().loadClass("org.jetbrains.kotlin.cli.jvm.K2JVMCompiler");
+                    compiler = k.getDeclaredConstructor().newInstance();
+                    exec = k.getMethod("exec", PrintStream.class, String[].class);
+                } catch (ReflectiveOperationException | LinkageError e) {
+                    LOG.println("nexus-jvm: kotlin compiler: " + e);
+                    return FALLBACK;
+                }
+                ClassLoader saved = Thread.currentThread().getContextClassLoader();
+                Thread.currentThread().setContextClassLoader(kotlinLoader);
+                try {
+                    Object code = exec.invoke(compiler, run.err, new String[] {
+                        args[0], "-include-runtime", "-d", args[1], "-kotlin-home", kotlinHome,
+                    });
+                    return (Integer) code.getClass().getMethod("getCode").invoke(code);
+                } finally {
+                    Thread.currentThread().setContextClassLoader(saved);
+                }
+            }
+            case "java":
+                if (args.length < 2) return FALLBACK;
+                return launch(run, args[0].split(":"), args[1]);
+            case "java-jar": {
+                if (args.length < 1) return FALLBACK;
+                String main = null;
+                try (JarFile jar = new JarFile(args[0])) {
+                    Manifest m = jar.getManifest();
+                    if (m != null) main = m.getMainAttributes().getValue("Main-Class");
+                } catch (IOException e) {
+                    return FALLBACK;
+                }
+                return main != null ? launch(run, new String[] {args[0]}, main) : FALLBACK;
+            }
+            default:
+                return FALLBACK;
+        }
+    }
+
+    // Run main() on a thread group of its own and wait for the program to
+    // end the way a JVM would: main and every non-daemon thread done, or exit()
+    static int launch(Run run, String[] classpath, String mainClass) throws Exception {
+        URL[] urls = new URL[classpath.length];
+        for (int i = 0; i < classpath.length; i++) urls[i] = Paths.get(classpath[i]).toUri().toURL();
+        RunLoader loader = new RunLoader(urls);
+        Method main;
+        try {
+            main = Class.forName(mainClass, false, loader).getMethod("main", String[].class);
+        } catch (ReflectiveOperationException | LinkageError e) {
+            loader.close();
+            return FALLBACK;        // The cold java explains it best
+        }
+        if (!Modifier.isStatic(main.getModifiers())) {
+            loader.close();
+            return FALLBACK;        // Instance main(): newer launcher protocols
+        }
+
+        RunGroup group = new RunGroup(run);
+        Thread thread = new Thread(group, () -> {
+            try {
+                main.invoke(null, (Object) new String[0]);
+            } catch (InvocationTargetException e) {
+                if (!(e.getCause() instanceof Exit.Unwind)) {
+                    group.uncaughtException(Thread.currentThread(), e.getCause());
+                    run.failed = true;
+                }
+            } catch (IllegalAccessException e) {
+                group.uncaughtException(Thread.currentThread(), e);
+                run.failed = true;
+            }
+        }, "main");
+        thread.setContextClassLoader(loader);
+        thread.start();
+
+        for (;;) {
+            thread.join(10);
+            if (run.exited) break;
+            if (thread.isAlive()) continue;
+            boolean waiting = false;
+            for (Thread t : threadsOf(group)) waiting |= !t.isDaemon();
+            if (!waiting) break;
+        }
+        run.out.flush();
+        run.err.flush();
+        return run.exited ? run.exitStatus : run.failed ? 1 : 0;
+    }
+
+    // ------------------------------------------------------------------------
+    // The program
+    // ------------------------------------------------------------------------
+
+    static final class Run {
+        final Frames frames;
+        final RunInput input;
+        final PrintStream out;
+        final PrintStream err;
+        volatile boolean exited;
+        volatile int exitStatus;
+        volatile boolean failed;            // main() threw
+
+        Run(Frames frames) throws UnsupportedEncodingException {
+            this.frames = frames;
+            this.input = new RunInput(frames);
+            this.out = new PrintStream(new FrameStream(frames, FRAME_OUT), false, "UTF-8");
+            this.err = new PrintStream(new FrameStream(frames, FRAME_ERR), false, "UTF-8");
+        }
+
+        synchronized void exit(int status) {
+            if (exited) return;
+            exitStatus = status;
+            exited = true;
+        }
+    }
+
+    // Threads of the program: uncaught exceptions print like the JVM's own
+    static final class RunGroup extends ThreadGroup {
+        private final Run run;
+
+        RunGroup(Run run) {
+            super("nexus-run");
+            this.run = run;
+        }
+
+        @Override
+        public void uncaughtException(Thread t, Throwable e) {
+            if (e instanceof Exit.Unwind) return;
+            synchronized (run.err) {
+                run.err.print("Exception in thread \"" + t.getName() + "\" ");
+                e.printStackTrace(run.err);
+            }
+        }
+    }
+
+    // Output of one program, in order across stdout and stderr and batched
+    // into frames; a frame goes out when the stream switches, the buffer
+    // fills, the program waits for input, or every FLUSH_MS
+    static final class Frames {
+        private final OutputStream socket;
+        private final byte[] buf = new byte[5 + FRAME_MAX];
+        private int len;
+        private int type;
+        private boolean broken;
+
+        Frames(OutputStream socket) {
+            this.socket = socket;
+        }
+
+        synchronized void write(int t, byte[] b, int off, int n) {
+            if (len > 0 && t != type) flush();
+            type = t;
+            while (n > 0) {
+                int k = Math.min(n, FRAME_MAX - len);
+                System.arraycopy(b, off, buf, 5 + len, k);
+                len += k;
+                off += k;
+                n -= k;
+                if (len == FRAME_MAX) flush();
+            }
+        }
+
+        synchronized void flush() {
+            if (len == 0) return;
+            header(buf, type, len);
+            emit(buf, 5 + len);
+            len = 0;
+        }
+
+        synchronized void send(int t, byte[] payload) {
+            flush();
+            byte[] frame = new byte[5 + payload.length];
+            header(frame, t, payload.length);
+            System.arraycopy(payload, 0, frame, 5, payload.length);
+            emit(frame, frame.length);
+        }
+
+        private static void header(byte[] b, int t, int n) {
+            b[0] = (byte) t;
+            b[1] = (byte) (n >>> 24);
+            b[2] = (byte) (n >>> 16);
+            b[3] = (byte) (n >>> 8);
+            b[4] = (byte) n;
+        }
+
+        private void emit(byte[] b, int n) {
+            if (broken) return;
+            try {
+                socket.write(b, 0, n);
+            } catch (IOException e) {
+                broken = true;      // The client is gone; pump() notices
+            }
+        }
+    }
+
+    static final class FrameStream extends OutputStream {
+        private final Frames frames;
+        private final int type;
+
+        FrameStream(Frames frames, int type) {
+            this.frames = frames;
+            this.type = type;
+        }
+
+        @Override
+        public void write(int b) {
+            frames.write(type, new byte[] {(byte) b}, 0, 1);
+        }
+
+        @Override
+        public void write(byte[] b, int off, int len) {
+            frames.write(type, b, off, len);
+        }
+
+        @Override
+        public void flush() {
+            frames.flush();
+        }
+    }
+
+    // stdin of one program, fed by pump()
+    static final class RunInput extends InputStream {
+        private final Frames frames;
+        private final ArrayDeque<byte[]> chunks = new ArrayDeque<>();
+        private long queued;
+        private byte[] head;
+        private int pos;
+        private boolean eof;
+
+        RunInput(Frames frames) {
+            this.frames = frames;
+        }
+
+        // A chunk, or null at EOF; waits while the program is far behind
+        synchronized void feed(byte[] chunk) {
+            if (chunk == null) {
+                eof = true;
+            } else {
+                while (queued > INPUT_MAX && !eof) {
+                    try {
+                        wait(100);
+                    } catch (InterruptedException e) {
+                        return;
+                    }
+                }
+                chunks.add(chunk);
+                queued += chunk.length;
+            }
+            notifyAll();
+        }
+
+        @Override
+        public int read() throws IOException {
+            byte[] one = new byte[1];
+            return read(one, 0, 1) < 0 ? -1 : one[0] & 0xff;
+        }
+
+        @Override
+        public int read(byte[] b, int off, int len) throws IOException {
+            if (len == 0) return 0;
+            frames.flush();     // A prompt shows before the program waits for the answer
+            synchronized (this) {
+                while ((head == null || pos == head.length) && chunks.isEmpty() && !eof) {
+                    try {
+                        wait();
+                    } catch (InterruptedException e) {
+                        Thread.currentThread().interrupt();
+                        throw new InterruptedIOException();
+                    }
+                }
+                if (head == null || pos == head.length) {
+                    head = chunks.poll();
+                    pos = 0;
+                    if (head == null) return -1;
+                    queued -= head.length;
+                    notifyAll();
+                }
+                int n = Math.min(len, head.length - pos);
+                System.arraycopy(head, pos, b, off, n);
+                pos += n;
+                return n;
+            }
+        }
+
+        @Override
+        public synchronized int available() {
+            return (head != null ? head.length - pos : 0) + (chunks.isEmpty() ? 0 : chunks.peek().length);
+        }
+    }
+
+    static final InputStream EMPTY_IN = new InputStream() {
+        @Override
+        public int read() {
+            return -1;
+        }
+    };
+
+    static final OutputStream NULL_OUT = new OutputStream() {
+        @Override
+        public void write(int b) {
+        }
+    };
+
+    // ------------------------------------------------------------------------
+    // Program classes: a fresh loader per run, System.exit() pointed at Exit
+    // ------------------------------------------------------------------------
+
+    public static final class Exit {
+        // Thrown through the program's frames once its exit status is set
+        public static final class Unwind extends Error {
+            Unwind() {
+                super("System.exit", null, false, false);
+            }
+        }
+
+        public static void exit(int status) {
+            Run r = run;
+            if (r != null) r.exit(status);
+            throw new Unwind();
+        }
+    }
+
+    static final class RunLoader extends URLClassLoader {
+        RunLoader(URL[] urls) {
+            super(urls, ClassLoader.getPlatformClassLoader());
+        }
+
+        @Override
+        protected Class<?> loadClass(String name, boolean resolve) throws ClassNotFoundException {
+            if (name.startsWith("NexusJvm$Exit")) return NexusJvm.class.getClassLoader().loadClass(name);
+            return super.loadClass(name, resolve);
+        }
+
+        @Override
+        protected Class<?> findClass(String name) throws ClassNotFoundException {
+            URL url = findResource(name.replace('.', '/') + ".class");
+            if (url == null) throw new ClassNotFoundException(name);
+            byte[] bytes;
+            try (InputStream in = url.openStream()) {
+                ByteArrayOutputStream all = new ByteArrayOutputStream();
+                byte[] chunk = new byte[8192];
+                for (int n; (n = in.read(chunk)) > 0; ) all.write(chunk, 0, n);
+                bytes = redirectExit(all.toByteArray());
+            } catch (IOException e) {
+                throw new ClassNotFoundException(name, e);
+            }
+            return defineClass(name, bytes, 0, bytes.length);
+        }
+    }
+
+    static int u2(byte[] b, int at) {
+        return (b[at] & 0xff) << 8 | (b[at + 1] & 0xff);
+    }
+
+    // Whether constant pool entry `index` is the UTF-8 string s
+    static boolean utf8Is(byte[] b, int[] offset, int index, String s) {
+        if (index <= 0 || index >= offset.length || offset[index] == 0) return false;
+        int at = offset[index];
+        if (b[at] != 1 || u2(b, at + 1) != s.length()) return false;
+        for (int i = 0; i < s.length(); i++) {
+            if (b[at + 3 + i] != (byte) s.charAt(i)) return false;
+        }
+        return true;
+    }
+
+    // Point every Methodref to java/lang/System.exit(I)V at Exit instead.
+    // Two entries are appended to the constant pool (the class name and the
+    // class) and the refs' class index is changed, so no bytecode moves.
+    static byte[] redirectExit(byte[] b) {
+        if (b.length < 10 || u2(b, 0) != 0xCAFE) return b;
+        int count = u2(b, 8);
+        int[] offset = new int[count];
+        int at = 10;
+        for (int i = 1; i < count; i++) {
+            if (at >= b.length) return b;
+            offset[i] = at;
+            switch (b[at]) {
+                case 1: at += 3 + u2(b, at + 1); break;                     // Utf8
+                case 3: case 4: at += 5; break;                             // Integer, Float
+                case 5: case 6: at += 9; i++; break;                        // Long, Double: two slots
+                case 7: case 8: case 16: case 19: case 20: at += 3; break;  // Class, String, MethodType, Module, Package
+                case 9: case 10: case 11: case 12: case 17: case 18: at += 5; break;
+                case 15: at += 4; break;                                    // MethodHandle
+                default: return b;                                          // Unknown: leave the class alone
+            }
+        }
+        if (at > b.length) return b;
+
+        List<Integer> refs = new ArrayList<>();
+        for (int i = 1; i < count; i++) {
+            int o = offset[i];
+            if (o == 0 || b[o] != 10) continue;
+            int cls = u2(b, o + 1), nat = u2(b, o + 3);
+            if (cls >= count || nat >= count || offset[cls] == 0 || offset[nat] == 0) continue;
+            if (!utf8Is(b, offset, u2(b, offset[cls] + 1), "java/lang/System")) continue;
+            if (utf8Is(b, offset, u2(b, offset[nat] + 1), "exit") &&
+                utf8Is(b, offset, u2(b, offset[nat] + 3), "(I)V")) {
+                refs.add(o);
+            }
+        }
+        if (refs.isEmpty() || count + 2 > 0xffff) return b;
+
+        byte[] name = "NexusJvm$Exit".getBytes(StandardCharsets.US_ASCII);
+        byte[] copy = b.clone();
+        for (int o : refs) {
+            copy[o + 1] = (byte) ((count + 1) >> 8);
+            copy[o + 2] = (byte) (count + 1);
+        }
+        copy[8] = (byte) ((count + 2) >> 8);
+        copy[9] = (byte) (count + 2);
+        ByteArrayOutputStream out = new ByteArrayOutputStream(b.length + name.length + 6);
+        out.write(copy, 0, at);
+        out.write(1);                                   // #count: "NexusJvm$Exit"
+        out.write(name.length >> 8);
+        out.write(name.length);
+        out.write(name, 0, name.length);
+        out.write(7);                                   // #count + 1: its class
+        out.write(count >> 8);
+        out.write(count);
+        out.write(copy, at, copy.length - at);
+        return out.toByteArray();
+    }
+}
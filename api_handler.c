@@ -3,11 +3,88 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <errno.h>
 #include <unistd.h>
 #include "api_handler.h"
+#include "arena.h"
+#include "bench.h"
+#include "build.h"
+#include "compress.h"
+#include "exec.h"
+#include "json_body.h"
+#include "json_writer.h"
+#include "jvm.h"
+#include "metrics.h"
 #include "mongoose.h"
+#include "objcache.h"
+#include "pty.h"
+#include "router.h"
+#include "tcc.h"
+#include "tests.h"
+#include "toolchain.h"
+#include "trace.h"
+#include "watch.h"
 
-#define MAX_OUTPUT_SIZE 8192
+#define MAX_OUTPUT_SIZE 65536         // Inline in the reply; the rest via /api/jobs/output
+
+_Static_assert(sizeof(struct request_state) <= MG_DATA_SIZE,
+               "request_state must fit in mg_connection::data");
+
+struct request_state *request_state(struct mg_connection *c) {
+    return (struct request_state *) c->data;
+}
+
+// Scratch arena for the request being handled on this connection.
+// Keep-alive requests reuse the same arena.
+struct arena *request_arena(struct mg_connection *c) {
+    struct request_state *rs = request_state(c);
+    if (rs->arena == NULL) rs->arena = arena_acquire();
+    return rs->arena;
+}
+
+// End of request: drop scratch memory and report how much was needed.
+// A reply still to come keeps the negotiated coding (and HEAD) until
+// request_replied().
+void request_end(struct mg_connection *c) {
+    struct request_state *rs = request_state(c);
+    if (!rs->deferred) {
+        rs->encoding = COMPRESS_NONE;
+        rs->head = false;
+    }
+    if (rs->arena == NULL) return;
+    size_t peak = arena_reset(rs->arena);
+    MG_DEBUG(("%lu request arena peak: %lu bytes", c->id, (unsigned long) peak));
+}
+
+void request_replied(struct mg_connection *c, int status, size_t bytes_out) {
+    struct request_state *rs = request_state(c);
+    if (!rs->deferred) return;
+    rs->deferred = false;
+    rs->encoding = COMPRESS_NONE;
+    rs->head = false;
+    router_replied(c, status, bytes_out);
+}
+
+// Traced response fully handed to the kernel
+void request_sent(struct mg_connection *c) {
+    struct request_state *rs = request_state(c);
+    if (rs->trace_send == 0 || c->send.len > 0) return;
+    trace_end("socket.write", rs->trace_send);
+    rs->trace_send = 0;
+}
+
+// Connection closed: return its arena to the thread-local pool
+void request_close(struct mg_connection *c) {
+    struct request_state *rs = request_state(c);
+    arena_release(rs->arena);
+    rs->arena = NULL;
+    compress_stream_free(rs->stream);
+    rs->stream = NULL;
+    exec_unsubscribe(c->id);
+    router_forget(c);
+    pty_close(c);
+    watch_close(c);
+}
 
 // Helper function to get file extension
 const char* get_extension(const char* filename) {
@@ -33,29 +110,29 @@ void handle_list_files(struct mg_connection *c, const char *location) {
     
     DIR *dir = opendir(path);
     if (!dir) {
-        mg_http_reply(c, 500, "Content-Type: application/json\r\n", 
-                     "{\"error\": \"Cannot open directory\"}");
+        json_reply_error(c, 500, "Cannot open directory");
         return;
     }
     
-    char response[8192] = "{\"files\": [";
-    struct dirent *entry;
-    int first = 1;
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_key(&w, "files");
+    jw_array_begin(&w);
     
+    uint64_t span = trace_begin();
+    struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
         if (entry->d_type == DT_REG) {
-            if (!first) strcat(response, ", ");
-            strcat(response, "\"");
-            strcat(response, entry->d_name);
-            strcat(response, "\"");
-            first = 0;
+            jw_string(&w, entry->d_name);
         }
     }
     
     closedir(dir);
-    strcat(response, "]}");
-    
-    mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s", response);
+    trace_end("disk.readdir", span);
+    jw_array_end(&w);
+    jw_object_end(&w);
+    jw_end(&w);
 }
 
 // View file contents
@@ -69,65 +146,44 @@ void handle_view_file(struct mg_connection *c, const char *filename, const char
     
     FILE *fp = fopen(filepath, "r");
     if (!fp) {
-        mg_http_reply(c, 404, "Content-Type: application/json\r\n", 
-                     "{\"error\": \"File not found\"}");
+        json_reply_error(c, 404, "File not found");
         return;
     }
     
-    fseek(fp, 0, SEEK_END);
-    long size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    
-    char *content = malloc(size + 1);
-    if (!content) {
+    size_t chunk_size = 64 * 1024;
+    char *chunk = arena_alloc(request_arena(c), chunk_size);
+    if (!chunk) {
         fclose(fp);
-        mg_http_reply(c, 500, "Content-Type: application/json\r\n", 
-                     "{\"error\": \"Memory allocation failed\"}");
+        json_reply_error(c, 500, "Memory allocation failed");
         return;
     }
     
-    fread(content, 1, size, fp);
-    content[size] = '\0';
-    fclose(fp);
-    
-    // Escape JSON special characters
-    char *response = malloc(size * 2 + 100);
-    strcpy(response, "{\"content\": \"");
-    
-    char *out = response + strlen(response);
-    for (long i = 0; i < size; i++) {
-        if (content[i] == '"') {
-            *out++ = '\\';
-            *out++ = '"';
-        } else if (content[i] == '\\') {
-            *out++ = '\\';
-            *out++ = '\\';
-        } else if (content[i] == '\n') {
-            *out++ = '\\';
-            *out++ = 'n';
-        } else if (content[i] == '\r') {
-            *out++ = '\\';
-            *out++ = 'r';
-        } else if (content[i] == '\t') {
-            *out++ = '\\';
-            *out++ = 't';
-        } else {
-            *out++ = content[i];
-        }
+    // Escape straight from the file into the send buffer
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_key(&w, "content");
+    jw_string_open(&w);
+    size_t n;
+    uint64_t span = trace_begin();
+    while ((n = fread(chunk, 1, chunk_size, fp)) > 0) {
+        trace_end("disk.read", span);
+        span = trace_begin();
+        jw_string_append(&w, chunk, n);
+        trace_end("json.escape", span);
+        span = trace_begin();
     }
-    *out = '\0';
-    
-    strcat(response, "\"}");
+    trace_end("disk.read", span);
+    jw_string_close(&w);
+    jw_object_end(&w);
+    jw_end(&w);
     
-    mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s", response);
-    
-    free(content);
-    free(response);
+    fclose(fp);
 }
 
 // Create new file
 void handle_create_file(struct mg_connection *c, const char *filename, 
-                       const char *content, const char *location) {
+                       const struct json_field *content, const char *location) {
     char filepath[1024];
     if (location && strlen(location) > 0) {
         snprintf(filepath, sizeof(filepath), "%s/%s", location, filename);
@@ -137,21 +193,32 @@ void handle_create_file(struct mg_connection *c, const char *filename,
     
     FILE *fp = fopen(filepath, "w");
     if (!fp) {
-        mg_http_reply(c, 500, "Content-Type: application/json\r\n", 
-                     "{\"error\": \"Cannot create file\"}");
+        json_reply_error(c, 500, "Cannot create file");
         return;
     }
     
-    fprintf(fp, "%s", content);
-    fclose(fp);
+    // Unescape the request body straight into the file
+    uint64_t span = trace_begin();
+    bool ok = content->found ? json_field_write(content, fp) : true;
+    if (fclose(fp) != 0) ok = false;
+    trace_end("disk.write", span);
+    if (!ok) {
+        json_reply_error(c, 500, "Cannot write file");
+        return;
+    }
     
-    mg_http_reply(c, 200, "Content-Type: application/json\r\n", 
-                 "{\"success\": true, \"message\": \"File created successfully\"}");
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_bool(&w, "success", true);
+    jw_kv_str(&w, "message", "File created successfully");
+    jw_object_end(&w);
+    jw_end(&w);
 }
 
 // Edit file
 void handle_edit_file(struct mg_connection *c, const char *filename, 
-                     const char *content, const char *location) {
+                     const struct json_field *content, const char *location) {
     handle_create_file(c, filename, content, location);
 }
 
@@ -165,11 +232,15 @@ void handle_delete_file(struct mg_connection *c, const char *filename, const cha
     }
     
     if (remove(filepath) == 0) {
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n", 
-                     "{\"success\": true, \"message\": \"File deleted\"}");
+        struct json_writer w;
+        jw_begin(&w, c, 200);
+        jw_object_begin(&w);
+        jw_kv_bool(&w, "success", true);
+        jw_kv_str(&w, "message", "File deleted");
+        jw_object_end(&w);
+        jw_end(&w);
     } else {
-        mg_http_reply(c, 500, "Content-Type: application/json\r\n", 
-                     "{\"error\": \"Cannot delete file\"}");
+        json_reply_error(c, 500, "Cannot delete file");
     }
 }
 
@@ -182,10 +253,12 @@ void handle_file_exists(struct mg_connection *c, const char *filename, const cha
         snprintf(filepath, sizeof(filepath), "%s", filename);
     }
     
-    int exists = file_exists(filepath);
-    
-    mg_http_reply(c, 200, "Content-Type: application/json\r\n", 
-                 "{\"exists\": %s}", exists ? "true" : "false");
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_bool(&w, "exists", file_exists(filepath));
+    jw_object_end(&w);
+    jw_end(&w);
 }
 
 // Browse directories
@@ -199,43 +272,255 @@ void handle_browse_directories(struct mg_connection *c, const char *path) {
     
     DIR *dir = opendir(dirpath);
     if (!dir) {
-        mg_http_reply(c, 500, "Content-Type: application/json\r\n", 
-                     "{\"error\": \"Cannot open directory\"}");
+        json_reply_error(c, 500, "Cannot open directory");
         return;
     }
     
-    char response[8192];
-    snprintf(response, sizeof(response), "{\"directories\": [");
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_key(&w, "directories");
+    jw_array_begin(&w);
     
+    uint64_t span = trace_begin();
     struct dirent *entry;
-    int first = 1;
-    
     while ((entry = readdir(dir)) != NULL) {
         if (entry->d_type == DT_DIR && strcmp(entry->d_name, ".") != 0 && 
             strcmp(entry->d_name, "..") != 0) {
-            if (!first) strcat(response, ", ");
-            strcat(response, "\"");
-            strcat(response, entry->d_name);
-            strcat(response, "\"");
-            first = 0;
+            jw_string(&w, entry->d_name);
         }
     }
     
     closedir(dir);
+    trace_end("disk.readdir", span);
+    
+    jw_array_end(&w);
+    jw_kv_str(&w, "currentPath", dirpath);
+    jw_object_end(&w);
+    jw_end(&w);
+}
+
+// Why a job did not finish on its own, for the error message
+static const char *execute_end_text(enum exec_end end) {
+    switch (end) {
+        case EXEC_TIMEOUT: return "Execution timed out";
+        case EXEC_CPU_TIMEOUT: return "CPU time limit exceeded";
+        case EXEC_CANCELLED: return "Execution cancelled";
+        case EXEC_NOT_STARTED: return "Could not start execution";
+        default: return "Execution failed";
+    }
+}
+
+// Compiling actions queue behind quick runs
+static bool is_build(const char *ext, const char *action) {
+    struct toolchain tc;
+    return strcmp(action, "run") != 0 && toolchain_get(ext, &tc) &&
+           toolchain_has(&tc, TOOLCHAIN_COMPILE);
+}
+
+// Write a finished job's result to one waiting connection
+static void execute_reply(struct mg_connection *c, struct exec_job *job) {
+    const struct exec_stats *st = &job->stats;
+    int result = st->exit_code;
     
-    char cwd[1024];
-    getcwd(cwd, sizeof(cwd));
+    // Copy output (capped at MAX_OUTPUT_SIZE) straight into the response
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_bool(&w, "success", result == 0 && job->end == EXEC_EXITED);
+    jw_kv_int(&w, "jobId", (long long) job->id);
+    jw_key(&w, "output");
+    jw_string_open(&w);
     
-    strcat(response, "], \"currentPath\": \"");
-    strcat(response, dirpath);
-    strcat(response, "\"}");
+    char chunk[4096];
+    size_t total = 0, n;
+    while (total < MAX_OUTPUT_SIZE &&
+           (n = output_read(job->output, total, chunk, sizeof(chunk))) > 0) {
+        if (n > MAX_OUTPUT_SIZE - total) n = MAX_OUTPUT_SIZE - total;
+        jw_string_append(&w, chunk, n);
+        total += n;
+    }
+    jw_string_close(&w);
+    jw_kv_int(&w, "outputBytes", (long long) job->output->total);
+    if (job->output->total > total) jw_kv_bool(&w, "outputTruncated", true);
     
-    mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s", response);
+    if (result != 0 || job->end != EXEC_EXITED) {
+        jw_kv_str(&w, "error", execute_end_text(job->end));
+    }
+    if (job->end == EXEC_TIMEOUT) jw_kv_bool(&w, "timedOut", true);
+    if (job->end == EXEC_CPU_TIMEOUT) jw_kv_bool(&w, "cpuTimeExceeded", true);
+    if (job->end == EXEC_CANCELLED) jw_kv_bool(&w, "cancelled", true);
+    jw_kv_int(&w, "exitCode", result);
+    if (st->signal != 0) jw_kv_int(&w, "signal", st->signal);
+    jw_key(&w, "stats");
+    jw_object_begin(&w);
+    jw_kv_double(&w, "queueMs", st->queue_ms);
+    jw_kv_double(&w, "wallMs", st->wall_ms);
+    jw_kv_double(&w, "userMs", st->user_ms);
+    jw_kv_double(&w, "sysMs", st->sys_ms);
+    jw_kv_int(&w, "maxRssKb", st->max_rss_kb);
+    jw_kv_int(&w, "ioReadBytes", st->io_read);
+    jw_kv_int(&w, "ioWriteBytes", st->io_write);
+    jw_kv_bool(&w, "cgroup", st->cgroup);
+    if (st->cgroup) {
+        // Only a leaf with every configured limit in place counts as one
+        const struct exec_limits *lim = exec_limits();
+        jw_key(&w, "limits");
+        jw_object_begin(&w);
+        jw_kv_double(&w, "cpus", lim->cpus);
+        jw_kv_int(&w, "memoryBytes", lim->memory_max);
+        jw_kv_int(&w, "pids", lim->pids_max);
+        jw_object_end(&w);
+    }
+    jw_object_end(&w);
+    jw_object_end(&w);
+    jw_end(&w);
 }
 
-// Execute code file with enhanced language support
-void handle_execute_file(struct mg_connection *c, const char *filename, 
-                        const char *action, const char *location) {
+// A job ended: record it and answer the connections still waiting for it
+static void execute_done(struct exec_job *job) {
+    struct mg_mgr *mgr = job->data;
+    metrics_exec_queued(job->priority, (uint64_t) (job->stats.queue_ms * 1000));
+    if (job->pid != 0) {
+        metrics_exec(get_extension(job->name), job->stats.exit_code,
+                     (uint64_t) (job->stats.wall_ms * 1000));
+    }
+    for (struct mg_connection *c = mgr->conns; c != NULL; c = c->next) {
+        for (int i = 0; i < job->nsubscribers; i++) {
+            if (job->subscribers[i] == c->id && !c->is_closing) execute_reply(c, job);
+        }
+    }
+}
+
+/**
+ * How execute_command() builds a source file
+ */
+struct compile_options {
+    const struct build_profile *profile;
+    char **training;            // PGO training inputs, each run through the instrumented build
+    size_t ntraining;
+};
+
+#define MAX_TRAINING_INPUTS 16
+#define QUOTED(n) ((n) * 4 + 3)     // Room for a word of n - 1 bytes, quoted (toolchain_quote())
+
+// "<objdir>" for a source file: <location>/.nexus-build
+static void object_dir(char *buf, size_t size, const char *location) {
+    if (location && strlen(location) > 0) {
+        snprintf(buf, size, "%s/" BUILD_DIR, location);
+    } else {
+        snprintf(buf, size, BUILD_DIR);
+    }
+}
+
+// "<base><suffix>", or "<base>.<profile><suffix>" for a named profile, so
+// every profile keeps its own artifacts
+static void profile_path(char *buf, size_t size, const char *base,
+                         const struct build_profile *profile, const char *suffix) {
+    if (profile == build_profile(NULL)) snprintf(buf, size, "%s%s", base, suffix);
+    else snprintf(buf, size, "%s.%s%s", base, profile->name, suffix);
+}
+
+// "compile to .nexus-build/<file>.o through the object cache && link".
+// filepath, compiler, linker and exe_name come quoted for the shell.
+static void object_command(char *buf, size_t size, const char *location, const char *filename,
+                           const char *filepath, const char *compiler, const char *linker,
+                           const char *exe_name, const struct build_profile *profile) {
+    char dir[1024], base[1300], path[1400], objdir[QUOTED(1024)], obj[QUOTED(1400)];
+    object_dir(dir, sizeof(dir), location);
+    snprintf(base, sizeof(base), "%s/%s", dir, filename);
+    profile_path(path, sizeof(path), base, profile, ".o");
+    toolchain_quote(dir, objdir, sizeof(objdir));
+    toolchain_quote(path, obj, sizeof(obj));
+    const char *cflags = profile->cflags, *ldflags = profile->ldflags;
+    int n = snprintf(buf, size, "mkdir -p %s && %s%s%s%s -c -o %s %s && %s%s%s -o %s %s",
+                     objdir, objcache_wrapper(), compiler, *cflags ? " " : "", cflags, obj,
+                     filepath, linker, *ldflags ? " " : "", ldflags, exe_name, obj);
+    if (n >= 0 && (size_t) n < size) return;
+
+    // Too long with the object path: compile and link in one step, uncached
+    n = snprintf(buf, size, "%s%s%s -o %s %s%s%s", compiler, *cflags ? " " : "", cflags,
+                 exe_name, filepath, *ldflags ? " " : "", ldflags);
+    if (n < 0 || (size_t) n >= size) buf[0] = '\0';
+}
+
+// Whether a profile-guided program is newer than its source and every
+// training input (a missing one counts as older), as `[ a -nt b ]` tells
+static bool pgo_fresh(const char *exe_name, const char *filepath,
+                      const struct compile_options *opts) {
+    struct stat exe, st;
+    if (access(exe_name, X_OK) != 0 || stat(exe_name, &exe) != 0) return false;
+    for (size_t i = 0; i <= opts->ntraining; i++) {
+        if (stat(i == 0 ? filepath : opts->training[i - 1], &st) != 0) continue;
+        if (exe.st_mtim.tv_sec < st.st_mtim.tv_sec ||
+            (exe.st_mtim.tv_sec == st.st_mtim.tv_sec && exe.st_mtim.tv_nsec <= st.st_mtim.tv_nsec)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Profile-guided build: instrumented build, one training run per input (or
+// one with no input), then the optimised rebuild from the recorded profile.
+// The training runs need the shell for their redirections; callers skip the
+// whole build while pgo_fresh(), as those runs are the slow part. False if
+// it does not fit in buf. filepath, compiler, linker and exe_name come
+// quoted for the shell.
+static bool pgo_command(char *buf, size_t size, const char *location, const char *filename,
+                        const char *filepath, const char *compiler, const char *linker,
+                        const char *exe_name, const struct compile_options *opts) {
+    char objdir[1024], path[1400], dir[QUOTED(1300)], obj[QUOTED(1400)], instr[QUOTED(1400)];
+    object_dir(objdir, sizeof(objdir), location);
+    snprintf(path, sizeof(path), "%s/%s.pgo", objdir, filename);
+    toolchain_quote(path, dir, sizeof(dir));
+    snprintf(path, sizeof(path), "%s/%s.pgo/%s.o", objdir, filename, filename);
+    toolchain_quote(path, obj, sizeof(obj));
+    snprintf(path, sizeof(path), "%s/%s.pgo/%s.instr", objdir, filename, filename);
+    toolchain_quote(path, instr, sizeof(instr));
+    char inputs[MAX_TRAINING_INPUTS][QUOTED(1024)];
+    for (size_t i = 0; i < opts->ntraining; i++) {
+        if (!toolchain_quote(opts->training[i], inputs[i], sizeof(inputs[i]))) return false;
+    }
+
+    // The object has the same path in both builds: the .gcda names derive from it
+    size_t n = (size_t) snprintf(buf, size,
+                                 "rm -rf %s && mkdir -p %s && "
+                                 "%s%s -O2 -fprofile-generate=%s -c -o %s %s && "
+                                 "%s -fprofile-generate=%s -o %s %s && { ",
+                                 dir, dir, objcache_wrapper(), compiler, dir, obj, filepath,
+                                 linker, dir, instr, obj);
+    for (size_t i = 0; i == 0 || i < opts->ntraining; i++) {
+        if (n >= size) break;
+        n += (size_t) snprintf(buf + n, size - n, "%s < %s > /dev/null 2>&1; ", instr,
+                               opts->ntraining > 0 ? inputs[i] : "/dev/null");
+    }
+    if (n < size) {
+        n += (size_t) snprintf(buf + n, size - n,
+                               "true; } && %s -O2 -fprofile-use=%s -fprofile-correction "
+                               "-Wno-missing-profile -c -o %s %s && %s -o %s %s",
+                               compiler, dir, obj, filepath, linker, exe_name, obj);
+    }
+    return n < size;
+}
+
+// "compile", "run" or "compile && run" by action; "" if it does not fit
+static void action_command(char *command, size_t size, const char *action, const char *compile,
+                           const char *run) {
+    int n;
+    if (strcmp(action, "compile") == 0) n = snprintf(command, size, "%s", compile);
+    else if (strcmp(action, "run") == 0) n = snprintf(command, size, "%s", run);
+    else n = snprintf(command, size, "%s && %s", compile, run);
+    if (n < 0 || (size_t) n >= size) command[0] = '\0';
+}
+
+// Command for an action ("compile", "run" or "both") on a source file, from
+// the toolchain registry (toolchain.h). stdout and stderr are captured by the
+// job (exec.h), so commands leave them alone. opts picks the optimisation
+// profile for C, C++ and Rust; NULL means the default one. Returns false
+// with a message for unsupported file types and missing toolchains.
+static bool execute_command(const char *filename, const char *action, const char *location,
+                            const struct compile_options *opts, char *command, size_t size,
+                            char *message, size_t message_size) {
     char filepath[1024];
     if (location && strlen(location) > 0) {
         snprintf(filepath, sizeof(filepath), "%s/%s", location, filename);
@@ -244,201 +529,907 @@ void handle_execute_file(struct mg_connection *c, const char *filename,
     }
     
     const char *ext = get_extension(filename);
-    char command[2048] = {0};
-    char output_file[256];
-    snprintf(output_file, sizeof(output_file), "/tmp/nexus_output_%d.txt", getpid());
+    const struct build_profile *profile = opts != NULL ? opts->profile : build_profile(NULL);
+    command[0] = '\0';
+    // Commands built below get every path quoted, like the registry's own
+    char path_q[QUOTED(1024)];
+    toolchain_quote(filepath, path_q, sizeof(path_q));
     
-    // Determine execution command based on file type
-    if (strcmp(ext, "c") == 0) {
-        char exe_name[256];
-        snprintf(exe_name, sizeof(exe_name), "%s.out", filepath);
+    struct toolchain tc;
+    enum toolchain_action step = strcmp(action, "compile") == 0 ? TOOLCHAIN_COMPILE
+                                 : strcmp(action, "run") == 0   ? TOOLCHAIN_RUN
+                                                                : TOOLCHAIN_BOTH;
+    if (!toolchain_get(ext, &tc)) {
+        snprintf(message, message_size, "Unsupported file type: %s", ext);
+        return false;
+    }
+    const char *missing = toolchain_missing(&tc, step);
+    if (missing != NULL) {
+        snprintf(message, message_size, "%s is not installed on the server", missing);
+        return false;
+    }
+    
+    // Languages with profiles, caches or the warm JVM are built here; the
+    // rest come straight from their templates
+    if (strcmp(tc.handler, "c") == 0) {
+        // The tcc profile runs C from memory; what TinyCC cannot build,
+        // C++ and compile-only requests get gcc with the default flags
+        bool tcc = profile->tcc;
+        if (tcc) profile = build_profile(NULL);
+        char exe_name[1100], exe_q[QUOTED(1100)];
+        profile_path(exe_name, sizeof(exe_name), filepath, profile, ".out");
+        toolchain_quote(exe_name, exe_q, sizeof(exe_q));
         
+        // Compile to an object through the object cache, then link, both
+        // with the section's first tool
+        char compile[6144], linker[QUOTED(256)], compiler[QUOTED(256) + 16];
+        toolchain_quote(toolchain_tool(&tc, tc.tools[0]), linker, sizeof(linker));
+        snprintf(compiler, sizeof(compiler), "%s%s", linker,
+                 strcmp(ext, "c") == 0 ? "" : " -std=c++17");
+        if (!profile->pgo) {
+            object_command(compile, sizeof(compile), location, filename, path_q,
+                           compiler, linker, exe_q, profile);
+        } else if (pgo_fresh(exe_name, filepath, opts)) {
+            snprintf(compile, sizeof(compile), "true");
+        } else if (!pgo_command(compile, sizeof(compile), location, filename, path_q,
+                                compiler, linker, exe_q, opts)) {
+            snprintf(message, message_size, "Too many or too long training inputs");
+            return false;
+        }
         if (strcmp(action, "compile") == 0) {
-            snprintf(command, sizeof(command), "gcc -o %s %s 2>&1", exe_name, filepath);
-        } else if (strcmp(action, "run") == 0) {
-            snprintf(command, sizeof(command), "%s 2>&1", exe_name);
+            snprintf(command, size, "%s", compile);
+        } else if (strcmp(action, "run") == 0 && !tcc) {
+            snprintf(command, size, "%s", exe_q);
         } else { // both
-            snprintf(command, sizeof(command), "gcc -o %s %s 2>&1 && %s 2>&1", 
-                    exe_name, filepath, exe_name);
+            action_command(command, size, "both", compile, exe_q);
+            if (tcc && strcmp(ext, "c") == 0) {
+                char fallback[7400];
+                snprintf(fallback, sizeof(fallback), "%s", command);
+                if (!tcc_command(command, size, filepath, exe_name, fallback)) {
+                    snprintf(command, size, "%s", fallback);
+                }
+            }
         }
-    } 
-    else if (strcmp(ext, "cpp") == 0 || strcmp(ext, "cc") == 0 || strcmp(ext, "cxx") == 0) {
-        char exe_name[256];
-        snprintf(exe_name, sizeof(exe_name), "%s.out", filepath);
+    }
+    else if (strcmp(tc.handler, "java") == 0) {
+        char class_name[256];
+        snprintf(class_name, sizeof(class_name), "%.*s", (int) (strlen(filename) - 5), filename);
         
-        if (strcmp(action, "compile") == 0) {
-            snprintf(command, sizeof(command), "g++ -std=c++17 -o %s %s 2>&1", exe_name, filepath);
-        } else if (strcmp(action, "run") == 0) {
-            snprintf(command, sizeof(command), "%s 2>&1", exe_name);
+        // Through the warm JVM when it is on; classes go next to the source
+        // either way, so a run does not depend on the server's directory
+        const char *jvm = jvm_wrapper();
+        char classes[QUOTED(1024)], class_q[QUOTED(256)], javac[QUOTED(256)], java[QUOTED(256)];
+        toolchain_quote(location && strlen(location) > 0 ? location : ".", classes, sizeof(classes));
+        toolchain_quote(class_name, class_q, sizeof(class_q));
+        toolchain_quote(toolchain_tool(&tc, "javac"), javac, sizeof(javac));
+        toolchain_quote(toolchain_tool(&tc, "java"), java, sizeof(java));
+        char compile[16384], run[8192];
+        if (*jvm) {
+            snprintf(compile, sizeof(compile), "%sjavac %s %s", jvm, classes, path_q);
+            snprintf(run, sizeof(run), "%sjava %s %s", jvm, classes, class_q);
         } else {
-            snprintf(command, sizeof(command), "g++ -std=c++17 -o %s %s 2>&1 && %s 2>&1", 
-                    exe_name, filepath, exe_name);
+            snprintf(compile, sizeof(compile), "%s -d %s %s", javac, classes, path_q);
+            snprintf(run, sizeof(run), "%s -cp %s %s", java, classes, class_q);
         }
+        action_command(command, size, action, compile, run);
     }
-    else if (strcmp(ext, "py") == 0) {
-        snprintf(command, sizeof(command), "python3 %s 2>&1", filepath);
-    }
-    else if (strcmp(ext, "js") == 0) {
-        snprintf(command, sizeof(command), "node %s 2>&1", filepath);
+    else if (strcmp(tc.handler, "rust") == 0) {
+        if (profile->rustflags == NULL) {
+            snprintf(message, message_size, "The %s profile is for C and C++ only", profile->name);
+            return false;
+        }
+        char exe_name[1100], exe_q[QUOTED(1100)];
+        profile_path(exe_name, sizeof(exe_name), filepath, profile, ".out");
+        toolchain_quote(exe_name, exe_q, sizeof(exe_q));
+        
+        // Managed incremental directory, one per profile: unchanged
+        // functions are not recompiled. rustc refuses it together with LTO.
+        char flags[4096], dir[600], incremental[700], incremental_q[QUOTED(700)];
+        snprintf(flags, sizeof(flags), "%s%s", profile->rustflags, *profile->rustflags ? " " : "");
+        if (strstr(profile->rustflags, "lto") == NULL &&
+            objcache_rust_dir(filepath, dir, sizeof(dir))) {
+            profile_path(incremental, sizeof(incremental), dir, profile, "");
+            toolchain_quote(incremental, incremental_q, sizeof(incremental_q));
+            snprintf(flags + strlen(flags), sizeof(flags) - strlen(flags),
+                     "-C incremental=%s ", incremental_q);
+        }
+        char rustc[QUOTED(256)];
+        toolchain_quote(toolchain_tool(&tc, tc.tools[0]), rustc, sizeof(rustc));
+        char compile[16384];
+        snprintf(compile, sizeof(compile), "%s %s-o %s %s", rustc, flags, exe_q, path_q);
+        action_command(command, size, action, compile, exe_q);
     }
-    else if (strcmp(ext, "java") == 0) {
-        char class_name[256];
-        strncpy(class_name, filename, strlen(filename) - 5);
-        class_name[strlen(filename) - 5] = '\0';
+    else if (strcmp(tc.handler, "kotlin") == 0) {
+        char jar_name[1100], jar_q[QUOTED(1100)];
+        snprintf(jar_name, sizeof(jar_name), "%s.jar", filepath);
+        toolchain_quote(jar_name, jar_q, sizeof(jar_q));
         
-        if (strcmp(action, "compile") == 0) {
-            snprintf(command, sizeof(command), "javac %s 2>&1", filepath);
-        } else if (strcmp(action, "run") == 0) {
-            snprintf(command, sizeof(command), "java %s 2>&1", class_name);
+        const char *jvm = jvm_wrapper();
+        char kotlinc[QUOTED(256)], java[QUOTED(256)];
+        toolchain_quote(toolchain_tool(&tc, "kotlinc"), kotlinc, sizeof(kotlinc));
+        toolchain_quote(toolchain_tool(&tc, "java"), java, sizeof(java));
+        char compile[16384], run[8192];
+        if (*jvm) {
+            snprintf(compile, sizeof(compile), "%skotlinc %s %s", jvm, path_q, jar_q);
+            snprintf(run, sizeof(run), "%sjava-jar %s", jvm, jar_q);
         } else {
-            snprintf(command, sizeof(command), "javac %s 2>&1 && java %s 2>&1", 
-                    filepath, class_name);
+            snprintf(compile, sizeof(compile), "%s %s -include-runtime -d %s", kotlinc, path_q,
+                     jar_q);
+            snprintf(run, sizeof(run), "%s -jar %s", java, jar_q);
         }
+        action_command(command, size, action, compile, run);
     }
-    else if (strcmp(ext, "sh") == 0 || strcmp(ext, "bash") == 0) {
-        snprintf(command, sizeof(command), "bash %s 2>&1", filepath);
+    else {
+        if (!toolchain_command(&tc, step, location, filename, command, size)) {
+            snprintf(message, message_size, "File name too long");
+            return false;
+        }
     }
-    else if (strcmp(ext, "rb") == 0) {
-        snprintf(command, sizeof(command), "ruby %s 2>&1", filepath);
+    // Cut short, the quoting would not add up
+    if (command[0] == '\0' || strlen(command) + 1 >= size) {
+        snprintf(message, message_size, "File name too long");
+        return false;
     }
-    else if (strcmp(ext, "go") == 0) {
-        if (strcmp(action, "compile") == 0) {
-            snprintf(command, sizeof(command), "go build %s 2>&1", filepath);
-        } else if (strcmp(action, "run") == 0) {
-            char exe_name[256];
-            strncpy(exe_name, filename, strlen(filename) - 3);
-            exe_name[strlen(filename) - 3] = '\0';
-            snprintf(command, sizeof(command), "./%s 2>&1", exe_name);
-        } else {
-            snprintf(command, sizeof(command), "go run %s 2>&1", filepath);
+    return true;
+}
+
+// "name" relative to location unless absolute; NULL stays NULL
+static char *location_path(const char *location, char *name) {
+    if (name == NULL || name[0] == '/' || location == NULL || location[0] == '\0') return name;
+    char *path = mg_mprintf("%s/%s", location, name);
+    free(name);
+    return path;
+}
+
+// Profile by name; replies 400 and returns NULL if there is none
+static const struct build_profile *find_profile(struct mg_connection *c, const char *name) {
+    const struct build_profile *profile = build_profile(name);
+    if (profile == NULL) {
+        json_reply_error(c, 400, "Unknown profile, expected default, debug, release, native, "
+                                 "lto, pgo or tcc");
+    }
+    return profile;
+}
+
+// Execute code file with enhanced language support
+void handle_execute_file(struct mg_connection *c, const char *filename, 
+                        const char *action, const char *location, double timeout,
+                        const char *profile, struct mg_str training, const char *client) {
+    struct compile_options opts = {.profile = find_profile(c, profile)};
+    if (opts.profile == NULL) return;
+
+    // Training inputs: a JSON array of files, relative to location
+    char *inputs[MAX_TRAINING_INPUTS];
+    size_t ofs = 0;
+    struct mg_str val;
+    const char *bad = NULL;
+    opts.training = inputs;
+    while (bad == NULL && training.len > 0 && (ofs = mg_json_next(training, ofs, NULL, &val)) > 0) {
+        char *path = location_path(location, mg_json_get_str(val, "$"));
+        struct stat st;
+        if (opts.ntraining == MAX_TRAINING_INPUTS) bad = "Too many training inputs";
+        else if (path == NULL || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            bad = "Training input not found";
         }
+        if (bad == NULL) inputs[opts.ntraining++] = path;
+        else free(path);
     }
-    else if (strcmp(ext, "rs") == 0) {
-        char exe_name[256];
-        snprintf(exe_name, sizeof(exe_name), "%s.out", filepath);
-        
-        if (strcmp(action, "compile") == 0) {
-            snprintf(command, sizeof(command), "rustc -o %s %s 2>&1", exe_name, filepath);
-        } else if (strcmp(action, "run") == 0) {
-            snprintf(command, sizeof(command), "%s 2>&1", exe_name);
-        } else {
-            snprintf(command, sizeof(command), "rustc -o %s %s 2>&1 && %s 2>&1", 
-                    exe_name, filepath, exe_name);
+    char command[8192], message[300];
+    bool ok = bad == NULL && execute_command(filename, action, location, &opts, command,
+                                             sizeof(command), message, sizeof(message));
+    for (size_t i = 0; i < opts.ntraining; i++) free(inputs[i]);
+    if (!ok) {
+        json_reply_error(c, 400, bad != NULL ? bad : message);
+        return;
+    }
+    const char *ext = get_extension(filename);
+    
+    // Queued, then run in the background; execute_done() answers every
+    // waiting connection
+    struct exec_request req = {
+        .command = command,
+        .name = filename,
+        .client = client,
+        .priority = is_build(ext, action) ? EXEC_PRIO_BUILD : EXEC_PRIO_RUN,
+        .timeout_s = timeout,
+        .done = execute_done,
+        .data = c->mgr,
+    };
+    uint64_t span = trace_begin();
+    struct exec_job *job = exec_start(&req);
+    trace_end("exec.start", span);
+    if (job == NULL) {
+        json_reply_error(c, 503, "Execution queue is full, try again later");
+        return;
+    }
+    exec_subscribe(job, c->id);
+}
+
+// Run a program on a terminal, driven over a WebSocket
+void handle_open_terminal(struct mg_connection *c, struct mg_http_message *hm,
+                          const char *filename, const char *location, int cols, int rows,
+                          const char *profile, const char *client) {
+    char command[8192], message[300];
+    if (mg_http_get_header(hm, "Sec-WebSocket-Key") == NULL) {
+        json_reply_error(c, 400, "Expected a WebSocket upgrade");
+        return;
+    }
+    struct compile_options opts = {.profile = find_profile(c, profile)};
+    if (opts.profile == NULL) return;
+    if (!execute_command(filename, "both", location, &opts, command, sizeof(command),
+                         message, sizeof(message))) {
+        json_reply_error(c, 400, message);
+        return;
+    }
+    const char *error = NULL;
+    if (!pty_open(c, hm, command, filename, cols, rows, client, &error)) {
+        json_reply_error(c, 503, error);
+    }
+}
+
+// Rebuild and rerun a code file each time it is saved, over a WebSocket
+void handle_watch(struct mg_connection *c, struct mg_http_message *hm, const char *filename,
+                  const char *location, const char *profile, const char *client) {
+    char build[8192], run[8192], path[1024], message[300];
+    if (mg_http_get_header(hm, "Sec-WebSocket-Key") == NULL) {
+        json_reply_error(c, 400, "Expected a WebSocket upgrade");
+        return;
+    }
+    struct compile_options opts = {.profile = find_profile(c, profile)};
+    if (opts.profile == NULL) return;
+    const char *ext = get_extension(filename);
+    bool compiled = is_build(ext, "both");
+    if (!execute_command(filename, "both", location, &opts, build, sizeof(build),
+                         message, sizeof(message)) ||
+        (compiled && !execute_command(filename, "run", location, &opts, run, sizeof(run),
+                                      message, sizeof(message)))) {
+        json_reply_error(c, 400, message);
+        return;
+    }
+    struct toolchain tc;
+    toolchain_get(ext, &tc);
+    snprintf(path, sizeof(path), "%s%s%s", location, *location ? "/" : "", filename);
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        json_reply_error(c, 404, "File not found");
+        return;
+    }
+    struct watch_request req = {
+        .path = path,
+        .build = build,
+        .run = compiled ? run : NULL,
+        .headers = strcmp(tc.handler, "c") == 0,
+        .name = filename,
+        .client = client,
+    };
+    const char *error = NULL;
+    if (!watch_open(c, hm, &req, &error)) {
+        json_reply_error(c, 503, error);
+    }
+}
+
+// A project build is over: answer the connection that asked for it
+static void build_done(struct build *b) {
+    struct mg_connection *c = NULL;
+    for (c = ((struct mg_mgr *) b->data)->conns; c != NULL; c = c->next) {
+        if (c->id == b->conn_id) break;
+    }
+    if (c == NULL || c->is_closing) return;
+
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_bool(&w, "success", b->failed_step == NULL && !b->cancelled);
+    jw_kv_int(&w, "buildId", (long long) b->id);
+    jw_kv_str(&w, "profile", b->profile->name);
+    jw_kv_str(&w, "program", b->bin);
+    if (b->cancelled) {
+        jw_kv_str(&w, "error", "Build cancelled");
+        jw_kv_bool(&w, "cancelled", true);
+    } else if (b->failed_step != NULL) {
+        char message[300];
+        snprintf(message, sizeof(message), "%s failed: %s",
+                 strcmp(b->failed_step, "run") == 0 ? "Program" : "Build", b->failed_step);
+        jw_kv_str(&w, "error", message);
+    }
+    jw_kv_int(&w, "sources", (long long) b->nunits);
+    jw_kv_int(&w, "compiled", (long long) b->compiled);
+    jw_kv_int(&w, "upToDate", (long long) b->fresh);
+    jw_kv_int(&w, "failed", (long long) b->failed);
+    jw_kv_bool(&w, "linked", b->linked);
+    jw_kv_str(&w, "buildOutput", b->log != NULL ? b->log : "");
+    if (b->ran) jw_kv_str(&w, "output", b->output != NULL ? b->output : "");
+    jw_kv_int(&w, "exitCode", b->exit_code);
+    jw_key(&w, "units");
+    jw_array_begin(&w);
+    for (size_t i = 0; i < b->nunits; i++) {
+        const struct build_unit *u = &b->units[i];
+        if (u->state == UNIT_FRESH) continue;
+        jw_object_begin(&w);
+        jw_kv_str(&w, "file", u->src);
+        jw_kv_str(&w, "state", u->state == UNIT_COMPILED ? "compiled" :
+                               u->state == UNIT_FAILED ? "failed" : "skipped");
+        jw_kv_double(&w, "ms", u->ms);
+        jw_object_end(&w);
+    }
+    jw_array_end(&w);
+    jw_key(&w, "stats");
+    jw_object_begin(&w);
+    jw_kv_double(&w, "wallMs", b->wall_ms);
+    jw_kv_double(&w, "cpuMs", b->cpu_ms);
+    jw_object_end(&w);
+    jw_object_end(&w);
+    jw_end(&w);
+}
+
+// Build a multi-file C/C++ project; each stale unit is its own queued job
+void handle_build_project(struct mg_connection *c, const char *location,
+                          const char *action, const char *profile, const char *client) {
+    const struct build_profile *p = find_profile(c, profile);
+    if (p == NULL) return;
+    const char *error = NULL;
+    bool run = strcmp(action, "both") == 0 || strcmp(action, "run") == 0;
+    if (!build_start(location, p, run, client, c->id, build_done, c->mgr, &error)) {
+        json_reply_error(c, 400, error);
+    }
+}
+
+// Connection streaming a batch build, NULL once it is gone
+static struct mg_connection *batch_conn(const struct build_batch *b) {
+    for (struct mg_connection *c = ((struct mg_mgr *) b->data)->conns; c != NULL; c = c->next) {
+        if (c->id == b->conn_id) return c->is_closing ? NULL : c;
+    }
+    return NULL;
+}
+
+// One line of the NDJSON stream
+static void batch_line(struct mg_connection *c, struct mg_iobuf *io) {
+    iobuf_append(io, "\n", 1);
+    chunked_write(c, io->buf, io->len);
+    mg_iobuf_free(io);
+}
+
+// A file of a batch build is settled: stream its line
+static void build_all_file(struct build_file *f) {
+    struct mg_connection *c = batch_conn(f->batch);
+    if (c == NULL) {
+        // Nobody reads the rest: queue nothing more
+        f->batch->cancelled = true;
+        return;
+    }
+    struct mg_iobuf io = {NULL, 0, 0, 256};
+    struct json_writer w;
+    jw_begin_buf(&w, &io);
+    jw_object_begin(&w);
+    jw_kv_str(&w, "file", f->name);
+    jw_kv_str(&w, "state", f->state == UNIT_FRESH ? "upToDate" :
+                           f->state == UNIT_COMPILED ? "compiled" : "failed");
+    jw_kv_bool(&w, "success", f->state != UNIT_FAILED);
+    if (f->state != UNIT_FRESH) jw_kv_int(&w, "exitCode", f->exit_code);
+    if (f->state != UNIT_FRESH && f->error[0] == '\0') jw_kv_double(&w, "ms", f->ms);
+    if (f->error[0] != '\0') jw_kv_str(&w, "error", f->error);
+    if (f->log != NULL && f->log_len > 0) jw_kv_str(&w, "buildOutput", f->log);
+    jw_object_end(&w);
+    batch_line(c, &io);
+}
+
+// Batch build over: the summary line ends the stream
+static void build_all_done(struct build_batch *b) {
+    struct mg_connection *c = batch_conn(b);
+    if (c == NULL) return;
+    struct mg_iobuf io = {NULL, 0, 0, 256};
+    struct json_writer w;
+    jw_begin_buf(&w, &io);
+    jw_object_begin(&w);
+    jw_kv_bool(&w, "done", true);
+    jw_kv_bool(&w, "success", b->failed == 0 && !b->cancelled);
+    if (b->cancelled) jw_kv_bool(&w, "cancelled", true);
+    jw_kv_int(&w, "sources", (long long) b->nfiles);
+    jw_kv_int(&w, "compiled", (long long) b->compiled);
+    jw_kv_int(&w, "upToDate", (long long) b->fresh);
+    jw_kv_int(&w, "failed", (long long) b->failed);
+    jw_key(&w, "stats");
+    jw_object_begin(&w);
+    jw_kv_double(&w, "wallMs", b->wall_ms);
+    jw_kv_double(&w, "cpuMs", b->cpu_ms);
+    jw_object_end(&w);
+    jw_object_end(&w);
+    batch_line(c, &io);
+    chunked_end(c);
+}
+
+// What compiling a file writes, for the up-to-date check; false if unknown
+static bool compile_artifact(const struct toolchain *tc, const char *filename,
+                             const char *location, const struct build_profile *profile,
+                             char *buf, size_t size) {
+    char filepath[1024], name[256];
+    snprintf(filepath, sizeof(filepath), "%s%s%s", location, *location ? "/" : "", filename);
+    if (strcmp(tc->handler, "c") == 0 || strcmp(tc->handler, "rust") == 0) {
+        // The tcc profile compiles C with the default flags (execute_command)
+        profile_path(buf, size, filepath, profile->tcc ? build_profile(NULL) : profile, ".out");
+    } else if (strcmp(tc->handler, "java") == 0) {
+        snprintf(name, sizeof(name), "%s", filename);
+        *strrchr(name, '.') = '\0';
+        snprintf(buf, size, "%s/%s.class", *location ? location : ".", name);
+    } else if (strcmp(tc->handler, "kotlin") == 0) {
+        snprintf(buf, size, "%s.jar", filepath);
+    } else {
+        return toolchain_artifact(tc, location, filename, buf, size);
+    }
+    return true;
+}
+
+// Files worth a batch build: regular, not hidden, of a compiled language
+static int build_all_filter(const struct dirent *entry) {
+    if (entry->d_name[0] == '.') return 0;
+    if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN) return 0;
+    return is_build(get_extension(entry->d_name), "compile");
+}
+
+// Compile every source file in a directory on its own, streaming each
+// result as NDJSON as it completes
+void handle_build_all(struct mg_connection *c, const char *location, const char *profile,
+                      const char *client) {
+    const struct build_profile *p = find_profile(c, profile);
+    if (p == NULL) return;
+    if (p->pgo) {
+        json_reply_error(c, 400, "PGO builds take a single source file");
+        return;
+    }
+    if (exec_queued() >= exec_limits()->queue_max) {
+        json_reply_error(c, 503, "Execution queue is full, try again later");
+        return;
+    }
+    struct dirent **list = NULL;
+    int n = scandir(*location ? location : ".", &list, build_all_filter, alphasort);
+    if (n < 0) {
+        if (errno == ENOMEM) json_reply_error(c, 500, "Out of memory");
+        else json_reply_error(c, 404, "Directory not found");
+        return;
+    }
+    struct build_batch *b = build_batch_new(location, client, c->id, build_all_file,
+                                            build_all_done, c->mgr);
+    struct compile_options opts = {.profile = p};
+    const char *error = b == NULL ? "Out of memory" : NULL;
+    int status = b == NULL ? 500 : 400;
+    for (int i = 0; i < n; i++) {
+        char command[8192], message[300], artifact[1100], path[1100];
+        const char *name = list[i]->d_name;
+        struct toolchain tc;
+        struct stat st;
+        snprintf(path, sizeof(path), "%s%s%s", location, *location ? "/" : "", name);
+        if (error == NULL && stat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+            toolchain_get(get_extension(name), &tc)) {
+            bool ok = execute_command(name, "compile", location, &opts, command, sizeof(command),
+                                      message, sizeof(message));
+            bool known = compile_artifact(&tc, name, location, p, artifact, sizeof(artifact));
+            if (!build_batch_add(b, name, ok ? command : NULL, ok && known ? artifact : NULL,
+                                 ok ? NULL : message)) {
+                error = "Too many source files";
+            }
+        }
+        free(list[i]);
+    }
+    free(list);
+    if (error == NULL && b->nfiles == 0) error = "No sources to compile in the directory";
+    if (error != NULL) {
+        if (b != NULL) build_batch_free(b);
+        json_reply_error(c, status, error);
+        return;
+    }
+    chunked_begin(c, 200, "application/x-ndjson");
+    build_batch_start(b);
+}
+
+// Test run over: answer the connection that asked for it
+static void tests_done(struct test_run *run) {
+    struct mg_connection *c = NULL;
+    for (c = ((struct mg_mgr *) run->data)->conns; c != NULL; c = c->next) {
+        if (c->id == run->conn_id) break;
+    }
+    if (c == NULL || c->is_closing) return;
+
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_bool(&w, "success", run->compiled && !run->cancelled && run->passed == run->ncases);
+    jw_kv_bool(&w, "compiled", run->compiled);
+    if (!run->compiled) jw_kv_str(&w, "error", run->cancelled ? "Cancelled" : "Compilation failed");
+    jw_kv_str(&w, "compileOutput", run->compile_output);
+    jw_kv_int(&w, "total", (long long) run->ncases);
+    jw_kv_int(&w, "passed", (long long) run->passed);
+    jw_kv_int(&w, "failed", (long long) (run->ncases - run->passed));
+    jw_key(&w, "cases");
+    jw_array_begin(&w);
+    for (size_t i = 0; i < run->ncases; i++) {
+        const struct test_case *tc = &run->cases[i];
+        jw_object_begin(&w);
+        jw_kv_str(&w, "name", tc->name);
+        jw_kv_str(&w, "verdict", tests_verdict_name(tc->verdict));
+        if (tc->verdict != TEST_SKIPPED) {
+            jw_kv_int(&w, "exitCode", tc->stats.exit_code);
+            if (tc->stats.signal != 0) jw_kv_int(&w, "signal", tc->stats.signal);
+            jw_kv_double(&w, "timeMs", tc->stats.wall_ms);
+            jw_kv_double(&w, "cpuMs", tc->stats.user_ms + tc->stats.sys_ms);
+            jw_kv_int(&w, "maxRssKb", tc->stats.max_rss_kb);
+            jw_key(&w, "output");
+            jw_string_open(&w);
+            jw_string_append(&w, tc->output, tc->output_len);
+            jw_string_close(&w);
+            if (tc->output_truncated) jw_kv_bool(&w, "outputTruncated", true);
+            jw_key(&w, "stderr");
+            jw_string_open(&w);
+            jw_string_append(&w, tc->error, tc->error_len);
+            jw_string_close(&w);
         }
+        jw_object_end(&w);
     }
-    else if (strcmp(ext, "php") == 0) {
-        snprintf(command, sizeof(command), "php %s 2>&1", filepath);
+    jw_array_end(&w);
+    jw_key(&w, "stats");
+    jw_object_begin(&w);
+    jw_kv_double(&w, "compileMs", run->compile_stats.wall_ms);
+    jw_kv_double(&w, "wallMs", run->wall_ms);
+    jw_object_end(&w);
+    jw_object_end(&w);
+    jw_end(&w);
+}
+
+// Compile once, run the program against every case
+void handle_run_tests(struct mg_connection *c, const char *filename, const char *location,
+                      struct mg_str cases, bool ignore_whitespace, double timeout,
+                      const char *profile, const char *client) {
+    char compile[8192], run[2048], message[300];
+    const char *ext = get_extension(filename);
+    struct compile_options opts = {.profile = find_profile(c, profile)};
+    if (opts.profile == NULL) return;
+    if (!execute_command(filename, "run", location, &opts, run, sizeof(run),
+                         message, sizeof(message)) ||
+        (is_build(ext, "compile") &&
+         !execute_command(filename, "compile", location, &opts, compile, sizeof(compile),
+                          message, sizeof(message)))) {
+        json_reply_error(c, 400, message);
+        return;
+    }
+
+    // {"name", "input" | "inputFile", "expected" | "expectedFile"} per case;
+    // the strings are heap copies until tests_start() has taken what it needs
+    struct test_spec *specs = calloc(TESTS_MAX_CASES + 1, sizeof(*specs));
+    if (specs == NULL) {
+        json_reply_error(c, 500, "Out of memory");
+        return;
     }
-    else if (strcmp(ext, "pl") == 0) {
-        snprintf(command, sizeof(command), "perl %s 2>&1", filepath);
+    size_t n = 0, ofs = 0;
+    struct mg_str val;
+    while (n <= TESTS_MAX_CASES && (ofs = mg_json_next(cases, ofs, NULL, &val)) > 0) {
+        struct test_spec *t = &specs[n++];
+        t->name = mg_json_get_str(val, "$.name");
+        t->input = mg_json_get_str(val, "$.input");
+        t->input_len = t->input != NULL ? strlen(t->input) : 0;
+        t->input_file = location_path(location, mg_json_get_str(val, "$.inputFile"));
+        t->expected = mg_json_get_str(val, "$.expected");
+        t->expected_len = t->expected != NULL ? strlen(t->expected) : 0;
+        t->expected_file = location_path(location, mg_json_get_str(val, "$.expectedFile"));
     }
-    else if (strcmp(ext, "lua") == 0) {
-        snprintf(command, sizeof(command), "lua %s 2>&1", filepath);
+
+    // Queued, then run in the background; tests_done() answers
+    struct test_request req = {
+        .compile = is_build(ext, "compile") ? compile : NULL,
+        .run = run,
+        .name = filename,
+        .cases = specs,
+        .ncases = n,
+        .ignore_whitespace = ignore_whitespace,
+        .timeout_s = timeout,
+        .client = client,
+        .conn_id = c->id,
+        .done = tests_done,
+        .data = c->mgr,
+    };
+    const char *error = NULL;
+    if (!tests_start(&req, &error)) json_reply_error(c, 400, error);
+    for (size_t i = 0; i < n; i++) {
+        free((char *) specs[i].name);
+        free((char *) specs[i].input);
+        free((char *) specs[i].input_file);
+        free((char *) specs[i].expected);
+        free((char *) specs[i].expected_file);
     }
-    else if (strcmp(ext, "r") == 0 || strcmp(ext, "R") == 0) {
-        snprintf(command, sizeof(command), "Rscript %s 2>&1", filepath);
+    free(specs);
+}
+
+// Benchmark over: answer the connection that asked for it
+static void bench_done(struct bench *b) {
+    struct mg_connection *c = NULL;
+    for (c = ((struct mg_mgr *) b->data)->conns; c != NULL; c = c->next) {
+        if (c->id == b->conn_id) break;
     }
-    else if (strcmp(ext, "swift") == 0) {
-        if (strcmp(action, "compile") == 0) {
-            snprintf(command, sizeof(command), "swiftc %s 2>&1", filepath);
-        } else if (strcmp(action, "run") == 0) {
-            char exe_name[256];
-            strncpy(exe_name, filename, strlen(filename) - 6);
-            exe_name[strlen(filename) - 6] = '\0';
-            snprintf(command, sizeof(command), "./%s 2>&1", exe_name);
-        } else {
-            snprintf(command, sizeof(command), "swift %s 2>&1", filepath);
+    if (c == NULL || c->is_closing) return;
+
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_bool(&w, "success", b->error == NULL);
+    if (b->error != NULL) {
+        jw_kv_str(&w, "error", b->error);
+        if (b->failed_program >= 0) {
+            jw_kv_str(&w, "failedProgram", b->programs[b->failed_program].name);
+            jw_kv_int(&w, "exitCode", b->exit_code);
         }
     }
-    else if (strcmp(ext, "kt") == 0) {
-        char jar_name[256];
-        snprintf(jar_name, sizeof(jar_name), "%s.jar", filepath);
-        
-        if (strcmp(action, "compile") == 0) {
-            snprintf(command, sizeof(command), "kotlinc %s -include-runtime -d %s 2>&1", 
-                    filepath, jar_name);
-        } else if (strcmp(action, "run") == 0) {
-            snprintf(command, sizeof(command), "java -jar %s 2>&1", jar_name);
-        } else {
-            snprintf(command, sizeof(command), "kotlinc %s -include-runtime -d %s 2>&1 && java -jar %s 2>&1", 
-                    filepath, jar_name, jar_name);
+    if (b->cancelled) jw_kv_bool(&w, "cancelled", true);
+    jw_kv_int(&w, "runs", b->runs);
+    jw_kv_int(&w, "warmup", b->warmup);
+    if (b->cpu >= 0) {
+        jw_kv_int(&w, "cpu", b->cpu);
+        jw_kv_bool(&w, "pinned", b->pinned);
+    }
+    jw_kv_bool(&w, "counters", b->counters);
+    jw_key(&w, "programs");
+    jw_array_begin(&w);
+    for (int i = 0; i < b->nprograms; i++) {
+        const struct bench_program *p = &b->programs[i];
+        jw_object_begin(&w);
+        jw_kv_str(&w, "file", p->name);
+        jw_kv_bool(&w, "compiled", p->compiled);
+        jw_kv_str(&w, "compileOutput", p->compile_output);
+        jw_key(&w, "output");
+        jw_string_open(&w);
+        jw_string_append(&w, p->output, p->output_len);
+        jw_string_close(&w);
+        jw_kv_int(&w, "measured", (long long) p->nsamples);
+        jw_key(&w, "stats");
+        jw_object_begin(&w);
+        for (int m = 0; m < BENCH_METRICS; m++) {
+            struct bench_stats st;
+            if (!bench_summarize(p, (enum bench_metric) m, &st)) continue;
+            jw_key(&w, bench_metric_name((enum bench_metric) m));
+            jw_object_begin(&w);
+            jw_kv_double(&w, "mean", st.mean);
+            jw_kv_double(&w, "stddev", st.stddev);
+            jw_kv_double(&w, "min", st.min);
+            jw_kv_double(&w, "max", st.max);
+            jw_kv_double(&w, "p50", st.p50);
+            jw_kv_double(&w, "p90", st.p90);
+            jw_kv_double(&w, "p95", st.p95);
+            jw_kv_double(&w, "p99", st.p99);
+            jw_object_end(&w);
         }
+        jw_object_end(&w);
+        jw_key(&w, "samples");
+        jw_array_begin(&w);
+        for (size_t j = 0; j < p->nsamples; j++) jw_double(&w, p->samples[j].wall_ms);
+        jw_array_end(&w);
+        jw_object_end(&w);
     }
-    else if (strcmp(ext, "dart") == 0) {
-        snprintf(command, sizeof(command), "dart %s 2>&1", filepath);
+    jw_array_end(&w);
+    if (b->nprograms == 2) {
+        // Second program against the first: ratio < 1 means it is faster
+        jw_key(&w, "comparison");
+        jw_object_begin(&w);
+        for (int m = 0; m < BENCH_METRICS; m++) {
+            struct bench_comparison cmp;
+            if (!bench_compare(&b->programs[0], &b->programs[1], (enum bench_metric) m, &cmp)) {
+                continue;
+            }
+            jw_key(&w, bench_metric_name((enum bench_metric) m));
+            jw_object_begin(&w);
+            jw_kv_double(&w, "ratio", cmp.ratio);
+            jw_kv_double(&w, "t", cmp.t);
+            jw_kv_bool(&w, "significant", cmp.significant);
+            jw_object_end(&w);
+        }
+        jw_object_end(&w);
     }
-    else if (strcmp(ext, "ts") == 0) {
-        if (strcmp(action, "compile") == 0) {
-            snprintf(command, sizeof(command), "tsc %s 2>&1", filepath);
-        } else if (strcmp(action, "run") == 0) {
-            char js_name[256];
-            strncpy(js_name, filename, strlen(filename) - 3);
-            js_name[strlen(filename) - 3] = '\0';
-            strcat(js_name, ".js");
-            snprintf(command, sizeof(command), "node %s 2>&1", js_name);
-        } else {
-            snprintf(command, sizeof(command), "ts-node %s 2>&1", filepath);
+    jw_key(&w, "stats");
+    jw_object_begin(&w);
+    jw_kv_double(&w, "wallMs", b->wall_ms);
+    jw_object_end(&w);
+    jw_object_end(&w);
+    jw_end(&w);
+}
+
+// Run a program, or two for an A/B comparison, many times and summarise
+void handle_benchmark(struct mg_connection *c, const char *filename, const char *compare,
+                      const char *location, int runs, int warmup, int cpu,
+                      const char *input, double timeout, const char *profile,
+                      const char *client) {
+    char compile[2][8192], run[2][2048], message[300];
+    struct compile_options opts = {.profile = find_profile(c, profile)};
+    if (opts.profile == NULL) return;
+    struct bench_request req = {
+        .nprograms = compare != NULL && compare[0] != '\0' ? 2 : 1,
+        .runs = runs,
+        .warmup = warmup,
+        .cpu = cpu,
+        .timeout_s = timeout,
+        .client = client,
+        .conn_id = c->id,
+        .done = bench_done,
+        .data = c->mgr,
+    };
+    for (int i = 0; i < req.nprograms; i++) {
+        const char *file = i == 0 ? filename : compare;
+        bool build = is_build(get_extension(file), "compile");
+        if (!execute_command(file, "run", location, &opts, run[i], sizeof(run[i]),
+                             message, sizeof(message)) ||
+            (build && !execute_command(file, "compile", location, &opts, compile[i],
+                                       sizeof(compile[i]), message, sizeof(message)))) {
+            json_reply_error(c, 400, message);
+            return;
         }
+        req.name[i] = file;
+        req.run[i] = run[i];
+        req.compile[i] = build ? compile[i] : NULL;
     }
-    else {
-        mg_http_reply(c, 400, "Content-Type: application/json\r\n", 
-                     "{\"error\": \"Unsupported file type: %s\"}", ext);
-        return;
+    // Comparing a file with itself: one compile, or both would write one binary
+    if (req.nprograms == 2 && req.compile[1] != NULL && strcmp(req.compile[0], req.compile[1]) == 0) {
+        req.compile[1] = NULL;
     }
+
+    // Queued, then run in the background; bench_done() answers
+    char *input_path = input != NULL && input[0] != '\0' ? location_path(location, strdup(input)) : NULL;
+    req.input = input_path;
+    const char *error = NULL;
+    if (!bench_start(&req, &error)) json_reply_error(c, 400, error);
+    free(input_path);
+}
+
+// Object cache counters and sizes
+void handle_cache_stats(struct mg_connection *c) {
+    struct objcache_stats st;
+    bool on = objcache_stats(&st);
+    long long lookups = st.hits + st.misses;
     
-    // Execute command and capture output
-    strcat(command, " > ");
-    strcat(command, output_file);
-    strcat(command, " 2>&1");
-    
-    int result = system(command);
-    
-    // Read output
-    FILE *output_fp = fopen(output_file, "r");
-    char output[MAX_OUTPUT_SIZE] = {0};
-    
-    if (output_fp) {
-        size_t bytes_read = fread(output, 1, MAX_OUTPUT_SIZE - 1, output_fp);
-        output[bytes_read] = '\0';
-        fclose(output_fp);
-        remove(output_file);
-    }
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_bool(&w, "success", true);
+    jw_kv_bool(&w, "enabled", on);
+    jw_kv_str(&w, "dir", objcache_dir());
+    jw_kv_int(&w, "maxBytes", objcache_max());
+    jw_kv_int(&w, "bytes", st.bytes);
+    jw_kv_int(&w, "objects", st.files);
+    jw_kv_int(&w, "hits", st.hits);
+    jw_kv_int(&w, "misses", st.misses);
+    jw_kv_int(&w, "uncacheable", st.uncacheable);
+    jw_kv_double(&w, "hitRate", lookups > 0 ? (double) st.hits / lookups : 0);
+    jw_kv_double(&w, "savedMs", st.saved_ms);
+    jw_key(&w, "rustIncremental");
+    jw_object_begin(&w);
+    jw_kv_int(&w, "dirs", st.rust_dirs);
+    jw_kv_int(&w, "bytes", st.rust_bytes);
+    jw_object_end(&w);
+    jw_object_end(&w);
+    jw_end(&w);
+}
+
+void handle_toolchains(struct mg_connection *c, bool reload) {
+    bool ok = !reload || toolchain_reload();
+    struct toolchain tc;
     
-    // Escape output for JSON
-    char escaped_output[MAX_OUTPUT_SIZE * 2] = {0};
-    char *out = escaped_output;
-    for (char *in = output; *in; in++) {
-        if (*in == '"') {
-            *out++ = '\\';
-            *out++ = '"';
-        } else if (*in == '\\') {
-            *out++ = '\\';
-            *out++ = '\\';
-        } else if (*in == '\n') {
-            *out++ = '\\';
-            *out++ = 'n';
-        } else if (*in == '\r') {
-            *out++ = '\\';
-            *out++ = 'r';
-        } else if (*in == '\t') {
-            *out++ = '\\';
-            *out++ = 't';
-        } else {
-            *out++ = *in;
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_bool(&w, "success", true);
+    if (!ok) jw_kv_str(&w, "warning", "Config file unreadable, using the built-in toolchains");
+    jw_key(&w, "toolchains");
+    jw_array_begin(&w);
+    for (size_t i = 0; toolchain_at(i, &tc); i++) {
+        jw_object_begin(&w);
+        jw_kv_str(&w, "name", tc.name);
+        jw_key(&w, "extensions");
+        jw_array_begin(&w);
+        for (int e = 0; e < tc.nexts; e++) jw_string(&w, tc.exts[e]);
+        jw_array_end(&w);
+        jw_kv_bool(&w, "available", tc.available);
+        jw_kv_bool(&w, "compiled", toolchain_has(&tc, TOOLCHAIN_COMPILE));
+        jw_key(&w, "actions");
+        jw_object_begin(&w);
+        jw_kv_bool(&w, "compile", toolchain_missing(&tc, TOOLCHAIN_COMPILE) == NULL);
+        jw_kv_bool(&w, "run", toolchain_missing(&tc, TOOLCHAIN_RUN) == NULL);
+        jw_kv_bool(&w, "both", toolchain_missing(&tc, TOOLCHAIN_BOTH) == NULL);
+        jw_object_end(&w);
+        jw_key(&w, "tools");
+        jw_object_begin(&w);
+        for (int t = 0; t < tc.ntools; t++) {
+            jw_key(&w, tc.tools[t]);
+            if (tc.paths[t][0] != '\0') jw_string(&w, tc.paths[t]);
+            else jw_null(&w);
         }
+        jw_object_end(&w);
+        jw_object_end(&w);
     }
-    *out = '\0';
-    
-    char response[MAX_OUTPUT_SIZE * 2 + 256];
-    if (result == 0) {
-        snprintf(response, sizeof(response), 
-                "{\"success\": true, \"output\": \"%s\", \"exitCode\": %d}", 
-                escaped_output, result);
-    } else {
-        snprintf(response, sizeof(response), 
-                "{\"success\": false, \"output\": \"%s\", \"error\": \"Execution failed\", \"exitCode\": %d}", 
-                escaped_output, result);
+    jw_array_end(&w);
+    jw_object_end(&w);
+    jw_end(&w);
+}
+
+// Jobs that are queued or running
+void handle_list_jobs(struct mg_connection *c) {
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_bool(&w, "success", true);
+    jw_kv_int(&w, "slots", exec_limits()->slots);
+    jw_kv_int(&w, "running", exec_running());
+    jw_kv_int(&w, "queued", exec_queued());
+    jw_key(&w, "jobs");
+    jw_array_begin(&w);
+    for (struct exec_job *job = exec_jobs(); job != NULL; job = job->next) {
+        if (job->state == EXEC_FINISHED) continue;
+        jw_object_begin(&w);
+        jw_kv_int(&w, "id", (long long) job->id);
+        jw_kv_str(&w, "file", job->name);
+        jw_kv_str(&w, "state", job->state == EXEC_QUEUED ? "queued" : "running");
+        jw_kv_str(&w, "priority", job->priority == EXEC_PRIO_RUN ? "run" : "build");
+        jw_kv_double(&w, "elapsedMs", exec_elapsed_ms(job));
+        jw_kv_int(&w, "waiting", job->nsubscribers);
+        jw_kv_bool(&w, "stopping", job->term_ms != 0);
+        jw_object_end(&w);
+    }
+    jw_array_end(&w);
+    jw_object_end(&w);
+    jw_end(&w);
+}
+
+// Stop a running job; its waiting connections get the result as usual
+void handle_cancel_job(struct mg_connection *c, unsigned long id) {
+    struct exec_job *job = exec_find(id);
+    if (job == NULL) {
+        json_reply_error(c, 404, "No such job");
+        return;
     }
+    exec_stop(job, EXEC_CANCELLED);
     
-    mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s", response);
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_bool(&w, "success", true);
+    jw_kv_int(&w, "id", (long long) id);
+    jw_object_end(&w);
+    jw_end(&w);
+}
+
+// Wait for a running job's result, alongside the connection that started it
+void handle_wait_job(struct mg_connection *c, unsigned long id) {
+    struct exec_job *job = exec_find(id);
+    if (job == NULL) {
+        json_reply_error(c, 404, "No such job");
+        return;
+    }
+    if (!exec_subscribe(job, c->id)) {
+        json_reply_error(c, 503, "Too many connections waiting for this job");
+    }
+}
+
+void handle_job_output(struct mg_connection *c, unsigned long id, uint64_t offset,
+                       size_t length, bool tail) {
+    struct output *o = output_find(id);
+    if (o == NULL) {
+        json_reply_error(c, 404, "No output for this job");
+        return;
+    }
+    if (length > OUTPUT_PAGE_MAX) length = OUTPUT_PAGE_MAX;
+    char *page = malloc(length > 0 ? length : 1);
+    if (page == NULL) {
+        json_reply_error(c, 500, "Out of memory");
+        return;
+    }
+    size_t n = tail ? output_tail(o, page, length, &offset) : output_read(o, offset, page, length);
+
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_int(&w, "jobId", (long long) id);
+    jw_kv_int(&w, "offset", (long long) offset);
+    jw_kv_int(&w, "length", (long long) n);
+    jw_kv_int(&w, "size", (long long) o->size);
+    jw_kv_int(&w, "total", (long long) o->total);
+    jw_kv_bool(&w, "complete", o->complete);
+    jw_kv_bool(&w, "truncated", o->total > o->size);
+    jw_key(&w, "data");
+    jw_string_n(&w, page, n);
+    jw_object_end(&w);
+    jw_end(&w);
+    free(page);
 }
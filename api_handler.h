@@ -7,6 +7,72 @@
 // NEXUS File Manager - API Handler Header
 // ============================================================================
 
+struct arena;
+struct json_field;
+struct compress_stream;
+
+/**
+ * Per-connection request state, kept in c->data (MG_DATA_SIZE bytes)
+ */
+struct request_state {
+    struct arena *arena;               // Scratch memory, see request_arena()
+    struct compress_stream *stream;    // Open compressed chunked body, if any
+    uint64_t trace_send;               // Sampled response waiting to drain (trace.h)
+    uint8_t encoding;                  // Negotiated response coding (compress.h)
+    bool deferred;                     // Reply comes later, from a job callback
+    bool head;                         // HEAD request: headers only (http_body_end())
+};
+
+/**
+ * Get the request state stored in a connection
+ * 
+ * @param c Mongoose connection
+ * @return State, zeroed for a fresh connection
+ */
+struct request_state *request_state(struct mg_connection *c);
+
+/**
+ * A reply is complete: a deferred one lets go of the request's settings
+ * (the negotiated coding) and has its metrics recorded now
+ *
+ * @param c Mongoose connection
+ * @param status HTTP status code sent
+ * @param bytes_out Response size, headers included
+ */
+void request_replied(struct mg_connection *c, int status, size_t bytes_out);
+
+/**
+ * Get the scratch arena for the request being handled on a connection.
+ * The arena is drawn from a thread-local pool on first use.
+ * 
+ * @param c Mongoose connection
+ * @return Arena, or NULL if out of memory
+ */
+struct arena *request_arena(struct mg_connection *c);
+
+/**
+ * Finish a request: release its scratch memory (logging the peak usage)
+ * and forget per-request settings
+ * 
+ * @param c Mongoose connection
+ */
+void request_end(struct mg_connection *c);
+
+/**
+ * The send buffer drained (call on MG_EV_WRITE); closes the
+ * "socket.write" span of a traced response
+ * 
+ * @param c Mongoose connection
+ */
+void request_sent(struct mg_connection *c);
+
+/**
+ * Release everything the connection holds (call on MG_EV_CLOSE)
+ * 
+ * @param c Mongoose connection
+ */
+void request_close(struct mg_connection *c);
+
 /**
  * List all files in the specified directory
  * 
@@ -29,22 +95,22 @@ void handle_view_file(struct mg_connection *c, const char *filename, const char
  * 
  * @param c Mongoose connection
  * @param filename Name of the new file
- * @param content Content to write to the file
+ * @param content Content to write, still JSON-escaped (see json_body.h)
  * @param location Directory path where file will be created
  */
 void handle_create_file(struct mg_connection *c, const char *filename, 
-                       const char *content, const char *location);
+                       const struct json_field *content, const char *location);
 
 /**
  * Edit an existing file (overwrites content)
  * 
  * @param c Mongoose connection
  * @param filename Name of the file to edit
- * @param content New content for the file
+ * @param content New content, still JSON-escaped (see json_body.h)
  * @param location Directory path
  */
 void handle_edit_file(struct mg_connection *c, const char *filename, 
-                     const char *content, const char *location);
+                     const struct json_field *content, const char *location);
 
 /**
  * Delete a file
@@ -80,12 +146,192 @@ void handle_browse_directories(struct mg_connection *c, const char *path);
  * - Ruby, PHP, Perl, Lua, R
  * - Shell scripts (Bash, Zsh, Fish)
  * 
+ * The job is queued, runs in the background and the reply is sent when it
+ * ends; it is stopped if the connection closes first (see exec.h).
+ * 
  * @param c Mongoose connection
  * @param filename Name of the file to execute
  * @param action Execution action: "compile", "run", or "both"
  * @param location Directory path
+ * @param timeout Wall-clock limit in seconds, 0 for the configured one
+ * @param profile Optimisation profile for C, C++ and Rust (build.h), NULL
+ *                for the default
+ * @param training JSON array of input files for the "pgo" training runs,
+ *                 relative to location; empty for one run without input
+ * @param client Fair-share key for the queue (session or peer address)
  */
 void handle_execute_file(struct mg_connection *c, const char *filename, 
-                        const char *action, const char *location);
+                        const char *action, const char *location, double timeout,
+                        const char *profile, struct mg_str training, const char *client);
+
+/**
+ * Run a code file interactively: compile it if needed, then run it on a
+ * pseudo-terminal, and switch the connection to a WebSocket carrying the
+ * keystrokes and the terminal output (see pty.h)
+ * 
+ * @param c Mongoose connection
+ * @param hm The upgrade request
+ * @param filename Name of the file to execute
+ * @param location Directory path
+ * @param cols Terminal width
+ * @param rows Terminal height
+ * @param profile Optimisation profile, NULL for the default
+ * @param client Fair-share key, for job listings
+ */
+void handle_open_terminal(struct mg_connection *c, struct mg_http_message *hm,
+                          const char *filename, const char *location, int cols, int rows,
+                          const char *profile, const char *client);
+
+/**
+ * Watch a code file: build and run it now and after every save, and switch
+ * the connection to a WebSocket carrying the results (see watch.h)
+ * 
+ * @param c Mongoose connection
+ * @param hm The upgrade request
+ * @param filename Name of the file to watch
+ * @param location Directory path
+ * @param profile Optimisation profile, NULL for the default
+ * @param client Fair-share key, for job listings
+ */
+void handle_watch(struct mg_connection *c, struct mg_http_message *hm, const char *filename,
+                  const char *location, const char *profile, const char *client);
+
+/**
+ * Compile every source file in a directory on its own, in parallel, and
+ * stream one NDJSON line per file as it completes: skipped as up to date
+ * (its program is newer than the source), compiled, or failed with the
+ * compiler output; a summary line ends the stream
+ * 
+ * @param c Mongoose connection
+ * @param location Directory
+ * @param profile Optimisation profile, NULL for the default
+ * @param client Fair-share key for the execution queue
+ */
+void handle_build_all(struct mg_connection *c, const char *location, const char *profile,
+                      const char *client);
+
+/**
+ * Build the C/C++ project in a directory, compiling only what changed, and
+ * optionally run it; the reply is sent when the build is over
+ * 
+ * @param c Mongoose connection
+ * @param location Project directory
+ * @param action "build" or "both" (build and run)
+ * @param profile Optimisation profile, NULL for the default (-O2)
+ * @param client Fair-share key for the execution queue
+ */
+void handle_build_project(struct mg_connection *c, const char *location,
+                          const char *action, const char *profile, const char *client);
+
+/**
+ * Compile a program once and run it against many inputs in parallel,
+ * judging each output against the expected one; the reply is sent when
+ * every case is over
+ * 
+ * @param c Mongoose connection
+ * @param filename Source file
+ * @param location Directory of the source; relative case files are under it
+ * @param cases JSON array of {"name", "input" | "inputFile", "expected" | "expectedFile"}
+ * @param ignore_whitespace Compare whitespace-separated tokens only
+ * @param timeout Per-case wall-clock limit in seconds, 0 for the configured one
+ * @param profile Optimisation profile, NULL for the default
+ * @param client Fair-share key for the execution queue
+ */
+void handle_run_tests(struct mg_connection *c, const char *filename, const char *location,
+                      struct mg_str cases, bool ignore_whitespace, double timeout,
+                      const char *profile, const char *client);
+
+/**
+ * Benchmark a program: warmup runs, then measured runs one at a time, each
+ * through the bench runner (CPU pinning, hardware counters). Answers with
+ * mean, stddev and percentiles per metric, and with `compare` set, the
+ * second program's ratio to the first and whether the gap is significant.
+ * 
+ * @param c Mongoose connection
+ * @param filename Program to measure
+ * @param compare Second program for an A/B comparison, NULL or "" for none
+ * @param location Directory path
+ * @param runs Measured runs per program
+ * @param warmup Unmeasured runs first
+ * @param cpu CPU to pin every run to, -1 for none
+ * @param input stdin file relative to location, NULL or "" for none
+ * @param timeout Per-run wall-clock limit in seconds, 0 for the configured one
+ * @param profile Optimisation profile, NULL for the default
+ * @param client Fair-share key for the execution queue
+ */
+void handle_benchmark(struct mg_connection *c, const char *filename, const char *compare,
+                      const char *location, int runs, int warmup, int cpu,
+                      const char *input, double timeout, const char *profile,
+                      const char *client);
+
+/**
+ * Object cache statistics: size, hit rate, compile time saved
+ * 
+ * @param c Mongoose connection
+ */
+void handle_cache_stats(struct mg_connection *c);
+
+/**
+ * Language toolchains: extensions, actions, tools and whether they are
+ * installed. With reload set the config file is read and the tools probed
+ * again first.
+ * 
+ * @param c Mongoose connection
+ * @param reload Reload the registry before listing it
+ */
+void handle_toolchains(struct mg_connection *c, bool reload);
+
+/**
+ * List running jobs
+ * 
+ * @param c Mongoose connection
+ */
+void handle_list_jobs(struct mg_connection *c);
+
+/**
+ * Stop a running job (SIGTERM, then SIGKILL)
+ * 
+ * @param c Mongoose connection
+ * @param id Job id
+ */
+void handle_cancel_job(struct mg_connection *c, unsigned long id);
+
+/**
+ * Wait for a running job's result; the reply is sent when it ends
+ * 
+ * @param c Mongoose connection
+ * @param id Job id
+ */
+void handle_wait_job(struct mg_connection *c, unsigned long id);
+
+/**
+ * One page of a job's output, while it runs or for a while after it ended
+ * (see output.h). With tail set the page is the last `length` bytes,
+ * including bytes past the per-job disk limit while the tail ring has them.
+ * 
+ * @param c Mongoose connection
+ * @param id Job id
+ * @param offset Byte offset of the page, ignored with tail
+ * @param length Bytes wanted, capped at OUTPUT_PAGE_MAX
+ * @param tail Read the end of the output rather than from offset
+ */
+void handle_job_output(struct mg_connection *c, unsigned long id, uint64_t offset,
+                       size_t length, bool tail);
+
+/**
+ * Get the extension of a file name
+ * 
+ * @param filename File name
+ * @return Extension without the dot, or "" if there is none
+ */
+const char* get_extension(const char* filename);
+
+/**
+ * Check whether a path exists
+ * 
+ * @param filepath Path to check
+ * @return 1 if it exists, 0 otherwise
+ */
+int file_exists(const char* filepath);
 
 #endif // API_HANDLER_H
@@ -6,6 +6,9 @@ const state = {
     currentLocation: '.',
     currentEditFile: null,
     currentExecuteFile: null,
+    executeAbort: null,
+    terminal: null,
+    watch: null,
     viewMode: 'grid'
 };
 
@@ -44,7 +47,22 @@ function setupEventListeners() {
     document.getElementById('compileBtn').addEventListener('click', () => executeFile('compile'));
     document.getElementById('runBtn').addEventListener('click', () => executeFile('run'));
     document.getElementById('compileRunBtn').addEventListener('click', () => executeFile('both'));
-    document.getElementById('closeExecute').addEventListener('click', () => closeModal('executeModal'));
+    document.getElementById('interactiveBtn').addEventListener('click', () => runInteractive());
+    document.getElementById('benchmarkBtn').addEventListener('click', () => runBenchmark());
+    document.getElementById('buildProjectBtn').addEventListener('click', () => buildProject());
+    document.getElementById('buildAllBtn').addEventListener('click', () => buildAll());
+    document.getElementById('watchBtn').addEventListener('click', () => state.watch ? closeWatch() : runWatch());
+    document.getElementById('closeExecute').addEventListener('click', () => {
+        // Dropping the request makes the server stop the job
+        if (state.executeAbort) state.executeAbort.abort();
+        closeTerminal();
+        closeWatch();
+        closeModal('executeModal');
+    });
+    document.getElementById('executionOutput').addEventListener('keydown', terminalKey);
+    document.getElementById('profileSelect').addEventListener('change', (e) => {
+        document.getElementById('trainingInputs').classList.toggle('hidden', e.target.value !== 'pgo');
+    });
     
     // Location Modal
     document.getElementById('browseLocation').addEventListener('click', openLocationBrowser);
@@ -68,6 +86,10 @@ function setupEventListeners() {
     document.querySelectorAll('.modal-close').forEach(btn => {
         btn.addEventListener('click', (e) => {
             const modal = e.target.closest('.modal');
+            if (modal.id === 'executeModal') {
+                closeTerminal();
+                closeWatch();
+            }
             closeModal(modal.id);
         });
     });
@@ -92,11 +114,19 @@ function setupEventListeners() {
 // ============================================================================
 // API Communication
 // ============================================================================
-async function apiCall(endpoint, method = 'GET', data = null) {
+// Identifies this tab to the server's execution queue, which takes turns
+// between sessions
+const sessionId = sessionStorage.getItem('nexusSession') ||
+    Math.random().toString(36).slice(2) + Date.now().toString(36);
+sessionStorage.setItem('nexusSession', sessionId);
+
+async function apiCall(endpoint, method = 'GET', data = null, signal = undefined) {
     const options = {
         method,
+        signal,
         headers: {
-            'Content-Type': 'application/json'
+            'Content-Type': 'application/json',
+            'X-Nexus-Session': sessionId
         }
     };
     
@@ -111,6 +141,7 @@ async function apiCall(endpoint, method = 'GET', data = null) {
         }
         return await response.json();
     } catch (error) {
+        if (error.name === 'AbortError') throw error;
         console.error('API Error:', error);
         showNotification('Error communicating with server', 'error');
         throw error;
@@ -329,46 +360,424 @@ function openExecuteModal(filename) {
     state.currentExecuteFile = filename;
     document.getElementById('executeFileName').textContent = filename;
     document.getElementById('executionOutput').textContent = '';
+    closeTerminal();
+    closeWatch();
     openModal('executeModal');
 }
 
+// Optimization profile picked in the execute modal, and the training
+// inputs of a profile-guided build
+function buildOptions() {
+    const profile = document.getElementById('profileSelect').value;
+    if (profile !== 'pgo') return { profile };
+    const training = document.getElementById('trainingInputs').value
+        .split(',').map(name => name.trim()).filter(name => name);
+    return { profile, training };
+}
+
+// Note under output cut short in the response; the rest is paged by job id
+function formatTruncated(data) {
+    if (!data.outputTruncated) return '';
+    const shown = new TextEncoder().encode(data.output || '').length;
+    return `\n\n… ${data.outputBytes - shown} more bytes: /api/jobs/output?id=${data.jobId}&offset=${shown}`;
+}
+
+// One-line resource summary for an execution response
+function formatExecStats(stats) {
+    if (!stats) return '';
+    const mb = (stats.maxRssKb / 1024).toFixed(1);
+    const queued = stats.queueMs >= 1 ? ` (queued ${stats.queueMs.toFixed(0)} ms)` : '';
+    return `\nTime: ${stats.wallMs.toFixed(0)} ms wall, ${stats.userMs.toFixed(0)} ms user, ` +
+        `${stats.sysMs.toFixed(0)} ms sys${queued} | Peak RSS: ${mb} MB`;
+}
+
 async function executeFile(action) {
     const outputElement = document.getElementById('executionOutput');
     outputElement.textContent = 'Executing...\n';
     
-    // Disable buttons during execution
-    document.getElementById('compileBtn').disabled = true;
-    document.getElementById('runBtn').disabled = true;
-    document.getElementById('compileRunBtn').disabled = true;
+    setExecuteBusy(true);
     
+    state.executeAbort = new AbortController();
     try {
         const data = await apiCall('/api/execute', 'POST', {
             filename: state.currentExecuteFile,
             action,
-            location: state.currentLocation
-        });
+            location: state.currentLocation,
+            ...buildOptions()
+        }, state.executeAbort.signal);
         
         if (data.success) {
             outputElement.textContent = '✓ Execution completed successfully!\n\n';
             outputElement.textContent += '═══════════ OUTPUT ═══════════\n\n';
             outputElement.textContent += data.output || '(No output)';
+            outputElement.textContent += formatTruncated(data);
             outputElement.textContent += '\n\n═══════════════════════════════';
             outputElement.textContent += `\nExit Code: ${data.exitCode || 0}`;
+            outputElement.textContent += formatExecStats(data.stats);
         } else {
             outputElement.textContent = '✗ Execution failed!\n\n';
             outputElement.textContent += '═══════════ ERROR ═══════════\n\n';
             outputElement.textContent += data.output || data.error || 'Unknown error';
+            outputElement.textContent += formatTruncated(data);
             outputElement.textContent += '\n\n═══════════════════════════════';
             outputElement.textContent += `\nExit Code: ${data.exitCode || 1}`;
+            outputElement.textContent += formatExecStats(data.stats);
         }
     } catch (error) {
         outputElement.textContent = '✗ Execution failed!\n\n';
         outputElement.textContent += 'Error: ' + error.message;
     } finally {
-        // Re-enable buttons
-        document.getElementById('compileBtn').disabled = false;
-        document.getElementById('runBtn').disabled = false;
-        document.getElementById('compileRunBtn').disabled = false;
+        state.executeAbort = null;
+        setExecuteBusy(false);
+    }
+}
+
+// Build the C/C++ project in the current folder (only stale files are
+// recompiled on the server) and run it
+async function buildProject() {
+    const outputElement = document.getElementById('executionOutput');
+    outputElement.textContent = 'Building project...\n';
+    setExecuteBusy(true);
+    
+    state.executeAbort = new AbortController();
+    try {
+        const data = await apiCall('/api/build', 'POST', {
+            location: state.currentLocation,
+            action: 'both',
+            profile: buildOptions().profile
+        }, state.executeAbort.signal);
+        
+        let text = data.success ? '✓ Build completed successfully!\n\n' : '✗ Build failed!\n\n';
+        if (data.sources !== undefined) {
+            text += `Sources: ${data.sources} | Compiled: ${data.compiled} | ` +
+                `Up to date: ${data.upToDate}${data.linked ? ' | Linked' : ''}\n`;
+        }
+        if (data.buildOutput) text += '\n' + data.buildOutput;
+        if (data.error) text += `\n${data.error}\n`;
+        if (data.output !== undefined) {
+            text += '\n═══════════ OUTPUT ═══════════\n\n';
+            text += data.output || '(No output)';
+            text += '\n\n═══════════════════════════════';
+            text += `\nExit Code: ${data.exitCode}`;
+        }
+        if (data.stats) {
+            text += `\nTime: ${data.stats.wallMs.toFixed(0)} ms wall, ${data.stats.cpuMs.toFixed(0)} ms CPU`;
+        }
+        outputElement.textContent = text;
+    } catch (error) {
+        outputElement.textContent = '✗ Build failed!\n\n';
+        outputElement.textContent += 'Error: ' + error.message;
+    } finally {
+        state.executeAbort = null;
+        setExecuteBusy(false);
+    }
+}
+
+// Compile every file of the folder on its own; the server streams a JSON
+// line per file as it completes, then a summary line
+async function buildAll() {
+    const outputElement = document.getElementById('executionOutput');
+    outputElement.textContent = 'Compiling every file in the folder...\n';
+    setExecuteBusy(true);
+    
+    state.executeAbort = new AbortController();
+    const params = new URLSearchParams({
+        location: state.currentLocation,
+        profile: buildOptions().profile
+    });
+    let lines = '', failures = '', count = 0;
+    const show = (line) => {
+        const file = JSON.parse(line);
+        if (file.done) {
+            let text = file.success ? '✓ All files compiled\n\n' : '✗ Some files failed\n\n';
+            text += `Sources: ${file.sources} | Compiled: ${file.compiled} | ` +
+                `Up to date: ${file.upToDate} | Failed: ${file.failed}\n`;
+            text += `Time: ${file.stats.wallMs.toFixed(0)} ms wall, ${file.stats.cpuMs.toFixed(0)} ms CPU\n`;
+            outputElement.textContent = text + failures + '\n' + lines;
+            return;
+        }
+        count++;
+        const mark = file.state === 'failed' ? '✗' : file.state === 'compiled' ? '✓' : '·';
+        const time = file.ms !== undefined ? `  ${file.ms.toFixed(0)} ms` : '';
+        lines += `${mark} ${file.file.padEnd(32)}${file.state}${time}\n`;
+        if (file.state === 'failed') {
+            failures += `\n── ${file.file} ──\n${file.error || file.buildOutput || ''}\n`;
+        }
+        outputElement.textContent = `Compiling... ${count} done\n\n` + lines;
+    };
+    try {
+        const response = await fetch(`/api/build-all?${params}`, {
+            signal: state.executeAbort.signal,
+            headers: { 'X-Nexus-Session': sessionId }
+        });
+        if (!response.ok) throw new Error((await response.json()).error || response.statusText);
+        const reader = response.body.getReader();
+        const decoder = new TextDecoder();
+        let pending = '';
+        for (;;) {
+            const { done, value } = await reader.read();
+            if (done) break;
+            pending += decoder.decode(value, { stream: true });
+            let newline;
+            while ((newline = pending.indexOf('\n')) >= 0) {
+                show(pending.slice(0, newline));
+                pending = pending.slice(newline + 1);
+            }
+        }
+    } catch (error) {
+        outputElement.textContent += '\n✗ Build failed: ' + error.message;
+    } finally {
+        state.executeAbort = null;
+        setExecuteBusy(false);
+    }
+}
+
+// Benchmark the file, or compare it with a second one: every run goes one
+// at a time on the server and the reply carries the statistics
+async function runBenchmark() {
+    const outputElement = document.getElementById('executionOutput');
+    const runs = parseInt(document.getElementById('benchRuns').value, 10) || 10;
+    const compare = document.getElementById('benchCompare').value.trim();
+    outputElement.textContent = `Benchmarking (${runs} runs${compare ? ' each' : ''})...\n`;
+    setExecuteBusy(true);
+    
+    state.executeAbort = new AbortController();
+    try {
+        const data = await apiCall('/api/execute/bench', 'POST', {
+            filename: state.currentExecuteFile,
+            compare,
+            location: state.currentLocation,
+            runs,
+            profile: buildOptions().profile
+        }, state.executeAbort.signal);
+        outputElement.textContent = formatBenchmark(data);
+    } catch (error) {
+        outputElement.textContent = '✗ Benchmark failed!\n\n';
+        outputElement.textContent += 'Error: ' + error.message;
+    } finally {
+        state.executeAbort = null;
+        setExecuteBusy(false);
+    }
+}
+
+const BENCH_METRICS = [
+    ['wallMs', 'Wall time (ms)'], ['cpuMs', 'CPU time (ms)'], ['maxRssKb', 'Peak RSS (KB)'],
+    ['cycles', 'Cycles'], ['instructions', 'Instructions'], ['cacheMisses', 'Cache misses']
+];
+
+function formatBenchNumber(v) {
+    return Math.abs(v) >= 1000 ? Math.round(v).toLocaleString() : v.toFixed(2);
+}
+
+function formatBenchmark(data) {
+    let text = data.success ? '✓ Benchmark completed!\n' : `✗ Benchmark failed: ${data.error}\n`;
+    if (data.failedProgram) text += `${data.failedProgram} exited with ${data.exitCode}\n`;
+    text += `Runs: ${data.runs} measured after ${data.warmup} warmup` +
+        (data.counters ? '' : ' | Hardware counters unavailable') + '\n';
+    for (const program of data.programs || []) {
+        text += `\n═══════════ ${program.file} (${program.measured} runs) ═══════════\n`;
+        if (program.compileOutput) text += program.compileOutput + '\n';
+        text += 'Metric'.padEnd(16) + ['mean', 'stddev', 'p50', 'p95', 'max']
+            .map(h => h.padStart(12)).join('') + '\n';
+        for (const [key, label] of BENCH_METRICS) {
+            const st = program.stats[key];
+            if (!st) continue;
+            text += label.padEnd(16) + [st.mean, st.stddev, st.p50, st.p95, st.max]
+                .map(v => formatBenchNumber(v).padStart(12)).join('') + '\n';
+        }
+        if (program.output) text += '\nOutput of the first run:\n' + program.output;
+    }
+    if (data.comparison) {
+        const [a, b] = data.programs;
+        text += `\n═══════════ ${b.file} vs ${a.file} ═══════════\n`;
+        for (const [key, label] of BENCH_METRICS) {
+            const cmp = data.comparison[key];
+            if (!cmp) continue;
+            const change = ((cmp.ratio - 1) * 100).toFixed(1);
+            text += `${label.padEnd(16)}${change > 0 ? '+' : ''}${change}%` +
+                (cmp.significant ? '' : '  (not significant)') + '\n';
+        }
+    }
+    return text;
+}
+
+// ============================================================================
+// Interactive Runs - the program gets a terminal on the server; keystrokes
+// go up a WebSocket and its output comes back the same way
+// ============================================================================
+function runInteractive() {
+    const outputElement = document.getElementById('executionOutput');
+    closeTerminal();
+    closeWatch();
+    outputElement.textContent = '';
+    outputElement.classList.add('terminal');
+    outputElement.focus();
+    setExecuteBusy(true);
+    
+    const size = terminalSize(outputElement);
+    const params = new URLSearchParams({
+        file: state.currentExecuteFile,
+        location: state.currentLocation,
+        cols: size.cols,
+        rows: size.rows,
+        profile: buildOptions().profile
+    });
+    const scheme = location.protocol === 'https:' ? 'wss:' : 'ws:';
+    const ws = new WebSocket(`${scheme}//${location.host}/api/pty?${params}`);
+    ws.binaryType = 'arraybuffer';
+    const decoder = new TextDecoder();
+    const term = { ws, text: '', ended: false };
+    state.terminal = term;
+    
+    ws.onmessage = (event) => {
+        if (typeof event.data !== 'string') {
+            terminalWrite(term, decoder.decode(new Uint8Array(event.data), { stream: true }));
+            return;
+        }
+        const msg = JSON.parse(event.data);
+        if (msg.type === 'exit') {
+            term.ended = true;
+            const why = msg.end === 'exited' ? '' : ` (${msg.end})`;
+            terminalWrite(term, `\n\n═══════════════════════════════\nExit Code: ${msg.exitCode}${why}`);
+        }
+    };
+    ws.onclose = () => {
+        if (!term.ended) terminalWrite(term, '\n\n✗ Session closed');
+        if (state.terminal === term) {
+            state.terminal = null;
+            setExecuteBusy(false);
+        }
+    };
+    term.onresize = () => {
+        const next = terminalSize(outputElement);
+        if (ws.readyState === WebSocket.OPEN) ws.send(JSON.stringify({ type: 'resize', ...next }));
+    };
+    window.addEventListener('resize', term.onresize);
+}
+
+function closeTerminal() {
+    const term = state.terminal;
+    if (!term) return;
+    state.terminal = null;
+    window.removeEventListener('resize', term.onresize);
+    // The server stops the program when the socket goes away
+    term.ws.close();
+    document.getElementById('executionOutput').classList.remove('terminal');
+    setExecuteBusy(false);
+}
+
+// Columns and rows that fit the output box
+function terminalSize(element) {
+    const style = getComputedStyle(element);
+    const charWidth = parseFloat(style.fontSize) * 0.6;
+    const lineHeight = parseFloat(style.lineHeight) || parseFloat(style.fontSize) * 1.6;
+    return {
+        cols: Math.max(20, Math.floor((element.clientWidth - 40) / charWidth)),
+        rows: Math.max(5, Math.floor(window.innerHeight * 0.6 / lineHeight))
+    };
+}
+
+// Append terminal output: colours and cursor movement are dropped, line
+// endings and the backspaces of the terminal's own echo are applied
+function terminalWrite(term, chunk) {
+    chunk = chunk.replace(/\x1b\[[0-9;?]*[ -\/]*[@-~]|\x1b\][^\x07\x1b]*(\x07|\x1b\\)|\x1b[@-Z\\-_]/g, '');
+    for (const ch of chunk) {
+        if (ch === '\b') term.text = term.text.slice(0, -1);
+        else if (ch !== '\r' && ch !== '\x07') term.text += ch;
+    }
+    const outputElement = document.getElementById('executionOutput');
+    outputElement.textContent = term.text;
+    outputElement.scrollTop = outputElement.scrollHeight;
+}
+
+// Keystrokes typed into the output box, as a terminal would encode them
+const TERMINAL_KEYS = {
+    Enter: '\r', Backspace: '\x7f', Tab: '\t', Escape: '\x1b',
+    ArrowUp: '\x1b[A', ArrowDown: '\x1b[B', ArrowRight: '\x1b[C', ArrowLeft: '\x1b[D',
+    Home: '\x1b[H', End: '\x1b[F', Delete: '\x1b[3~'
+};
+
+function terminalKey(event) {
+    const term = state.terminal;
+    if (!term || term.ended || term.ws.readyState !== WebSocket.OPEN) return;
+    let data = TERMINAL_KEYS[event.key];
+    if (event.ctrlKey && event.key.length === 1) {
+        const code = event.key.toUpperCase().charCodeAt(0);
+        if (code >= 64 && code < 96) data = String.fromCharCode(code - 64);     // Ctrl-C is \x03
+    } else if (!data && event.key.length === 1 && !event.metaKey) {
+        data = event.key;
+    }
+    if (!data) return;
+    event.preventDefault();
+    term.ws.send(new TextEncoder().encode(data));
+}
+
+// ============================================================================
+// Watch Mode - the server rebuilds and reruns the file on every save and
+// pushes each result up a WebSocket; a save during a run replaces it
+// ============================================================================
+function runWatch() {
+    const outputElement = document.getElementById('executionOutput');
+    closeTerminal();
+    closeWatch();
+    outputElement.textContent = 'Watching for changes...';
+    setExecuteBusy(true);
+    const button = document.getElementById('watchBtn');
+    button.disabled = false;
+    button.textContent = 'Stop Watching';
+    
+    const params = new URLSearchParams({
+        file: state.currentExecuteFile,
+        location: state.currentLocation,
+        profile: buildOptions().profile
+    });
+    const scheme = location.protocol === 'https:' ? 'wss:' : 'ws:';
+    const ws = new WebSocket(`${scheme}//${location.host}/api/watch?${params}`);
+    const watch = { ws, files: [], started: 0 };
+    state.watch = watch;
+    
+    ws.onmessage = (event) => {
+        const msg = JSON.parse(event.data);
+        if (msg.type === 'watching') {
+            watch.files = msg.files;
+        } else if (msg.type === 'start') {
+            watch.started = performance.now();
+            outputElement.textContent = msg.rebuild ? '⏳ Rebuilding...' : '⏳ Unchanged, running again...';
+        } else if (msg.type === 'stale') {
+            outputElement.textContent = '⏳ Changed again, restarting...';
+        } else if (msg.type === 'error') {
+            outputElement.textContent = `✗ ${msg.error}`;
+        } else if (msg.type === 'result') {
+            const time = new Date().toLocaleTimeString();
+            let text = `${msg.success ? '✓' : '✗'} ${time}  ${msg.rebuild ? 'rebuilt' : 'reused build'}, ` +
+                `${msg.wallMs.toFixed(0)} ms  (watching ${watch.files.length} file${watch.files.length === 1 ? '' : 's'})\n` +
+                '═══════════════════════════════\n' + msg.output;
+            if (msg.outputTruncated) text += `\n… ${msg.outputBytes - msg.output.length} more bytes not shown`;
+            text += `\n═══════════════════════════════\nExit Code: ${msg.exitCode}`;
+            outputElement.textContent = text;
+        }
+    };
+    ws.onclose = () => {
+        if (state.watch !== watch) return;
+        outputElement.textContent += '\n\n✗ Watch ended';
+        closeWatch();
+    };
+}
+
+function closeWatch() {
+    const watch = state.watch;
+    if (!watch) return;
+    state.watch = null;
+    // The server stops watching when nobody follows the file
+    watch.ws.close();
+    document.getElementById('watchBtn').textContent = 'Watch';
+    setExecuteBusy(false);
+}
+
+// Disable the execute buttons while a request is in flight
+function setExecuteBusy(busy) {
+    for (const id of ['compileBtn', 'runBtn', 'compileRunBtn', 'interactiveBtn', 'benchmarkBtn', 'buildProjectBtn', 'buildAllBtn', 'watchBtn']) {
+        document.getElementById(id).disabled = busy;
     }
 }
 
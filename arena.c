@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)   // Default block, covers most requests
+#define ARENA_POOL_MAX 16              // Idle arenas kept per thread
+#define ARENA_ALIGN 8
+
+struct arena_block {
+    struct arena_block *next;
+    size_t size;   // Usable bytes in data[]
+    size_t pos;    // Next free offset in data[]
+    unsigned char data[];
+};
+
+// Idle arenas owned by the current thread
+static __thread struct arena *pool_head = NULL;
+static __thread int pool_count = 0;
+
+static struct arena_block *block_new(size_t size) {
+    struct arena_block *b = malloc(sizeof(*b) + size);
+    if (!b) return NULL;
+    b->next = NULL;
+    b->size = size;
+    b->pos = 0;
+    return b;
+}
+
+struct arena *arena_acquire(void) {
+    struct arena *a = pool_head;
+    if (a) {
+        pool_head = a->next_free;
+        pool_count--;
+        a->next_free = NULL;
+        return a;
+    }
+
+    a = calloc(1, sizeof(*a));
+    if (!a) return NULL;
+    a->blocks = block_new(ARENA_BLOCK_SIZE);
+    if (!a->blocks) {
+        free(a);
+        return NULL;
+    }
+    return a;
+}
+
+void arena_release(struct arena *a) {
+    if (!a) return;
+    arena_reset(a);
+
+    if (pool_count >= ARENA_POOL_MAX) {
+        free(a->blocks);
+        free(a);
+        return;
+    }
+    a->next_free = pool_head;
+    pool_head = a;
+    pool_count++;
+}
+
+void *arena_alloc(struct arena *a, size_t size) {
+    if (!a) return NULL;
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+    if (size == 0) size = ARENA_ALIGN;
+
+    struct arena_block *b = a->blocks;
+    if (!b || b->size - b->pos < size) {
+        // Grow geometrically so a large request needs only a few blocks
+        size_t want = b ? b->size * 2 : ARENA_BLOCK_SIZE;
+        if (want < size) want = size;
+        struct arena_block *nb = block_new(want);
+        if (!nb) {
+            a->failed = true;
+            return NULL;
+        }
+        nb->next = b;
+        a->blocks = b = nb;
+    }
+
+    void *p = b->data + b->pos;
+    b->pos += size;
+    a->used += size;
+    if (a->used > a->peak) a->peak = a->used;
+    return p;
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t len) {
+    char *p = arena_alloc(a, len + 1);
+    if (!p) return NULL;
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
+size_t arena_reset(struct arena *a) {
+    size_t peak = a->peak;
+    struct arena_block *b = a->blocks;
+
+    // Keep only the oldest (default-sized) block
+    while (b && b->next) {
+        struct arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    if (b) b->pos = 0;
+    a->blocks = b;
+    a->used = 0;
+    a->peak = 0;
+    a->failed = false;
+    return peak;
+}
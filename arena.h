@@ -0,0 +1,67 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// ============================================================================
+// NEXUS File Manager - Request Arena Allocator
+// ============================================================================
+
+struct arena_block;
+
+/**
+ * Bump allocator for per-request scratch memory.
+ * Everything allocated from an arena is released at once by arena_reset().
+ */
+struct arena {
+    struct arena_block *blocks;   // Most recent block first
+    size_t used;                  // Bytes handed out since the last reset
+    size_t peak;                  // High-water mark of `used` since the last reset
+    bool failed;                  // An allocation failed since the last reset
+    struct arena *next_free;      // Linkage in the thread-local pool
+};
+
+/**
+ * Take an arena from the calling thread's pool (or create a new one)
+ *
+ * @return Arena ready for use, or NULL if out of memory
+ */
+struct arena *arena_acquire(void);
+
+/**
+ * Reset an arena and hand it back to the calling thread's pool
+ *
+ * @param a Arena obtained from arena_acquire()
+ */
+void arena_release(struct arena *a);
+
+/**
+ * Allocate memory from the arena (8-byte aligned, not zeroed)
+ *
+ * @param a Arena, or NULL (arena_acquire() failed)
+ * @param size Number of bytes
+ * @return Pointer valid until the next arena_reset(), or NULL
+ */
+void *arena_alloc(struct arena *a, size_t size);
+
+/**
+ * Copy `len` bytes into the arena and NUL-terminate them
+ *
+ * @param a Arena
+ * @param s Source bytes
+ * @param len Number of bytes to copy
+ * @return NUL-terminated copy, or NULL
+ */
+char *arena_strndup(struct arena *a, const char *s, size_t len);
+
+/**
+ * Free everything allocated since the last reset.
+ * The first block is kept so the next request allocates nothing.
+ *
+ * @param a Arena
+ * @return Peak number of bytes in use before the reset
+ */
+size_t arena_reset(struct arena *a);
+
+#endif // ARENA_H
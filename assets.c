@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assets.h"
+
+// Mongoose guesses the type from the extension, but only for known ones
+static const char *content_type(const char *name) {
+    const char *ext = strrchr(name, '.');
+    if (ext == NULL) return "application/octet-stream";
+    if (strcmp(ext, ".html") == 0) return "text/html; charset=utf-8";
+    if (strcmp(ext, ".css") == 0) return "text/css; charset=utf-8";
+    if (strcmp(ext, ".js") == 0) return "text/javascript; charset=utf-8";
+    if (strcmp(ext, ".png") == 0) return "image/png";
+    if (strcmp(ext, ".svg") == 0) return "image/svg+xml";
+    return "application/octet-stream";
+}
+
+static struct mg_str trim(struct mg_str s) {
+    while (s.len > 0 && (s.buf[0] == ' ' || s.buf[0] == '\t')) s.buf++, s.len--;
+    while (s.len > 0 && (s.buf[s.len - 1] == ' ' || s.buf[s.len - 1] == '\t')) s.len--;
+    return s;
+}
+
+// True if the Accept-Encoding header lists `coding` with a non-zero q value
+bool http_accepts_encoding(struct mg_http_message *hm, const char *coding) {
+    struct mg_str *ae = mg_http_get_header(hm, "Accept-Encoding");
+    if (ae == NULL) return false;
+
+    struct mg_str list = *ae, item;
+    while (mg_span(list, &item, &list, ',')) {
+        struct mg_str token, params = mg_str_n(NULL, 0);
+        if (!mg_span(item, &token, &params, ';')) token = item;
+        if (mg_strcasecmp(trim(token), mg_str(coding)) != 0) continue;
+
+        params = trim(params);
+        if (params.len > 2 && params.buf[0] == 'q' && params.buf[1] == '=') {
+            char q[8];
+            snprintf(q, sizeof(q), "%.*s", (int) params.len - 2, params.buf + 2);
+            return atof(q) > 0;
+        }
+        return true;
+    }
+    return false;
+}
+
+// True if If-None-Match lists `etag` (quoted) or is "*". Weak comparison
+// (RFC 9110 13.1.2): a W/ prefix on either side is ignored.
+static bool etag_matches(struct mg_str inm, struct mg_str etag) {
+    struct mg_str list = inm, item;
+    while (mg_span(list, &item, &list, ',')) {
+        item = trim(item);
+        if (item.len == 1 && item.buf[0] == '*') return true;
+        if (item.len > 2 && item.buf[0] == 'W' && item.buf[1] == '/') {
+            item.buf += 2;
+            item.len -= 2;
+        }
+        if (mg_strcmp(item, etag) == 0) return true;
+    }
+    return false;
+}
+
+void assets_serve(struct mg_connection *c, struct mg_http_message *hm, const char *name) {
+    char path[128], variant[136];
+    size_t size = 0, hash_len = 0;
+
+    snprintf(path, sizeof(path), "/web/%s", name);
+    const char *data = mg_unpack(path, &size, NULL);
+    if (data == NULL) {
+        mg_http_reply(c, 404, "", "Not found");
+        return;
+    }
+
+    // Precompressed variants, best first
+    const char *encoding = NULL, *tag_suffix = "";
+    static const char *codings[][3] = {{"br", ".br", "-br"}, {"gzip", ".gz", "-gz"}};
+    for (size_t i = 0; i < sizeof(codings) / sizeof(codings[0]) && encoding == NULL; i++) {
+        if (!http_accepts_encoding(hm, codings[i][0])) continue;
+        size_t vsize = 0;
+        snprintf(variant, sizeof(variant), "%s%s", path, codings[i][1]);
+        const char *vdata = mg_unpack(variant, &vsize, NULL);
+        if (vdata != NULL && vsize < size) {
+            data = vdata;
+            size = vsize;
+            encoding = codings[i][0];
+            tag_suffix = codings[i][2];
+        }
+    }
+
+    // Each coding is a different representation, so it gets its own strong tag
+    snprintf(variant, sizeof(variant), "%s.etag", path);
+    const char *hash = mg_unpack(variant, &hash_len, NULL);
+    char etag[80] = "";
+    if (hash != NULL) snprintf(etag, sizeof(etag), "\"%.*s%s\"", (int) hash_len, hash, tag_suffix);
+
+    struct mg_str *inm = mg_http_get_header(hm, "If-None-Match");
+    if (etag[0] != '\0' && inm != NULL && etag_matches(*inm, mg_str(etag))) {
+        mg_printf(c, "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n"
+                  "Vary: Accept-Encoding\r\nContent-Length: 0\r\n\r\n", etag);
+        c->is_resp = 0;
+        return;
+    }
+
+    mg_printf(c, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n", content_type(name));
+    if (encoding != NULL) mg_printf(c, "Content-Encoding: %s\r\n", encoding);
+    if (etag[0] != '\0') mg_printf(c, "ETag: %s\r\n", etag);
+    // Names are not fingerprinted, so browsers must revalidate (cheap: 304)
+    mg_printf(c, "Cache-Control: no-cache\r\nVary: Accept-Encoding\r\n"
+              "Content-Length: %lu\r\n\r\n", (unsigned long) size);
+    if (mg_strcmp(hm->method, mg_str("HEAD")) != 0) mg_send(c, data, size);
+    c->is_resp = 0;     // Response complete; lets keep-alive requests through
+}
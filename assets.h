@@ -0,0 +1,31 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include "mongoose.h"
+
+// ============================================================================
+// NEXUS File Manager - Embedded Web Assets
+// ============================================================================
+
+/**
+ * Serve a web interface file from the copy packed into the binary.
+ * Picks the brotli or gzip variant when the client accepts it, and answers
+ * If-None-Match with 304. Each variant has its own strong ETag, built from
+ * the hash computed at build time.
+ * 
+ * @param c Mongoose connection
+ * @param hm HTTP request
+ * @param name Asset name, e.g. "index.html"
+ */
+void assets_serve(struct mg_connection *c, struct mg_http_message *hm, const char *name);
+
+/**
+ * Check whether the client accepts a content coding
+ * 
+ * @param hm HTTP request
+ * @param coding Coding name, e.g. "gzip"
+ * @return true if listed in Accept-Encoding with a non-zero q value
+ */
+bool http_accepts_encoding(struct mg_http_message *hm, const char *coding);
+
+#endif // ASSETS_H
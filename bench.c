@@ -0,0 +1,482 @@
+#define _GNU_SOURCE  // sched_setaffinity()
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "bench.h"
+#include "metrics.h"
+#include "mongoose.h"
+
+static unsigned long next_id = 1;
+static char run_exe[PATH_MAX];      // This binary, for --bench-run
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+void bench_init(void) {
+    ssize_t n = readlink("/proc/self/exe", run_exe, sizeof(run_exe) - 1);
+    run_exe[n > 0 ? n : 0] = '\0';
+    if (n <= 0) MG_ERROR(("bench: cannot find the server binary, benchmarks are off"));
+}
+
+// Read the start of a file
+static size_t read_head(const char *path, char *buf, size_t size) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return 0;
+    size_t len = fread(buf, 1, size, fp);
+    fclose(fp);
+    return len;
+}
+
+// ----------------------------------------------------------------------------
+// Statistics
+// ----------------------------------------------------------------------------
+
+const char *bench_metric_name(enum bench_metric m) {
+    switch (m) {
+        case BENCH_WALL_MS: return "wallMs";
+        case BENCH_CPU_MS: return "cpuMs";
+        case BENCH_MAX_RSS_KB: return "maxRssKb";
+        case BENCH_CYCLES: return "cycles";
+        case BENCH_INSTRUCTIONS: return "instructions";
+        case BENCH_CACHE_MISSES: return "cacheMisses";
+        default: return "";
+    }
+}
+
+// One metric of a sample, negative if it was not measured
+static double sample_value(const struct bench_sample *s, enum bench_metric m) {
+    switch (m) {
+        case BENCH_WALL_MS: return s->wall_ms;
+        case BENCH_CPU_MS: return s->cpu_ms;
+        case BENCH_MAX_RSS_KB: return (double) s->max_rss_kb;
+        case BENCH_CYCLES: return (double) s->cycles;
+        case BENCH_INSTRUCTIONS: return (double) s->instructions;
+        case BENCH_CACHE_MISSES: return (double) s->cache_misses;
+        default: return -1;
+    }
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const double *v, size_t n, double q) {
+    size_t rank = (size_t) ceil(q * (double) n);
+    return v[rank > 0 ? rank - 1 : 0];
+}
+
+bool bench_summarize(const struct bench_program *p, enum bench_metric m, struct bench_stats *st) {
+    size_t n = p->nsamples;
+    if (n == 0) return false;
+    double *v = malloc(n * sizeof(*v));
+    if (v == NULL) return false;
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        v[i] = sample_value(&p->samples[i], m);
+        if (v[i] < 0) {
+            free(v);
+            return false;
+        }
+        sum += v[i];
+    }
+    qsort(v, n, sizeof(*v), compare_double);
+    st->mean = sum / (double) n;
+    double squares = 0;
+    for (size_t i = 0; i < n; i++) squares += (v[i] - st->mean) * (v[i] - st->mean);
+    st->stddev = n > 1 ? sqrt(squares / (double) (n - 1)) : 0;
+    st->min = v[0];
+    st->max = v[n - 1];
+    st->p50 = percentile(v, n, 0.50);
+    st->p90 = percentile(v, n, 0.90);
+    st->p95 = percentile(v, n, 0.95);
+    st->p99 = percentile(v, n, 0.99);
+    free(v);
+    return true;
+}
+
+// Two-sided 95% critical value of Student's t
+static double t_critical(double df) {
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    if (df < 1) df = 1;
+    if (df <= 30) return table[(int) df - 1];  // Rounding df down is conservative
+    return 1.96 + 2.5 / df;                    // Within 0.002 of the exact value
+}
+
+bool bench_compare(const struct bench_program *a, const struct bench_program *b,
+                   enum bench_metric m, struct bench_comparison *cmp) {
+    struct bench_stats sa, sb;
+    if (!bench_summarize(a, m, &sa) || !bench_summarize(b, m, &sb) || sa.mean == 0) return false;
+    cmp->ratio = sb.mean / sa.mean;
+    cmp->t = 0;
+    cmp->significant = false;
+    if (a->nsamples < 2 || b->nsamples < 2) return true;
+
+    // Welch's t-test: no assumption that both programs vary alike
+    double va = sa.stddev * sa.stddev / (double) a->nsamples;
+    double vb = sb.stddev * sb.stddev / (double) b->nsamples;
+    if (va + vb == 0) {
+        cmp->significant = sa.mean != sb.mean;     // Every run alike: any gap is real
+        return true;
+    }
+    cmp->t = (sb.mean - sa.mean) / sqrt(va + vb);
+    double df = (va + vb) * (va + vb) /
+                (va * va / (double) (a->nsamples - 1) + vb * vb / (double) (b->nsamples - 1));
+    cmp->significant = fabs(cmp->t) > t_critical(df);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Benchmark
+// ----------------------------------------------------------------------------
+
+static void bench_free(struct bench *b) {
+    for (int i = 0; i < b->nprograms; i++) {
+        free(b->programs[i].compile);
+        free(b->programs[i].run);
+        free(b->programs[i].samples);
+    }
+    free(b->input);
+    free(b);
+}
+
+static void bench_finish(struct bench *b) {
+    b->wall_ms = now_ms() - b->start_ms;
+    if (b->error != NULL) {
+        MG_INFO(("bench %lu %s: %s after %d runs, %.0f ms", b->id, b->programs[0].name,
+                 b->error, b->next, b->wall_ms));
+    } else {
+        MG_INFO(("bench %lu %s: %d x %d runs, %.0f ms", b->id, b->programs[0].name,
+                 b->nprograms, b->runs, b->wall_ms));
+    }
+    b->done(b);
+    bench_free(b);
+}
+
+// Account for a finished job of this benchmark
+static void job_ended(struct bench *b, struct exec_job *job) {
+    b->pending--;
+    metrics_exec_queued(job->priority, (uint64_t) (job->stats.queue_ms * 1000));
+    if (job->end == EXEC_CANCELLED) b->cancelled = true;
+}
+
+static void result_path(const struct bench *b, int run, char *buf, size_t size) {
+    snprintf(buf, size, "/tmp/nexus_bench_%d_%lu_%d.txt", (int) getpid(), b->id, run);
+}
+
+static void put(char *buf, size_t size, size_t *len, const char *s, size_t n) {
+    if (*len < size) memcpy(buf + *len, s, *len + n < size ? n : size - *len);
+    *len += n;
+}
+
+// Append one single-quoted shell word; returns the length it needs
+static size_t quote_arg(char *buf, size_t size, size_t len, const char *s) {
+    put(buf, size, &len, " '", 2);
+    for (; *s != '\0'; s++) {
+        if (*s == '\'') put(buf, size, &len, "'\\''", 4);
+        else put(buf, size, &len, s, 1);
+    }
+    put(buf, size, &len, "'", 2);       // With the NUL
+    return len - 1;
+}
+
+static void run_done(struct exec_job *job);
+
+// Queue the next run; they go one at a time so they never compete for CPUs
+static void start_run(struct bench *b) {
+    int index = b->next++;
+    struct bench_program *p = &b->programs[index % b->nprograms];
+    char result[128], command[8192];
+    result_path(b, index, result, sizeof(result));
+    size_t len = (size_t) snprintf(command, sizeof(command), "'%s' " BENCH_RUN_FLAG " %d '%s'",
+                                   run_exe, b->cpu, result);
+    if (quote_arg(command, sizeof(command), len, p->run) >= sizeof(command)) {
+        b->error = "Command too long";
+        b->failed_program = index % b->nprograms;
+        bench_finish(b);
+        return;
+    }
+
+    struct exec_request req = {
+        .command = command,
+        .name = p->name,
+        .client = b->client,
+        .priority = EXEC_PRIO_RUN,
+        .timeout_s = b->timeout_s,
+        .input = b->input,
+        .done = run_done,
+        .data = b,
+    };
+    struct exec_job *job = exec_start(&req);
+    if (job == NULL) {
+        b->error = "Execution queue is full, try again later";
+        bench_finish(b);
+        return;
+    }
+    exec_subscribe(job, b->conn_id);
+    b->pending++;
+}
+
+static void run_done(struct exec_job *job) {
+    struct bench *b = job->data;
+    job_ended(b, job);
+    int index = b->next - 1;
+    int which = index % b->nprograms;
+    struct bench_program *p = &b->programs[which];
+
+    char result[128], line[256];
+    result_path(b, index, result, sizeof(result));
+    size_t len = read_head(result, line, sizeof(line) - 1);
+    line[len] = '\0';
+    unlink(result);
+    struct bench_sample s;
+    int pinned = 0;
+    bool measured = sscanf(line, "%lf %lf %ld %lld %lld %lld %d", &s.wall_ms, &s.cpu_ms,
+                           &s.max_rss_kb, &s.cycles, &s.instructions, &s.cache_misses,
+                           &pinned) == 7;
+
+    // The first run of each program shows what it printed
+    if (index < b->nprograms || job->end != EXEC_EXITED || job->stats.exit_code != 0) {
+        p->output_len = output_read(job->output, 0, p->output, sizeof(p->output));
+    }
+    if (job->end != EXEC_EXITED || job->stats.exit_code != 0 || !measured) {
+        b->error = job->end == EXEC_CANCELLED                              ? "Cancelled"
+                   : job->end == EXEC_TIMEOUT || job->end == EXEC_CPU_TIMEOUT ? "Time limit exceeded"
+                   : job->end == EXEC_NOT_STARTED                          ? "Could not start the run"
+                   : job->stats.exit_code != 0                             ? "Run failed"
+                                                                           : "Run was not measured";
+        b->failed_program = which;
+        b->exit_code = job->stats.exit_code;
+        bench_finish(b);
+        return;
+    }
+    if (index / b->nprograms >= b->warmup) {
+        p->samples[p->nsamples++] = s;
+        b->counters = s.cycles >= 0;
+        b->pinned = pinned != 0;
+    }
+    if (b->next < (b->warmup + b->runs) * b->nprograms) start_run(b);
+    else bench_finish(b);
+}
+
+static void compile_done(struct exec_job *job) {
+    struct bench_program *p = job->data;
+    struct bench *b = p->bench;
+    job_ended(b, job);
+    size_t len = output_read(job->output, 0, p->compile_output, sizeof(p->compile_output) - 1);
+    p->compile_output[len] = '\0';
+    if (job->end == EXEC_EXITED && job->stats.exit_code == 0) {
+        p->compiled = true;
+    } else if (b->error == NULL) {
+        b->error = job->end == EXEC_CANCELLED ? "Cancelled" : "Compilation failed";
+        b->failed_program = (int) (p - b->programs);
+        b->exit_code = job->stats.exit_code;
+    }
+    if (b->pending > 0) return;
+    if (b->error != NULL) bench_finish(b);
+    else start_run(b);
+}
+
+bool bench_start(const struct bench_request *req, const char **error) {
+    if (run_exe[0] == '\0') {
+        *error = "Benchmarks are not available";
+        return false;
+    }
+    if (req->nprograms < 1 || req->nprograms > BENCH_MAX_PROGRAMS) {
+        *error = "Expected one program, or two to compare";
+        return false;
+    }
+    if (req->runs < 1 || req->runs > BENCH_MAX_RUNS) {
+        *error = "Expected 1 to 1000 runs";
+        return false;
+    }
+    if (req->warmup < 0 || req->warmup > BENCH_MAX_WARMUP) {
+        *error = "Expected 0 to 100 warmup runs";
+        return false;
+    }
+    if (req->cpu < -1 || req->cpu >= sysconf(_SC_NPROCESSORS_CONF)) {
+        *error = "No such CPU";
+        return false;
+    }
+    struct stat st;
+    if (req->input != NULL && (stat(req->input, &st) != 0 || !S_ISREG(st.st_mode))) {
+        *error = "Input file not found";
+        return false;
+    }
+
+    struct bench *b = calloc(1, sizeof(*b));
+    if (b == NULL) {
+        *error = "Out of memory";
+        return false;
+    }
+    b->nprograms = req->nprograms;
+    bool ok = req->input == NULL || (b->input = strdup(req->input)) != NULL;
+    for (int i = 0; i < req->nprograms; i++) {
+        struct bench_program *p = &b->programs[i];
+        p->bench = b;
+        snprintf(p->name, sizeof(p->name), "%s", req->name[i]);
+        p->run = strdup(req->run[i]);
+        p->samples = calloc((size_t) req->runs, sizeof(*p->samples));
+        if (req->compile[i] != NULL) p->compile = strdup(req->compile[i]);
+        else p->compiled = true;
+        ok = ok && p->run != NULL && p->samples != NULL &&
+             (req->compile[i] == NULL || p->compile != NULL);
+    }
+    if (!ok) {
+        bench_free(b);
+        *error = "Out of memory";
+        return false;
+    }
+    b->id = next_id++;
+    b->runs = req->runs;
+    b->warmup = req->warmup;
+    b->cpu = req->cpu;
+    b->timeout_s = req->timeout_s;
+    b->failed_program = -1;
+    b->start_ms = now_ms();
+    snprintf(b->client, sizeof(b->client), "%s", req->client != NULL ? req->client : "");
+    b->conn_id = req->conn_id;
+    b->done = req->done;
+    b->data = req->data;
+
+    // Both programs compile in parallel; runs start once every compile is over
+    for (int i = 0; i < b->nprograms; i++) {
+        struct bench_program *p = &b->programs[i];
+        if (p->compile == NULL) continue;
+        struct exec_request compile = {
+            .command = p->compile,
+            .name = p->name,
+            .client = b->client,
+            .priority = EXEC_PRIO_BUILD,
+            .done = compile_done,
+            .data = p,
+        };
+        struct exec_job *job = exec_start(&compile);
+        if (job == NULL) {
+            b->error = "Execution queue is full, try again later";
+            break;
+        }
+        exec_subscribe(job, b->conn_id);
+        b->pending++;
+    }
+    if (b->pending > 0) return true;
+    if (b->error != NULL) {
+        bench_free(b);
+        *error = "Execution queue is full, try again later";
+        return false;
+    }
+    start_run(b);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Measured run: --bench-run
+// ----------------------------------------------------------------------------
+
+// A hardware counter on this process and everything it starts, or -1
+static int counter_open(uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+// Counter value, scaled up if the PMU was shared with other events; -1 if none
+static long long counter_read(int fd) {
+    uint64_t v[3];
+    if (fd < 0 || read(fd, v, sizeof(v)) != (ssize_t) sizeof(v) || v[2] == 0) return -1;
+    return (long long) ((double) v[0] * (double) v[1] / (double) v[2]);
+}
+
+int bench_run_main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <cpu> <result-file> <command>\n", BENCH_RUN_FLAG);
+        return 2;
+    }
+    int cpu = atoi(argv[0]);
+    const char *result = argv[1];
+    int pinned = 0;
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pinned = sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+
+    static const uint64_t events[] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+    };
+    int fds[3];
+    for (int i = 0; i < 3; i++) {
+        fds[i] = counter_open(events[i]);
+        if (fds[i] >= 0) ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+    }
+
+    struct timespec t0, t1;
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl("/bin/sh", "sh", "-c", argv[2], (char *) NULL);
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+    while (pid > 0 && wait4(pid, &status, 0, &ru) < 0 && errno == EINTR) {}
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long long counts[3];
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        counts[i] = counter_read(fds[i]);
+        if (fds[i] >= 0) close(fds[i]);
+    }
+    if (pid < 0) {
+        perror("fork");
+        return 126;
+    }
+    // All or nothing, so a partial counter set never looks like a result
+    if (counts[0] < 0 || counts[1] < 0 || counts[2] < 0) counts[0] = counts[1] = counts[2] = -1;
+
+    double wall_ms = (double) (t1.tv_sec - t0.tv_sec) * 1e3 + (double) (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    double cpu_ms = (double) (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 +
+                    (double) (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3;
+    FILE *fp = fopen(result, "w");
+    if (fp != NULL) {
+        fprintf(fp, "%.6f %.3f %ld %lld %lld %lld %d\n", wall_ms, cpu_ms, ru.ru_maxrss,
+                counts[0], counts[1], counts[2], pinned);
+        fclose(fp);
+    }
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return WEXITSTATUS(status);
+}
@@ -0,0 +1,187 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "exec.h"
+
+// ============================================================================
+// NEXUS File Manager - Benchmarks
+// ============================================================================
+
+// Every measured run goes through this binary, which pins the CPU, counts
+// hardware events and times the program without the shell around it:
+//   file_manager --bench-run <cpu> <result-file> <command>
+#define BENCH_RUN_FLAG "--bench-run"
+
+#define BENCH_MAX_RUNS 1000
+#define BENCH_MAX_WARMUP 100
+#define BENCH_MAX_PROGRAMS 2           // A/B comparison
+#define BENCH_OUTPUT_MAX 4096          // Output of the first run, kept for the reply
+#define BENCH_COMPILE_LOG_MAX 8192
+
+struct bench;
+typedef void (*bench_done_fn)(struct bench *b);
+
+/**
+ * One measured run. Counters are -1 when perf events are unavailable
+ * (no PMU access, e.g. perf_event_paranoid or a container).
+ */
+struct bench_sample {
+    double wall_ms;
+    double cpu_ms;              // User + system, every process of the run
+    long max_rss_kb;
+    long long cycles;
+    long long instructions;
+    long long cache_misses;
+};
+
+/**
+ * What bench_summarize() and bench_compare() look at
+ */
+enum bench_metric {
+    BENCH_WALL_MS,
+    BENCH_CPU_MS,
+    BENCH_MAX_RSS_KB,
+    BENCH_CYCLES,
+    BENCH_INSTRUCTIONS,
+    BENCH_CACHE_MISSES,
+    BENCH_METRICS
+};
+
+/**
+ * Summary of one metric over the measured runs
+ */
+struct bench_stats {
+    double mean;
+    double stddev;              // Sample standard deviation
+    double min, max;
+    double p50, p90, p95, p99;  // Nearest-rank percentiles
+};
+
+/**
+ * Program B against program A on one metric
+ */
+struct bench_comparison {
+    double ratio;               // mean(B) / mean(A)
+    double t;                   // Welch's t statistic, 0 if no run varied
+    bool significant;           // |t| beyond the 95% two-sided critical value
+};
+
+/**
+ * A program under test
+ */
+struct bench_program {
+    char name[256];
+    char *compile;              // NULL if nothing to compile
+    char *run;
+    bool compiled;
+    char compile_output[BENCH_COMPILE_LOG_MAX];
+    struct bench_sample *samples;
+    size_t nsamples;
+    char output[BENCH_OUTPUT_MAX];
+    size_t output_len;
+    struct bench *bench;
+};
+
+/**
+ * What to benchmark, for bench_start()
+ */
+struct bench_request {
+    const char *compile[BENCH_MAX_PROGRAMS];    // Shell commands, NULL if none
+    const char *run[BENCH_MAX_PROGRAMS];
+    const char *name[BENCH_MAX_PROGRAMS];
+    int nprograms;              // 2 for an A/B comparison
+    const char *input;          // stdin of every run, NULL for /dev/null
+    int runs;                   // Measured runs per program
+    int warmup;                 // Unmeasured runs first
+    int cpu;                    // Pin every run to this CPU, -1 for none
+    double timeout_s;           // Per run, 0 for the configured limit
+    const char *client;         // Fair-share key for the execution queue
+    unsigned long conn_id;      // Connection waiting; closing it cancels
+    bench_done_fn done;         // Called once the benchmark is over
+    void *data;
+};
+
+/**
+ * A benchmark: compile, then warmup and measured runs one at a time,
+ * alternating between the programs so drift affects both alike
+ */
+struct bench {
+    unsigned long id;
+    struct bench_program programs[BENCH_MAX_PROGRAMS];
+    int nprograms;
+    char *input;
+    int runs, warmup, cpu;
+    double timeout_s;
+    int next;                   // Runs started, warmup included, over all programs
+    size_t pending;
+    bool counters;              // Hardware counters were available
+    bool pinned;                // Pinning to `cpu` worked
+    const char *error;          // Why it stopped early, NULL if it did not
+    int failed_program;         // Index of the program that failed, -1 if none
+    int exit_code;              // Of the failed run
+    bool cancelled;
+    double start_ms;
+    double wall_ms;
+    char client[64];
+    unsigned long conn_id;
+    bench_done_fn done;
+    void *data;
+};
+
+/**
+ * Find the server binary, which measured runs go through
+ */
+void bench_init(void);
+
+/**
+ * Compile, then run each program `warmup + runs` times, one run at a time
+ * so runs do not compete with each other. Each run is an execution job of
+ * its own, in its own cgroup when cgroups are available. The benchmark
+ * stops at the first failing run. `done` may be called before bench_start()
+ * returns when nothing could be queued.
+ *
+ * @param req What to run
+ * @param error Set to a message when false is returned
+ * @return false if the benchmark could not be started
+ */
+bool bench_start(const struct bench_request *req, const char **error);
+
+/**
+ * JSON name of a metric: "wallMs", "cpuMs", "maxRssKb", "cycles", ...
+ */
+const char *bench_metric_name(enum bench_metric m);
+
+/**
+ * Summarise one metric of a program's measured runs
+ *
+ * @param p Program
+ * @param m Metric
+ * @param st Filled in
+ * @return false if there is nothing to summarise (no runs, no counters)
+ */
+bool bench_summarize(const struct bench_program *p, enum bench_metric m, struct bench_stats *st);
+
+/**
+ * Compare two programs on one metric
+ *
+ * @param a Baseline
+ * @param b Candidate
+ * @param m Metric
+ * @param cmp Filled in
+ * @return false if either side has nothing to compare
+ */
+bool bench_compare(const struct bench_program *a, const struct bench_program *b,
+                   enum bench_metric m, struct bench_comparison *cmp);
+
+/**
+ * Measured-run entry point
+ *
+ * @param argc Number of arguments
+ * @param argv CPU (-1 for none), result file and the command
+ * @return The command's exit status, 128 + signal if it was killed
+ */
+int bench_run_main(int argc, char **argv);
+
+#endif // BENCH_H
@@ -0,0 +1,663 @@
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "build.h"
+#include "exec.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "mongoose.h"
+#include "objcache.h"
+
+static unsigned long next_id = 1;
+
+static const struct build_profile profiles[] = {
+    {"default", "", "", "", false, false},
+    {"debug", "-O0 -g", "", "-g", false, false},
+    {"release", "-O2", "", "-C opt-level=2", false, false},
+    {"native", "-O3 -march=native", "", "-C opt-level=3 -C target-cpu=native", false, false},
+    {"lto", "-O2 -flto", "-O2 -flto", "-C opt-level=2 -C lto=fat", false, false},
+    {"pgo", "-O2", "", NULL, true, false},
+    {"tcc", "", "", NULL, false, true},
+};
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// a is newer than b
+static bool mtime_after(const struct stat *a, const struct stat *b) {
+    if (a->st_mtim.tv_sec != b->st_mtim.tv_sec) return a->st_mtim.tv_sec > b->st_mtim.tv_sec;
+    return a->st_mtim.tv_nsec > b->st_mtim.tv_nsec;
+}
+
+// Source language by extension: 0 = not a source, 1 = C, 2 = C++
+static int source_kind(const char *name) {
+    const char *dot = strrchr(name, '.');
+    if (dot == NULL) return 0;
+    if (strcmp(dot, ".c") == 0) return 1;
+    if (strcmp(dot, ".cpp") == 0 || strcmp(dot, ".cc") == 0 || strcmp(dot, ".cxx") == 0) return 2;
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Sources
+// ----------------------------------------------------------------------------
+
+// Collect sources under dir/rel; hidden entries (and so BUILD_DIR) are skipped
+static bool discover(struct build *b, const char *rel, int depth, const char **error) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s%s", b->dir, *rel ? "/" : "", rel);
+    DIR *dir = opendir(path);
+    if (dir == NULL) return true;
+
+    struct dirent *entry;
+    bool ok = true;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char sub[PATH_MAX], full[PATH_MAX];
+        if (snprintf(sub, sizeof(sub), "%s%s%s", rel, *rel ? "/" : "", entry->d_name) >=
+                (int) sizeof(sub) ||
+            snprintf(full, sizeof(full), "%s/%s", b->dir, sub) >= (int) sizeof(full)) {
+            *error = "Source path too long";
+            ok = false;
+            break;
+        }
+        struct stat st;
+        if (lstat(full, &st) != 0) continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            if (depth < BUILD_MAX_DEPTH) ok = discover(b, sub, depth + 1, error);
+            continue;
+        }
+        int kind = source_kind(entry->d_name);
+        if (!S_ISREG(st.st_mode) || kind == 0) continue;
+        if (b->nunits == BUILD_MAX_SOURCES) {
+            *error = "Too many source files";
+            ok = false;
+            break;
+        }
+        if (b->nunits % 64 == 0) {
+            struct build_unit *units = realloc(b->units, (b->nunits + 64) * sizeof(*units));
+            if (units == NULL) {
+                *error = "Out of memory";
+                ok = false;
+                break;
+            }
+            b->units = units;
+        }
+        struct build_unit *u = &b->units[b->nunits];
+        memset(u, 0, sizeof(*u));
+        u->src = strdup(sub);
+        if (u->src == NULL) {
+            *error = "Out of memory";
+            ok = false;
+            break;
+        }
+        u->cxx = kind == 2;
+        b->nunits++;
+    }
+    closedir(dir);
+    return ok;
+}
+
+const struct build_profile *build_profile(const char *name) {
+    if (name == NULL || name[0] == '\0') return &profiles[0];
+    for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+        if (strcmp(profiles[i].name, name) == 0) return &profiles[i];
+    }
+    return NULL;
+}
+
+static int unit_cmp(const void *a, const void *b) {
+    return strcmp(((const struct build_unit *) a)->src, ((const struct build_unit *) b)->src);
+}
+
+// <dir>/<objdir>/<src><suffix>
+static void unit_path(const struct build *b, const struct build_unit *u, const char *suffix,
+                      char *buf, size_t size) {
+    snprintf(buf, size, "%s/%s/%s%s", b->dir, b->objdir, u->src, suffix);
+}
+
+// Create the directories above path, below the project directory
+static void make_parents(const struct build *b, const char *path) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + strlen(b->dir) + 1; (p = strchr(p, '/')) != NULL; p++) {
+        *p = '\0';
+        mkdir(tmp, 0755);
+        *p = '/';
+    }
+}
+
+// Whether every prerequisite of the first rule in a -MMD file exists and is
+// no newer than the object
+static bool deps_fresh(const struct build *b, const char *dep_path, const struct stat *obj) {
+    FILE *fp = fopen(dep_path, "r");
+    if (fp == NULL) return false;
+    char *text = NULL;
+    size_t cap = 0, len = 0, n;
+    char chunk[4096];
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        if (len + n + 1 > cap) {
+            cap = (len + n + 1) * 2;
+            char *grown = realloc(text, cap);
+            if (grown == NULL) break;
+            text = grown;
+        }
+        memcpy(text + len, chunk, n);
+        len += n;
+    }
+    fclose(fp);
+    if (text == NULL) return false;
+    text[len] = '\0';
+
+    // "obj: src hdr1 \\\n hdr2" - names escape spaces as "\ "; the rule ends
+    // at an unescaped newline (-MP's phony targets follow)
+    bool fresh = true;
+    char *p = strchr(text, ':');
+    if (p == NULL) fresh = false;
+    else p++;
+    while (fresh) {
+        while (*p == ' ' || *p == '\t' || (p[0] == '\\' && p[1] == '\n')) p += *p == '\\' ? 2 : 1;
+        if (*p == '\0' || *p == '\n') break;
+
+        char name[PATH_MAX];
+        size_t k = 0;
+        while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\n') {
+            if (p[0] == '\\' && (p[1] == ' ' || p[1] == '#')) p++;
+            else if (p[0] == '\\' && p[1] == '\n') break;
+            else if (p[0] == '$' && p[1] == '$') p++;
+            if (k < sizeof(name) - 1) name[k++] = *p;
+            p++;
+        }
+        name[k] = '\0';
+
+        // A dependency whose path does not fit cannot be checked: rebuild
+        char full[PATH_MAX];
+        int n = name[0] == '/' ? snprintf(full, sizeof(full), "%s", name)
+                               : snprintf(full, sizeof(full), "%s/%s", b->dir, name);
+        struct stat st;
+        if (n >= (int) sizeof(full) || stat(full, &st) != 0 || mtime_after(&st, obj)) fresh = false;
+    }
+    free(text);
+    return fresh;
+}
+
+// Whether the unit's object is up to date
+static bool unit_fresh(const struct build *b, const struct build_unit *u) {
+    char obj[PATH_MAX], dep[PATH_MAX], src[PATH_MAX];
+    unit_path(b, u, ".o", obj, sizeof(obj));
+    unit_path(b, u, ".d", dep, sizeof(dep));
+    snprintf(src, sizeof(src), "%s/%s", b->dir, u->src);
+    struct stat os, ss;
+    if (stat(obj, &os) != 0 || stat(src, &ss) != 0 || mtime_after(&ss, &os)) return false;
+    return deps_fresh(b, dep, &os);
+}
+
+// Whether the program must be linked again
+static bool link_needed(const struct build *b) {
+    if (b->compiled > 0) return true;
+    char bin[PATH_MAX];
+    snprintf(bin, sizeof(bin), "%s/%s", b->dir, b->bin);
+    struct stat bs;
+    if (stat(bin, &bs) != 0) return true;
+    for (size_t i = 0; i < b->nunits; i++) {
+        char obj[PATH_MAX];
+        unit_path(b, &b->units[i], ".o", obj, sizeof(obj));
+        struct stat os;
+        if (stat(obj, &os) != 0 || mtime_after(&os, &bs)) return true;
+    }
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+// Steps
+// ----------------------------------------------------------------------------
+
+static void cmd_str(struct mg_iobuf *cmd, const char *s) {
+    iobuf_append(cmd, s, strlen(s));
+}
+
+// Append one single-quoted shell word
+static void cmd_arg(struct mg_iobuf *cmd, const char *s) {
+    cmd_str(cmd, " '");
+    for (const char *q; (q = strchr(s, '\'')) != NULL; s = q + 1) {
+        iobuf_append(cmd, s, (size_t) (q - s));
+        cmd_str(cmd, "'\\''");
+    }
+    cmd_str(cmd, s);
+    cmd_str(cmd, "'");
+}
+
+// Append a step's output to a capped buffer
+static void output_append(char **buf, size_t *len, const struct output *o) {
+    if (*buf == NULL) *buf = calloc(1, BUILD_LOG_MAX);
+    if (*buf != NULL) {
+        *len += output_read(o, 0, *buf + *len, BUILD_LOG_MAX - 1 - *len);
+        (*buf)[*len] = '\0';
+    }
+}
+
+// Bookkeeping shared by every step
+static void step_ended(struct build *b, struct exec_job *job, const char *what) {
+    const struct exec_stats *st = &job->stats;
+    b->pending--;
+    b->cpu_ms += st->user_ms + st->sys_ms;
+    metrics_exec_queued(job->priority, (uint64_t) (st->queue_ms * 1000));
+    if (job->end == EXEC_CANCELLED) {
+        b->cancelled = true;
+    } else if ((job->end != EXEC_EXITED || st->exit_code != 0) && b->failed_step == NULL) {
+        b->failed_step = what;
+        b->exit_code = st->exit_code;
+    }
+}
+
+static void build_next(struct build *b);
+
+static void unit_done(struct exec_job *job) {
+    struct build_unit *u = job->data;
+    struct build *b = u->build;
+    step_ended(b, job, u->src);
+    output_append(&b->log, &b->log_len, job->output);
+    if (job->end == EXEC_EXITED && job->stats.exit_code == 0) {
+        u->state = UNIT_COMPILED;
+        u->ms = job->stats.wall_ms;
+        b->compiled++;
+    } else if (job->end != EXEC_CANCELLED) {
+        u->state = UNIT_FAILED;
+        b->failed++;
+    }
+    build_next(b);
+}
+
+static void link_done(struct exec_job *job) {
+    struct build *b = job->data;
+    step_ended(b, job, "link");
+    output_append(&b->log, &b->log_len, job->output);
+    b->linked = true;
+    build_next(b);
+}
+
+static void run_done(struct exec_job *job) {
+    struct build *b = job->data;
+    step_ended(b, job, "run");
+    output_append(&b->output, &b->output_len, job->output);
+    b->ran = true;
+    b->exit_code = job->stats.exit_code;
+    build_next(b);
+}
+
+// Queue one step as an execution job the waiting connection is subscribed to
+static bool step_start(struct build *b, struct mg_iobuf *cmd, const char *name,
+                       enum exec_priority priority, exec_done_fn done, void *data) {
+    cmd_str(cmd, " 2>&1");
+    iobuf_append(cmd, "", 1);
+    struct exec_request req = {
+        .command = (const char *) cmd->buf,
+        .name = name,
+        .client = b->client,
+        .priority = priority,
+        .done = done,
+        .data = data,
+    };
+    struct exec_job *job = cmd->buf != NULL ? exec_start(&req) : NULL;
+    mg_iobuf_free(cmd);
+    if (job == NULL) return false;
+    exec_subscribe(job, b->conn_id);
+    b->pending++;
+    return true;
+}
+
+// Could not start a step: fail the build with a message in the log
+static void step_failed(struct build *b, const char *what, const char *message) {
+    if (b->failed_step == NULL) {
+        b->failed_step = what;
+        b->exit_code = -1;
+    }
+    size_t len = strlen(message);
+    if (b->log == NULL) b->log = calloc(1, BUILD_LOG_MAX);
+    if (b->log != NULL && b->log_len + len < BUILD_LOG_MAX) {
+        memcpy(b->log + b->log_len, message, len + 1);
+        b->log_len += len;
+    }
+}
+
+static void step_refused(struct build *b, const char *what) {
+    step_failed(b, what, "Execution queue is full, try again later\n");
+}
+
+static void compile(struct build *b, struct build_unit *u) {
+    char obj[PATH_MAX], dep[PATH_MAX], full[PATH_MAX];
+    if (snprintf(obj, sizeof(obj), "%s/%s.o", b->objdir, u->src) >= (int) sizeof(obj) ||
+        snprintf(dep, sizeof(dep), "%s/%s.d", b->objdir, u->src) >= (int) sizeof(dep) ||
+        snprintf(full, sizeof(full), "%s/%s", b->dir, obj) >= (int) sizeof(full)) {
+        u->state = UNIT_FAILED;
+        b->failed++;
+        step_failed(b, u->src, "Object file path too long\n");
+        return;
+    }
+    make_parents(b, full);
+
+    // Relative names keep diagnostics and the .d file short
+    struct mg_iobuf cmd = {0};
+    cmd_str(&cmd, "cd");
+    cmd_arg(&cmd, b->dir);
+    cmd_str(&cmd, " && ");
+    cmd_str(&cmd, objcache_wrapper());
+    cmd_str(&cmd, u->cxx ? "g++ -std=c++17 " : "gcc ");
+    // Projects have always been built with -O2
+    cmd_str(&cmd, b->profile->cflags[0] != '\0' ? b->profile->cflags : "-O2");
+    cmd_str(&cmd, " -c -MMD -MP -I. -Iinclude -MF");
+    cmd_arg(&cmd, dep);
+    cmd_str(&cmd, " -o");
+    cmd_arg(&cmd, obj);
+    cmd_arg(&cmd, u->src);
+    u->state = UNIT_STALE;
+    if (!step_start(b, &cmd, u->src, EXEC_PRIO_BUILD, unit_done, u)) {
+        u->state = UNIT_FAILED;
+        b->failed++;
+        step_refused(b, u->src);
+    }
+}
+
+static bool link_program(struct build *b) {
+    struct mg_iobuf cmd = {0};
+    cmd_str(&cmd, "cd");
+    cmd_arg(&cmd, b->dir);
+    cmd_str(&cmd, b->cxx ? " && g++ " : " && gcc ");
+    cmd_str(&cmd, b->profile->ldflags);
+    cmd_str(&cmd, " -o");
+    cmd_arg(&cmd, b->bin);
+    for (size_t i = 0; i < b->nunits; i++) {
+        char obj[PATH_MAX];
+        snprintf(obj, sizeof(obj), "%s/%s.o", b->objdir, b->units[i].src);
+        cmd_arg(&cmd, obj);
+    }
+    cmd_str(&cmd, " -lm");
+    if (step_start(b, &cmd, b->bin, EXEC_PRIO_BUILD, link_done, b)) return true;
+    step_refused(b, "link");
+    return false;
+}
+
+static bool run_program(struct build *b) {
+    struct mg_iobuf cmd = {0};
+    cmd_str(&cmd, "cd");
+    cmd_arg(&cmd, b->dir);
+    cmd_str(&cmd, " &&");
+    char bin[310];
+    snprintf(bin, sizeof(bin), "./%s", b->bin);
+    cmd_arg(&cmd, bin);
+    if (step_start(b, &cmd, bin + 2, EXEC_PRIO_RUN, run_done, b)) return true;
+    step_refused(b, "run");
+    return false;
+}
+
+static void build_free(struct build *b) {
+    for (size_t i = 0; i < b->nunits; i++) free(b->units[i].src);
+    free(b->units);
+    free(b->log);
+    free(b->output);
+    free(b);
+}
+
+// All queued steps are over: start the next one, or report
+static void build_next(struct build *b) {
+    if (b->pending > 0) return;
+    if (b->failed_step == NULL && !b->cancelled) {
+        if (!b->linked && link_needed(b) && link_program(b)) return;
+        if (b->failed_step == NULL && b->run && !b->ran && run_program(b)) return;
+    }
+    b->wall_ms = now_ms() - b->start_ms;
+    MG_INFO(("build %lu %s: %lu units, %lu compiled, %lu failed, %.0f ms", b->id, b->dir,
+             (unsigned long) b->nunits, (unsigned long) b->compiled, (unsigned long) b->failed,
+             b->wall_ms));
+    b->done(b);
+    build_free(b);
+}
+
+bool build_start(const char *dir, const struct build_profile *profile, bool run,
+                 const char *client, unsigned long conn_id, build_done_fn done, void *data,
+                 const char **error) {
+    if (profile->pgo) {
+        *error = "PGO builds take a single source file";
+        return false;
+    }
+    if (profile->tcc) {
+        *error = "The tcc profile runs single C files";
+        return false;
+    }
+    char real[PATH_MAX];
+    struct stat st;
+    if (realpath(dir, real) == NULL || stat(real, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        *error = "Project directory not found";
+        return false;
+    }
+
+    struct build *b = calloc(1, sizeof(*b));
+    if (b == NULL) {
+        *error = "Out of memory";
+        return false;
+    }
+    if (snprintf(b->dir, sizeof(b->dir), "%s", real) >= (int) sizeof(b->dir)) {
+        free(b);
+        *error = "Project path too long";
+        return false;
+    }
+    b->id = next_id++;
+    const char *slash = strrchr(b->dir, '/');
+    snprintf(b->name, sizeof(b->name), "%s", slash != NULL && slash[1] ? slash + 1 : "main");
+    b->profile = profile;
+    if (profile == &profiles[0]) {
+        snprintf(b->objdir, sizeof(b->objdir), BUILD_DIR);
+        snprintf(b->bin, sizeof(b->bin), "%s.out", b->name);
+    } else {
+        snprintf(b->objdir, sizeof(b->objdir), BUILD_DIR "/.%s", profile->name);
+        snprintf(b->bin, sizeof(b->bin), "%s.%s.out", b->name, profile->name);
+    }
+    b->run = run;
+    b->start_ms = now_ms();
+    snprintf(b->client, sizeof(b->client), "%s", client != NULL ? client : "");
+    b->conn_id = conn_id;
+    b->done = done;
+    b->data = data;
+
+    if (!discover(b, "", 0, error)) {
+        build_free(b);
+        return false;
+    }
+    if (b->nunits == 0) {
+        *error = "No C or C++ sources in the directory";
+        build_free(b);
+        return false;
+    }
+    qsort(b->units, b->nunits, sizeof(*b->units), unit_cmp);
+
+    char top[PATH_MAX];
+    snprintf(top, sizeof(top), "%s/" BUILD_DIR, b->dir);
+    if (mkdir(top, 0755) != 0 && errno != EEXIST) {
+        *error = "Cannot create the build directory";
+        build_free(b);
+        return false;
+    }
+
+    // Queue every stale unit at once; the execution queue runs as many in
+    // parallel as it has slots
+    for (size_t i = 0; i < b->nunits; i++) {
+        struct build_unit *u = &b->units[i];
+        u->build = b;
+        if (u->cxx) b->cxx = true;
+    }
+    for (size_t i = 0; i < b->nunits; i++) {
+        struct build_unit *u = &b->units[i];
+        if (unit_fresh(b, u)) {
+            u->state = UNIT_FRESH;
+            b->fresh++;
+        } else {
+            compile(b, u);
+        }
+    }
+    build_next(b);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Batch builds
+// ----------------------------------------------------------------------------
+
+struct build_batch *build_batch_new(const char *dir, const char *client, unsigned long conn_id,
+                                    build_file_fn file_done, build_batch_fn done, void *data) {
+    struct build_batch *b = calloc(1, sizeof(*b));
+    if (b == NULL) return NULL;
+    b->id = next_id++;
+    snprintf(b->dir, sizeof(b->dir), "%s", dir);
+    snprintf(b->client, sizeof(b->client), "%s", client != NULL ? client : "");
+    b->conn_id = conn_id;
+    b->file_done = file_done;
+    b->done = done;
+    b->data = data;
+    // Enough queued to keep every slot busy as jobs end, and no more
+    b->window = 2 * (size_t) exec_slots();
+    return b;
+}
+
+bool build_batch_add(struct build_batch *b, const char *name, const char *command,
+                     const char *artifact, const char *error) {
+    if (b->nfiles == BUILD_MAX_SOURCES) return false;
+    if (b->nfiles % 64 == 0) {
+        struct build_file *files = realloc(b->files, (b->nfiles + 64) * sizeof(*files));
+        if (files == NULL) return false;
+        b->files = files;
+    }
+    struct build_file *f = &b->files[b->nfiles];
+    memset(f, 0, sizeof(*f));
+    f->name = strdup(name);
+    f->command = command != NULL ? strdup(command) : NULL;
+    f->artifact = artifact != NULL ? strdup(artifact) : NULL;
+    if (f->name == NULL || (command != NULL && f->command == NULL) ||
+        (artifact != NULL && f->artifact == NULL)) {
+        free(f->name);
+        free(f->command);
+        free(f->artifact);
+        return false;
+    }
+    snprintf(f->error, sizeof(f->error), "%s", error != NULL ? error : "");
+    f->batch = b;
+    b->nfiles++;
+    return true;
+}
+
+void build_batch_free(struct build_batch *b) {
+    for (size_t i = 0; i < b->nfiles; i++) {
+        free(b->files[i].name);
+        free(b->files[i].command);
+        free(b->files[i].artifact);
+        free(b->files[i].log);
+    }
+    free(b->files);
+    free(b);
+}
+
+// Whether the file's artifact is newer than the file
+static bool file_fresh(const struct build_batch *b, const struct build_file *f) {
+    char src[PATH_MAX];
+    snprintf(src, sizeof(src), "%s/%s", b->dir, f->name);
+    struct stat as, ss;
+    return f->artifact != NULL && stat(f->artifact, &as) == 0 && stat(src, &ss) == 0 &&
+           !mtime_after(&ss, &as);
+}
+
+// Hand a settled file to the caller; its log goes with it
+static void file_settled(struct build_file *f) {
+    f->batch->file_done(f);
+    free(f->log);
+    f->log = NULL;
+}
+
+static void batch_next(struct build_batch *b);
+
+static void batch_file_done(struct exec_job *job) {
+    struct build_file *f = job->data;
+    struct build_batch *b = f->batch;
+    const struct exec_stats *st = &job->stats;
+    b->pending--;
+    b->cpu_ms += st->user_ms + st->sys_ms;
+    metrics_exec_queued(job->priority, (uint64_t) (st->queue_ms * 1000));
+    if (job->end == EXEC_CANCELLED) {
+        b->cancelled = true;
+    } else {
+        output_append(&f->log, &f->log_len, job->output);
+        f->exit_code = st->exit_code;
+        f->ms = st->wall_ms;
+        if (job->end == EXEC_EXITED && st->exit_code == 0) {
+            f->state = UNIT_COMPILED;
+            b->compiled++;
+        } else {
+            f->state = UNIT_FAILED;
+            b->failed++;
+        }
+        file_settled(f);
+    }
+    batch_next(b);
+}
+
+// Keep the window full; report once the last job is over
+static void batch_next(struct build_batch *b) {
+    while (!b->cancelled && b->pending < b->window && b->next < b->nfiles) {
+        struct build_file *f = &b->files[b->next++];
+        if (f->state != UNIT_STALE) continue;
+        struct exec_request req = {
+            .command = f->command,
+            .name = f->name,
+            .client = b->client,
+            .priority = EXEC_PRIO_BUILD,
+            .done = batch_file_done,
+            .data = f,
+        };
+        struct exec_job *job = exec_start(&req);
+        if (job == NULL) {
+            snprintf(f->error, sizeof(f->error), "Execution queue is full, try again later");
+            f->state = UNIT_FAILED;
+            f->exit_code = -1;
+            b->failed++;
+            file_settled(f);
+            continue;
+        }
+        exec_subscribe(job, b->conn_id);
+        b->pending++;
+    }
+    if (b->pending > 0 || (b->next < b->nfiles && !b->cancelled)) return;
+    b->wall_ms = now_ms() - b->start_ms;
+    MG_INFO(("build %lu %s: %lu files, %lu compiled, %lu up to date, %lu failed, %d ms",
+             b->id, b->dir, (unsigned long) b->nfiles, (unsigned long) b->compiled,
+             (unsigned long) b->fresh, (unsigned long) b->failed, (int) b->wall_ms));
+    b->done(b);
+    build_batch_free(b);
+}
+
+void build_batch_start(struct build_batch *b) {
+    b->start_ms = now_ms();
+    // Whatever needs no job is reported first
+    for (size_t i = 0; i < b->nfiles; i++) {
+        struct build_file *f = &b->files[i];
+        if (f->command == NULL) {
+            f->state = UNIT_FAILED;
+            f->exit_code = -1;
+            b->failed++;
+            file_settled(f);
+        } else if (file_fresh(b, f)) {
+            f->state = UNIT_FRESH;
+            b->fresh++;
+            file_settled(f);
+        } else {
+            f->state = UNIT_STALE;
+        }
+    }
+    batch_next(b);
+}
@@ -0,0 +1,213 @@
+#ifndef BUILD_H
+#define BUILD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// ============================================================================
+// NEXUS File Manager - Project Builds
+// ============================================================================
+
+#define BUILD_DIR ".nexus-build"        // Objects and dependency files, per project
+#define BUILD_MAX_SOURCES 4096
+#define BUILD_MAX_DEPTH 16
+#define BUILD_LOG_MAX (64 * 1024)       // Compiler / program output kept, each
+
+struct build;
+typedef void (*build_done_fn)(struct build *b);
+
+/**
+ * Optimisation profile. Artifacts are kept per profile (objects under
+ * BUILD_DIR/.<profile>, programs named <name>.<profile>.out), so switching
+ * back and forth does not rebuild anything.
+ */
+struct build_profile {
+    const char *name;
+    const char *cflags;         // C / C++ compile flags
+    const char *ldflags;        // Extra link flags
+    const char *rustflags;      // rustc flags, NULL if the profile has no Rust form
+    bool pgo;                   // Instrumented build, training runs, optimised rebuild
+    bool tcc;                   // Single C files compiled in memory and run (tcc.h)
+};
+
+enum build_unit_state {
+    UNIT_FRESH,             // Object newer than the source and every header it uses
+    UNIT_STALE,             // Queued for compilation
+    UNIT_COMPILED,
+    UNIT_FAILED,
+};
+
+/**
+ * One translation unit
+ */
+struct build_unit {
+    char *src;              // Relative to the project directory
+    bool cxx;
+    enum build_unit_state state;
+    double ms;              // Compile time (queue wait excluded)
+    struct build *build;
+};
+
+/**
+ * A project build: compile stale units in parallel as execution jobs
+ * (exec.h), link, and optionally run the result
+ */
+struct build {
+    unsigned long id;
+    char dir[1024];
+    char name[256];             // Project name: last component of dir
+    const struct build_profile *profile;
+    char objdir[64];            // BUILD_DIR, or BUILD_DIR/.<profile> (no source dir is hidden)
+    char bin[300];              // <name>.out, or <name>.<profile>.out
+    bool run;                   // Run the program after a successful link
+    struct build_unit *units;
+    size_t nunits;
+    size_t pending;             // Jobs not finished yet
+    size_t compiled, fresh, failed;     // Units
+    bool cxx;                   // Any C++ unit: link with g++
+    bool linked;                // A link step ran
+    bool ran;                   // The program ran
+    bool cancelled;
+    const char *failed_step;    // First source that failed, "link" or "run"
+    int exit_code;              // Of the program when run, else of the failing step
+    double cpu_ms;              // User + system time of every step
+    char *log;                  // Compiler and linker output
+    size_t log_len;
+    char *output;               // Program output
+    size_t output_len;
+    double start_ms;
+    double wall_ms;
+    char client[64];            // Fair-share key for the execution queue
+    unsigned long conn_id;      // Connection waiting for the result
+    build_done_fn done;
+    void *data;                 // Caller's
+};
+
+/**
+ * Look up a profile: "default" (the compiler's own defaults; -O2 for
+ * projects), "debug", "release", "native", "lto", "pgo" or "tcc"
+ *
+ * @param name Profile name; NULL or "" for "default"
+ * @return The profile, or NULL if there is none by that name
+ */
+const struct build_profile *build_profile(const char *name);
+
+/**
+ * Start building the C/C++ sources found under a directory. Objects go to
+ * <dir>/.nexus-build with their -MMD dependency files; a unit is recompiled
+ * only when its object is missing or older than the source or one of the
+ * headers listed there. Stale units compile in parallel, as many at once as
+ * the execution queue has slots. The link runs when an object changed or
+ * the program (<dir>/<name>.out) is missing.
+ *
+ * `done` may be called before build_start() returns, when there is nothing
+ * to do.
+ *
+ * @param dir Project directory
+ * @param profile Optimisation profile, not "pgo" or "tcc"
+ * @param run Run the program once linked
+ * @param client Fair-share key for the execution queue
+ * @param conn_id Connection waiting for the result; closing it cancels
+ * @param done Called once, when the build is over; `b` is freed after it
+ * @param data Stored in b->data
+ * @param error Set to a message when false is returned
+ * @return false if the build could not be started
+ */
+bool build_start(const char *dir, const struct build_profile *profile, bool run,
+                 const char *client, unsigned long conn_id, build_done_fn done, void *data,
+                 const char **error);
+
+// ----------------------------------------------------------------------------
+// Batch builds: every file in a directory compiled on its own
+// ----------------------------------------------------------------------------
+
+struct build_batch;
+
+/**
+ * One file of a batch: a single compile job producing one artifact
+ */
+struct build_file {
+    char *name;                 // File name in the batch directory
+    char *command;              // Compile command, NULL when it cannot be built
+    char *artifact;             // What the command writes; up to date when newer
+                                // than the source
+    char error[160];            // Why there is no command
+    enum build_unit_state state;
+    int exit_code;
+    double ms;                  // Compile time (queue wait excluded)
+    char *log;                  // Compiler output while file_done runs, else NULL
+    size_t log_len;
+    struct build_batch *batch;
+};
+
+typedef void (*build_file_fn)(struct build_file *f);
+typedef void (*build_batch_fn)(struct build_batch *b);
+
+/**
+ * Files compiled independently, a window of them queued at a time so a
+ * large directory neither overflows the execution queue nor starves it
+ */
+struct build_batch {
+    unsigned long id;
+    char dir[1024];
+    struct build_file *files;
+    size_t nfiles;
+    size_t next;                // First file not queued yet
+    size_t pending;             // Jobs not finished yet
+    size_t window;              // Jobs queued at once
+    size_t compiled, fresh, failed;
+    bool cancelled;
+    double cpu_ms;
+    double start_ms;
+    double wall_ms;
+    char client[64];
+    unsigned long conn_id;      // Connection waiting for the results; closing it cancels
+    build_file_fn file_done;
+    build_batch_fn done;
+    void *data;                 // Caller's
+};
+
+/**
+ * Create an empty batch for a directory
+ *
+ * @param dir Directory the file names are relative to
+ * @param client Fair-share key for the execution queue
+ * @param conn_id Connection waiting for the results
+ * @param file_done Called as each file is settled: up to date, compiled or
+ *                  failed
+ * @param done Called once, after the last file; `b` is freed after it
+ * @param data Stored in b->data
+ * @return The batch, or NULL when out of memory
+ */
+struct build_batch *build_batch_new(const char *dir, const char *client, unsigned long conn_id,
+                                    build_file_fn file_done, build_batch_fn done, void *data);
+
+/**
+ * Add a file to a batch not started yet
+ *
+ * @param b Batch
+ * @param name File name in the batch directory
+ * @param command Compile command, NULL if the file cannot be built
+ * @param artifact Path of what the command writes, NULL if unknown (always
+ *                 compiled)
+ * @param error Why the file cannot be built, when command is NULL
+ * @return false when out of memory or past BUILD_MAX_SOURCES
+ */
+bool build_batch_add(struct build_batch *b, const char *name, const char *command,
+                     const char *artifact, const char *error);
+
+/**
+ * Report the files that are up to date or cannot be built, then compile
+ * the rest, as many at once as the execution queue has slots. `file_done`
+ * and `done` may be called before this returns.
+ *
+ * @param b Batch; owned by the build from here on
+ */
+void build_batch_start(struct build_batch *b);
+
+/**
+ * Free a batch that was never started
+ */
+void build_batch_free(struct build_batch *b);
+
+#endif // BUILD_H
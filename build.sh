@@ -16,9 +16,14 @@ echo -e "${CYAN}║                                                        ║${
 echo -e "${CYAN}╚════════════════════════════════════════════════════════╝${NC}"
 echo ""
 
+# Usage: ./build.sh                 build the file manager
+#        ./build.sh bench ...       build it, then load test it (extra args go to loadgen)
+#        ./build.sh microbench ...  build and run the microbenchmarks (args go to microbench)
+TARGET="${1:-app}"
+
 # Check for required files
-echo -e "${YELLOW}[1/5]${NC} Checking required files..."
-REQUIRED_FILES=("main.c" "api_handler.c" "api_handler.h" "mongoose.c" "mongoose.h")
+echo -e "${YELLOW}[1/6]${NC} Checking required files..."
+REQUIRED_FILES=("main.c" "api_handler.c" "api_handler.h" "arena.c" "arena.h" "json_writer.c" "json_writer.h" "json_body.c" "json_body.h" "router.c" "router.h" "assets.c" "assets.h" "compress.c" "compress.h" "metrics.c" "metrics.h" "trace.c" "trace.h" "exec.c" "exec.h" "build.c" "build.h" "objcache.c" "objcache.h" "tests.c" "tests.h" "pty.c" "pty.h" "bench.c" "bench.h" "jvm.c" "jvm.h" "tcc.c" "tcc.h" "output.c" "output.h" "toolchain.c" "toolchain.h" "watch.c" "watch.h" "NexusJvm.java" "pack.c" "loadgen.c" "microbench.c" "mongoose.c" "mongoose.h")
 MISSING_FILES=0
 
 for file in "${REQUIRED_FILES[@]}"; do
@@ -37,25 +42,51 @@ fi
 
 # Check for web interface files (optional)
 echo ""
-echo -e "${YELLOW}[2/5]${NC} Checking web interface files..."
-WEB_FILES=("index.html" "styles.css" "app.js")
+echo -e "${YELLOW}[2/6]${NC} Checking web interface files..."
+WEB_FILES=("index.html" "style.css" "app.js")
 WEB_COMPLETE=1
 
 for file in "${WEB_FILES[@]}"; do
     if [ ! -f "$file" ]; then
-        echo -e "${YELLOW}  ⚠ Missing: $file (web interface will be limited)${NC}"
+        echo -e "${RED}  ✗ Missing: $file (it is packed into the binary)${NC}"
         WEB_COMPLETE=0
     else
         echo -e "${GREEN}  ✓ Found: $file${NC}"
     fi
 done
 
+if [ $WEB_COMPLETE -eq 0 ]; then
+    echo -e "${RED}Error: Missing web interface files.${NC}"
+    exit 1
+fi
+
+# Pack the web interface (plus gzip/brotli variants and ETags) into the binary
+echo ""
+echo -e "${YELLOW}[3/6]${NC} Packing web assets..."
+echo -e "${BLUE}  Command: gcc -o pack pack.c mongoose.c -lz -lbrotlienc && ./pack index.html style.css app.js > packed_fs.c${NC}"
+
+if ! (gcc -o pack pack.c mongoose.c -lz -lbrotlienc && ./pack "${WEB_FILES[@]}" > packed_fs.c); then
+    echo -e "${RED}  ✗ Packing failed! (needs zlib and brotli development headers)${NC}"
+    exit 1
+fi
+echo -e "${GREEN}  ✓ Web assets packed${NC}"
+
 # Compile the project
 echo ""
-echo -e "${YELLOW}[3/5]${NC} Compiling project..."
-echo -e "${BLUE}  Command: gcc -o file_manager main.c api_handler.c mongoose.c -lpthread -DENABLE_WEB_SERVER${NC}"
+echo -e "${YELLOW}[4/6]${NC} Compiling project..."
+# In-memory C runs for the tcc profile when libtcc is installed
+TCC_FLAGS=""
+if echo '#include <libtcc.h>' | gcc -E - > /dev/null 2>&1; then
+    TCC_FLAGS=" -DNEXUS_TCC -ltcc -ldl"
+fi
+# zstd response coding when libzstd is installed
+ZSTD_FLAGS=""
+if echo '#include <zstd.h>' | gcc -E - > /dev/null 2>&1; then
+    ZSTD_FLAGS=" -DNEXUS_ENABLE_ZSTD -lzstd"
+fi
+echo -e "${BLUE}  Command: gcc -o file_manager main.c api_handler.c arena.c json_writer.c json_body.c router.c assets.c compress.c metrics.c trace.c exec.c build.c objcache.c tests.c pty.c bench.c jvm.c tcc.c output.c toolchain.c watch.c mongoose.c packed_fs.c -lpthread -lz -lm -DENABLE_WEB_SERVER -DMG_ENABLE_PACKED_FS=1${TCC_FLAGS}${ZSTD_FLAGS}${NC}"
 
-if gcc -o file_manager main.c api_handler.c mongoose.c -lpthread -DENABLE_WEB_SERVER 2>&1 | tee /tmp/compile_output.txt; then
+if gcc -o file_manager main.c api_handler.c arena.c json_writer.c json_body.c router.c assets.c compress.c metrics.c trace.c exec.c build.c objcache.c tests.c pty.c bench.c jvm.c tcc.c output.c toolchain.c watch.c mongoose.c packed_fs.c -lpthread -lz -lm -DENABLE_WEB_SERVER -DMG_ENABLE_PACKED_FS=1${TCC_FLAGS}${ZSTD_FLAGS} 2>&1 | tee /tmp/compile_output.txt; then
     echo -e "${GREEN}  ✓ Compilation successful!${NC}"
 else
     echo -e "${RED}  ✗ Compilation failed!${NC}"
@@ -66,13 +97,45 @@ fi
 
 # Set executable permissions
 echo ""
-echo -e "${YELLOW}[4/5]${NC} Setting permissions..."
+echo -e "${YELLOW}[5/6]${NC} Setting permissions..."
 chmod +x file_manager
 echo -e "${GREEN}  ✓ Executable permissions set${NC}"
 
+# Microbenchmark target: handler internals, no server needed
+if [ "$TARGET" == "microbench" ]; then
+    echo ""
+    echo -e "${YELLOW}[6/6]${NC} Running microbenchmarks..."
+    echo -e "${BLUE}  Command: gcc -O2 -o microbench microbench.c api_handler.c arena.c json_writer.c json_body.c router.c assets.c compress.c metrics.c trace.c exec.c build.c objcache.c tests.c pty.c bench.c jvm.c tcc.c output.c toolchain.c watch.c mongoose.c packed_fs.c -lpthread -lz -lm -DENABLE_WEB_SERVER -DMG_ENABLE_PACKED_FS=1${NC}"
+    if ! gcc -O2 -o microbench microbench.c api_handler.c arena.c json_writer.c json_body.c router.c assets.c compress.c metrics.c trace.c exec.c build.c objcache.c tests.c pty.c bench.c jvm.c tcc.c output.c toolchain.c watch.c mongoose.c packed_fs.c -lpthread -lz -lm -DENABLE_WEB_SERVER -DMG_ENABLE_PACKED_FS=1; then
+        echo -e "${RED}  ✗ Microbenchmarks failed to compile!${NC}"
+        exit 1
+    fi
+    ./microbench "${@:2}"
+    exit $?
+fi
+
+# Benchmark target: load test a fresh local server and keep the JSON report
+if [ "$TARGET" == "bench" ]; then
+    echo ""
+    echo -e "${YELLOW}[6/6]${NC} Running load benchmark..."
+    echo -e "${BLUE}  Command: gcc -O2 -o loadgen loadgen.c -lpthread${NC}"
+    if ! gcc -O2 -o loadgen loadgen.c -lpthread; then
+        echo -e "${RED}  ✗ Load generator failed to compile!${NC}"
+        exit 1
+    fi
+    mkdir -p bench-results
+    REPORT="bench-results/$(date +%Y%m%d-%H%M%S).json"
+    if ./loadgen --spawn ./file_manager --out "$REPORT" "${@:2}"; then
+        echo -e "${GREEN}  ✓ Report written to $REPORT${NC}"
+        exit 0
+    fi
+    echo -e "${RED}  ✗ Benchmark failed!${NC}"
+    exit 1
+fi
+
 # Check if we should run the application
 echo ""
-echo -e "${YELLOW}[5/5]${NC} Build complete!"
+echo -e "${YELLOW}[6/6]${NC} Build complete!"
 echo ""
 echo -e "${GREEN}╔════════════════════════════════════════════════════════╗${NC}"
 echo -e "${GREEN}║                                                        ║${NC}"
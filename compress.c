@@ -0,0 +1,260 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef NEXUS_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+#include "compress.h"
+#include "assets.h"
+#include "api_handler.h"
+#include "json_writer.h"
+#include "trace.h"
+
+#define PRESSURE_WINDOW_MS 1000
+
+// Levels per pressure tier: normal, busy, overloaded
+static const int gzip_levels[] = {6, 4, 1};
+#ifdef NEXUS_ENABLE_ZSTD
+static const int zstd_levels[] = {3, 1, -1};
+#endif
+
+struct compress_stream {
+    uint8_t encoding;
+    z_stream zs;
+#ifdef NEXUS_ENABLE_ZSTD
+    ZSTD_CCtx *zc;
+#endif
+};
+
+// Pressure bookkeeping is per thread, like the event loop that uses it
+static __thread uint64_t window_start_ms;
+static __thread uint64_t window_busy_ns;
+static __thread int tier;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// Re-evaluate at most once per window: load average per core, and the share
+// of wall time this thread spent compressing during the last window
+static int pressure_tier(void) {
+    uint64_t now = mg_millis();
+    if (now - window_start_ms < PRESSURE_WINDOW_MS) return tier;
+
+    double busy = window_start_ms == 0 ? 0 :
+                  (double) window_busy_ns / ((double) (now - window_start_ms) * 1e6);
+    double load = 0;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (getloadavg(&load, 1) == 1 && cores > 0) load /= (double) cores;
+
+    int next = 0;
+    if (load > 1.0 || busy > 0.25) {
+        next = 2;
+    } else if (load > 0.7 || busy > 0.10) {
+        next = 1;
+    }
+    if (next != tier) MG_INFO(("compression tier %d (load/core %.2f, busy %.2f)", next, load, busy));
+
+    tier = next;
+    window_start_ms = now;
+    window_busy_ns = 0;
+    return tier;
+}
+
+int compress_level(uint8_t encoding) {
+    int t = pressure_tier();
+#ifdef NEXUS_ENABLE_ZSTD
+    if (encoding == COMPRESS_ZSTD) return zstd_levels[t];
+#endif
+    (void) encoding;
+    return gzip_levels[t];
+}
+
+static const char *encoding_name(uint8_t encoding) {
+    return encoding == COMPRESS_ZSTD ? "zstd" : "gzip";
+}
+
+uint8_t compress_negotiate(struct mg_http_message *hm) {
+#ifdef NEXUS_ENABLE_ZSTD
+    if (http_accepts_encoding(hm, "zstd")) return COMPRESS_ZSTD;
+#endif
+    if (http_accepts_encoding(hm, "gzip")) return COMPRESS_GZIP;
+    return COMPRESS_NONE;
+}
+
+// One-shot compression into a malloc'ed buffer. Returns its size, 0 on failure.
+static size_t compress_buffer(uint8_t encoding, const unsigned char *in, size_t len,
+                              unsigned char **out) {
+    int level = compress_level(encoding);
+    size_t n = 0;
+    *out = NULL;
+
+#ifdef NEXUS_ENABLE_ZSTD
+    if (encoding == COMPRESS_ZSTD) {
+        size_t cap = ZSTD_compressBound(len);
+        if ((*out = malloc(cap)) == NULL) return 0;
+        n = ZSTD_compress(*out, cap, in, len, level);
+        if (ZSTD_isError(n)) n = 0;
+        return n;
+    }
+#endif
+
+    // zlib counts in uInt: larger bodies go out as they are
+    if (len > UINT_MAX) return 0;
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits 15 + 16 selects the gzip wrapper
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return 0;
+    size_t cap = deflateBound(&zs, len);
+    if (cap <= UINT_MAX && (*out = malloc(cap)) != NULL) {
+        zs.next_in = (unsigned char *) in;
+        zs.avail_in = (uInt) len;
+        zs.next_out = *out;
+        zs.avail_out = (uInt) cap;
+        if (deflate(&zs, Z_FINISH) == Z_STREAM_END) n = zs.total_out;
+    }
+    deflateEnd(&zs);
+    return n;
+}
+
+bool compress_response(struct mg_connection *c, size_t hdr_ofs, size_t body_ofs) {
+    uint8_t encoding = request_state(c)->encoding;
+    size_t len = c->send.len - body_ofs;
+    if (encoding == COMPRESS_NONE || len < COMPRESS_MIN_SIZE || len > COMPRESS_MAX_SIZE) {
+        return false;
+    }
+
+    uint64_t start = now_ns(), span = trace_begin();
+    unsigned char *out;
+    size_t n = compress_buffer(encoding, c->send.buf + body_ofs, len, &out);
+    window_busy_ns += now_ns() - start;
+    trace_end("compress", span);
+
+    if (n == 0 || n >= len) {
+        free(out);
+        return false;
+    }
+
+    char hdr[160];
+    int hlen = snprintf(hdr, sizeof(hdr),
+                        "Content-Encoding: %s\r\nVary: Accept-Encoding\r\n"
+                        "Content-Length: %lu\r\n\r\n", encoding_name(encoding), (unsigned long) n);
+    c->send.len = hdr_ofs;
+    iobuf_append(&c->send, hdr, (size_t) hlen);
+    iobuf_append(&c->send, out, n);
+    free(out);
+    return true;
+}
+
+void compress_stream_free(struct compress_stream *s) {
+    if (s == NULL) return;
+#ifdef NEXUS_ENABLE_ZSTD
+    if (s->encoding == COMPRESS_ZSTD) ZSTD_freeCCtx(s->zc);
+#endif
+    if (s->encoding == COMPRESS_GZIP) deflateEnd(&s->zs);
+    free(s);
+}
+
+void chunked_begin(struct mg_connection *c, int status, const char *content_type) {
+    struct request_state *rs = request_state(c);
+    struct compress_stream *s = NULL;
+
+    if (rs->encoding != COMPRESS_NONE && (s = calloc(1, sizeof(*s))) != NULL) {
+        s->encoding = rs->encoding;
+        bool ok;
+#ifdef NEXUS_ENABLE_ZSTD
+        if (s->encoding == COMPRESS_ZSTD) {
+            s->zc = ZSTD_createCCtx();
+            ok = s->zc != NULL &&
+                 !ZSTD_isError(ZSTD_CCtx_setParameter(s->zc, ZSTD_c_compressionLevel,
+                                                      compress_level(COMPRESS_ZSTD)));
+        } else
+#endif
+        {
+            ok = deflateInit2(&s->zs, compress_level(COMPRESS_GZIP), Z_DEFLATED, 15 + 16, 8,
+                              Z_DEFAULT_STRATEGY) == Z_OK;
+        }
+        if (!ok) {
+            free(s);
+            s = NULL;
+        }
+    }
+
+    compress_stream_free(rs->stream);
+    rs->stream = s;
+    mg_printf(c, "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n",
+              status, http_status_text(status), content_type);
+    if (s != NULL) {
+        mg_printf(c, "Content-Encoding: %s\r\nVary: Accept-Encoding\r\n", encoding_name(s->encoding));
+    }
+    mg_printf(c, "\r\n");
+    c->is_resp = 1;
+}
+
+// Run the compressor and send whatever it produced as one chunk
+static void stream_flush(struct mg_connection *c, struct compress_stream *s,
+                         const void *data, size_t len, bool finish) {
+    unsigned char out[16 * 1024];
+    struct mg_iobuf acc = {NULL, 0, 0, 1024};
+    uint64_t start = now_ns();
+
+#ifdef NEXUS_ENABLE_ZSTD
+    if (s->encoding == COMPRESS_ZSTD) {
+        ZSTD_inBuffer in = {data, len, 0};
+        size_t remaining;
+        do {
+            ZSTD_outBuffer ob = {out, sizeof(out), 0};
+            remaining = ZSTD_compressStream2(s->zc, &ob, &in, finish ? ZSTD_e_end : ZSTD_e_flush);
+            if (ZSTD_isError(remaining)) break;
+            iobuf_append(&acc, out, ob.pos);
+        } while (remaining != 0 || in.pos < in.size);
+    } else
+#endif
+    {
+        s->zs.next_in = (unsigned char *) data;
+        s->zs.avail_in = (uInt) len;
+        do {
+            s->zs.next_out = out;
+            s->zs.avail_out = sizeof(out);
+            deflate(&s->zs, finish ? Z_FINISH : Z_SYNC_FLUSH);
+            iobuf_append(&acc, out, sizeof(out) - s->zs.avail_out);
+        } while (s->zs.avail_out == 0);
+    }
+
+    window_busy_ns += now_ns() - start;
+    if (acc.len > 0) mg_http_write_chunk(c, (const char *) acc.buf, acc.len);
+    mg_iobuf_free(&acc);
+}
+
+void chunked_write(struct mg_connection *c, const void *data, size_t len) {
+    struct compress_stream *s = request_state(c)->stream;
+    if (len == 0) return;   // An empty chunk would end the body
+    if (s == NULL) {
+        mg_http_write_chunk(c, data, len);
+        return;
+    }
+    // zlib takes at most UINT_MAX bytes at a time
+    for (const char *p = data; len > 0;) {
+        size_t n = len < UINT_MAX ? len : UINT_MAX;
+        stream_flush(c, s, p, n, false);
+        p += n;
+        len -= n;
+    }
+}
+
+void chunked_end(struct mg_connection *c) {
+    struct request_state *rs = request_state(c);
+    if (rs->stream != NULL) {
+        stream_flush(c, rs->stream, NULL, 0, true);
+        compress_stream_free(rs->stream);
+        rs->stream = NULL;
+    }
+    mg_http_write_chunk(c, "", 0);
+    c->is_resp = 0;
+}
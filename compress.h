@@ -0,0 +1,94 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mongoose.h"
+
+// ============================================================================
+// NEXUS File Manager - API Response Compression
+// ============================================================================
+
+// Response codings, best last
+#define COMPRESS_NONE 0
+#define COMPRESS_GZIP 1
+#define COMPRESS_ZSTD 2     // Only with -DNEXUS_ENABLE_ZSTD (links -lzstd)
+
+// Bodies smaller than this are sent as-is: the headers would eat the gain
+#ifndef COMPRESS_MIN_SIZE
+#define COMPRESS_MIN_SIZE 1024
+#endif
+
+// Buffered bodies larger than this are sent as-is too: compressing them in
+// one go would hold up the event loop and need a second copy of the body
+#ifndef COMPRESS_MAX_SIZE
+#define COMPRESS_MAX_SIZE (2 * 1024 * 1024)
+#endif
+
+struct compress_stream;
+
+/**
+ * Pick the best coding the client accepts
+ *
+ * @param hm HTTP request
+ * @return COMPRESS_* value
+ */
+uint8_t compress_negotiate(struct mg_http_message *hm);
+
+/**
+ * Current compression level for a coding. Levels drop automatically when
+ * the host load or the time the server spends compressing goes up.
+ *
+ * @param encoding COMPRESS_GZIP or COMPRESS_ZSTD
+ * @return Level passed to the compressor
+ */
+int compress_level(uint8_t encoding);
+
+/**
+ * Compress a complete response body in c->send, if negotiated and worth it
+ * (between COMPRESS_MIN_SIZE and COMPRESS_MAX_SIZE bytes).
+ * Replaces everything from `hdr_ofs` (the Content-Length header line) on
+ * with coding headers and the compressed body.
+ *
+ * @param c Mongoose connection
+ * @param hdr_ofs Offset of the Content-Length header line in c->send
+ * @param body_ofs Offset of the first body byte in c->send
+ * @return true if the body was replaced; false leaves c->send untouched
+ */
+bool compress_response(struct mg_connection *c, size_t hdr_ofs, size_t body_ofs);
+
+/**
+ * Start a chunked response whose body is compressed on the fly when the
+ * request negotiated a coding. Every chunked_write() is flushed so a
+ * streaming client sees data as soon as it is produced.
+ *
+ * @param c Mongoose connection
+ * @param status HTTP status code
+ * @param content_type Content-Type header value
+ */
+void chunked_begin(struct mg_connection *c, int status, const char *content_type);
+
+/**
+ * Send part of a chunked body
+ *
+ * @param c Mongoose connection
+ * @param data Bytes to send
+ * @param len Number of bytes
+ */
+void chunked_write(struct mg_connection *c, const void *data, size_t len);
+
+/**
+ * Finish a chunked body (flushes the compressor, sends the last chunk)
+ *
+ * @param c Mongoose connection
+ */
+void chunked_end(struct mg_connection *c);
+
+/**
+ * Free an unfinished stream, e.g. when the client went away
+ *
+ * @param s Stream or NULL
+ */
+void compress_stream_free(struct compress_stream *s);
+
+#endif // COMPRESS_H
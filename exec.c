@@ -0,0 +1,818 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "exec.h"
+
+#define CPU_PERIOD_US 100000
+#define CHECK_INTERVAL_MS 50        // Deadline / CPU checks between SIGCHLDs
+#define LEAF_RETRIES 100            // Checks before a busy leaf is given up
+
+static struct exec_limits limits = {
+    .cpus = 1.0,
+    .memory_max = 512ll << 20,
+    .pids_max = 256,
+    .timeout_s = 30,
+    .cpu_time_s = 10,
+    .queue_max = 256,
+    .interactive_timeout_s = 600,
+};
+static char cgroup_root[256];
+static bool cgroup_ok;
+
+/**
+ * Controllers the cgroup root hands down to job leaves
+ */
+enum {
+    CG_CPU = 1 << 0,
+    CG_MEMORY = 1 << 1,
+    CG_PIDS = 1 << 2,
+    CG_IO = 1 << 3,
+};
+static const char *controller_names[] = {"cpu", "memory", "pids", "io"};
+static unsigned controllers_on;
+
+/**
+ * A client with queued jobs
+ */
+struct exec_client {
+    char key[64];
+    struct exec_job *head[EXEC_PRIORITIES];
+    struct exec_job *tail[EXEC_PRIORITIES];
+    struct exec_client *next;
+};
+
+/**
+ * A job leaf that was still busy when its job finished: the kernel has not
+ * let go of the killed processes yet
+ */
+struct stale_leaf {
+    char path[384];
+    int tries;
+    struct stale_leaf *next;
+};
+
+static struct exec_job *jobs;       // Queued, running and finished-unreported
+static struct stale_leaf *stale_leaves;
+static struct exec_client *clients;
+static int running, queued;
+static unsigned long next_id = 1;
+static int wake_fds[2] = {-1, -1};  // SIGCHLD -> event loop
+static bool reap_pending;
+static double last_check_ms;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Write a short string to a cgroup control file
+static bool cg_write(const char *dir, const char *file, const char *value) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    ssize_t n = write(fd, value, strlen(value));
+    close(fd);
+    return n == (ssize_t) strlen(value);
+}
+
+// Read a cgroup control file into buf; returns false if it is missing
+static bool cg_read(const char *dir, const char *file, char *buf, size_t size) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0) return false;
+    buf[n] = '\0';
+    return true;
+}
+
+// Value of "key N" in a flat-keyed file such as cpu.stat
+static long long cg_key(const char *text, const char *key) {
+    size_t len = strlen(key);
+    for (const char *p = text; p != NULL && *p != '\0'; p = strchr(p, '\n')) {
+        if (*p == '\n') p++;
+        if (strncmp(p, key, len) == 0 && p[len] == ' ') return strtoll(p + len + 1, NULL, 10);
+    }
+    return -1;
+}
+
+// Sum "name=N" over every device line of io.stat
+static long long io_sum(const char *text, const char *name) {
+    size_t len = strlen(name);
+    long long total = 0;
+    for (const char *p = strstr(text, name); p != NULL; p = strstr(p + len, name)) {
+        if ((p == text || p[-1] == ' ') && p[len] == '=') total += strtoll(p + len + 1, NULL, 10);
+    }
+    return total;
+}
+
+// "512M" -> bytes
+static long long parse_size(const char *s) {
+    char *end;
+    long long v = strtoll(s, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': return v << 10;
+        case 'm': case 'M': return v << 20;
+        case 'g': case 'G': return v << 30;
+        default: return v;
+    }
+}
+
+// Runs in whichever thread takes the signal: only wake the event loop
+static void on_sigchld(int sig) {
+    (void) sig;
+    int saved = errno;
+    if (wake_fds[1] >= 0) send(wake_fds[1], "", 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    errno = saved;
+}
+
+static void exec_poll(void);
+
+// Wake-up socket: a SIGCHLD arrived, or another loop iteration went by
+static void wake_handler(struct mg_connection *c, int ev, void *ev_data) {
+    (void) ev_data;
+    if (ev == MG_EV_READ) {
+        c->recv.len = 0;
+        reap_pending = true;
+    }
+    if (ev == MG_EV_READ || ev == MG_EV_POLL) exec_poll();
+}
+
+// Delegated cgroup v2 root for the job leaves
+static void cgroup_init(void) {
+    // The root must sit in a cgroup v2 hierarchy we may write to, and hold no
+    // processes itself, so that the controllers can be handed down to jobs
+    char parent[256], buf[256];
+    snprintf(parent, sizeof(parent), "%s", cgroup_root);
+    char *slash = strrchr(parent, '/');
+    if (slash != NULL) *slash = '\0';
+    if (!cg_read(slash != NULL && slash != parent ? parent : "/", "cgroup.controllers",
+                 buf, sizeof(buf))) {
+        MG_INFO(("exec: %s is not in a cgroup v2 hierarchy, limits disabled", cgroup_root));
+        return;
+    }
+    if (mkdir(cgroup_root, 0755) != 0 && errno != EEXIST) {
+        MG_INFO(("exec: cannot create %s (%s), limits disabled", cgroup_root, strerror(errno)));
+        return;
+    }
+    for (size_t i = 0; i < sizeof(controller_names) / sizeof(controller_names[0]); i++) {
+        char enable[16];
+        snprintf(enable, sizeof(enable), "+%s", controller_names[i]);
+        cg_write(cgroup_root, "cgroup.subtree_control", enable);
+    }
+
+    // What the kernel actually enabled, whatever the writes above returned
+    if (!cg_read(cgroup_root, "cgroup.subtree_control", buf, sizeof(buf))) buf[0] = '\0';
+    for (size_t i = 0; i < sizeof(controller_names) / sizeof(controller_names[0]); i++) {
+        size_t len = strlen(controller_names[i]);
+        for (const char *p = strstr(buf, controller_names[i]); p != NULL;
+             p = strstr(p + len, controller_names[i])) {
+            if ((p == buf || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\n' || p[len] == '\0')) {
+                controllers_on |= 1u << i;
+                break;
+            }
+        }
+    }
+
+    // A configured limit without its controller would leave jobs unbounded
+    // while they report a cgroup: run them without one instead
+    unsigned needed = (limits.cpus > 0 ? CG_CPU : 0) | (limits.memory_max > 0 ? CG_MEMORY : 0) |
+                      (limits.pids_max > 0 ? CG_PIDS : 0);
+    for (size_t i = 0; i < sizeof(controller_names) / sizeof(controller_names[0]); i++) {
+        if ((needed & ~controllers_on) & (1u << i)) {
+            MG_ERROR(("exec: controller %s not delegated to %s, limits disabled",
+                      controller_names[i], cgroup_root));
+            return;
+        }
+    }
+    if (!(controllers_on & CG_IO)) MG_INFO(("exec: controller io not delegated, no I/O stats"));
+    cgroup_ok = true;
+    MG_INFO(("exec: jobs in %s, cpus %.2f, memory %lld, pids %ld", cgroup_root,
+             limits.cpus, limits.memory_max, limits.pids_max));
+}
+
+void exec_init(struct mg_mgr *mgr) {
+    const char *env;
+    if ((env = getenv("NEXUS_JOB_CPUS")) != NULL && *env != '\0') limits.cpus = atof(env);
+    if ((env = getenv("NEXUS_JOB_MEMORY")) != NULL && *env != '\0') limits.memory_max = parse_size(env);
+    if ((env = getenv("NEXUS_JOB_PIDS")) != NULL && *env != '\0') limits.pids_max = atol(env);
+    if ((env = getenv("NEXUS_JOB_TIMEOUT")) != NULL && *env != '\0') limits.timeout_s = atof(env);
+    if ((env = getenv("NEXUS_JOB_CPU_TIME")) != NULL && *env != '\0') limits.cpu_time_s = atof(env);
+    if ((env = getenv("NEXUS_JOB_QUEUE")) != NULL && *env != '\0') limits.queue_max = atoi(env);
+    if ((env = getenv("NEXUS_PTY_TIMEOUT")) != NULL && *env != '\0') {
+        limits.interactive_timeout_s = atof(env);
+    }
+    limits.slots = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if ((env = getenv("NEXUS_JOB_SLOTS")) != NULL && *env != '\0') limits.slots = atoi(env);
+    if (limits.slots < 1) limits.slots = 1;
+    env = getenv("NEXUS_CGROUP_ROOT");
+    snprintf(cgroup_root, sizeof(cgroup_root), "%s",
+             env != NULL && *env != '\0' ? env : "/sys/fs/cgroup/nexus");
+    cgroup_init();
+    MG_INFO(("exec: %d slots, queue %d, timeout %.0f s wall, %.0f s CPU", limits.slots,
+             limits.queue_max, limits.timeout_s, limits.cpu_time_s));
+
+    // Children are reaped from the event loop; SIGCHLD only wakes it up
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, wake_fds) != 0 ||
+        mg_wrapfd(mgr, wake_fds[0], wake_handler, NULL) == NULL) {
+        MG_ERROR(("exec: cannot create the wake-up socket"));
+        return;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigchld;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+}
+
+const struct exec_limits *exec_limits(void) {
+    return &limits;
+}
+
+// Create a leaf for one job and apply the limits; returns false, with no
+// leaf left behind, unless every configured limit is in place
+static bool leaf_create(struct exec_job *job) {
+    snprintf(job->leaf, sizeof(job->leaf), "%s/job-%d-%lu", cgroup_root, (int) getpid(), job->id);
+    if (mkdir(job->leaf, 0755) != 0) return false;
+
+    char value[64];
+    const char *failed = NULL;
+    if (limits.cpus > 0) {
+        snprintf(value, sizeof(value), "%lld %d",
+                 (long long) (limits.cpus * CPU_PERIOD_US), CPU_PERIOD_US);
+        if (!cg_write(job->leaf, "cpu.max", value)) failed = "cpu.max";
+    }
+    if (failed == NULL && limits.memory_max > 0) {
+        snprintf(value, sizeof(value), "%lld", limits.memory_max);
+        if (!cg_write(job->leaf, "memory.max", value)) failed = "memory.max";
+        // memory.swap.max only exists with swap accounting
+        else if (!cg_write(job->leaf, "memory.swap.max", "0") && errno != ENOENT) {
+            failed = "memory.swap.max";
+        }
+    }
+    if (failed == NULL && limits.pids_max > 0) {
+        snprintf(value, sizeof(value), "%ld", limits.pids_max);
+        if (!cg_write(job->leaf, "pids.max", value)) failed = "pids.max";
+    }
+    if (failed != NULL) {
+        MG_ERROR(("exec: cannot set %s in %s: %s", failed, job->leaf, strerror(errno)));
+        rmdir(job->leaf);
+        return false;
+    }
+    return true;
+}
+
+// Collect the leaf's counters, kill anything the job left behind and remove it
+static void leaf_finish(const char *leaf, struct exec_stats *st) {
+    char buf[1024];
+    if (cg_read(leaf, "cpu.stat", buf, sizeof(buf))) {
+        long long user = cg_key(buf, "user_usec"), sys = cg_key(buf, "system_usec");
+        if (user >= 0) st->user_ms = user / 1e3;
+        if (sys >= 0) st->sys_ms = sys / 1e3;
+    }
+    if (cg_read(leaf, "memory.peak", buf, sizeof(buf))) {
+        st->max_rss_kb = (long) (strtoll(buf, NULL, 10) >> 10);
+    }
+    if (cg_read(leaf, "io.stat", buf, sizeof(buf))) {
+        st->io_read = io_sum(buf, "rbytes");
+        st->io_write = io_sum(buf, "wbytes");
+    }
+
+    cg_write(leaf, "cgroup.kill", "1");
+    if (rmdir(leaf) == 0 || errno != EBUSY) return;
+
+    // Killed processes take a moment to leave; exec_poll() tries again
+    struct stale_leaf *s = calloc(1, sizeof(*s));
+    if (s == NULL) return;
+    snprintf(s->path, sizeof(s->path), "%s", leaf);
+    s->next = stale_leaves;
+    stale_leaves = s;
+}
+
+// One more rmdir for each leaf that was busy
+static void retry_stale_leaves(void) {
+    for (struct stale_leaf **p = &stale_leaves; *p != NULL;) {
+        struct stale_leaf *s = *p;
+        if (rmdir(s->path) != 0 && errno == EBUSY && ++s->tries < LEAF_RETRIES) {
+            p = &s->next;
+            continue;
+        }
+        if (s->tries == LEAF_RETRIES) MG_ERROR(("exec: cannot remove %s: still busy", s->path));
+        *p = s->next;
+        free(s);
+    }
+}
+
+// CPU time used so far by the whole job, or -1 without a cgroup
+static double cgroup_cpu_ms(const struct exec_job *job) {
+    char buf[1024];
+    if (!job->in_cgroup || !cg_read(job->leaf, "cpu.stat", buf, sizeof(buf))) return -1;
+    long long usage = cg_key(buf, "usage_usec");
+    return usage < 0 ? -1 : usage / 1e3;
+}
+
+// Replace the job's child with one step; only returns through _exit()
+static void exec_step(char **argv) {
+    execvp(argv[0], argv);
+    int err = errno;        // As sh would report it
+    const char *what = err == ENOENT ? ": not found\n" : ": cannot execute\n";
+    if (write(STDERR_FILENO, argv[0], strlen(argv[0])) >= 0 &&
+        write(STDERR_FILENO, what, strlen(what)) >= 0) {}
+    _exit(err == ENOENT ? 127 : 126);
+}
+
+// In the job's child: run the steps of split_words() one after the other
+// and stop at the first failure, as sh runs "a && b". The last step takes
+// the child over, so a run after its compile is the job's own process.
+// Returns the exit status of the step that failed.
+static int run_steps(char **argv) {
+    for (char **step = argv;;) {
+        char **end = step;
+        while (*end != NULL) end++;
+        if (end[1] == NULL) exec_step(step);
+
+        pid_t pid = fork();
+        if (pid == 0) exec_step(step);
+        if (pid < 0) return 126;
+        int status;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) return 126;
+        }
+        if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+        if (WEXITSTATUS(status) != 0) return WEXITSTATUS(status);
+        step = end + 1;
+    }
+}
+
+// Fork a dequeued job. On failure it is marked finished for exec_poll()
+// to report.
+static void job_spawn(struct exec_job *job) {
+    job->start_ms = now_ms();
+    job->stats.queue_ms = job->start_ms - job->queued_ms;
+    job->state = EXEC_FINISHED;
+    job->end = EXEC_NOT_STARTED;
+    reap_pending = true;
+
+    int procs_fd = -1;
+    if (cgroup_ok && leaf_create(job)) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/cgroup.procs", job->leaf);
+        procs_fd = open(path, O_WRONLY | O_CLOEXEC);
+        if (procs_fd < 0) rmdir(job->leaf);
+    }
+    job->in_cgroup = procs_fd >= 0;
+
+    int out_fd = output_attach(job->output);
+    int err_fd = job->error == NULL ? out_fd : output_attach(job->error);
+    bool stdio = job->stdio_fd > 0;
+    int in_fd = stdio ? job->stdio_fd :
+                open(job->input != NULL ? job->input : "/dev/null", O_RDONLY | O_CLOEXEC);
+    job->stdio_fd = -1;
+    if (out_fd < 0 || err_fd < 0 || in_fd < 0) {
+        if (out_fd >= 0) close(out_fd);
+        if (err_fd >= 0 && err_fd != out_fd) close(err_fd);
+        if (in_fd >= 0) close(in_fd);
+        if (job->in_cgroup) {
+            close(procs_fd);
+            rmdir(job->leaf);
+        }
+        return;
+    }
+
+    // Per-process CPU limit: SIGXCPU at the soft limit, SIGKILL soon after.
+    // The cgroup check in exec_poll() covers the job as a whole.
+    struct rlimit cpu = {RLIM_INFINITY, RLIM_INFINITY};
+    if (limits.cpu_time_s > 0) {
+        cpu.rlim_cur = (rlim_t) limits.cpu_time_s;
+        if ((double) cpu.rlim_cur < limits.cpu_time_s) cpu.rlim_cur++;
+        cpu.rlim_max = cpu.rlim_cur + 2;
+    }
+    struct sigaction dfl;
+    memset(&dfl, 0, sizeof(dfl));
+    dfl.sa_handler = SIG_DFL;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Only async-signal-safe calls from here on
+        setpgid(0, 0);
+        if (procs_fd >= 0 && write(procs_fd, "0", 1) != 1) _exit(126);
+        setrlimit(RLIMIT_CPU, &cpu);
+        sigaction(SIGPIPE, &dfl, NULL);     // Ignored by the server, not by programs
+        dup2(in_fd, STDIN_FILENO);
+        dup2(stdio ? in_fd : out_fd, STDOUT_FILENO);
+        dup2(err_fd, STDERR_FILENO);
+        if (job->argv != NULL) _exit(run_steps(job->argv));
+        execl("/bin/sh", "sh", "-c", job->command, (char *) NULL);
+        _exit(127);
+    }
+    close(out_fd);
+    if (err_fd != out_fd) close(err_fd);
+    close(in_fd);
+    if (job->in_cgroup) close(procs_fd);
+    if (pid < 0) {
+        if (job->in_cgroup) rmdir(job->leaf);
+        return;
+    }
+    setpgid(pid, pid);
+    job->pid = pid;
+    job->state = EXEC_RUNNING;
+    job->end = EXEC_EXITED;
+    job->deadline_ms = job->timeout_s > 0 ? job->start_ms + job->timeout_s * 1e3 : INFINITY;
+    if (!job->interactive) running++;
+}
+
+// ----------------------------------------------------------------------------
+// Queue: one FIFO per client and priority class. `clients` holds the clients
+// with queued work in turn order; the one served goes to the back.
+// ----------------------------------------------------------------------------
+
+static struct exec_client *client_find(const char *key) {
+    for (struct exec_client *cl = clients; cl != NULL; cl = cl->next) {
+        if (strcmp(cl->key, key) == 0) return cl;
+    }
+    return NULL;
+}
+
+static bool client_empty(const struct exec_client *cl) {
+    for (int p = 0; p < EXEC_PRIORITIES; p++) {
+        if (cl->head[p] != NULL) return false;
+    }
+    return true;
+}
+
+// Take a client out of the turn order; put it back at the end if it still
+// has work
+static void client_requeue(struct exec_client *cl) {
+    struct exec_client **pp = &clients;
+    while (*pp != cl) pp = &(*pp)->next;
+    *pp = cl->next;
+    cl->next = NULL;
+    if (client_empty(cl)) {
+        free(cl);
+        return;
+    }
+    for (pp = &clients; *pp != NULL; pp = &(*pp)->next) {}
+    *pp = cl;
+}
+
+static bool enqueue(struct exec_job *job) {
+    struct exec_client *cl = client_find(job->client);
+    if (cl == NULL) {
+        cl = calloc(1, sizeof(*cl));
+        if (cl == NULL) return false;
+        snprintf(cl->key, sizeof(cl->key), "%s", job->client);
+        struct exec_client **pp = &clients;
+        while (*pp != NULL) pp = &(*pp)->next;
+        *pp = cl;
+    }
+    int p = job->priority;
+    if (cl->tail[p] != NULL) {
+        cl->tail[p]->qnext = job;
+    } else {
+        cl->head[p] = job;
+    }
+    cl->tail[p] = job;
+    queued++;
+    return true;
+}
+
+// Next job for a free slot: a build that has waited too long, else the
+// first client in turn order with work in the highest class
+static struct exec_job *dequeue(void) {
+    struct exec_client *pick = NULL;
+    int prio = EXEC_PRIO_BUILD;
+    double now = now_ms();
+    for (struct exec_client *cl = clients; cl != NULL; cl = cl->next) {
+        struct exec_job *job = cl->head[EXEC_PRIO_BUILD];
+        if (job != NULL && now - job->queued_ms >= EXEC_STARVATION_MS &&
+            (pick == NULL || job->queued_ms < pick->head[EXEC_PRIO_BUILD]->queued_ms)) {
+            pick = cl;
+        }
+    }
+    for (int p = 0; pick == NULL && p < EXEC_PRIORITIES; p++) {
+        for (struct exec_client *cl = clients; cl != NULL; cl = cl->next) {
+            if (cl->head[p] != NULL) {
+                pick = cl;
+                prio = p;
+                break;
+            }
+        }
+    }
+    if (pick == NULL) return NULL;
+
+    struct exec_job *job = pick->head[prio];
+    pick->head[prio] = job->qnext;
+    if (pick->head[prio] == NULL) pick->tail[prio] = NULL;
+    job->qnext = NULL;
+    queued--;
+    client_requeue(pick);
+    return job;
+}
+
+// Take a queued job off its client's queue
+static void dequeue_job(struct exec_job *job) {
+    struct exec_client *cl = client_find(job->client);
+    if (cl == NULL) return;
+    int p = job->priority;
+    struct exec_job *prev = NULL;
+    for (struct exec_job *q = cl->head[p]; q != NULL; prev = q, q = q->qnext) {
+        if (q != job) continue;
+        if (prev != NULL) {
+            prev->qnext = q->qnext;
+        } else {
+            cl->head[p] = q->qnext;
+        }
+        if (cl->tail[p] == q) cl->tail[p] = prev;
+        queued--;
+        break;
+    }
+    if (client_empty(cl)) client_requeue(cl);
+}
+
+// Fill free slots from the queue
+static void schedule(void) {
+    struct exec_job *job;
+    while (running < limits.slots && (job = dequeue()) != NULL) job_spawn(job);
+}
+
+// A command with nothing for the shell to do (plain words, single quotes
+// and backslashes, steps joined by " && ") as argvs, saving the shell; NULL
+// otherwise. Each step ends with a NULL and an empty step ends the list,
+// as with toolchain_argv().
+static char **split_words(const char *command) {
+    size_t len = strlen(command);
+    char **argv = malloc((len / 2 + 3) * sizeof(char *) + len + 1);
+    if (argv == NULL) return NULL;
+    char *out = (char *) (argv + len / 2 + 3);
+    int argc = 0, step_start = 0;
+    bool in_word = false, shell = false;
+    for (const char *p = command; *p != '\0' && !shell; p++) {
+        if (*p == ' ' || *p == '\t') {
+            if (in_word) *out++ = '\0';
+            in_word = false;
+            continue;
+        }
+        if (!in_word && p[0] == '&' && p[1] == '&' && (p[2] == ' ' || p[2] == '\t')) {
+            shell = argc == step_start;     // "&&" with no step before it
+            argv[argc++] = NULL;
+            step_start = argc;
+            p++;
+            continue;
+        }
+        if (!in_word) argv[argc++] = out;
+        in_word = true;
+        const char *end;
+        if (*p == '\'') {
+            shell = (end = strchr(p + 1, '\'')) == NULL;
+            if (!shell) {
+                memcpy(out, p + 1, (size_t) (end - p - 1));
+                out += end - p - 1;
+                p = end;
+            }
+        } else if (*p == '\\' && p[1] != '\0' && p[1] != '\n') {
+            *out++ = *++p;
+        } else {
+            // Redirections, expansions, lists and assignments are the shell's
+            shell = strchr("|&;<>()$`\\\"*?[]#~{}!\n", *p) != NULL ||
+                    (*p == '=' && argc == step_start + 1);
+            *out++ = *p;
+        }
+    }
+    if (shell || argc == step_start) {
+        free(argv);
+        return NULL;
+    }
+    *out = '\0';
+    argv[argc] = argv[argc + 1] = NULL;
+    return argv;
+}
+
+static void job_free(struct exec_job *job) {
+    if (job->stdio_fd > 0) close(job->stdio_fd);
+    output_release(job->output);
+    output_release(job->error);
+    free(job->command);
+    free(job->argv);
+    free(job->input);
+    free(job);
+}
+
+struct exec_job *exec_start(const struct exec_request *req) {
+    struct exec_job *job = NULL;
+    if (req->interactive || queued < limits.queue_max) job = calloc(1, sizeof(*job));
+    if (job == NULL) {
+        if (req->stdio_fd > 0) close(req->stdio_fd);
+        return NULL;
+    }
+    job->stdio_fd = req->stdio_fd > 0 ? req->stdio_fd : -1;
+    job->interactive = req->interactive;
+    job->command = strdup(req->command);
+    job->argv = job->command != NULL ? split_words(job->command) : NULL;
+    job->input = req->input != NULL ? strdup(req->input) : NULL;
+    if (job->command == NULL || (req->input != NULL && job->input == NULL)) {
+        job_free(job);
+        return NULL;
+    }
+    job->id = next_id++;
+    job->state = EXEC_QUEUED;
+    job->priority = req->priority;
+    job->done = req->done;
+    job->data = req->data;
+    job->queued_ms = now_ms();
+    job->timeout_s = req->timeout_s;
+    double limit = job->interactive ? limits.interactive_timeout_s : limits.timeout_s;
+    if (job->timeout_s <= 0 || job->timeout_s > limit) job->timeout_s = limit;
+    snprintf(job->name, sizeof(job->name), "%s", req->name);
+    snprintf(job->client, sizeof(job->client), "%s", req->client != NULL ? req->client : "");
+    job->output = output_create(job->id, true, "output");
+    if (req->split_stderr) job->error = output_create(job->id, false, "error");
+    if (job->output == NULL || (req->split_stderr && job->error == NULL)) {
+        job_free(job);
+        return NULL;
+    }
+    if (job->interactive) {
+        // Mostly waits for a person: no slot, no queue
+        job->next = jobs;
+        jobs = job;
+        job_spawn(job);
+        return job;
+    }
+    if (!enqueue(job)) {
+        job_free(job);
+        return NULL;
+    }
+    job->next = jobs;
+    jobs = job;
+    schedule();
+    return job;
+}
+
+struct exec_job *exec_find(unsigned long id) {
+    for (struct exec_job *job = jobs; job != NULL; job = job->next) {
+        if (job->id == id) return job;
+    }
+    return NULL;
+}
+
+struct exec_job *exec_jobs(void) {
+    return jobs;
+}
+
+double exec_elapsed_ms(const struct exec_job *job) {
+    return now_ms() - (job->state == EXEC_QUEUED ? job->queued_ms : job->start_ms);
+}
+
+int exec_running(void) {
+    return running;
+}
+
+int exec_queued(void) {
+    return queued;
+}
+
+int exec_slots(void) {
+    return limits.slots;
+}
+
+bool exec_busy(void) {
+    return jobs != NULL || stale_leaves != NULL;
+}
+
+bool exec_subscribe(struct exec_job *job, unsigned long conn_id) {
+    if (job->nsubscribers == EXEC_MAX_SUBSCRIBERS) return false;
+    job->subscribers[job->nsubscribers++] = conn_id;
+    return true;
+}
+
+void exec_unsubscribe(unsigned long conn_id) {
+    for (struct exec_job *job = jobs; job != NULL; job = job->next) {
+        for (int i = 0; i < job->nsubscribers; i++) {
+            if (job->subscribers[i] != conn_id) continue;
+            job->subscribers[i] = job->subscribers[--job->nsubscribers];
+            if (job->nsubscribers == 0 && job->state != EXEC_FINISHED) {
+                MG_INFO(("exec: job %lu (%s) abandoned, stopping it", job->id, job->name));
+                exec_stop(job, EXEC_CANCELLED);
+            }
+            break;
+        }
+    }
+}
+
+void exec_stop(struct exec_job *job, enum exec_end why) {
+    if (job->state == EXEC_QUEUED) {
+        // Never started: report it on the next poll
+        dequeue_job(job);
+        job->state = EXEC_FINISHED;
+        job->end = why;
+        job->stats.queue_ms = now_ms() - job->queued_ms;
+        reap_pending = true;
+        return;
+    }
+    if (job->state != EXEC_RUNNING || job->term_ms != 0) return;
+    job->end = why;
+    job->term_ms = now_ms();
+    kill(-job->pid, SIGTERM);
+}
+
+// The job's shell has exited (still a zombie): collect it
+static void job_reap(struct exec_job *job) {
+    struct exec_stats *st = &job->stats;
+    st->wall_ms = now_ms() - job->start_ms;
+
+    // Whatever the job left running goes with it. The zombie leader keeps
+    // the process group id from being reused until wait4() below.
+    kill(-job->pid, SIGKILL);
+    int status = 0;
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+    while (wait4(job->pid, &status, 0, &ru) < 0 && errno == EINTR) {}
+    job->state = EXEC_FINISHED;
+    if (!job->interactive) running--;
+
+    // rusage covers the shell and every descendant it waited for; peak RSS
+    // is that of the largest single process
+    st->user_ms = ru.ru_utime.tv_sec * 1e3 + ru.ru_utime.tv_usec / 1e3;
+    st->sys_ms = ru.ru_stime.tv_sec * 1e3 + ru.ru_stime.tv_usec / 1e3;
+    st->max_rss_kb = ru.ru_maxrss;
+    st->io_read = (long long) ru.ru_inblock * 512;
+    st->io_write = (long long) ru.ru_oublock * 512;
+    if (job->in_cgroup) {
+        st->cgroup = true;
+        leaf_finish(job->leaf, st);
+    }
+
+    if (WIFSIGNALED(status)) {
+        st->signal = WTERMSIG(status);
+        st->exit_code = 128 + st->signal;
+    } else {
+        st->exit_code = WEXITSTATUS(status);
+    }
+    // A command that hit RLIMIT_CPU under a waiting shell shows up as 128 + SIGXCPU
+    if (job->end == EXEC_EXITED && (st->signal == SIGXCPU || st->exit_code == 128 + SIGXCPU)) {
+        job->end = EXEC_CPU_TIMEOUT;
+    }
+}
+
+// Hand a finished job to its owner and free it; its output stays
+// available by id for a while (output.h)
+static void job_report(struct exec_job *job) {
+    if (job->pid == 0) job->stats.exit_code = -1;     // Never ran
+    output_end(job->output);
+    output_end(job->error);
+    job->done(job);
+    job_free(job);
+}
+
+// Reap finished jobs; enforce deadlines, CPU limits and the kill grace
+// period; start queued jobs in the slots that freed up
+static void exec_poll(void) {
+    if (jobs == NULL && stale_leaves == NULL) return;
+    double now = now_ms();
+    if (!reap_pending && now - last_check_ms < CHECK_INTERVAL_MS) return;
+    reap_pending = false;
+    last_check_ms = now;
+    retry_stale_leaves();
+
+    for (struct exec_job **p = &jobs; *p != NULL;) {
+        struct exec_job *job = *p;
+        if (job->state == EXEC_RUNNING) {
+            siginfo_t info;
+            memset(&info, 0, sizeof(info));
+            if (waitid(P_PID, (id_t) job->pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 &&
+                info.si_pid != 0) {
+                job_reap(job);
+            } else if (job->term_ms == 0) {
+                if (now >= job->deadline_ms) {
+                    exec_stop(job, EXEC_TIMEOUT);
+                } else if (limits.cpu_time_s > 0 && cgroup_cpu_ms(job) > limits.cpu_time_s * 1e3) {
+                    exec_stop(job, EXEC_CPU_TIMEOUT);
+                }
+            } else if (now - job->term_ms >= EXEC_KILL_GRACE_MS) {
+                kill(-job->pid, SIGKILL);
+                if (job->in_cgroup) cg_write(job->leaf, "cgroup.kill", "1");
+            }
+        }
+        if (job->state == EXEC_FINISHED) {
+            *p = job->next;
+            job_report(job);
+            continue;
+        }
+        p = &job->next;
+    }
+    schedule();
+}
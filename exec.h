@@ -0,0 +1,236 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "mongoose.h"
+#include "output.h"
+
+// ============================================================================
+// NEXUS File Manager - Program Execution
+// ============================================================================
+
+#define EXEC_MAX_SUBSCRIBERS 8
+#define EXEC_KILL_GRACE_MS 2000     // SIGTERM -> SIGKILL
+#define EXEC_STARVATION_MS 10000    // Queued builds older than this go first
+
+/**
+ * Limits applied to every job. Read from the environment by exec_init():
+ *   NEXUS_CGROUP_ROOT    delegated cgroup v2 directory (default /sys/fs/cgroup/nexus)
+ *   NEXUS_JOB_CPUS       CPU quota in cores, e.g. 1.5 (default 1, 0 = unlimited)
+ *   NEXUS_JOB_MEMORY     memory.max, suffixes K/M/G allowed (default 512M, 0 = unlimited)
+ *   NEXUS_JOB_PIDS       pids.max (default 256, 0 = unlimited)
+ *   NEXUS_JOB_TIMEOUT    wall-clock seconds before a job is stopped (default 30)
+ *   NEXUS_JOB_CPU_TIME   CPU seconds before a job is stopped (default 10)
+ *   NEXUS_JOB_SLOTS      jobs running at once (default: online CPUs)
+ *   NEXUS_JOB_QUEUE      jobs waiting for a slot before new ones are refused (default 256)
+ *   NEXUS_PTY_TIMEOUT    wall-clock seconds for interactive jobs (default 600)
+ */
+struct exec_limits {
+    double cpus;
+    long long memory_max;
+    long pids_max;
+    double timeout_s;
+    double cpu_time_s;
+    int slots;
+    int queue_max;
+    double interactive_timeout_s;
+};
+
+/**
+ * What a finished job used
+ */
+struct exec_stats {
+    int exit_code;          // Exit status, or 128 + signal number
+    int signal;             // Terminating signal, 0 if it exited
+    double queue_ms;        // Waiting for a slot
+    double wall_ms;         // Running
+    double user_ms;
+    double sys_ms;
+    long max_rss_kb;        // Peak RSS (cgroup memory.peak when available)
+    long long io_read;      // Bytes read from storage
+    long long io_write;     // Bytes written to storage
+    bool cgroup;            // Ran in its own cgroup leaf with every configured
+                            // limit applied (limits + cgroup stats)
+};
+
+/**
+ * Why a job ended
+ */
+enum exec_end {
+    EXEC_EXITED,            // On its own
+    EXEC_TIMEOUT,           // Wall-clock limit
+    EXEC_CPU_TIMEOUT,       // CPU time limit
+    EXEC_CANCELLED,         // exec_stop() by request, or nobody waits any more
+    EXEC_NOT_STARTED,       // fork() or the output capture failed
+};
+
+/**
+ * Scheduling class. A free slot goes to the highest class with queued
+ * work; within a class, clients take turns.
+ */
+enum exec_priority {
+    EXEC_PRIO_RUN,          // Quick: run an existing program or a script
+    EXEC_PRIO_BUILD,        // Slow: compile first
+    EXEC_PRIORITIES,
+};
+
+enum exec_state {
+    EXEC_QUEUED,
+    EXEC_RUNNING,
+    EXEC_FINISHED,          // Ended, waiting for exec_poll() to report it
+};
+
+struct exec_job;
+typedef void (*exec_done_fn)(struct exec_job *job);
+
+/**
+ * What to run, for exec_start()
+ */
+struct exec_request {
+    const char *command;        // Command line; plain words, or steps of them
+                                // joined by " && ", are run directly, the
+                                // rest through /bin/sh -c
+    const char *name;           // Label for listings
+    const char *client;         // Fair-share key: session or peer address
+    enum exec_priority priority;
+    double timeout_s;           // Wall-clock limit; 0, or more than the
+                                // configured limit, means the configured one
+    const char *input;          // File to use as stdin, NULL for /dev/null
+    bool split_stderr;          // stderr to job->error, not job->output
+    int stdio_fd;               // > 0: the job's stdin and stdout instead (a
+                                // socket); exec_start() takes it over
+    bool interactive;           // Starts at once, outside the slots, with the
+                                // interactive time limit
+    exec_done_fn done;          // Called once the job has ended
+    void *data;                 // Stored in job->data
+};
+
+/**
+ * A queued or running program. Jobs belong to the event loop thread:
+ * start, poll, stop and the done callback all run there.
+ */
+struct exec_job {
+    unsigned long id;
+    enum exec_state state;
+    pid_t pid;                  // Also the process group id, 0 until running
+    char *command;
+    char **argv;                // `command` split into steps of words (see
+                                // split_words()), NULL when it needs a shell
+    char name[128];             // What runs, for listings (the file name)
+    char client[64];
+    enum exec_priority priority;
+    struct output *output;      // stdout + stderr; complete in `done`, kept afterwards
+    struct output *error;       // stderr with split_stderr, else NULL
+    char *input;                // stdin file, NULL for /dev/null
+    int stdio_fd;               // See exec_request, -1 once handed to the job
+    bool interactive;
+    double queued_ms;
+    double timeout_s;
+    double start_ms;
+    double deadline_ms;         // Wall-clock limit, absolute
+    double term_ms;             // When SIGTERM went out, 0 before that
+    enum exec_end end;
+    struct exec_stats stats;    // Valid in `done`
+    unsigned long subscribers[EXEC_MAX_SUBSCRIBERS];   // Connection ids
+    int nsubscribers;
+    exec_done_fn done;
+    void *data;                 // Caller's
+    bool in_cgroup;
+    char leaf[384];
+    struct exec_job *next;      // All jobs
+    struct exec_job *qnext;     // Client queue, while queued
+};
+
+/**
+ * Read the job limits, set up the cgroup root and hook job reaping into
+ * the event loop. Without a usable cgroup v2 hierarchy jobs still run, just
+ * without resource limits and with rusage-only stats.
+ *
+ * @param mgr Event manager whose loop runs the jobs' callbacks
+ */
+void exec_init(struct mg_mgr *mgr);
+
+/**
+ * Current job limits
+ */
+const struct exec_limits *exec_limits(void);
+
+/**
+ * Queue a shell command. It runs in its own process group and cgroup once
+ * a slot is free (interactive jobs start at once). Returns at once; `done`
+ * is called when the job has ended and been reaped, and the job is freed
+ * after it returns.
+ *
+ * @param req What to run
+ * @return Job, or NULL if the queue is full (req->stdio_fd is closed then)
+ */
+struct exec_job *exec_start(const struct exec_request *req);
+
+/**
+ * Find a queued or running job
+ *
+ * @param id Job id
+ * @return Job, or NULL if it has finished or never existed
+ */
+struct exec_job *exec_find(unsigned long id);
+
+/**
+ * Queued and running jobs, newest first
+ */
+struct exec_job *exec_jobs(void);
+
+/**
+ * Time the job has been running, or waiting while queued
+ */
+double exec_elapsed_ms(const struct exec_job *job);
+
+/**
+ * Jobs running now
+ */
+int exec_running(void);
+
+/**
+ * Jobs waiting for a slot
+ */
+int exec_queued(void);
+
+/**
+ * Jobs that may run at once (NEXUS_JOB_SLOTS)
+ */
+int exec_slots(void);
+
+/**
+ * Register a connection as waiting for the job's result
+ *
+ * @param job Running job
+ * @param conn_id Mongoose connection id
+ * @return false if the job already has EXEC_MAX_SUBSCRIBERS
+ */
+bool exec_subscribe(struct exec_job *job, unsigned long conn_id);
+
+/**
+ * A connection closed: drop it from every job, and cancel the jobs that
+ * are left with nobody waiting for them
+ *
+ * @param conn_id Mongoose connection id
+ */
+void exec_unsubscribe(unsigned long conn_id);
+
+/**
+ * Stop a job: SIGTERM to its process group, SIGKILL after EXEC_KILL_GRACE_MS.
+ * A queued job is just taken off the queue.
+ *
+ * @param job Running job
+ * @param why Reported as job->end
+ */
+void exec_stop(struct exec_job *job, enum exec_end why);
+
+/**
+ * Whether any job is queued or running, or a finished job's cgroup leaf is
+ * still to be removed; the event loop must then wake up often enough to
+ * enforce deadlines and retry the removal
+ */
+bool exec_busy(void);
+
+#endif // EXEC_H
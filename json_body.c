@@ -0,0 +1,257 @@
+#include <string.h>
+#include "json_body.h"
+#include "arena.h"
+#include "trace.h"
+
+#define JSON_MAX_NESTING 64
+
+static const char *skip_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+// p points just past the opening quote. Returns the closing quote or NULL.
+// memchr() jumps over long unescaped runs, which is the common case for
+// file contents.
+static const char *scan_string(const char *p, const char *end) {
+    const char *start = p;
+    while (p < end) {
+        const char *q = memchr(p, '"', (size_t) (end - p));
+        if (q == NULL) return NULL;
+
+        // The quote is escaped if an odd number of backslashes precede it
+        size_t backslashes = 0;
+        while (q - backslashes > start && q[-1 - (long) backslashes] == '\\') backslashes++;
+        if ((backslashes & 1) == 0) return q;
+        p = q + 1;
+    }
+    return NULL;
+}
+
+// Skip any JSON value; returns the first byte after it or NULL
+static const char *skip_value(const char *p, const char *end) {
+    int depth = 0;
+    do {
+        p = skip_ws(p, end);
+        if (p >= end) return NULL;
+
+        if (*p == '"') {
+            p = scan_string(p + 1, end);
+            if (p == NULL) return NULL;
+            p++;
+        } else if (*p == '{' || *p == '[') {
+            if (++depth > JSON_MAX_NESTING) return NULL;
+            p++;
+        } else if (*p == '}' || *p == ']') {
+            if (--depth < 0) return NULL;
+            p++;
+        } else if (*p == ',' || *p == ':') {
+            if (depth == 0) return NULL;
+            p++;
+        } else {
+            // Number or literal: run up to the next delimiter
+            const char *q = p;
+            while (q < end && strchr(",:]}\" \t\r\n", *q) == NULL) q++;
+            if (q == p) return NULL;
+            p = q;
+        }
+    } while (depth > 0);
+    return p;
+}
+
+static int parse_body(struct mg_str body, struct json_field *fields, size_t count) {
+    const char *p = body.buf, *end = body.buf + body.len;
+    size_t remaining = count;
+
+    for (size_t i = 0; i < count; i++) {
+        fields[i].found = false;
+        fields[i].string = false;
+        fields[i].raw = mg_str_n(NULL, 0);
+    }
+
+    p = skip_ws(p, end);
+    if (p >= end || *p != '{') return -1;
+    p = skip_ws(p + 1, end);
+    if (p < end && *p == '}') return 0;
+
+    while (p < end) {
+        // Key
+        if (*p != '"') return -1;
+        const char *key = p + 1;
+        const char *key_end = scan_string(key, end);
+        if (key_end == NULL) return -1;
+        size_t key_len = (size_t) (key_end - key);
+
+        p = skip_ws(key_end + 1, end);
+        if (p >= end || *p != ':') return -1;
+        p = skip_ws(p + 1, end);
+        if (p >= end) return -1;
+
+        // Value: record views for wanted keys, skip everything else
+        struct json_field *want = NULL;
+        if (remaining > 0) {
+            for (size_t i = 0; i < count; i++) {
+                if (!fields[i].found && strlen(fields[i].name) == key_len &&
+                    memcmp(fields[i].name, key, key_len) == 0) {
+                    want = &fields[i];
+                    break;
+                }
+            }
+        }
+        if (want && *p != '"') {
+            const char *val_end = skip_value(p, end);
+            if (val_end == NULL) return -1;
+            want->raw = mg_str_n(p, (size_t) (val_end - p));
+            want->found = true;
+            remaining--;
+            p = val_end;
+        } else if (want) {
+            const char *val_end = scan_string(p + 1, end);
+            if (val_end == NULL) return -1;
+            want->raw = mg_str_n(p + 1, (size_t) (val_end - p - 1));
+            want->found = true;
+            want->string = true;
+            remaining--;
+            p = val_end + 1;
+        } else {
+            p = skip_value(p, end);
+            if (p == NULL) return -1;
+        }
+
+        p = skip_ws(p, end);
+        if (p >= end) return -1;
+        if (*p == '}') return 0;
+        if (*p != ',') return -1;
+        p = skip_ws(p + 1, end);
+    }
+    return -1;
+}
+
+int json_body_parse(struct mg_str body, struct json_field *fields, size_t count) {
+    uint64_t span = trace_begin();
+    int rc = parse_body(body, fields, count);
+    trace_end("json.parse", span);
+    return rc;
+}
+
+static int hex4(const char *s) {
+    int v = 0;
+    for (int i = 0; i < 4; i++) {
+        char ch = s[i];
+        v <<= 4;
+        if (ch >= '0' && ch <= '9') v |= ch - '0';
+        else if (ch >= 'a' && ch <= 'f') v |= ch - 'a' + 10;
+        else if (ch >= 'A' && ch <= 'F') v |= ch - 'A' + 10;
+        else return -1;
+    }
+    return v;
+}
+
+static size_t utf8_encode(unsigned long cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char) cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = (char) (0xc0 | (cp >> 6));
+        out[1] = (char) (0x80 | (cp & 0x3f));
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char) (0xe0 | (cp >> 12));
+        out[1] = (char) (0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (char) (0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (char) (0xf0 | (cp >> 18));
+    out[1] = (char) (0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (char) (0x80 | ((cp >> 6) & 0x3f));
+    out[3] = (char) (0x80 | (cp & 0x3f));
+    return 4;
+}
+
+// Decode one escape starting at in[0] == '\\'. Writes up to 4 bytes to out.
+// Returns the number of input bytes consumed, or 0 on error.
+static size_t decode_escape(const char *in, size_t len, char *out, size_t *out_len) {
+    if (len < 2) return 0;
+    *out_len = 1;
+    switch (in[1]) {
+        case '"': *out = '"'; return 2;
+        case '\\': *out = '\\'; return 2;
+        case '/': *out = '/'; return 2;
+        case 'b': *out = '\b'; return 2;
+        case 'f': *out = '\f'; return 2;
+        case 'n': *out = '\n'; return 2;
+        case 'r': *out = '\r'; return 2;
+        case 't': *out = '\t'; return 2;
+        case 'u': break;
+        default: return 0;
+    }
+
+    if (len < 6) return 0;
+    int hi = hex4(in + 2);
+    if (hi < 0) return 0;
+    size_t used = 6;
+    unsigned long cp = (unsigned long) hi;
+
+    // Characters outside the BMP arrive as a UTF-16 surrogate pair
+    if (hi >= 0xd800 && hi <= 0xdbff && len >= 12 && in[6] == '\\' && in[7] == 'u') {
+        int lo = hex4(in + 8);
+        if (lo >= 0xdc00 && lo <= 0xdfff) {
+            cp = 0x10000 + (((unsigned long) hi - 0xd800) << 10) + ((unsigned long) lo - 0xdc00);
+            used = 12;
+        }
+    }
+    *out_len = utf8_encode(cp, out);
+    return used;
+}
+
+long json_unescape(const char *in, size_t in_len, char *out) {
+    const char *p = in, *end = in + in_len;
+    char *o = out;
+
+    while (p < end) {
+        const char *bs = memchr(p, '\\', (size_t) (end - p));
+        size_t run = (size_t) ((bs ? bs : end) - p);
+        memcpy(o, p, run);
+        o += run;
+        p += run;
+        if (bs == NULL) break;
+
+        size_t n;
+        size_t used = decode_escape(p, (size_t) (end - p), o, &n);
+        if (used == 0) return -1;
+        o += n;
+        p += used;
+    }
+    return (long) (o - out);
+}
+
+char *json_field_str(const struct json_field *f, struct arena *a) {
+    if (!f->found || !f->string) return NULL;
+
+    char *buf = arena_alloc(a, f->raw.len + 1);
+    if (!buf) return NULL;
+    long n = json_unescape(f->raw.buf, f->raw.len, buf);
+    if (n < 0) return NULL;
+    buf[n] = '\0';
+    return buf;
+}
+
+bool json_field_write(const struct json_field *f, FILE *fp) {
+    if (!f->found || !f->string) return true;
+    const char *p = f->raw.buf, *end = f->raw.buf + f->raw.len;
+
+    while (p < end) {
+        const char *bs = memchr(p, '\\', (size_t) (end - p));
+        size_t run = (size_t) ((bs ? bs : end) - p);
+        if (run > 0 && fwrite(p, 1, run, fp) != run) return false;
+        p += run;
+        if (bs == NULL) break;
+
+        char ch[4];
+        size_t n;
+        size_t used = decode_escape(p, (size_t) (end - p), ch, &n);
+        if (used == 0 || fwrite(ch, 1, n, fp) != n) return false;
+        p += used;
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef JSON_BODY_H
+#define JSON_BODY_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "mongoose.h"
+
+// ============================================================================
+// NEXUS File Manager - Single-Pass JSON Request Body Parser
+// ============================================================================
+
+struct arena;
+
+/**
+ * A top-level field of a JSON object.
+ * `raw` points into the request body and still holds the JSON escapes;
+ * nothing is copied until the value is actually used. For numbers,
+ * booleans and null it is the literal token, for arrays and objects the
+ * whole value, brackets included.
+ */
+struct json_field {
+    const char *name;      // Key to look for (set by the caller)
+    struct mg_str raw;     // Escaped string contents without quotes, or the value as sent
+    bool found;            // Key present
+    bool string;           // The value is a JSON string
+};
+
+/**
+ * Extract several fields from a JSON object in one walk of the body
+ *
+ * @param body Request body
+ * @param fields Fields to fill in; `name` must be set
+ * @param count Number of fields
+ * @return 0 on success, -1 if the body is not a well-formed JSON object
+ */
+int json_body_parse(struct mg_str body, struct json_field *fields, size_t count);
+
+/**
+ * Unescape a field into an arena
+ *
+ * @param f Field filled by json_body_parse()
+ * @param a Arena for the result
+ * @return NUL-terminated value, or NULL if the field is missing, not a
+ *         string (null, a number, ...) or invalid, or if the arena ran out
+ *         of memory (a->failed tells that case apart)
+ */
+char *json_field_str(const struct json_field *f, struct arena *a);
+
+/**
+ * Unescape a field directly into a file, without an intermediate copy.
+ * Like a missing field, a value that is not a string writes nothing.
+ *
+ * @param f Field filled by json_body_parse()
+ * @param fp Destination stream
+ * @return true on success
+ */
+bool json_field_write(const struct json_field *f, FILE *fp);
+
+/**
+ * Unescape JSON string contents (supports \uXXXX including surrogate pairs)
+ *
+ * @param in Escaped contents, without quotes
+ * @param in_len Length of `in`
+ * @param out Destination, at least `in_len` bytes
+ * @return Number of bytes written, or -1 on a bad escape
+ */
+long json_unescape(const char *in, size_t in_len, char *out);
+
+#endif // JSON_BODY_H
@@ -0,0 +1,271 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json_writer.h"
+#include "api_handler.h"
+#include "compress.h"
+
+// Wide enough for any body size_t can describe
+#define CONTENT_LENGTH_DIGITS 20
+
+// mg_iobuf_add() resizes the buffer to the exact length on every call, which
+// makes appending a large body piece by piece quadratic. Grow geometrically
+// and copy in place instead.
+static bool reserve(struct mg_iobuf *io, size_t extra) {
+    if (io->size - io->len >= extra) return true;
+    size_t want = io->size * 2;
+    if (want < io->len + extra) want = io->len + extra;
+    return mg_iobuf_resize(io, want);
+}
+
+size_t iobuf_append(struct mg_iobuf *io, const void *data, size_t len) {
+    if (len == 0 || !reserve(io, len)) return 0;
+    memcpy(io->buf + io->len, data, len);
+    io->len += len;
+    return len;
+}
+
+static void put(struct json_writer *w, const char *s, size_t len) {
+    iobuf_append(w->io, s, len);
+}
+
+const char *http_status_text(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 409: return "Conflict";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "OK";
+    }
+}
+
+// Comma handling shared by every value and key
+static void value_prefix(struct json_writer *w) {
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    uint32_t bit = 1u << w->depth;
+    if (w->has_items & bit) put(w, ", ", 2);
+    w->has_items |= bit;
+}
+
+void http_body_begin(struct http_body *b, struct mg_connection *c, int status,
+                     const char *content_type) {
+    b->start_ofs = c->send.len;
+    mg_printf(c, "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: ",
+              status, http_status_text(status), content_type);
+    b->hdr_ofs = c->send.len - (sizeof("Content-Length: ") - 1);
+    b->len_ofs = c->send.len;
+    char blank[CONTENT_LENGTH_DIGITS + 4];
+    memset(blank, ' ', CONTENT_LENGTH_DIGITS);
+    memcpy(blank + CONTENT_LENGTH_DIGITS, "\r\n\r\n", 4);
+    iobuf_append(&c->send, blank, sizeof(blank));
+    b->body_ofs = c->send.len;
+    c->is_resp = 1;
+}
+
+// A HEAD request gets the headers of the GET response only; Content-Length
+// stays that of the body the GET would have had
+static void head_trim(struct mg_connection *c, size_t start_ofs) {
+    if (!request_state(c)->head) return;
+    struct mg_str rest = mg_str_n((char *) c->send.buf + start_ofs, c->send.len - start_ofs);
+    int hdr_len = mg_http_get_request_len((const unsigned char *) rest.buf, rest.len);
+    if (hdr_len > 0) c->send.len = start_ofs + (size_t) hdr_len;
+}
+
+size_t http_body_end(struct http_body *b, struct mg_connection *c) {
+    if (!compress_response(c, b->hdr_ofs, b->body_ofs)) {
+        char digits[CONTENT_LENGTH_DIGITS + 1];
+        // Left-aligned, space padded: header values may carry trailing whitespace
+        snprintf(digits, sizeof(digits), "%-*lu", CONTENT_LENGTH_DIGITS,
+                 (unsigned long) (c->send.len - b->body_ofs));
+        memcpy(c->send.buf + b->len_ofs, digits, CONTENT_LENGTH_DIGITS);
+    }
+    head_trim(c, b->start_ofs);
+    c->is_resp = 0;
+    return c->send.len - b->start_ofs;
+}
+
+void jw_begin(struct json_writer *w, struct mg_connection *c, int status) {
+    memset(w, 0, sizeof(*w));
+    w->c = c;
+    w->io = &c->send;
+    w->status = status;
+    http_body_begin(&w->body, c, status, "application/json");
+}
+
+void jw_begin_buf(struct json_writer *w, struct mg_iobuf *io) {
+    memset(w, 0, sizeof(*w));
+    w->io = io;
+}
+
+void jw_end(struct json_writer *w) {
+    request_replied(w->c, w->status, http_body_end(&w->body, w->c));
+}
+
+static void open_level(struct json_writer *w, char ch) {
+    value_prefix(w);
+    put(w, &ch, 1);
+    if (w->depth < JSON_WRITER_MAX_DEPTH - 1) w->depth++;
+    w->has_items &= ~(1u << w->depth);
+}
+
+static void close_level(struct json_writer *w, char ch) {
+    if (w->depth > 0) w->depth--;
+    put(w, &ch, 1);
+}
+
+void jw_object_begin(struct json_writer *w) { open_level(w, '{'); }
+void jw_object_end(struct json_writer *w) { close_level(w, '}'); }
+void jw_array_begin(struct json_writer *w) { open_level(w, '['); }
+void jw_array_end(struct json_writer *w) { close_level(w, ']'); }
+
+void jw_key(struct json_writer *w, const char *key) {
+    value_prefix(w);
+    put(w, "\"", 1);
+    json_escape_append(w->io, key, strlen(key));
+    put(w, "\": ", 3);
+    w->after_key = true;
+}
+
+void json_escape_append(struct mg_iobuf *io, const char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    size_t run = 0;
+
+    reserve(io, len + len / 8 + 16);
+
+    // Most bytes need no escaping, so copy them in runs
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = (unsigned char) s[i];
+        if (ch >= 0x20 && ch != '"' && ch != '\\') continue;
+
+        if (i > run) iobuf_append(io, s + run, i - run);
+        run = i + 1;
+
+        char esc[6] = {'\\', 0, 0, 0, 0, 0};
+        size_t n = 2;
+        switch (ch) {
+            case '"': esc[1] = '"'; break;
+            case '\\': esc[1] = '\\'; break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            case '\b': esc[1] = 'b'; break;
+            case '\f': esc[1] = 'f'; break;
+            default:
+                esc[1] = 'u';
+                esc[2] = '0';
+                esc[3] = '0';
+                esc[4] = hex[ch >> 4];
+                esc[5] = hex[ch & 15];
+                n = 6;
+                break;
+        }
+        reserve(io, n + (len - i));
+        iobuf_append(io, esc, n);
+    }
+    if (len > run) iobuf_append(io, s + run, len - run);
+}
+
+void jw_string_open(struct json_writer *w) {
+    value_prefix(w);
+    put(w, "\"", 1);
+}
+
+void jw_string_append(struct json_writer *w, const char *s, size_t len) {
+    json_escape_append(w->io, s, len);
+}
+
+void jw_string_close(struct json_writer *w) {
+    put(w, "\"", 1);
+}
+
+void jw_string_n(struct json_writer *w, const char *s, size_t len) {
+    jw_string_open(w);
+    json_escape_append(w->io, s, len);
+    jw_string_close(w);
+}
+
+void jw_string(struct json_writer *w, const char *s) {
+    if (s == NULL) {
+        jw_null(w);
+    } else {
+        jw_string_n(w, s, strlen(s));
+    }
+}
+
+void jw_int(struct json_writer *w, long long v) {
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%lld", v);
+    value_prefix(w);
+    put(w, buf, (size_t) n);
+}
+
+// Shortest form that reads back as the same double; JSON has no NaN or
+// infinity, so those are null
+void jw_double(struct json_writer *w, double v) {
+    if (!isfinite(v)) {
+        jw_null(w);
+        return;
+    }
+    char buf[32];
+    int n = 0;
+    for (int digits = 15; digits <= 17; digits++) {
+        n = snprintf(buf, sizeof(buf), "%.*g", digits, v);
+        if (strtod(buf, NULL) == v) break;
+    }
+    value_prefix(w);
+    put(w, buf, (size_t) n);
+}
+
+void jw_bool(struct json_writer *w, bool v) {
+    value_prefix(w);
+    if (v) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+}
+
+void jw_null(struct json_writer *w) {
+    value_prefix(w);
+    put(w, "null", 4);
+}
+
+void jw_kv_str(struct json_writer *w, const char *key, const char *s) {
+    jw_key(w, key);
+    jw_string(w, s);
+}
+
+void jw_kv_int(struct json_writer *w, const char *key, long long v) {
+    jw_key(w, key);
+    jw_int(w, v);
+}
+
+void jw_kv_double(struct json_writer *w, const char *key, double v) {
+    jw_key(w, key);
+    jw_double(w, v);
+}
+
+void jw_kv_bool(struct json_writer *w, const char *key, bool v) {
+    jw_key(w, key);
+    jw_bool(w, v);
+}
+
+void json_reply_error(struct mg_connection *c, int status, const char *message) {
+    struct json_writer w;
+    jw_begin(&w, c, status);
+    jw_object_begin(&w);
+    jw_kv_str(&w, "error", message);
+    jw_object_end(&w);
+    jw_end(&w);
+}
@@ -0,0 +1,155 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mongoose.h"
+
+// ============================================================================
+// NEXUS File Manager - Streaming JSON Response Writer
+// ============================================================================
+
+#define JSON_WRITER_MAX_DEPTH 32
+
+/**
+ * A response written straight into c->send. Headers go out first with a
+ * blank Content-Length that http_body_end() patches, so the body is never
+ * staged in a separate buffer.
+ */
+struct http_body {
+    size_t start_ofs;         // Offset of the status line
+    size_t hdr_ofs;           // Offset of the Content-Length header line
+    size_t len_ofs;           // Offset of the Content-Length digits
+    size_t body_ofs;          // Offset of the first body byte
+};
+
+/**
+ * Writes an HTTP response with a JSON body, see struct http_body
+ */
+struct json_writer {
+    struct mg_iobuf *io;      // Destination, normally &c->send
+    struct mg_connection *c;
+    struct http_body body;
+    int status;               // HTTP status code sent
+    int depth;                // Current nesting level
+    uint32_t has_items;       // Bit per level: a value was already written
+    bool after_key;           // Next value belongs to a key, no comma
+};
+
+/**
+ * Start a response: status line, JSON headers and a Content-Length placeholder
+ *
+ * @param w Writer to initialize
+ * @param c Mongoose connection
+ * @param status HTTP status code
+ */
+void jw_begin(struct json_writer *w, struct mg_connection *c, int status);
+
+/**
+ * Write a bare JSON value into a buffer instead, e.g. one line of a
+ * streamed response; there is nothing to finish
+ *
+ * @param w Writer to initialize
+ * @param io Buffer the value is appended to
+ */
+void jw_begin_buf(struct json_writer *w, struct mg_iobuf *io);
+
+/**
+ * Finish the response and patch Content-Length, or compress the body when
+ * the client negotiated a coding and the body is large enough
+ *
+ * @param w Writer
+ */
+void jw_end(struct json_writer *w);
+
+void jw_object_begin(struct json_writer *w);
+void jw_object_end(struct json_writer *w);
+void jw_array_begin(struct json_writer *w);
+void jw_array_end(struct json_writer *w);
+
+/**
+ * Write an object key; the next value call writes its value
+ */
+void jw_key(struct json_writer *w, const char *key);
+
+void jw_string(struct json_writer *w, const char *s);
+void jw_string_n(struct json_writer *w, const char *s, size_t len);
+void jw_int(struct json_writer *w, long long v);
+void jw_double(struct json_writer *w, double v);
+void jw_bool(struct json_writer *w, bool v);
+void jw_null(struct json_writer *w);
+
+/**
+ * String value in pieces: open the quote, append escaped chunks, close it.
+ * Used to stream file contents without loading them first.
+ */
+void jw_string_open(struct json_writer *w);
+void jw_string_append(struct json_writer *w, const char *s, size_t len);
+void jw_string_close(struct json_writer *w);
+
+// Key/value shorthands
+void jw_kv_str(struct json_writer *w, const char *key, const char *s);
+void jw_kv_int(struct json_writer *w, const char *key, long long v);
+void jw_kv_double(struct json_writer *w, const char *key, double v);
+void jw_kv_bool(struct json_writer *w, const char *key, bool v);
+
+/**
+ * Append raw bytes to an iobuf, growing it geometrically
+ *
+ * @param io Destination buffer
+ * @param data Bytes to append
+ * @param len Number of bytes
+ * @return Number of bytes appended (0 on allocation failure)
+ */
+size_t iobuf_append(struct mg_iobuf *io, const void *data, size_t len);
+
+/**
+ * Reason phrase for the status codes this server sends
+ *
+ * @param status HTTP status code
+ * @return Reason phrase, "OK" for unknown codes
+ */
+const char *http_status_text(int status);
+
+/**
+ * Append JSON-escaped bytes to an iobuf (no surrounding quotes)
+ *
+ * @param io Destination buffer
+ * @param s Source bytes
+ * @param len Number of bytes
+ */
+void json_escape_append(struct mg_iobuf *io, const char *s, size_t len);
+
+/**
+ * Start a response whose body the caller then appends to c->send: status
+ * line, Content-Type and a Content-Length placeholder
+ *
+ * @param b Offsets to fill in
+ * @param c Mongoose connection
+ * @param status HTTP status code
+ * @param content_type Content-Type header value
+ */
+void http_body_begin(struct http_body *b, struct mg_connection *c, int status,
+                     const char *content_type);
+
+/**
+ * Finish a response from http_body_begin(): compress the body when the
+ * client negotiated a coding and the body is large enough, else patch
+ * Content-Length. A HEAD request keeps the headers only.
+ *
+ * @param b Offsets from http_body_begin()
+ * @param c Mongoose connection
+ * @return Response size, headers included
+ */
+size_t http_body_end(struct http_body *b, struct mg_connection *c);
+
+/**
+ * Reply with {"error": message}
+ *
+ * @param c Mongoose connection
+ * @param status HTTP status code
+ * @param message Error text
+ */
+void json_reply_error(struct mg_connection *c, int status, const char *message);
+
+#endif // JSON_WRITER_H
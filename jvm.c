@@ -0,0 +1,590 @@
+#define _GNU_SOURCE         // prlimit()
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "exec.h"
+#include "jvm.h"
+#include "mongoose.h"
+
+#define SHORT_LIFE_MS 30000         // A JVM that dies sooner unclaimed counts as a failed start
+#define MAX_BACKOFF_MS 300000
+#define MAX_WORKERS 64              // Spares plus JVMs running a job's program
+#define CLIENT_BUF (64 * 1024)
+#define RUN_COLD (-1)               // worker_relay(): the JVM handed the step back
+#define REFILL_MS 200               // Claimed spares are replaced this often
+#define STATUS_KEEP_MS 5000         // A claimed JVM's zombie waits this long for its client
+
+/**
+ * A JVM started by the server: a spare until a job's client claims it by
+ * renaming spare.<slot> to claimed.<slot>, then that job's program
+ */
+struct worker {
+    pid_t pid;
+    unsigned long slot;
+    double started_ms;
+    double exited_ms;               // 0 while it runs
+};
+
+static bool enabled;
+static char jvm_dir[64];            // Spare files, compiled worker classes, log
+static char source[PATH_MAX];       // NexusJvm.java
+static char kotlin_home[PATH_MAX];  // "" without kotlinc
+static char heap[32] = "512m";
+static long spares = 2;
+static long idle_s = 900;
+static char wrapper[PATH_MAX + sizeof(jvm_dir) + 32];
+
+static struct worker workers[MAX_WORKERS];
+static int nworkers;
+static unsigned long next_slot = 1;
+static double retry_ms;             // No start before this
+static int failures;                // Short-lived spares in a row
+static bool wanted;                 // A Java or Kotlin job came; keep spares ready
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Full path of a program on PATH into buf; false if there is none
+static bool find_program(const char *name, char *buf, size_t size) {
+    const char *env = getenv("PATH");
+    char dirs[4096];
+    snprintf(dirs, sizeof(dirs), "%s", env != NULL ? env : "/usr/bin:/bin");
+    char *save = NULL;
+    for (char *d = strtok_r(dirs, ":", &save); d != NULL; d = strtok_r(NULL, ":", &save)) {
+        if (snprintf(buf, size, "%s/%s", d, name) >= (int) size) continue;
+        if (access(buf, X_OK) == 0) return true;
+    }
+    return false;
+}
+
+// Kotlin distribution the kotlinc on PATH belongs to: <home>/bin/kotlinc
+static void find_kotlin(void) {
+    char path[PATH_MAX], real[PATH_MAX], jar[PATH_MAX + 32];
+    kotlin_home[0] = '\0';
+    if (!find_program("kotlinc", path, sizeof(path)) || realpath(path, real) == NULL) return;
+    char *slash = strrchr(real, '/');
+    if (slash != NULL) *slash = '\0';
+    slash = strrchr(real, '/');
+    if (slash != NULL) *slash = '\0';
+    snprintf(jar, sizeof(jar), "%s/lib/kotlin-compiler.jar", real);
+    if (access(jar, R_OK) == 0) snprintf(kotlin_home, sizeof(kotlin_home), "%s", real);
+}
+
+static void refill_timer(void *arg);
+
+void jvm_init(struct mg_mgr *mgr) {
+    const char *s = getenv("NEXUS_JVM");
+    if (s == NULL || strcmp(s, "1") != 0) return;
+    // Like the JVM's own default in a container: a quarter of the job's memory
+    long long memory = exec_limits()->memory_max;
+    if (memory > 0) snprintf(heap, sizeof(heap), "%lldm", memory >> 22 > 16 ? memory >> 22 : 16);
+    if ((s = getenv("NEXUS_JVM_HEAP")) != NULL && *s) snprintf(heap, sizeof(heap), "%s", s);
+    if ((s = getenv("NEXUS_JVM_SPARES")) != NULL && atol(s) > 0) spares = atol(s);
+    if ((s = getenv("NEXUS_JVM_IDLE")) != NULL && atol(s) > 0) idle_s = atol(s);
+    if (spares > MAX_WORKERS / 2) spares = MAX_WORKERS / 2;
+
+    char exe[PATH_MAX], path[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (n <= 0) return;
+    exe[n] = '\0';
+    if ((s = getenv("NEXUS_JVM_SOURCE")) != NULL && *s) {
+        snprintf(source, sizeof(source), "%s", s);
+    } else {
+        char *slash = strrchr(exe, '/');
+        snprintf(source, sizeof(source), "%.*s/NexusJvm.java", (int) (slash - exe), exe);
+    }
+    if (access(source, R_OK) != 0) {
+        MG_INFO(("jvm: %s not found, warm JVM disabled", source));
+        return;
+    }
+    if (!find_program("java", path, sizeof(path)) || !find_program("javac", path, sizeof(path))) {
+        MG_INFO(("jvm: no java/javac on PATH, warm JVM disabled"));
+        return;
+    }
+    // A fresh directory only we can write: the spare files in it are trusted
+    snprintf(jvm_dir, sizeof(jvm_dir), "/tmp/nexus_jvm_XXXXXX");
+    if (mkdtemp(jvm_dir) == NULL) {
+        MG_ERROR(("jvm: cannot create %s: %s", jvm_dir, strerror(errno)));
+        return;
+    }
+    find_kotlin();
+    snprintf(wrapper, sizeof(wrapper), "'%s' " JVM_FLAG " '%s' ", exe, jvm_dir);
+    enabled = true;
+    mg_timer_add(mgr, REFILL_MS, MG_TIMER_REPEAT, refill_timer, NULL);
+    MG_INFO(("jvm: warm JVMs in %s, %ld spare, heap %s, kotlin %s", jvm_dir, spares, heap,
+             kotlin_home[0] != '\0' ? kotlin_home : "not found"));
+}
+
+static void slot_path(char *buf, size_t size, const char *state, unsigned long slot) {
+    snprintf(buf, size, "%s/%s.%lu", jvm_dir, state, slot);
+}
+
+// Whether the worker classes are newer than NexusJvm.java
+static bool classes_fresh(void) {
+    char path[sizeof(jvm_dir) + 32];
+    snprintf(path, sizeof(path), "%s/classes/NexusJvm.class", jvm_dir);
+    struct stat cs, ss;
+    return stat(path, &cs) == 0 && stat(source, &ss) == 0 && cs.st_mtime > ss.st_mtime;
+}
+
+// Start a spare JVM, detached from the server's process group. The first
+// one compiles the worker classes. Each spare warms up, advertises itself
+// in spare.<slot>, serves the one client that claims it and exits; it
+// never outlives the server.
+static void spare_start(void) {
+    char classes[sizeof(jvm_dir) + 16], log[sizeof(jvm_dir) + 16];
+    snprintf(classes, sizeof(classes), "%s/classes", jvm_dir);
+    snprintf(log, sizeof(log), "%s/jvm.log", jvm_dir);
+    char command[PATH_MAX * 4 + 512];
+    snprintf(command, sizeof(command),
+             "{ [ '%s/NexusJvm.class' -nt '%s' ] || javac -nowarn -d '%s' '%s'; } && "
+             "exec java '-Xmx%s' -XX:MaxMetaspaceSize=256m -XX:+UseSerialGC "
+             "-XX:+ExitOnOutOfMemoryError -Dfile.encoding=UTF-8 "
+             "-cp '%s' NexusJvm '%s' %d %lu %ld '%s'",
+             classes, source, classes, source, heap, classes, jvm_dir, (int) getpid(),
+             next_slot, idle_s, kotlin_home);
+    pid_t pid = fork();
+    if (pid < 0) {
+        MG_ERROR(("jvm: fork: %s", strerror(errno)));
+        return;
+    }
+    if (pid == 0) {
+        setsid();
+        int null = open("/dev/null", O_RDONLY);
+        int out = open(log, O_WRONLY | O_CREAT | O_APPEND, 0600);
+        if (null >= 0) dup2(null, STDIN_FILENO);
+        if (out >= 0) {
+            dup2(out, STDOUT_FILENO);
+            dup2(out, STDERR_FILENO);
+        }
+        for (int fd = 3; fd < 1024; fd++) close(fd);
+        execl("/bin/sh", "sh", "-c", command, (char *) NULL);
+        _exit(127);
+    }
+    struct worker *w = &workers[nworkers++];
+    memset(w, 0, sizeof(*w));
+    w->pid = pid;
+    w->slot = next_slot++;
+    w->started_ms = now_ms();
+    MG_DEBUG(("jvm: starting spare %lu, pid %d", w->slot, (int) pid));
+}
+
+// Forget the workers that exited; returns how many are spare or starting.
+// A claimed JVM stays a zombie until its client renamed claimed.<slot> to
+// done.<slot>, or for STATUS_KEEP_MS, so the client can read how it ended
+// (worker_status()).
+static int workers_reap(void) {
+    int waiting = 0;
+    double now = now_ms();
+    for (int i = 0; i < nworkers;) {
+        struct worker *w = &workers[i];
+        char spare[sizeof(jvm_dir) + 32], claimed[sizeof(jvm_dir) + 32], done[sizeof(jvm_dir) + 32];
+        slot_path(spare, sizeof(spare), "spare", w->slot);
+        slot_path(claimed, sizeof(claimed), "claimed", w->slot);
+        slot_path(done, sizeof(done), "done", w->slot);
+        bool running = access(claimed, F_OK) == 0;
+        bool taken = running || access(done, F_OK) == 0;
+        siginfo_t info;
+        memset(&info, 0, sizeof(info));
+        if (w->exited_ms == 0 &&
+            waitid(P_PID, (id_t) w->pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 &&
+            info.si_pid != 0) {
+            w->exited_ms = now;
+        }
+        if (w->exited_ms == 0 || (running && now - w->exited_ms < STATUS_KEEP_MS)) {
+            if (w->exited_ms == 0 && !taken) waiting++;
+            i++;
+            continue;
+        }
+        waitpid(w->pid, NULL, 0);
+
+        // Gone: its step ended, it sat idle, or it never came up. A claimed
+        // JVM's files (spare.<slot>, if it was cut short) are its client's.
+        double lived = w->exited_ms - w->started_ms;
+        if (taken || lived >= SHORT_LIFE_MS) {
+            failures = 0;
+        } else {
+            failures++;
+            double backoff = 1000.0 * (1 << (failures < 9 ? failures : 9));
+            retry_ms = now + (backoff < MAX_BACKOFF_MS ? backoff : MAX_BACKOFF_MS);
+            MG_INFO(("jvm: spare %d exited after %.0f s, backing off", (int) w->pid, lived / 1e3));
+        }
+        unlink(spare);
+        unlink(claimed);
+        unlink(done);
+        *w = workers[--nworkers];
+    }
+    return waiting;
+}
+
+// Reap and start spares up to NEXUS_JVM_SPARES
+static void spares_refill(void) {
+    int waiting = workers_reap();
+    // Until the classes exist, one spare compiles them and the rest wait
+    long want = classes_fresh() ? spares : (nworkers == 0 ? 1 : 0);
+    while (waiting < want && nworkers < MAX_WORKERS && now_ms() >= retry_ms) {
+        spare_start();
+        waiting++;
+    }
+}
+
+static void refill_timer(void *arg) {
+    (void) arg;
+    if (wanted) spares_refill();
+}
+
+const char *jvm_wrapper(void) {
+    if (!enabled) return "";
+    wanted = true;
+    spares_refill();
+    return wrapper;
+}
+
+// ----------------------------------------------------------------------------
+// Client: --jvm
+// ----------------------------------------------------------------------------
+
+// The step without the warm JVM
+static int run_cold(int argc, char **argv) {
+    char *cold[64];
+    int n = 0;
+    const char *step = argv[0];
+    if (strcmp(step, "javac") == 0 && argc >= 3) {
+        cold[n++] = "javac";
+        cold[n++] = "-d";
+        cold[n++] = argv[1];
+        cold[n++] = argv[2];
+    } else if (strcmp(step, "java") == 0 && argc >= 3) {
+        cold[n++] = "java";
+        cold[n++] = "-cp";
+        cold[n++] = argv[1];
+        cold[n++] = argv[2];
+    } else if (strcmp(step, "kotlinc") == 0 && argc >= 3) {
+        cold[n++] = "kotlinc";
+        cold[n++] = argv[1];
+        cold[n++] = "-include-runtime";
+        cold[n++] = "-d";
+        cold[n++] = argv[2];
+    } else if (strcmp(step, "java-jar") == 0 && argc >= 2) {
+        cold[n++] = "java";
+        cold[n++] = "-jar";
+        cold[n++] = argv[1];
+    } else {
+        fprintf(stderr, "usage: %s <dir> javac|java|kotlinc|java-jar <args>\n", JVM_FLAG);
+        return 2;
+    }
+    cold[n] = NULL;
+    execvp(cold[0], cold);
+    fprintf(stderr, "%s: %s\n", cold[0], strerror(errno));
+    return 127;
+}
+
+static char claim[PATH_MAX];        // claimed.<slot> of our JVM, "" before the claim
+static char claim_done[PATH_MAX];   // done.<slot>: the server may reap it
+
+// Claim a spare JVM in dir: renaming spare.<slot> to claimed.<slot> is
+// atomic, so of several clients only one gets each spare
+static bool worker_claim(const char *dir, int *port, char *token, pid_t *pid) {
+    DIR *d = opendir(dir);
+    if (d == NULL) return false;
+    bool ok = false;
+    struct dirent *e;
+    while (!ok && (e = readdir(d)) != NULL) {
+        char *end;
+        if (strncmp(e->d_name, "spare.", 6) != 0) continue;
+        unsigned long slot = strtoul(e->d_name + 6, &end, 10);
+        if (end == e->d_name + 6 || *end != '\0') continue;
+        char spare[PATH_MAX], claimed[PATH_MAX];
+        if (snprintf(spare, sizeof(spare), "%s/%s", dir, e->d_name) >= (int) sizeof(spare) ||
+            snprintf(claimed, sizeof(claimed), "%s/claimed.%lu", dir, slot) >= (int) sizeof(claimed) ||
+            snprintf(claim_done, sizeof(claim_done), "%s/done.%lu", dir, slot) >= (int) sizeof(claim_done) ||
+            rename(spare, claimed) != 0) {
+            continue;
+        }
+        snprintf(claim, sizeof(claim), "%s", claimed);
+        FILE *fp = fopen(claimed, "r");
+        int p = 0;
+        ok = fp != NULL && fscanf(fp, "%d %63s %d", port, token, &p) == 3 &&
+             *port > 0 && *port <= 65535 && p > 0;
+        if (fp != NULL) fclose(fp);
+        *pid = (pid_t) p;
+    }
+    closedir(d);
+    return ok;
+}
+
+// Done with the claimed JVM, whatever became of it
+static void worker_release(void) {
+    if (claim[0] != '\0') rename(claim, claim_done);
+    claim[0] = '\0';
+}
+
+// cgroup v2 path of a process, e.g. "/nexus/job-42"; false if unknown
+static bool cgroup_of(pid_t pid, char *buf, size_t size) {
+    char path[64], line[PATH_MAX];
+    snprintf(path, sizeof(path), "/proc/%d/cgroup", (int) pid);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return false;
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), fp) != NULL) {
+        if (strncmp(line, "0::", 3) != 0) continue;
+        line[strcspn(line, "\n")] = '\0';
+        found = snprintf(buf, size, "%s", line + 3) < (int) size;
+    }
+    fclose(fp);
+    return found;
+}
+
+// CPU seconds a process has used, rounded up; -1 if unknown
+static long cpu_seconds(pid_t pid) {
+    char path[64], stat[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, stat, sizeof(stat) - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    stat[n] = '\0';
+    const char *p = strrchr(stat, ')');
+    unsigned long utime, stime;
+    if (p == NULL || sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                            &utime, &stime) != 2) {
+        return -1;
+    }
+    long tick = sysconf(_SC_CLK_TCK);
+    return tick > 0 ? (long) ((utime + stime + (unsigned long) tick - 1) / (unsigned long) tick) : -1;
+}
+
+// Put the claimed JVM under this job: into our cgroup, so the job's memory,
+// pids and CPU limits, its counters and its kill cover the program, and
+// under our CPU time limit on top of what warming up took
+static bool worker_adopt(pid_t pid) {
+    char own[PATH_MAX], theirs[PATH_MAX], procs[PATH_MAX + 32];
+    if (cgroup_of(getpid(), own, sizeof(own)) && cgroup_of(pid, theirs, sizeof(theirs)) &&
+        strcmp(own, theirs) != 0) {
+        snprintf(procs, sizeof(procs), "/sys/fs/cgroup%s/cgroup.procs", own);
+        int fd = open(procs, O_WRONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        char num[16];
+        int len = snprintf(num, sizeof(num), "%d", (int) pid);
+        bool moved = write(fd, num, (size_t) len) == len;
+        close(fd);
+        if (!moved) return false;
+    }
+    struct rlimit cpu;
+    if (getrlimit(RLIMIT_CPU, &cpu) != 0) return false;
+    if (cpu.rlim_cur == RLIM_INFINITY) return true;
+    long used = cpu_seconds(pid);
+    if (used < 0) return false;
+    cpu.rlim_cur += (rlim_t) used;
+    if (cpu.rlim_max != RLIM_INFINITY) cpu.rlim_max += (rlim_t) used;
+    return prlimit(pid, RLIMIT_CPU, &cpu, NULL) == 0;
+}
+
+// Claim a spare, adopt it and send it the step; -1 if there is none
+static int worker_connect(const char *dir, int argc, char **argv, pid_t *pid) {
+    char token[64];
+    int port = 0;
+    *pid = 0;
+    if (!worker_claim(dir, &port, token, pid)) return -1;
+    if (!worker_adopt(*pid)) {
+        kill(*pid, SIGKILL);
+        *pid = 0;
+        return -1;
+    }
+
+    // One header: token, step and arguments, a line each. Paths are made
+    // absolute here, so the JVM's own directory never matters.
+    char cwd[PATH_MAX], header[8192];
+    int fd = -1;
+    size_t len = 0;
+    if (getcwd(cwd, sizeof(cwd)) != NULL) {
+        len = (size_t) snprintf(header, sizeof(header), "NEXUS1 %s\n%s\n%d\n", token, argv[0],
+                                argc - 1);
+        for (int i = 1; i < argc && len < sizeof(header); i++) {
+            if (strchr(argv[i], '\n') != NULL) len = sizeof(header);
+            if (len >= sizeof(header)) break;
+            bool path = i == 1 || (i == 2 && strcmp(argv[0], "java") != 0);
+            bool relative = path && argv[i][0] != '/';
+            len += (size_t) snprintf(header + len, sizeof(header) - len, "%s%s%s\n",
+                                     relative ? cwd : "", relative ? "/" : "", argv[i]);
+        }
+        if (len < sizeof(header)) fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    }
+    if (fd >= 0) {
+        struct sockaddr_in sin;
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons((uint16_t) port);
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, (struct sockaddr *) &sin, sizeof(sin)) != 0 ||
+            send(fd, header, len, MSG_NOSIGNAL) != (ssize_t) len) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    // A claimed spare serves nobody else
+    if (fd < 0) {
+        kill(*pid, SIGKILL);
+        *pid = 0;
+    }
+    return fd;
+}
+
+// Exit status of the JVM after it closed the connection without sending
+// one: it was killed (e.g. SIGXCPU) or halted. The server reaps it, so it
+// is read from the zombie's /proc entry while that lasts.
+static int worker_status(pid_t pid) {
+    char path[64], stat[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+    for (int tries = 0; tries < 100; tries++) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return -1;
+        ssize_t n = read(fd, stat, sizeof(stat) - 1);
+        close(fd);
+        if (n <= 0) return -1;
+        stat[n] = '\0';
+        const char *p = strrchr(stat, ')');
+        if (p != NULL && p[1] == ' ' && p[2] == 'Z') {
+            const char *last = strrchr(stat, ' ');
+            int code = last != NULL ? atoi(last + 1) : 0;
+            return WIFSIGNALED(code) ? 128 + WTERMSIG(code) : WEXITSTATUS(code);
+        }
+        usleep(10000);
+    }
+    return -1;
+}
+
+static volatile sig_atomic_t stop_signal;
+
+static void on_stop(int sig) {
+    stop_signal = sig;
+}
+
+static bool write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+// Relay stdin and the program's output until its exit status; RUN_COLD
+// when the JVM cannot take the step
+static int worker_relay(int fd, pid_t worker) {
+    // The job being stopped stops the program, which is in another session
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+
+    // stdin goes up in frames, output comes back in frames; both at once,
+    // so a program reading while it writes never deadlocks
+    static char in[CLIENT_BUF + 5], buf[CLIENT_BUF + 5];
+    size_t in_len = 0, in_off = 0, buf_len = 0;
+    bool in_eof = false, output = false;
+    for (;;) {
+        if (stop_signal != 0) {
+            kill(worker, SIGKILL);
+            return 128 + stop_signal;
+        }
+        struct pollfd fds[2] = {{fd, POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+        if (in_off < in_len) fds[0].events |= POLLOUT;
+        bool want_stdin = !in_eof && in_off == in_len;
+        if (poll(fds, want_stdin ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (want_stdin && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            ssize_t n = read(STDIN_FILENO, in + 5, CLIENT_BUF);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) in_eof = true;
+            n = n > 0 ? n : 0;
+            in[0] = JVM_FRAME_IN;
+            in[1] = (char) (n >> 24);
+            in[2] = (char) (n >> 16);
+            in[3] = (char) (n >> 8);
+            in[4] = (char) n;
+            in_off = 0;
+            in_len = (size_t) n + 5;
+        }
+        if ((fds[0].revents & POLLOUT) && in_off < in_len) {
+            ssize_t n = send(fd, in + in_off, in_len - in_off, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n > 0) in_off += (size_t) n;
+            else if (n < 0 && errno != EAGAIN && errno != EINTR) in_off = in_len;
+        }
+        if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        ssize_t n = recv(fd, buf + buf_len, sizeof(buf) - buf_len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        buf_len += (size_t) n;
+
+        // Frames both ways: type, 4-byte big-endian length, payload
+        size_t off = 0;
+        while (buf_len - off >= 5) {
+            const unsigned char *h = (const unsigned char *) buf + off;
+            size_t len = (size_t) h[1] << 24 | (size_t) h[2] << 16 | (size_t) h[3] << 8 | h[4];
+            if (len > CLIENT_BUF) {
+                fprintf(stderr, "nexus: bad frame from the warm JVM\n");
+                kill(worker, SIGKILL);
+                return 1;
+            }
+            if (buf_len - off < 5 + len) break;
+            const char *p = buf + off + 5;
+            if (h[0] == JVM_FRAME_OUT || h[0] == JVM_FRAME_ERR) {
+                write_all(h[0] == JVM_FRAME_OUT ? STDOUT_FILENO : STDERR_FILENO, p, len);
+                output = true;
+            } else if (h[0] == JVM_FRAME_EXIT && len == 4) {
+                const unsigned char *x = (const unsigned char *) p;
+                return (int) ((uint32_t) x[0] << 24 | (uint32_t) x[1] << 16 |
+                              (uint32_t) x[2] << 8 | x[3]);
+            } else if (h[0] == JVM_FRAME_FALLBACK && !output) {
+                return RUN_COLD;
+            }
+            off += 5 + len;
+        }
+        memmove(buf, buf + off, buf_len - off);
+        buf_len -= off;
+    }
+    int status = worker_status(worker);
+    if (status > 128) return status;        // Killed, e.g. over the CPU limit
+    fprintf(stderr, "nexus: the warm JVM stopped during the run\n");
+    return 1;
+}
+
+int jvm_main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <dir> javac|java|kotlinc|java-jar <args>\n", JVM_FLAG);
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    pid_t worker;
+    int fd = worker_connect(argv[0], argc - 1, argv + 1, &worker);
+    int status = fd < 0 ? RUN_COLD : worker_relay(fd, worker);
+    if (fd >= 0) close(fd);
+    worker_release();
+    return status == RUN_COLD ? run_cold(argc - 1, argv + 1) : status;
+}
@@ -0,0 +1,62 @@
+#ifndef JVM_H
+#define JVM_H
+
+#include <stdbool.h>
+#include "mongoose.h"
+
+// ============================================================================
+// NEXUS File Manager - Warm JVM
+// ============================================================================
+
+// Java and Kotlin jobs call back into this binary, which hands the compile
+// or run to a spare JVM started ahead of time (NexusJvm.java) instead of
+// starting one:
+//   file_manager --jvm <dir> javac <class-dir> <source>
+//   file_manager --jvm <dir> java <class-path> <main-class>
+//   file_manager --jvm <dir> kotlinc <source> <jar>
+//   file_manager --jvm <dir> java-jar <jar>
+// The client claims a spare, moves it into the job's cgroup and under its
+// CPU time limit, and the spare runs that one step. When no spare is ready
+// the client runs the usual cold command, so a job never waits for one.
+#define JVM_FLAG "--jvm"
+
+#define JVM_FRAME_OUT 'o'           // JVM -> client: stdout bytes
+#define JVM_FRAME_ERR 'e'           // JVM -> client: stderr bytes
+#define JVM_FRAME_EXIT 'x'          // JVM -> client: exit status, 4 bytes
+#define JVM_FRAME_FALLBACK 'f'      // JVM -> client: run the cold command
+#define JVM_FRAME_IN 'i'            // Client -> JVM: stdin bytes, empty at EOF
+
+/**
+ * Read the settings from the environment:
+ *   NEXUS_JVM          1 enables warm JVMs when java and javac are on
+ *                      PATH (default off)
+ *   NEXUS_JVM_HEAP     -Xmx of each JVM (default a quarter of the job
+ *                      memory limit)
+ *   NEXUS_JVM_SPARES   warm JVMs kept ready (default 2)
+ *   NEXUS_JVM_IDLE     seconds an unclaimed spare waits (default 900)
+ *   NEXUS_JVM_SOURCE   NexusJvm.java (default: next to the server binary)
+ * Call after exec_init(). Nothing is started until the first Java or
+ * Kotlin job; from then on claimed spares are replaced in the background.
+ *
+ * @param mgr Event manager whose loop replaces the spares
+ */
+void jvm_init(struct mg_mgr *mgr);
+
+/**
+ * Command prefix that routes a Java or Kotlin step through the warm JVM,
+ * e.g. "'/usr/bin/file_manager' --jvm '/tmp/nexus_jvm_AbC123' ", or "" when
+ * it is off. Starts spares in the background up to NEXUS_JVM_SPARES; after
+ * spares die young, starts back off up to five minutes.
+ */
+const char *jvm_wrapper(void);
+
+/**
+ * Client entry point: one compile or run through the warm JVM
+ *
+ * @param argc Number of arguments
+ * @param argv JVM directory, the step and its arguments
+ * @return Exit status of the compile or program
+ */
+int jvm_main(int argc, char **argv);
+
+#endif // JVM_H
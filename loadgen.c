@@ -0,0 +1,642 @@
+// ============================================================================
+// NEXUS File Manager - HTTP Load Generator (benchmark tool)
+// ============================================================================
+//
+// Drives the web server's routes at a fixed concurrency and reports
+// throughput and latency percentiles as JSON, so runs can be compared over
+// time. It can build its own synthetic workspace and start a local server.
+//
+// Usage: ./loadgen [options]
+//   --url HOST:PORT        Server to test (default 127.0.0.1:8080)
+//   --spawn PATH           Start this server binary first, on the --url port,
+//                          and stop it at the end
+//   --workspace DIR        Synthetic workspace (default /tmp/nexus-bench)
+//   --huge-entries N       Files in the large directory (default 100000)
+//   --big-mb N             Size of the large file in MB (default 1024, 0 = none)
+//   --routes LIST          Comma separated scenarios (default: all)
+//   --concurrency N        Parallel connections (default 8)
+//   --duration SEC         Seconds per scenario (default 10)
+//   --requests N           Stop a scenario after N requests instead
+//   --no-keepalive         New connection for every request
+//   --out FILE             Write the JSON report here (default stdout)
+//
+// Built by `./build.sh bench`, or: gcc -O2 -o loadgen loadgen.c -lpthread
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SMALL_FILES 200
+#define SMALL_FILE_SIZE 1024
+#define READ_BUF 65536
+
+struct options {
+    char host[256];
+    char port[16];
+    const char *spawn;
+    const char *workspace;
+    long huge_entries;
+    long big_mb;
+    const char *routes;
+    int concurrency;
+    double duration;
+    long requests;
+    bool keepalive;
+    const char *out;
+};
+
+struct scenario {
+    const char *name;
+    const char *method;
+    char path[2048];
+    char body[4096];            // Empty for GET; "%d" fields are filled per request
+    bool enabled;
+};
+
+struct latencies {
+    uint32_t *us;
+    size_t len, cap;
+};
+
+struct worker {
+    const struct options *opt;
+    const struct scenario *sc;
+    pthread_t thread;
+    int id;
+    struct latencies lat;
+    uint64_t bytes;
+    long errors;
+};
+
+struct result {
+    const char *name;
+    long requests, errors;
+    double seconds;
+    uint64_t bytes;
+    uint32_t p50, p90, p99, p999, max;
+    double mean;
+};
+
+static double deadline;
+static long quota;          // Requests left when --requests is used, shared
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// ----------------------------------------------------------------------------
+// Synthetic workspace
+// ----------------------------------------------------------------------------
+
+static int write_file(const char *path, const char *data, size_t len) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) return -1;
+    size_t n = fwrite(data, 1, len, fp);
+    return fclose(fp) == 0 && n == len ? 0 : -1;
+}
+
+static long count_entries(const char *dir) {
+    char cmd[1200];
+    snprintf(cmd, sizeof(cmd), "ls -f '%s' 2>/dev/null | wc -l", dir);
+    FILE *p = popen(cmd, "r");
+    long n = 0;
+    if (p) {
+        if (fscanf(p, "%ld", &n) != 1) n = 0;
+        pclose(p);
+    }
+    return n > 2 ? n - 2 : 0;   // . and ..
+}
+
+// Creates what is missing; an existing workspace of the right shape is reused
+static int setup_workspace(const struct options *opt) {
+    char path[1024], line[SMALL_FILE_SIZE];
+    const char *ws = opt->workspace;
+
+    mkdir(ws, 0755);
+    snprintf(path, sizeof(path), "%s/small", ws);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/huge", ws);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/scratch", ws);
+    mkdir(path, 0755);
+
+    // Text with quotes, backslashes and newlines so escaping is exercised
+    for (size_t i = 0; i < sizeof(line); i++) line[i] = "abc \"def\\ ghi\n"[i % 14];
+    for (int i = 0; i < SMALL_FILES; i++) {
+        snprintf(path, sizeof(path), "%s/small/f%04d.txt", ws, i);
+        if (access(path, F_OK) == 0) continue;
+        if (write_file(path, line, sizeof(line)) != 0) return -1;
+    }
+    snprintf(path, sizeof(path), "%s/small/hello.sh", ws);
+    if (write_file(path, "echo hello\n", 11) != 0) return -1;
+
+    snprintf(path, sizeof(path), "%s/huge", ws);
+    if (count_entries(path) < opt->huge_entries) {
+        fprintf(stderr, "loadgen: creating %ld files in %s\n", opt->huge_entries, path);
+        for (long i = 0; i < opt->huge_entries; i++) {
+            snprintf(path, sizeof(path), "%s/huge/entry_%07ld.dat", ws, i);
+            int fd = open(path, O_CREAT | O_WRONLY, 0644);
+            if (fd < 0) return -1;
+            close(fd);
+        }
+    }
+
+    if (opt->big_mb > 0) {
+        struct stat st;
+        off_t want = (off_t) opt->big_mb * 1024 * 1024;
+        snprintf(path, sizeof(path), "%s/big.txt", ws);
+        if (stat(path, &st) != 0 || st.st_size != want) {
+            fprintf(stderr, "loadgen: writing %ld MB to %s\n", opt->big_mb, path);
+            FILE *fp = fopen(path, "w");
+            if (!fp) return -1;
+            for (off_t done = 0; done < want; done += (off_t) sizeof(line)) {
+                size_t n = want - done < (off_t) sizeof(line) ? (size_t) (want - done) : sizeof(line);
+                if (fwrite(line, 1, n, fp) != n) {
+                    fclose(fp);
+                    return -1;
+                }
+            }
+            if (fclose(fp) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Minimal HTTP/1.1 client
+// ----------------------------------------------------------------------------
+
+struct conn {
+    int fd;
+    char buf[READ_BUF];
+    size_t len, pos;
+};
+
+static int conn_open(struct conn *c, const struct options *opt) {
+    struct addrinfo hints = {0}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(opt->host, opt->port, &hints, &res) != 0) return -1;
+    c->fd = socket(res->ai_family, SOCK_STREAM, 0);
+    if (c->fd >= 0 && connect(c->fd, res->ai_addr, res->ai_addrlen) != 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+    freeaddrinfo(res);
+    if (c->fd < 0) return -1;
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c->len = c->pos = 0;
+    return 0;
+}
+
+static void conn_close(struct conn *c) {
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+}
+
+static int fill(struct conn *c) {
+    if (c->pos == c->len) c->pos = c->len = 0;
+    if (c->len == sizeof(c->buf)) {
+        memmove(c->buf, c->buf + c->pos, c->len - c->pos);
+        c->len -= c->pos;
+        c->pos = 0;
+    }
+    ssize_t n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+    if (n <= 0) return -1;
+    c->len += (size_t) n;
+    return 0;
+}
+
+// Read one CRLF-terminated line (without the CRLF)
+static int read_line(struct conn *c, char *out, size_t size) {
+    for (;;) {
+        char *nl = memchr(c->buf + c->pos, '\n', c->len - c->pos);
+        if (nl) {
+            size_t n = (size_t) (nl - (c->buf + c->pos));
+            if (n > 0 && nl[-1] == '\r') n--;
+            if (n >= size) n = size - 1;
+            memcpy(out, c->buf + c->pos, n);
+            out[n] = '\0';
+            c->pos = (size_t) (nl - c->buf) + 1;
+            return 0;
+        }
+        if (fill(c) != 0) return -1;
+    }
+}
+
+static int skip_bytes(struct conn *c, uint64_t n) {
+    while (n > 0) {
+        if (c->pos == c->len && fill(c) != 0) return -1;
+        size_t take = c->len - c->pos;
+        if (take > n) take = (size_t) n;
+        c->pos += take;
+        n -= take;
+    }
+    return 0;
+}
+
+// Send a request and consume the response. Returns the status or -1.
+static int http_request(struct conn *c, const struct scenario *sc, const char *body,
+                        bool keepalive, uint64_t *bytes, bool *server_closes) {
+    char req[8192];
+    size_t blen = strlen(body);
+    int n = snprintf(req, sizeof(req),
+                     "%s %s HTTP/1.1\r\nHost: bench\r\nAccept-Encoding: gzip, br\r\n"
+                     "Connection: %s\r\nContent-Type: application/json\r\n"
+                     "Content-Length: %lu\r\n\r\n%s",
+                     sc->method, sc->path, keepalive ? "keep-alive" : "close",
+                     (unsigned long) blen, body);
+    if (n < 0 || (size_t) n >= sizeof(req) || send(c->fd, req, (size_t) n, MSG_NOSIGNAL) != n) {
+        return -1;
+    }
+
+    char line[1024];
+    int status;
+    if (read_line(c, line, sizeof(line)) != 0 || sscanf(line, "HTTP/1.%*d %d", &status) != 1) {
+        return -1;
+    }
+
+    long long length = -1;
+    bool chunked = false;
+    *server_closes = !keepalive;
+    for (;;) {
+        if (read_line(c, line, sizeof(line)) != 0) return -1;
+        if (line[0] == '\0') break;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) length = atoll(line + 15);
+        if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line, "chunked")) chunked = true;
+        if (strncasecmp(line, "Connection:", 11) == 0 && strstr(line, "close")) *server_closes = true;
+    }
+
+    if (chunked) {
+        for (;;) {
+            if (read_line(c, line, sizeof(line)) != 0) return -1;
+            unsigned long long size = strtoull(line, NULL, 16);
+            if (skip_bytes(c, size + 2) != 0) return -1;
+            *bytes += size;
+            if (size == 0) break;
+        }
+    } else if (length >= 0) {
+        if (skip_bytes(c, (uint64_t) length) != 0) return -1;
+        *bytes += (uint64_t) length;
+    } else {
+        // Body runs until the server closes
+        while (fill(c) == 0) {
+            *bytes += c->len - c->pos;
+            c->pos = c->len;
+        }
+        *server_closes = true;
+    }
+    return status;
+}
+
+// ----------------------------------------------------------------------------
+// Scenario runner
+// ----------------------------------------------------------------------------
+
+static void lat_push(struct latencies *l, uint32_t us) {
+    if (l->len == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 4096;
+        l->us = realloc(l->us, l->cap * sizeof(*l->us));
+        if (!l->us) abort();
+    }
+    l->us[l->len++] = us;
+}
+
+static bool take_ticket(void) {
+    if (quota < 0) return now_s() < deadline;
+    return __atomic_sub_fetch(&quota, 1, __ATOMIC_RELAXED) >= 0;
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    struct conn *c = malloc(sizeof(*c));
+    char body[sizeof(w->sc->body) + 64];
+    long seq = 0;
+    if (!c) return NULL;
+    c->fd = -1;
+
+    while (take_ticket()) {
+        // Each worker writes its own rotating set of files
+        snprintf(body, sizeof(body), w->sc->body, w->id, (int) (seq++ % 16));
+
+        double t0 = now_s();
+        bool closes = true;
+        int status = -1;
+        if (c->fd >= 0 || conn_open(c, w->opt) == 0) {
+            status = http_request(c, w->sc, body, w->opt->keepalive, &w->bytes, &closes);
+        }
+        double t1 = now_s();
+
+        if (status < 200 || status >= 300) w->errors++;
+        lat_push(&w->lat, (uint32_t) ((t1 - t0) * 1e6));
+        if (status < 0 || closes) conn_close(c);
+    }
+    conn_close(c);
+    free(c);
+    return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t percentile(const uint32_t *v, size_t n, double p) {
+    if (n == 0) return 0;
+    size_t i = (size_t) (p * (double) (n - 1) + 0.5);
+    return v[i];
+}
+
+static struct result run_scenario(const struct options *opt, const struct scenario *sc) {
+    struct worker *workers = calloc((size_t) opt->concurrency, sizeof(*workers));
+    struct result r = {.name = sc->name};
+    if (!workers) abort();
+
+    quota = opt->requests > 0 ? opt->requests : -1;
+    double start = now_s();
+    deadline = start + opt->duration;
+    for (int i = 0; i < opt->concurrency; i++) {
+        workers[i] = (struct worker) {.opt = opt, .sc = sc, .id = i};
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+    }
+
+    struct latencies all = {0};
+    for (int i = 0; i < opt->concurrency; i++) {
+        pthread_join(workers[i].thread, NULL);
+        for (size_t k = 0; k < workers[i].lat.len; k++) lat_push(&all, workers[i].lat.us[k]);
+        r.errors += workers[i].errors;
+        r.bytes += workers[i].bytes;
+        free(workers[i].lat.us);
+    }
+    r.seconds = now_s() - start;
+    free(workers);
+
+    qsort(all.us, all.len, sizeof(*all.us), cmp_u32);
+    double sum = 0;
+    for (size_t k = 0; k < all.len; k++) sum += all.us[k];
+    r.requests = (long) all.len;
+    r.mean = all.len ? sum / (double) all.len : 0;
+    r.p50 = percentile(all.us, all.len, 0.50);
+    r.p90 = percentile(all.us, all.len, 0.90);
+    r.p99 = percentile(all.us, all.len, 0.99);
+    r.p999 = percentile(all.us, all.len, 0.999);
+    r.max = all.len ? all.us[all.len - 1] : 0;
+    free(all.us);
+    return r;
+}
+
+// ----------------------------------------------------------------------------
+// Server process
+// ----------------------------------------------------------------------------
+
+// Start --spawn and wait until it accepts connections; -1 with a message
+// if it could not be started, exited, or something else holds the port
+static pid_t spawn_server(const struct options *opt) {
+    // The spawned server could not bind, and we would measure the other one
+    struct conn c;
+    if (conn_open(&c, opt) == 0) {
+        conn_close(&c);
+        fprintf(stderr, "loadgen: %s:%s already answers; stop that server or drop --spawn\n",
+                opt->host, opt->port);
+        return -1;
+    }
+
+    int in[2];
+    if (pipe(in) != 0) {
+        fprintf(stderr, "loadgen: cannot start %s: %s\n", opt->spawn, strerror(errno));
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Answer the interface prompt with "web" and keep stdin open
+        dup2(in[0], 0);
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, 1);
+        dup2(null, 2);
+        close(in[1]);
+        // Listen where --url points
+        setenv("NEXUS_PORT", opt->port, 1);
+        execl(opt->spawn, opt->spawn, (char *) NULL);
+        _exit(127);
+    }
+    close(in[0]);
+    if (pid < 0) {
+        fprintf(stderr, "loadgen: cannot start %s: %s\n", opt->spawn, strerror(errno));
+        return -1;
+    }
+    // A server that died at once is reported by waitpid() below, not SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    if (write(in[1], "2\n", 2) != 2) {}
+
+    // Wait until it accepts connections, as long as it is still running
+    for (int i = 0; i < 100; i++) {
+        int status;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            fprintf(stderr, "loadgen: server %s exited (%s %d) before listening on %s:%s\n",
+                    opt->spawn, WIFSIGNALED(status) ? "signal" : "status",
+                    WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status),
+                    opt->host, opt->port);
+            return -1;
+        }
+        if (conn_open(&c, opt) == 0) {
+            conn_close(&c);
+            return pid;
+        }
+        usleep(100000);
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    fprintf(stderr, "loadgen: server %s did not come up on %s:%s\n", opt->spawn, opt->host,
+            opt->port);
+    return -1;
+}
+
+// ----------------------------------------------------------------------------
+// Main
+// ----------------------------------------------------------------------------
+
+static void url_encode(const char *in, char *out, size_t size) {
+    size_t o = 0;
+    for (; *in && o + 4 < size; in++) {
+        unsigned char ch = (unsigned char) *in;
+        if (isalnum(ch) || strchr("-_.~/", ch)) {
+            out[o++] = (char) ch;
+        } else {
+            o += (size_t) snprintf(out + o, size - o, "%%%02X", ch);
+        }
+    }
+    out[o] = '\0';
+}
+
+static bool selected(const char *list, const char *name) {
+    if (list == NULL) return true;
+    size_t len = strlen(name);
+    for (const char *p = list; (p = strstr(p, name)) != NULL; p += len) {
+        bool start = p == list || p[-1] == ',';
+        bool end = p[len] == '\0' || p[len] == ',';
+        if (start && end) return true;
+    }
+    return false;
+}
+
+static int build_scenarios(const struct options *opt, struct scenario *s) {
+    char ws[1024], small[1100], huge[1100], content[SMALL_FILE_SIZE + 1];
+    url_encode(opt->workspace, ws, sizeof(ws));
+    snprintf(small, sizeof(small), "%s/small", ws);
+    snprintf(huge, sizeof(huge), "%s/huge", ws);
+    memset(content, 'x', SMALL_FILE_SIZE);
+    content[SMALL_FILE_SIZE] = '\0';
+
+    int n = 0;
+    s[n] = (struct scenario) {.name = "static_index", .method = "GET"};
+    snprintf(s[n++].path, sizeof(s->path), "/");
+    s[n] = (struct scenario) {.name = "static_js", .method = "GET"};
+    snprintf(s[n++].path, sizeof(s->path), "/app.js");
+    s[n] = (struct scenario) {.name = "files_small", .method = "GET"};
+    snprintf(s[n++].path, sizeof(s->path), "/api/files?location=%s", small);
+    s[n] = (struct scenario) {.name = "files_huge", .method = "GET"};
+    snprintf(s[n++].path, sizeof(s->path), "/api/files?location=%s", huge);
+    s[n] = (struct scenario) {.name = "view_small", .method = "GET"};
+    snprintf(s[n++].path, sizeof(s->path), "/api/view?file=f0000.txt&location=%s", small);
+    if (opt->big_mb > 0) {
+        s[n] = (struct scenario) {.name = "view_big", .method = "GET"};
+        snprintf(s[n++].path, sizeof(s->path), "/api/view?file=big.txt&location=%s", ws);
+    }
+    s[n] = (struct scenario) {.name = "create", .method = "POST"};
+    snprintf(s[n].path, sizeof(s->path), "/api/create");
+    snprintf(s[n++].body, sizeof(s->body),
+             "{\"filename\": \"w%%d_%%d.txt\", \"content\": \"%s\", \"location\": \"%s/scratch\"}",
+             content, opt->workspace);
+    s[n] = (struct scenario) {.name = "execute", .method = "POST"};
+    snprintf(s[n].path, sizeof(s->path), "/api/execute");
+    snprintf(s[n++].body, sizeof(s->body),
+             "{\"filename\": \"hello.sh\", \"action\": \"run\", \"location\": \"%s/small\"}",
+             opt->workspace);
+
+    for (int i = 0; i < n; i++) s[i].enabled = selected(opt->routes, s[i].name);
+    return n;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [--url HOST:PORT] [--spawn SERVER] [--workspace DIR]\n"
+                    "       [--huge-entries N] [--big-mb N] [--routes a,b,...]\n"
+                    "       [--concurrency N] [--duration SEC | --requests N]\n"
+                    "       [--no-keepalive] [--out FILE]\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    struct options opt = {
+        .host = "127.0.0.1", .port = "8080", .workspace = "/tmp/nexus-bench",
+        .huge_entries = 100000, .big_mb = 1024, .concurrency = 8, .duration = 10,
+        .requests = 0, .keepalive = true,
+    };
+    static const struct option longopts[] = {
+        {"url", required_argument, 0, 'u'}, {"spawn", required_argument, 0, 's'},
+        {"workspace", required_argument, 0, 'w'}, {"huge-entries", required_argument, 0, 'H'},
+        {"big-mb", required_argument, 0, 'B'}, {"routes", required_argument, 0, 'r'},
+        {"concurrency", required_argument, 0, 'c'}, {"duration", required_argument, 0, 'd'},
+        {"requests", required_argument, 0, 'n'}, {"no-keepalive", no_argument, 0, 'k'},
+        {"out", required_argument, 0, 'o'}, {"help", no_argument, 0, 'h'}, {0, 0, 0, 0},
+    };
+
+    int ch;
+    while ((ch = getopt_long(argc, argv, "u:s:w:H:B:r:c:d:n:ko:h", longopts, NULL)) != -1) {
+        switch (ch) {
+            case 'u': {
+                const char *colon = strrchr(optarg, ':');
+                if (!colon) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                char *end;
+                long port = strtol(colon + 1, &end, 10);
+                if (end == colon + 1 || *end != '\0' || port < 1 || port > 65535) {
+                    fprintf(stderr, "loadgen: bad port in --url %s\n", optarg);
+                    return 1;
+                }
+                snprintf(opt.host, sizeof(opt.host), "%.*s", (int) (colon - optarg), optarg);
+                snprintf(opt.port, sizeof(opt.port), "%ld", port);
+                break;
+            }
+            case 's': opt.spawn = optarg; break;
+            case 'w': opt.workspace = optarg; break;
+            case 'H': opt.huge_entries = atol(optarg); break;
+            case 'B': opt.big_mb = atol(optarg); break;
+            case 'r': opt.routes = optarg; break;
+            case 'c': opt.concurrency = atoi(optarg); break;
+            case 'd': opt.duration = atof(optarg); break;
+            case 'n': opt.requests = atol(optarg); break;
+            case 'k': opt.keepalive = false; break;
+            case 'o': opt.out = optarg; break;
+            default: usage(argv[0]); return ch == 'h' ? 0 : 1;
+        }
+    }
+    if (opt.concurrency < 1) opt.concurrency = 1;
+
+    if (setup_workspace(&opt) != 0) {
+        fprintf(stderr, "loadgen: cannot set up workspace %s: %s\n", opt.workspace, strerror(errno));
+        return 1;
+    }
+
+    pid_t server = 0;
+    if (opt.spawn && (server = spawn_server(&opt)) < 0) return 1;
+
+    static struct scenario scenarios[16];
+    struct result results[16];
+    int count = build_scenarios(&opt, scenarios), ran = 0;
+    for (int i = 0; i < count; i++) {
+        if (!scenarios[i].enabled) continue;
+        results[ran] = run_scenario(&opt, &scenarios[i]);
+        struct result *r = &results[ran++];
+        fprintf(stderr, "%-13s %8.0f req/s  p50 %7u us  p99 %8u us  errors %ld\n", r->name,
+                r->seconds > 0 ? (double) r->requests / r->seconds : 0, r->p50, r->p99, r->errors);
+    }
+
+    if (server > 0) {
+        kill(server, SIGTERM);
+        waitpid(server, NULL, 0);
+    }
+
+    FILE *out = opt.out ? fopen(opt.out, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "loadgen: cannot write %s\n", opt.out);
+        return 1;
+    }
+    fprintf(out, "{\n  \"timestamp\": %ld,\n  \"server\": \"%s:%s\",\n  \"concurrency\": %d,\n"
+                 "  \"keepalive\": %s,\n  \"results\": [\n",
+            (long) time(NULL), opt.host, opt.port, opt.concurrency, opt.keepalive ? "true" : "false");
+    for (int i = 0; i < ran; i++) {
+        struct result *r = &results[i];
+        fprintf(out, "    {\"route\": \"%s\", \"requests\": %ld, \"errors\": %ld, \"seconds\": %.3f, "
+                     "\"rps\": %.1f, \"bytes\": %llu, \"latency_us\": {\"mean\": %.1f, \"p50\": %u, "
+                     "\"p90\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u}}%s\n",
+                r->name, r->requests, r->errors, r->seconds,
+                r->seconds > 0 ? (double) r->requests / r->seconds : 0,
+                (unsigned long long) r->bytes, r->mean, r->p50, r->p90, r->p99, r->p999, r->max,
+                i + 1 < ran ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    if (out != stdout) fclose(out);
+    return 0;
+}
@@ -20,7 +20,9 @@ echo -e "${YELLOW}--- 🛠️  Phase 1: Compiling ---${NC}"
 # Check if we have the new separated files
 if [ -f "api_handler.c" ] && [ -f "main.c" ]; then
     echo -e "${CYAN}Detected new project structure${NC}"
-    gcc -o $APP_NAME main.c api_handler.c mongoose.c -lpthread -DENABLE_WEB_SERVER
+    # Web assets are packed into the binary
+    gcc -o pack pack.c mongoose.c -lz -lbrotlienc && ./pack index.html style.css app.js > packed_fs.c &&
+        gcc -o $APP_NAME main.c api_handler.c arena.c json_writer.c json_body.c router.c assets.c compress.c metrics.c trace.c exec.c build.c objcache.c tests.c pty.c bench.c jvm.c tcc.c output.c toolchain.c watch.c mongoose.c packed_fs.c -lpthread -lz -lm -DENABLE_WEB_SERVER -DMG_ENABLE_PACKED_FS=1
 else
     echo -e "${CYAN}Using original main.c${NC}"
     gcc -o $APP_NAME main.c mongoose.c -lpthread -DENABLE_WEB_SERVER
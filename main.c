@@ -1,15 +1,28 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <termios.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <dirent.h>
+#include "toolchain.h"
 
 #ifdef ENABLE_WEB_SERVER
 #include <pthread.h>
 #include "mongoose.h"
 #include "api_handler.h"
+#include "bench.h"
+#include "exec.h"
+#include "jvm.h"
+#include "metrics.h"
+#include "objcache.h"
+#include "pty.h"
+#include "router.h"
+#include "tcc.h"
+#include "trace.h"
+#include "watch.h"
 #endif
 
 // ANSI Color codes
@@ -338,6 +351,25 @@ int createNewFile(char *filename, char files[][100], int fileCount) {
 }
 
 // Execute code file
+// Run the steps of a command (toolchain_argv()) one after the other, no
+// shell in between; stops at the first one that fails
+int runSteps(char **argv) {
+    int status = 0;
+    for (char **step = argv; *step != NULL && status == 0; step++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) return -1;
+        if (pid == 0) {
+            execvp(step[0], step);
+            fprintf(stderr, "%s: %s\n", step[0], strerror(errno));
+            _exit(127);
+        }
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+        while (*step != NULL) step++;
+    }
+    return status;
+}
+
 void executeCodeFile(const char *filename) {
     clearScreen();
     drawBox("CODE EXECUTION", GREEN);
@@ -366,52 +398,29 @@ void executeCodeFile(const char *filename) {
     int choice;
     if (scanf("%d", &choice) != 1) return;
     
-    if (choice == 4) return;
+    if (choice < 1 || choice > 3) return;
     
-    char command[1024];
+    char command[4096], words[4096];
+    char *argv[64];
     printf("\n%s%s───────────────────────────────────────────────────%s\n", 
            DIM, CYAN, RESET);
     
-    if (strcmp(ext, "c") == 0) {
-        if (choice == 1) {
-            snprintf(command, sizeof(command), "gcc -o %s.out %s", filename, filename);
-        } else if (choice == 2) {
-            snprintf(command, sizeof(command), "./%s.out", filename);
-        } else if (choice == 3) {
-            snprintf(command, sizeof(command), "gcc -o %s.out %s && ./%s.out", 
-                    filename, filename, filename);
-        }
-    } else if (strcmp(ext, "cpp") == 0 || strcmp(ext, "cc") == 0) {
-        if (choice == 1) {
-            snprintf(command, sizeof(command), "g++ -o %s.out %s", filename, filename);
-        } else if (choice == 2) {
-            snprintf(command, sizeof(command), "./%s.out", filename);
-        } else if (choice == 3) {
-            snprintf(command, sizeof(command), "g++ -o %s.out %s && ./%s.out", 
-                    filename, filename, filename);
-        }
-    } else if (strcmp(ext, "py") == 0) {
-        snprintf(command, sizeof(command), "python3 %s", filename);
-    } else if (strcmp(ext, "js") == 0) {
-        snprintf(command, sizeof(command), "node %s", filename);
-    } else if (strcmp(ext, "sh") == 0) {
-        snprintf(command, sizeof(command), "bash %s", filename);
-    } else if (strcmp(ext, "java") == 0) {
-        if (choice == 1) {
-            snprintf(command, sizeof(command), "javac %s", filename);
-        } else if (choice == 2) {
-            char className[256];
-            strncpy(className, filename, strlen(filename) - 5);
-            className[strlen(filename) - 5] = '\0';
-            snprintf(command, sizeof(command), "java %s", className);
-        } else if (choice == 3) {
-            char className[256];
-            strncpy(className, filename, strlen(filename) - 5);
-            className[strlen(filename) - 5] = '\0';
-            snprintf(command, sizeof(command), "javac %s && java %s", filename, className);
-        }
-    } else {
-        showError("Unsupported file type for execution");
+    // Same registry as the web interface (toolchain.h)
+    struct toolchain tc;
+    enum toolchain_action step = choice == 1 ? TOOLCHAIN_COMPILE :
+                                 choice == 2 ? TOOLCHAIN_RUN : TOOLCHAIN_BOTH;
+    const char *problem = NULL;
+    if (!toolchain_get(ext, &tc)) {
+        problem = "Unsupported file type for execution";
+    } else if (toolchain_missing(&tc, step) != NULL) {
+        problem = "The toolchain for this file type is not installed";
+    } else if (!toolchain_command(&tc, step, "", filename, command, sizeof(command)) ||
+               !toolchain_argv(&tc, step, "", filename, words, sizeof(words), argv,
+                               (int) (sizeof(argv) / sizeof(argv[0])))) {
+        problem = "File name too long";
+    }
+    if (problem != NULL) {
+        showError(problem);
         printf("\n%s%sPress Enter to continue...%s", DIM, WHITE, RESET);
         getchar();
         getchar();
@@ -419,7 +428,7 @@ void executeCodeFile(const char *filename) {
     }
     
     printf("%s%sExecuting: %s%s\n\n", BOLD, YELLOW, command, RESET);
-    int result = system(command);
+    int result = runSteps(argv);
     
     printf("\n%s%s───────────────────────────────────────────────────%s\n", 
            DIM, CYAN, RESET);
@@ -460,84 +469,70 @@ void showMainMenu(char files[][100], int fileCount) {
 // Web server integration
 static struct mg_mgr g_mgr;
 
-// HTTP event handler - FIXED for new Mongoose API
+// HTTP event handler: routing lives in router.c
 static void http_handler(struct mg_connection *c, int ev, void *ev_data) {
-    if (ev == MG_EV_HTTP_MSG) {
-        struct mg_http_message *hm = (struct mg_http_message *) ev_data;
+    if (ev == MG_EV_ACCEPT) {
+        metrics_connection(+1);
+    } else if (ev == MG_EV_HTTP_HDRS) {
+        // Unknown routes and oversized bodies are refused before the body is read
+        router_check_headers(c, (struct mg_http_message *) ev_data);
+    } else if (ev == MG_EV_HTTP_MSG) {
+        router_dispatch(c, (struct mg_http_message *) ev_data);
         
-        // Parse query parameters
-        char filename[256] = {0};
-        char location[1024] = {0};
-        
-        mg_http_get_var(&hm->query, "file", filename, sizeof(filename));
-        mg_http_get_var(&hm->query, "location", location, sizeof(location));
-        mg_http_get_var(&hm->query, "path", location, sizeof(location));
-        
-        // Route requests - FIXED: Use mg_http_serve_opts
-        if (mg_match(hm->uri, mg_str("/"), NULL)) {
-            struct mg_http_serve_opts opts = {.root_dir = "."};
-            mg_http_serve_file(c, hm, "index.html", &opts);
-        } else if (mg_match(hm->uri, mg_str("/styles.css"), NULL)) {
-            struct mg_http_serve_opts opts = {.root_dir = "."};
-            mg_http_serve_file(c, hm, "styles.css", &opts);
-        } else if (mg_match(hm->uri, mg_str("/style.css"), NULL)) {
-            struct mg_http_serve_opts opts = {.root_dir = "."};
-            mg_http_serve_file(c, hm, "style.css", &opts);
-        } else if (mg_match(hm->uri, mg_str("/app.js"), NULL)) {
-            struct mg_http_serve_opts opts = {.root_dir = "."};
-            mg_http_serve_file(c, hm, "app.js", &opts);
-        } else if (mg_match(hm->uri, mg_str("/api/files"), NULL)) {
-            handle_list_files(c, location);
-        } else if (mg_match(hm->uri, mg_str("/api/view"), NULL)) {
-            handle_view_file(c, filename, location);
-        } else if (mg_match(hm->uri, mg_str("/api/create"), NULL)) {
-            char *fn = mg_json_get_str(hm->body, "$.filename");
-            char *cnt = mg_json_get_str(hm->body, "$.content");
-            char *loc = mg_json_get_str(hm->body, "$.location");
-            handle_create_file(c, fn ? fn : "", cnt ? cnt : "", loc ? loc : "");
-            free(fn); free(cnt); free(loc);
-        } else if (mg_match(hm->uri, mg_str("/api/edit"), NULL)) {
-            char *fn = mg_json_get_str(hm->body, "$.filename");
-            char *cnt = mg_json_get_str(hm->body, "$.content");
-            char *loc = mg_json_get_str(hm->body, "$.location");
-            handle_edit_file(c, fn ? fn : "", cnt ? cnt : "", loc ? loc : "");
-            free(fn); free(cnt); free(loc);
-        } else if (mg_match(hm->uri, mg_str("/api/delete"), NULL)) {
-            char *fn = mg_json_get_str(hm->body, "$.filename");
-            char *loc = mg_json_get_str(hm->body, "$.location");
-            handle_delete_file(c, fn ? fn : "", loc ? loc : "");
-            free(fn); free(loc);
-        } else if (mg_match(hm->uri, mg_str("/api/exists"), NULL)) {
-            handle_file_exists(c, filename, location);
-        } else if (mg_match(hm->uri, mg_str("/api/browse"), NULL)) {
-            handle_browse_directories(c, location);
-        } else if (mg_match(hm->uri, mg_str("/api/execute"), NULL)) {
-            char *fn = mg_json_get_str(hm->body, "$.filename");
-            char *act = mg_json_get_str(hm->body, "$.action");
-            char *loc = mg_json_get_str(hm->body, "$.location");
-            handle_execute_file(c, fn ? fn : "", act ? act : "run", loc ? loc : "");
-            free(fn); free(act); free(loc);
-        } else {
-            mg_http_reply(c, 404, "", "Not found");
-        }
+        // All handler scratch memory goes away with the request
+        request_end(c);
+    } else if (ev == MG_EV_WS_MSG) {
+        pty_ws_message(c, (struct mg_ws_message *) ev_data);
+        watch_ws_message(c, (struct mg_ws_message *) ev_data);
+    } else if (ev == MG_EV_WRITE) {
+        request_sent(c);
+    } else if (ev == MG_EV_CLOSE) {
+        if (c->is_accepted) metrics_connection(-1);
+        request_close(c);
+    }
+}
+
+// Port the web interface listens on: NEXUS_PORT, default 8080
+static const char *web_port(void) {
+    const char *env = getenv("NEXUS_PORT");
+    if (env == NULL || *env == '\0' || strlen(env) > 5) return "8080";
+    for (const char *p = env; *p; p++) {
+        if (*p < '0' || *p > '9') return "8080";
     }
+    long port = atol(env);
+    return port >= 1 && port <= 65535 ? env : "8080";
 }
 
 void *web_server_thread(void *arg) {
     mg_mgr_init(&g_mgr);
-    mg_http_listen(&g_mgr, "http://0.0.0.0:8080", http_handler, NULL);
+    router_init();
+    trace_init();
+    exec_init(&g_mgr);
+    output_init(&g_mgr);
+    objcache_init();
+    pty_init();
+    bench_init();
+    jvm_init(&g_mgr);
+    tcc_init();
+    watch_init(&g_mgr);
+    char url[32];
+    snprintf(url, sizeof(url), "http://0.0.0.0:%s", web_port());
+    mg_http_listen(&g_mgr, url, http_handler, NULL);
     
     printf("%s%s", GREEN, BOLD);
     printf("\n  ╔═══════════════════════════════════════════════════════════════╗\n");
     printf("  ║                                                               ║\n");
     printf("  ║          🌐 Web Interface Started!                           ║\n");
-    printf("  ║          Open: http://localhost:8080                         ║\n");
+    printf("  ║          Open: http://localhost:%-5s                        ║\n", web_port());
     printf("  ║                                                               ║\n");
     printf("  ╚═══════════════════════════════════════════════════════════════╝\n");
     printf("%s\n", RESET);
     
     while (1) {
-        mg_mgr_poll(&g_mgr, 1000);
+        uint64_t start = metrics_now_us();
+        // Running jobs have deadlines to enforce
+        mg_mgr_poll(&g_mgr, exec_busy() ? 50 : 1000);
+        metrics_loop_iteration(metrics_now_us() - start);
     }
     
     mg_mgr_free(&g_mgr);
@@ -545,10 +540,36 @@ void *web_server_thread(void *arg) {
 }
 #endif
 
-int main() {
+int main(int argc, char **argv) {
     char files[100][100];
     int fileCount = 0;
     
+#ifdef ENABLE_WEB_SERVER
+    // Compile jobs call back into this binary as a caching compiler wrapper
+    if (argc > 1 && strcmp(argv[1], OBJCACHE_FLAG) == 0) {
+        return objcache_main(argc - 2, argv + 2);
+    }
+    // Interactive runs: the job owning a program's terminal
+    if (argc > 1 && strcmp(argv[1], PTY_RELAY_FLAG) == 0) {
+        return pty_relay_main(argc - 2, argv + 2);
+    }
+    // Benchmarks: one measured run, pinned and counted
+    if (argc > 1 && strcmp(argv[1], BENCH_RUN_FLAG) == 0) {
+        return bench_run_main(argc - 2, argv + 2);
+    }
+    // Java and Kotlin steps: handed to the warm JVM when it is up
+    if (argc > 1 && strcmp(argv[1], JVM_FLAG) == 0) {
+        return jvm_main(argc - 2, argv + 2);
+    }
+    // C under the tcc profile: compiled in memory and run in the job
+    if (argc > 1 && strcmp(argv[1], TCC_RUN_FLAG) == 0) {
+        return tcc_run_main(argc - 2, argv + 2);
+    }
+#endif
+    
+    // Both interfaces build through the registry; load it before either starts
+    toolchain_init();
+    
 #ifdef ENABLE_WEB_SERVER
     // Start web server
     pthread_t web_thread;
@@ -558,8 +579,8 @@ int main() {
     
     clearScreen();
     drawBox("INTERFACE SELECTION", CYAN);
-    printf("\n%s%sThe Web Server is running on http://localhost:8080%s\n\n", 
-           WHITE, BOLD, RESET);
+    printf("\n%s%sThe Web Server is running on http://localhost:%s%s\n\n", 
+           WHITE, BOLD, web_port(), RESET);
     printf("How would you like to proceed?\n\n");
     printf("  %s[1]%s Continue in TERMINAL\n", GREEN, RESET);
     printf("  %s[2]%s Use WEB INTERFACE (Terminal will standby)\n", MAGENTA, RESET);
@@ -572,7 +593,9 @@ int main() {
         clearScreen();
         drawBox("WEB MODE ACTIVE", MAGENTA);
         showInfo("Terminal is on standby");
-        showInfo("Use browser at http://localhost:8080");
+        char hint[64];
+        snprintf(hint, sizeof(hint), "Use browser at http://localhost:%s", web_port());
+        showInfo(hint);
         showInfo("Press Ctrl+C to exit");
         
         while(1) sleep(10);
@@ -0,0 +1,307 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "metrics.h"
+#include "compress.h"
+#include "exec.h"
+#include "json_writer.h"
+#include "router.h"
+#include "toolchain.h"
+
+#define STATUS_CLASSES 5        // 1xx .. 5xx
+
+// Language slots, named after the toolchain (toolchain.h) the first time
+// one runs; unknown extensions, and languages past the table after config
+// reloads, count as the last one, "other". Names are guarded by shards_lock.
+#define EXEC_LANGS (TOOLCHAIN_MAX + 1)
+
+static char exec_langs[EXEC_LANGS][sizeof(((struct toolchain *) NULL)->name)] = {
+    [EXEC_LANGS - 1] = "other",
+};
+static size_t nlangs;
+
+struct histogram {
+    uint64_t buckets[METRICS_BUCKETS + 1];    // Last one is +Inf
+    uint64_t count;
+    uint64_t sum_us;
+};
+
+struct route_metrics {
+    uint64_t status[STATUS_CLASSES];
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    struct histogram latency;
+};
+
+struct exec_metrics {
+    uint64_t ok;
+    uint64_t failed;
+    struct histogram duration;
+};
+
+/**
+ * Counters owned by one thread. Only the owner writes, so updates need no
+ * locked instructions; relaxed atomic stores keep the scraper's reads whole.
+ */
+struct metrics_shard {
+    struct route_metrics routes[METRICS_MAX_ROUTES];
+    struct exec_metrics exec[EXEC_LANGS];
+    struct histogram exec_wait[EXEC_PRIORITIES];
+    struct histogram loop;
+    int64_t connections;
+    struct metrics_shard *next;
+};
+
+// Shards live for the life of the process, so counters of exited threads
+// still show up in the totals
+static struct metrics_shard *shards;
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct metrics_shard *local;
+
+#define BUMP(field, n) __atomic_store_n(&(field), (field) + (n), __ATOMIC_RELAXED)
+#define LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+static struct metrics_shard *shard(void) {
+    if (local != NULL) return local;
+    local = calloc(1, sizeof(*local));
+    if (local == NULL) abort();
+    pthread_mutex_lock(&shards_lock);
+    local->next = shards;
+    shards = local;
+    pthread_mutex_unlock(&shards_lock);
+    return local;
+}
+
+uint64_t metrics_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000u + (uint64_t) ts.tv_nsec / 1000u;
+}
+
+static void observe(struct histogram *h, uint64_t us) {
+    // Smallest k with us <= 2^k, shifted so bucket 0 is 2^METRICS_BUCKET_MIN_LOG2
+    int k = us <= 1 ? 0 : 64 - __builtin_clzll(us - 1);
+    int b = k <= METRICS_BUCKET_MIN_LOG2 ? 0 : k - METRICS_BUCKET_MIN_LOG2;
+    if (b > METRICS_BUCKETS) b = METRICS_BUCKETS;
+    BUMP(h->buckets[b], 1);
+    BUMP(h->count, 1);
+    BUMP(h->sum_us, us);
+}
+
+void metrics_request(size_t route, int status, size_t bytes_in, size_t bytes_out,
+                     uint64_t duration_us) {
+    if (route >= METRICS_MAX_ROUTES) return;
+    struct route_metrics *m = &shard()->routes[route];
+    if (status >= 100 && status < 600) BUMP(m->status[status / 100 - 1], 1);
+    BUMP(m->bytes_in, bytes_in);
+    BUMP(m->bytes_out, bytes_out);
+    observe(&m->latency, duration_us);
+}
+
+void metrics_connection(int delta) {
+    struct metrics_shard *s = shard();
+    BUMP(s->connections, delta);
+}
+
+void metrics_loop_iteration(uint64_t duration_us) {
+    observe(&shard()->loop, duration_us);
+}
+
+static size_t lang_index(const char *ext) {
+    struct toolchain tc;
+    if (!toolchain_get(ext, &tc)) return EXEC_LANGS - 1;
+    pthread_mutex_lock(&shards_lock);
+    size_t l = 0;
+    while (l < nlangs && strcmp(exec_langs[l], tc.name) != 0) l++;
+    if (l == nlangs && nlangs < EXEC_LANGS - 1) {
+        snprintf(exec_langs[nlangs++], sizeof(exec_langs[0]), "%s", tc.name);
+    }
+    pthread_mutex_unlock(&shards_lock);
+    return l;
+}
+
+void metrics_exec(const char *ext, int exit_code, uint64_t duration_us) {
+    struct exec_metrics *m = &shard()->exec[lang_index(ext)];
+    if (exit_code == 0) {
+        BUMP(m->ok, 1);
+    } else {
+        BUMP(m->failed, 1);
+    }
+    observe(&m->duration, duration_us);
+}
+
+void metrics_exec_queued(int priority, uint64_t wait_us) {
+    if (priority < 0 || priority >= EXEC_PRIORITIES) return;
+    observe(&shard()->exec_wait[priority], wait_us);
+}
+
+// ----------------------------------------------------------------------------
+// Scrape
+// ----------------------------------------------------------------------------
+
+static void out(struct mg_iobuf *io, const char *fmt, ...) {
+    char line[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n > 0) iobuf_append(io, line, (size_t) n < sizeof(line) ? (size_t) n : sizeof(line) - 1);
+}
+
+static void hist_add(struct histogram *dst, struct histogram *src) {
+    for (int b = 0; b <= METRICS_BUCKETS; b++) dst->buckets[b] += LOAD(src->buckets[b]);
+    dst->count += LOAD(src->count);
+    dst->sum_us += LOAD(src->sum_us);
+}
+
+// Prometheus buckets are cumulative and in seconds
+static void hist_print(struct mg_iobuf *io, const char *name, const char *labels,
+                       const struct histogram *h) {
+    const char *sep = labels[0] ? "," : "";
+    uint64_t cumulative = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        cumulative += h->buckets[b];
+        double le = (double) (1ull << (b + METRICS_BUCKET_MIN_LOG2)) / 1e6;
+        out(io, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, sep, le,
+            (unsigned long long) cumulative);
+    }
+    out(io, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep,
+        (unsigned long long) h->count);
+    const char *open = labels[0] ? "{" : "", *close = labels[0] ? "}" : "";
+    out(io, "%s_sum%s%s%s %.6f\n", name, open, labels, close, (double) h->sum_us / 1e6);
+    out(io, "%s_count%s%s%s %llu\n", name, open, labels, close, (unsigned long long) h->count);
+}
+
+static void route_label(char *buf, size_t size, size_t i) {
+    if (i < router_route_count()) {
+        const struct route *r = router_route(i);
+        snprintf(buf, size, "method=\"%s\",path=\"%s\"", r->method, r->path);
+    } else {
+        snprintf(buf, size, "method=\"\",path=\"unmatched\"");
+    }
+}
+
+static void print_all(struct mg_iobuf *io) {
+    static struct route_metrics routes[METRICS_MAX_ROUTES];
+    static struct exec_metrics exec[EXEC_LANGS];
+    static struct histogram exec_wait[EXEC_PRIORITIES];
+    static struct histogram loop;
+    int64_t connections = 0;
+    size_t nroutes = router_route_count() + 1;
+    char labels[192];
+
+    // Sum the shards. The scrape buffers are static; scrapes are serialized
+    // by the lock.
+    pthread_mutex_lock(&shards_lock);
+    memset(routes, 0, sizeof(routes));
+    memset(exec, 0, sizeof(exec));
+    memset(exec_wait, 0, sizeof(exec_wait));
+    memset(&loop, 0, sizeof(loop));
+    for (struct metrics_shard *s = shards; s != NULL; s = s->next) {
+        for (size_t i = 0; i < nroutes; i++) {
+            for (int k = 0; k < STATUS_CLASSES; k++) routes[i].status[k] += LOAD(s->routes[i].status[k]);
+            routes[i].bytes_in += LOAD(s->routes[i].bytes_in);
+            routes[i].bytes_out += LOAD(s->routes[i].bytes_out);
+            hist_add(&routes[i].latency, &s->routes[i].latency);
+        }
+        for (size_t l = 0; l < EXEC_LANGS; l++) {
+            exec[l].ok += LOAD(s->exec[l].ok);
+            exec[l].failed += LOAD(s->exec[l].failed);
+            hist_add(&exec[l].duration, &s->exec[l].duration);
+        }
+        for (int p = 0; p < EXEC_PRIORITIES; p++) hist_add(&exec_wait[p], &s->exec_wait[p]);
+        hist_add(&loop, &s->loop);
+        connections += LOAD(s->connections);
+    }
+
+    out(io, "# HELP nexus_http_requests_total HTTP requests by route and status class.\n"
+            "# TYPE nexus_http_requests_total counter\n");
+    for (size_t i = 0; i < nroutes; i++) {
+        route_label(labels, sizeof(labels), i);
+        for (int k = 0; k < STATUS_CLASSES; k++) {
+            if (routes[i].status[k] == 0) continue;
+            out(io, "nexus_http_requests_total{%s,code=\"%dxx\"} %llu\n", labels, k + 1,
+                (unsigned long long) routes[i].status[k]);
+        }
+    }
+
+    out(io, "# HELP nexus_http_request_bytes_total Request bytes received, headers included.\n"
+            "# TYPE nexus_http_request_bytes_total counter\n");
+    for (size_t i = 0; i < nroutes; i++) {
+        route_label(labels, sizeof(labels), i);
+        out(io, "nexus_http_request_bytes_total{%s} %llu\n", labels,
+            (unsigned long long) routes[i].bytes_in);
+    }
+
+    out(io, "# HELP nexus_http_response_bytes_total Response bytes queued, headers included.\n"
+            "# TYPE nexus_http_response_bytes_total counter\n");
+    for (size_t i = 0; i < nroutes; i++) {
+        route_label(labels, sizeof(labels), i);
+        out(io, "nexus_http_response_bytes_total{%s} %llu\n", labels,
+            (unsigned long long) routes[i].bytes_out);
+    }
+
+    out(io, "# HELP nexus_http_request_duration_seconds Time spent in the route handler.\n"
+            "# TYPE nexus_http_request_duration_seconds histogram\n");
+    for (size_t i = 0; i < nroutes; i++) {
+        route_label(labels, sizeof(labels), i);
+        hist_print(io, "nexus_http_request_duration_seconds", labels, &routes[i].latency);
+    }
+
+    out(io, "# HELP nexus_http_active_connections Open client connections.\n"
+            "# TYPE nexus_http_active_connections gauge\n"
+            "nexus_http_active_connections %lld\n", (long long) connections);
+
+    out(io, "# HELP nexus_event_loop_iteration_seconds mg_mgr_poll() duration, I/O wait included.\n"
+            "# TYPE nexus_event_loop_iteration_seconds histogram\n");
+    hist_print(io, "nexus_event_loop_iteration_seconds", "", &loop);
+
+    out(io, "# HELP nexus_exec_jobs_total /api/execute jobs by language and result.\n"
+            "# TYPE nexus_exec_jobs_total counter\n");
+    for (size_t l = 0; l < EXEC_LANGS; l++) {
+        if (exec[l].duration.count == 0) continue;
+        out(io, "nexus_exec_jobs_total{language=\"%s\",result=\"ok\"} %llu\n", exec_langs[l],
+            (unsigned long long) exec[l].ok);
+        out(io, "nexus_exec_jobs_total{language=\"%s\",result=\"error\"} %llu\n", exec_langs[l],
+            (unsigned long long) exec[l].failed);
+    }
+
+    out(io, "# HELP nexus_exec_duration_seconds /api/execute job wall time.\n"
+            "# TYPE nexus_exec_duration_seconds histogram\n");
+    for (size_t l = 0; l < EXEC_LANGS; l++) {
+        if (exec[l].duration.count == 0) continue;
+        snprintf(labels, sizeof(labels), "language=\"%.*s\"", (int) sizeof(exec_langs[l]),
+                 exec_langs[l]);
+        hist_print(io, "nexus_exec_duration_seconds", labels, &exec[l].duration);
+    }
+
+    // The scheduler lives on the event loop thread, which is also the one
+    // serving this scrape
+    static const char *classes[EXEC_PRIORITIES] = {"run", "build"};
+    out(io, "# HELP nexus_exec_queue_wait_seconds Time jobs waited for a slot.\n"
+            "# TYPE nexus_exec_queue_wait_seconds histogram\n");
+    for (int p = 0; p < EXEC_PRIORITIES; p++) {
+        snprintf(labels, sizeof(labels), "priority=\"%s\"", classes[p]);
+        hist_print(io, "nexus_exec_queue_wait_seconds", labels, &exec_wait[p]);
+    }
+    out(io, "# HELP nexus_exec_queue_depth Jobs waiting for a slot.\n"
+            "# TYPE nexus_exec_queue_depth gauge\n"
+            "nexus_exec_queue_depth %d\n"
+            "# HELP nexus_exec_running Jobs running.\n"
+            "# TYPE nexus_exec_running gauge\n"
+            "nexus_exec_running %d\n"
+            "# HELP nexus_exec_slots Jobs allowed to run at once.\n"
+            "# TYPE nexus_exec_slots gauge\n"
+            "nexus_exec_slots %d\n", exec_queued(), exec_running(), exec_limits()->slots);
+    pthread_mutex_unlock(&shards_lock);
+}
+
+void metrics_serve(struct mg_connection *c) {
+    struct http_body body;
+    http_body_begin(&body, c, 200, "text/plain; version=0.0.4");
+    print_all(&c->send);
+    http_body_end(&body, c);
+}
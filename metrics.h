@@ -0,0 +1,76 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mongoose.h"
+
+// ============================================================================
+// NEXUS File Manager - Server Metrics
+// ============================================================================
+
+// Route slots: router.c route indices, plus one for unrouted requests
+#define METRICS_MAX_ROUTES 32
+
+// Histogram buckets: upper bounds 2^4 .. 2^(4 + N - 1) microseconds, then +Inf
+#define METRICS_BUCKET_MIN_LOG2 4
+#define METRICS_BUCKETS 22
+
+/**
+ * Monotonic clock in microseconds
+ */
+uint64_t metrics_now_us(void);
+
+/**
+ * Record a finished HTTP request
+ *
+ * @param route Route index (router_route()), or router_route_count() if unrouted
+ * @param status HTTP status code sent, 0 if unknown
+ * @param bytes_in Request size (headers and body)
+ * @param bytes_out Response bytes queued
+ * @param duration_us Time from dispatch until the reply was queued; for
+ *                    requests answered by a job callback this includes the job
+ */
+void metrics_request(size_t route, int status, size_t bytes_in, size_t bytes_out,
+                     uint64_t duration_us);
+
+/**
+ * Track an accepted connection opening (+1) or closing (-1)
+ */
+void metrics_connection(int delta);
+
+/**
+ * Record one event loop iteration (mg_mgr_poll call)
+ *
+ * @param duration_us Iteration time, including the wait for I/O
+ */
+void metrics_loop_iteration(uint64_t duration_us);
+
+/**
+ * Record a finished /api/execute job. Build steps, tests and benchmark
+ * runs are not counted here; they only show up in the queue wait.
+ *
+ * @param ext File extension that selected the toolchain ("c", "py", ...);
+ *            the language label is the toolchain's name
+ * @param exit_code Job exit status, 0 for success
+ * @param duration_us Wall time
+ */
+void metrics_exec(const char *ext, int exit_code, uint64_t duration_us);
+
+/**
+ * Record how long a job waited in the execution queue
+ *
+ * @param priority Scheduling class (enum exec_priority)
+ * @param wait_us Time from queued to started (or cancelled)
+ */
+void metrics_exec_queued(int priority, uint64_t wait_us);
+
+/**
+ * Reply with all metrics in the Prometheus text format. Counters are
+ * summed over every thread's shard at this point.
+ *
+ * @param c Mongoose connection
+ */
+void metrics_serve(struct mg_connection *c);
+
+#endif // METRICS_H
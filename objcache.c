@@ -0,0 +1,589 @@
+#define _GNU_SOURCE             // nftw()
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "mongoose.h"
+#include "objcache.h"
+
+#define KEY_VERSION "nexus-objcache-1"
+#define EVICT_TO 0.9                // Of the limit, once over it
+
+static bool enabled;
+static char cache_dir[512];
+static long long cache_max = 1ll << 30;
+static char wrapper[PATH_MAX + 32];
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// "1G" -> bytes
+static long long parse_size(const char *s) {
+    char *end;
+    long long v = strtoll(s, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': return v << 10;
+        case 'm': case 'M': return v << 20;
+        case 'g': case 'G': return v << 30;
+        default: return v;
+    }
+}
+
+// Settings shared by the server and the wrapper processes it starts
+static void config_read(void) {
+    const char *s = getenv("NEXUS_OBJCACHE");
+    enabled = s == NULL || strcmp(s, "0") != 0;
+    if ((s = getenv("NEXUS_OBJCACHE_DIR")) != NULL && *s) {
+        snprintf(cache_dir, sizeof(cache_dir), "%s", s);
+    } else if ((s = getenv("HOME")) != NULL && *s) {
+        snprintf(cache_dir, sizeof(cache_dir), "%s/.cache/nexus", s);
+    } else {
+        snprintf(cache_dir, sizeof(cache_dir), "/tmp/nexus-cache");
+    }
+    if ((s = getenv("NEXUS_OBJCACHE_MAX")) != NULL) cache_max = parse_size(s);
+    if (cache_max <= 0) cache_max = 1ll << 30;
+}
+
+// mkdir -p for the directories above path
+static void make_parents(const char *path) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; (p = strchr(p, '/')) != NULL; p++) {
+        *p = '\0';
+        mkdir(tmp, 0755);
+        *p = '/';
+    }
+}
+
+static void to_hex(const unsigned char *bytes, size_t n, char *out) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < n; i++) {
+        out[i * 2] = digits[bytes[i] >> 4];
+        out[i * 2 + 1] = digits[bytes[i] & 15];
+    }
+    out[n * 2] = '\0';
+}
+
+void objcache_init(void) {
+    config_read();
+    if (!enabled) return;
+    char exe[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (n <= 0) {
+        MG_ERROR(("objcache: cannot find the server binary, cache disabled"));
+        enabled = false;
+        return;
+    }
+    exe[n] = '\0';
+    char probe[sizeof(cache_dir) + 8];
+    snprintf(probe, sizeof(probe), "%s/stats", cache_dir);
+    make_parents(probe);
+    snprintf(wrapper, sizeof(wrapper), "'%s' " OBJCACHE_FLAG " ", exe);
+    MG_INFO(("objcache: %s, limit %lld MB", cache_dir, cache_max >> 20));
+}
+
+const char *objcache_wrapper(void) {
+    return enabled ? wrapper : "";
+}
+
+const char *objcache_dir(void) {
+    return enabled ? cache_dir : "";
+}
+
+long long objcache_max(void) {
+    return cache_max;
+}
+
+bool objcache_rust_dir(const char *src, char *buf, size_t size) {
+    if (!enabled) return false;
+    char real[PATH_MAX];
+    if (realpath(src, real) == NULL) snprintf(real, sizeof(real), "%s", src);
+    unsigned char digest[32];
+    mg_sha256(digest, (uint8_t *) real, strlen(real));
+    char hex[65];
+    to_hex(digest, 8, hex);
+    const char *base = strrchr(real, '/');
+    snprintf(buf, size, "%s/rust/%s-%s", cache_dir, base != NULL ? base + 1 : real, hex);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Counters: <dir>/stats, updated under flock() by every wrapper
+// ----------------------------------------------------------------------------
+
+static int stats_open(int lock) {
+    char path[sizeof(cache_dir) + 8];
+    snprintf(path, sizeof(path), "%s/stats", cache_dir);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd >= 0 && flock(fd, lock) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static void stats_parse(int fd, struct objcache_stats *st) {
+    char text[512];
+    ssize_t n = pread(fd, text, sizeof(text) - 1, 0);
+    memset(st, 0, sizeof(*st));
+    if (n <= 0) return;
+    text[n] = '\0';
+    sscanf(text, "hits %lld\nmisses %lld\nuncacheable %lld\nsaved_ms %lf\nbytes %lld\nfiles %lld",
+           &st->hits, &st->misses, &st->uncacheable, &st->saved_ms, &st->bytes, &st->files);
+}
+
+// Add `d` to the counters; with `set_size`, its bytes/files replace them
+static void stats_update(const struct objcache_stats *d, bool set_size, struct objcache_stats *out) {
+    int fd = stats_open(LOCK_EX);
+    if (fd < 0) return;
+    struct objcache_stats st;
+    stats_parse(fd, &st);
+    st.hits += d->hits;
+    st.misses += d->misses;
+    st.uncacheable += d->uncacheable;
+    st.saved_ms += d->saved_ms;
+    st.bytes = set_size ? d->bytes : st.bytes + d->bytes;
+    st.files = set_size ? d->files : st.files + d->files;
+    if (st.bytes < 0) st.bytes = 0;
+    if (st.files < 0) st.files = 0;
+    char text[512];
+    int n = snprintf(text, sizeof(text),
+                     "hits %lld\nmisses %lld\nuncacheable %lld\nsaved_ms %.1f\nbytes %lld\nfiles %lld\n",
+                     st.hits, st.misses, st.uncacheable, st.saved_ms, st.bytes, st.files);
+    if (ftruncate(fd, 0) == 0 && pwrite(fd, text, (size_t) n, 0) != n) {
+        // Counters only; the next update rewrites them
+    }
+    close(fd);
+    if (out != NULL) *out = st;
+}
+
+static long long rust_bytes, rust_dirs;
+
+static int rust_visit(const char *path, const struct stat *sb, int type, struct FTW *ftw) {
+    (void) path;
+    if (type == FTW_F) rust_bytes += sb->st_size;
+    if (type == FTW_D && ftw->level == 1) rust_dirs++;
+    return 0;
+}
+
+bool objcache_stats(struct objcache_stats *st) {
+    memset(st, 0, sizeof(*st));
+    if (!enabled) return false;
+    int fd = stats_open(LOCK_SH);
+    if (fd >= 0) {
+        stats_parse(fd, st);
+        close(fd);
+    }
+    char rust[sizeof(cache_dir) + 8];
+    snprintf(rust, sizeof(rust), "%s/rust", cache_dir);
+    rust_bytes = rust_dirs = 0;
+    nftw(rust, rust_visit, 16, FTW_PHYS);
+    st->rust_bytes = rust_bytes;
+    st->rust_dirs = rust_dirs;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Wrapper
+// ----------------------------------------------------------------------------
+
+/**
+ * What the wrapper needs to know about a compiler command line
+ */
+struct cc_args {
+    const char *output;         // -o
+    const char *dep;            // -MF, or derived from output for -MD/-MMD
+    char dep_buf[PATH_MAX];
+    int sources;
+    bool compile;               // -c
+    bool other_mode;            // -E, -S, -M, -MM: not an object compile
+    bool profile_use;           // -fprofile-use: depends on .gcda data not in the key
+    bool records_cwd;           // -g, --coverage...: the object names the working directory
+    char **pp;                  // Preprocessor command line
+};
+
+// Debug info and coverage notes record the compiler's working directory
+static bool records_cwd(const char *a) {
+    if (strncmp(a, "-g", 2) == 0) return strcmp(a, "-g0") != 0 && strcmp(a, "-ggdb0") != 0;
+    return strcmp(a, "--coverage") == 0 || strcmp(a, "-fprofile-arcs") == 0 ||
+           strcmp(a, "-ftest-coverage") == 0;
+}
+
+// Options whose value may be the next argument
+static bool takes_value(const char *a) {
+    static const char *opts[] = {"-o", "-MF", "-MT", "-MQ", "-I", "-D", "-U", "-x", "-include",
+                                 "-isystem", "-iquote", "-idirafter", "-imacros", "-L", "-l"};
+    for (size_t i = 0; i < sizeof(opts) / sizeof(opts[0]); i++) {
+        if (strcmp(a, opts[i]) == 0) return true;
+    }
+    return false;
+}
+
+// Classify the command line and derive the preprocessor one from it:
+// same flags minus -c, -o and the dependency-file options, plus -E
+static bool parse_args(int argc, char **argv, struct cc_args *a) {
+    memset(a, 0, sizeof(*a));
+    a->pp = calloc((size_t) argc + 2, sizeof(char *));
+    if (a->pp == NULL) return false;
+    int np = 0;
+    bool md = false;
+    a->pp[np++] = argv[0];
+    for (int i = 1; i < argc; i++) {
+        const char *s = argv[i];
+        if (strcmp(s, "-c") == 0) {
+            a->compile = true;
+        } else if (strcmp(s, "-E") == 0 || strcmp(s, "-S") == 0 || strcmp(s, "-M") == 0 ||
+                   strcmp(s, "-MM") == 0) {
+            a->other_mode = true;
+        } else if (strncmp(s, "-fprofile-use", 13) == 0 || strncmp(s, "-fauto-profile", 14) == 0) {
+            a->profile_use = true;
+            a->pp[np++] = argv[i];
+        } else if (strcmp(s, "-MD") == 0 || strcmp(s, "-MMD") == 0) {
+            md = true;
+        } else if (strcmp(s, "-MP") == 0) {
+            // Dependency file only
+        } else if (strncmp(s, "-o", 2) == 0) {
+            a->output = s[2] ? s + 2 : (i + 1 < argc ? argv[++i] : NULL);
+        } else if (strncmp(s, "-MF", 3) == 0) {
+            a->dep = s[3] ? s + 3 : (i + 1 < argc ? argv[++i] : NULL);
+        } else if (strcmp(s, "-MT") == 0 || strcmp(s, "-MQ") == 0) {
+            i++;
+        } else if (s[0] == '-' && takes_value(s) && i + 1 < argc) {
+            a->pp[np++] = argv[i];
+            a->pp[np++] = argv[++i];
+        } else {
+            if (s[0] != '-') a->sources++;
+            if (records_cwd(s)) a->records_cwd = true;
+            a->pp[np++] = argv[i];
+        }
+    }
+    a->pp[np++] = "-E";
+    a->pp[np] = NULL;
+
+    if (md && a->dep == NULL && a->output != NULL) {
+        snprintf(a->dep_buf, sizeof(a->dep_buf), "%s", a->output);
+        char *dot = strrchr(a->dep_buf, '.');
+        char *slash = strrchr(a->dep_buf, '/');
+        if (dot != NULL && (slash == NULL || dot > slash)) *dot = '\0';
+        strncat(a->dep_buf, ".d", sizeof(a->dep_buf) - strlen(a->dep_buf) - 1);
+        a->dep = a->dep_buf;
+    }
+    if (!md) a->dep = NULL;
+    return a->compile && !a->other_mode && !a->profile_use && a->sources == 1 &&
+           a->output != NULL && strcmp(a->output, "-") != 0;
+}
+
+// Exit status of a child, 128 + signal if it was killed
+static int wait_status(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return 127;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// Run the compiler; stderr goes to err_fd when it is >= 0
+static int run(char **argv, int err_fd) {
+    pid_t pid = fork();
+    if (pid < 0) return 127;
+    if (pid == 0) {
+        if (err_fd >= 0) dup2(err_fd, STDERR_FILENO);
+        execvp(argv[0], argv);
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    return wait_status(pid);
+}
+
+// Compiler identity: resolved path, size and mtime of the driver
+static void hash_compiler(mg_sha256_ctx *ctx, const char *cc) {
+    char path[PATH_MAX] = "";
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    if (strchr(cc, '/') != NULL) {
+        snprintf(path, sizeof(path), "%s", cc);
+        stat(path, &st);
+    } else {
+        const char *env = getenv("PATH");
+        char dirs[4096];
+        snprintf(dirs, sizeof(dirs), "%s", env != NULL ? env : "/usr/bin:/bin");
+        char *save = NULL;
+        for (char *d = strtok_r(dirs, ":", &save); d != NULL; d = strtok_r(NULL, ":", &save)) {
+            snprintf(path, sizeof(path), "%s/%s", d, cc);
+            if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) break;
+            path[0] = '\0';
+        }
+    }
+    char id[PATH_MAX + 64];
+    int n = snprintf(id, sizeof(id), "%s %lld %lld", path, (long long) st.st_size,
+                     (long long) st.st_mtime);
+    mg_sha256_update(ctx, (unsigned char *) id, (size_t) n + 1);
+}
+
+// Feed the preprocessed source into the hash
+static bool hash_preprocessed(mg_sha256_ctx *ctx, char **pp) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) dup2(null, STDERR_FILENO);
+        execvp(pp[0], pp);
+        _exit(127);
+    }
+    close(fds[1]);
+    unsigned char buf[65536];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        mg_sha256_update(ctx, buf, (size_t) n);
+    }
+    close(fds[0]);
+    return wait_status(pid) == 0;
+}
+
+// Copy through a temporary name so readers never see half a file
+static bool copy_file(const char *from, const char *to) {
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    char tmp[PATH_MAX + 32];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", to, (int) getpid());
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        make_parents(to);
+        out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    bool ok = out >= 0;
+    char buf[65536];
+    ssize_t n;
+    while (ok && (n = read(in, buf, sizeof(buf))) > 0) {
+        ok = write(out, buf, (size_t) n) == n;
+    }
+    close(in);
+    if (out >= 0 && close(out) != 0) ok = false;
+    if (ok && rename(tmp, to) != 0) ok = false;
+    if (!ok) unlink(tmp);
+    return ok;
+}
+
+// Write a captured stderr file to our stderr
+static void replay(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    char buf[8192];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        if (write(STDERR_FILENO, buf, (size_t) n) != n) break;
+    }
+    close(fd);
+}
+
+static long long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long) st.st_size : 0;
+}
+
+/**
+ * A cached object, for eviction
+ */
+struct entry {
+    char base[PATH_MAX];        // Path without extension
+    time_t used;                // .meta mtime, touched on every hit
+    long long bytes;
+};
+
+static int entry_cmp(const void *a, const void *b) {
+    time_t x = ((const struct entry *) a)->used, y = ((const struct entry *) b)->used;
+    return x < y ? -1 : x > y;
+}
+
+static const char *entry_exts[] = {".o", ".d", ".err", ".meta"};
+
+// Evict the least recently used objects until the cache is under EVICT_TO
+// of its limit. One wrapper at a time; the others carry on.
+static void evict(void) {
+    char lock_path[sizeof(cache_dir) + 16];
+    snprintf(lock_path, sizeof(lock_path), "%s/evict.lock", cache_dir);
+    int lock = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock < 0) return;
+    if (flock(lock, LOCK_EX | LOCK_NB) != 0) {
+        close(lock);
+        return;
+    }
+
+    struct entry *entries = NULL;
+    size_t n = 0, cap = 0;
+    long long total = 0;
+    for (int i = 0; i < 256; i++) {
+        char sub[sizeof(cache_dir) + 8];
+        snprintf(sub, sizeof(sub), "%s/%02x", cache_dir, i);
+        DIR *dir = opendir(sub);
+        if (dir == NULL) continue;
+        struct dirent *de;
+        while ((de = readdir(dir)) != NULL) {
+            size_t len = strlen(de->d_name);
+            if (len < 6 || strcmp(de->d_name + len - 5, ".meta") != 0) continue;
+            if (n == cap) {
+                cap = cap ? cap * 2 : 256;
+                struct entry *grown = realloc(entries, cap * sizeof(*entries));
+                if (grown == NULL) break;
+                entries = grown;
+            }
+            struct entry *e = &entries[n];
+            snprintf(e->base, sizeof(e->base), "%s/%.*s", sub, (int) (len - 5), de->d_name);
+            struct stat st;
+            char path[PATH_MAX + 8];
+            snprintf(path, sizeof(path), "%s.meta", e->base);
+            e->used = stat(path, &st) == 0 ? st.st_mtime : 0;
+            e->bytes = 0;
+            for (size_t k = 0; k < sizeof(entry_exts) / sizeof(entry_exts[0]); k++) {
+                snprintf(path, sizeof(path), "%s%s", e->base, entry_exts[k]);
+                e->bytes += file_size(path);
+            }
+            total += e->bytes;
+            n++;
+        }
+        closedir(dir);
+    }
+
+    qsort(entries, n, sizeof(*entries), entry_cmp);
+    size_t kept = n;
+    for (size_t i = 0; i < n && total > (long long) (cache_max * EVICT_TO); i++) {
+        char path[PATH_MAX + 8];
+        snprintf(path, sizeof(path), "%s.meta", entries[i].base);       // Invalidate first
+        unlink(path);
+        for (size_t k = 0; k < sizeof(entry_exts) / sizeof(entry_exts[0]); k++) {
+            snprintf(path, sizeof(path), "%s%s", entries[i].base, entry_exts[k]);
+            unlink(path);
+        }
+        total -= entries[i].bytes;
+        kept--;
+    }
+    free(entries);
+
+    struct objcache_stats size = {.bytes = total, .files = (long long) kept};
+    stats_update(&size, true, NULL);
+    close(lock);
+}
+
+int objcache_main(int argc, char **argv) {
+    if (argc < 1) {
+        fprintf(stderr, "usage: file_manager " OBJCACHE_FLAG " <compiler> <args...>\n");
+        return 2;
+    }
+    config_read();
+    struct objcache_stats delta = {0};
+    struct cc_args a;
+    bool cacheable = enabled && parse_args(argc, argv, &a);
+
+    // Key: format version, compiler identity, arguments, the working
+    // directory when the object records it, preprocessed source
+    mg_sha256_ctx ctx;
+    mg_sha256_init(&ctx);
+    if (cacheable) {
+        mg_sha256_update(&ctx, (unsigned char *) KEY_VERSION, sizeof(KEY_VERSION));
+        hash_compiler(&ctx, argv[0]);
+        for (int i = 1; i < argc; i++) {
+            mg_sha256_update(&ctx, (unsigned char *) argv[i], strlen(argv[i]) + 1);
+        }
+        char cwd[PATH_MAX];
+        if (a.records_cwd && getcwd(cwd, sizeof(cwd)) == NULL) cacheable = false;
+        if (cacheable && a.records_cwd) {
+            mg_sha256_update(&ctx, (unsigned char *) cwd, strlen(cwd) + 1);
+        }
+        if (cacheable) cacheable = hash_preprocessed(&ctx, a.pp);
+    }
+    if (!cacheable) {
+        if (enabled) {
+            delta.uncacheable = 1;
+            stats_update(&delta, false, NULL);
+        }
+        if (enabled) free(a.pp);
+        return run(argv, -1);
+    }
+
+    unsigned char digest[32];
+    mg_sha256_final(digest, &ctx);
+    char key[65];
+    to_hex(digest, sizeof(digest), key);
+    char base[PATH_MAX], obj[PATH_MAX + 8], dep[PATH_MAX + 8], err[PATH_MAX + 8], meta[PATH_MAX + 8];
+    snprintf(base, sizeof(base), "%s/%.2s/%s", cache_dir, key, key);
+    snprintf(obj, sizeof(obj), "%s.o", base);
+    snprintf(dep, sizeof(dep), "%s.d", base);
+    snprintf(err, sizeof(err), "%s.err", base);
+    snprintf(meta, sizeof(meta), "%s.meta", base);
+
+    // Hit: copy the object (and dependency file) out, replay the warnings
+    double start = now_ms();
+    FILE *fp = fopen(meta, "r");
+    if (fp != NULL) {
+        double compile_ms = 0;
+        bool valid = fscanf(fp, "%lf", &compile_ms) == 1;
+        fclose(fp);
+        if (valid && copy_file(obj, a.output) && (a.dep == NULL || copy_file(dep, a.dep))) {
+            replay(err);
+            utime(meta, NULL);
+            delta.hits = 1;
+            delta.saved_ms = compile_ms - (now_ms() - start);
+            if (delta.saved_ms < 0) delta.saved_ms = 0;
+            stats_update(&delta, false, NULL);
+            free(a.pp);
+            return 0;
+        }
+    }
+
+    // Miss: compile with stderr captured, then store the results
+    char err_tmp[PATH_MAX + 32];
+    snprintf(err_tmp, sizeof(err_tmp), "%s.tmp.%d", err, (int) getpid());
+    make_parents(err_tmp);
+    int err_fd = open(err_tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int status = run(argv, err_fd);
+    double compile_ms = now_ms() - start;
+    if (err_fd >= 0) close(err_fd);
+    replay(err_tmp);
+
+    delta.misses = 1;
+    if (status == 0 && err_fd >= 0 && rename(err_tmp, err) == 0 && copy_file(a.output, obj) &&
+        (a.dep == NULL || copy_file(a.dep, dep))) {
+        FILE *out = fopen(meta, "w");
+        if (out != NULL) {
+            fprintf(out, "%.3f\n", compile_ms);
+            fclose(out);
+            delta.files = 1;
+            delta.bytes = file_size(obj) + file_size(err) + file_size(meta) +
+                          (a.dep != NULL ? file_size(dep) : 0);
+        }
+    } else {
+        unlink(err_tmp);
+    }
+    struct objcache_stats now;
+    memset(&now, 0, sizeof(now));
+    stats_update(&delta, false, &now);
+    if (now.bytes > cache_max) evict();
+    free(a.pp);
+    return status;
+}
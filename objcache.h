@@ -0,0 +1,82 @@
+#ifndef OBJCACHE_H
+#define OBJCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// ============================================================================
+// NEXUS File Manager - Object Cache
+// ============================================================================
+
+// The server binary doubles as a ccache-style compiler wrapper:
+//   file_manager --objcache gcc -c -o x.o x.c
+// It runs inside the compile job, so cache lookups never block the event loop.
+#define OBJCACHE_FLAG "--objcache"
+
+/**
+ * Cache counters, shared by every wrapper process through <dir>/stats
+ */
+struct objcache_stats {
+    long long hits;
+    long long misses;
+    long long uncacheable;      // Not a single -c compile, profile-guided, or preprocessing failed
+    double saved_ms;            // Compile time the hits did not spend
+    long long bytes;            // Object cache size
+    long long files;            // Cached objects
+    long long rust_bytes;       // rustc -C incremental directories
+    long long rust_dirs;
+};
+
+/**
+ * Read the cache settings from the environment:
+ *   NEXUS_OBJCACHE       0 disables the cache (default on)
+ *   NEXUS_OBJCACHE_DIR   cache directory (default $HOME/.cache/nexus)
+ *   NEXUS_OBJCACHE_MAX   size limit, suffixes K/M/G allowed (default 1G);
+ *                        least recently used objects are evicted beyond it
+ */
+void objcache_init(void);
+
+/**
+ * Command prefix that routes a compile through the cache, e.g.
+ * "'/usr/bin/file_manager' --objcache ", or "" when the cache is off
+ */
+const char *objcache_wrapper(void);
+
+/**
+ * Managed `-C incremental` directory for a Rust source
+ *
+ * @param src Source path
+ * @param buf Destination
+ * @param size Size of buf
+ * @return false when the cache is off
+ */
+bool objcache_rust_dir(const char *src, char *buf, size_t size);
+
+/**
+ * Current counters and sizes
+ *
+ * @param st Filled in
+ * @return false when the cache is off
+ */
+bool objcache_stats(struct objcache_stats *st);
+
+/**
+ * Cache directory, "" when the cache is off
+ */
+const char *objcache_dir(void);
+
+/**
+ * Size limit in bytes
+ */
+long long objcache_max(void);
+
+/**
+ * Wrapper entry point: compile through the cache
+ *
+ * @param argc Number of compiler arguments, compiler included
+ * @param argv Compiler and its arguments
+ * @return Compiler exit status
+ */
+int objcache_main(int argc, char **argv);
+
+#endif // OBJCACHE_H
@@ -0,0 +1,296 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "output.h"
+
+#define READ_BUDGET (1 << 20)       // Bytes taken from one stream per loop iteration
+#define INITIAL_BUF 4096
+
+static struct mg_mgr *mgr;
+static size_t memory_max = 256 * 1024;
+static uint64_t output_max = 4ull << 30;
+static int keep_max = 32;
+static double ttl_ms = 600 * 1e3;
+static struct output *outputs;      // Running and kept, newest first
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// "256K" -> bytes
+static unsigned long long parse_size(const char *s) {
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': return v << 10;
+        case 'm': case 'M': return v << 20;
+        case 'g': case 'G': return v << 30;
+        default: return v;
+    }
+}
+
+void output_init(struct mg_mgr *m) {
+    const char *env;
+    mgr = m;
+    if ((env = getenv("NEXUS_OUTPUT_MEMORY")) != NULL && parse_size(env) >= INITIAL_BUF) {
+        memory_max = (size_t) parse_size(env);
+    }
+    if ((env = getenv("NEXUS_OUTPUT_MAX")) != NULL && *env != '\0') output_max = parse_size(env);
+    if ((env = getenv("NEXUS_OUTPUT_KEEP")) != NULL && *env != '\0') keep_max = atoi(env);
+    if ((env = getenv("NEXUS_OUTPUT_TTL")) != NULL && *env != '\0') ttl_ms = atof(env) * 1e3;
+    MG_INFO(("output: %lu bytes in memory per job, %llu kept, last %d jobs for %d s",
+             (unsigned long) memory_max, (unsigned long long) output_max, keep_max,
+             (int) (ttl_ms / 1e3)));
+}
+
+struct output *output_create(unsigned long id, bool keep, const char *kind) {
+    struct output *o = calloc(1, sizeof(*o));
+    if (o == NULL) return NULL;
+    o->id = id;
+    o->fd = -1;
+    o->limit = output_max;
+    o->keep = keep;
+    o->refs = 1;
+    snprintf(o->path, sizeof(o->path), "/tmp/nexus_%s_%d_%lu.txt", kind, (int) getpid(), id);
+    o->next = outputs;
+    outputs = o;
+    return o;
+}
+
+static bool write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+// Memory buffer to the spill file, creating it the first time. When the
+// disk fails nothing more is kept: readers get what made it so far.
+static void flush(struct output *o) {
+    if (o->buf_len == 0) return;
+    if (o->fd < 0 && (o->fd = open(o->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0) {
+        MG_ERROR(("output: job %lu: cannot create %s: %s", o->id, o->path, strerror(errno)));
+        o->limit = o->size;
+        return;
+    }
+    if (!write_all(o->fd, o->buf, o->buf_len)) {
+        MG_ERROR(("output: job %lu: cannot write %s: %s", o->id, o->path, strerror(errno)));
+        if (ftruncate(o->fd, (off_t) o->flushed) != 0) o->flushed = 0;
+        o->size = o->limit = o->flushed;
+        o->buf_len = 0;
+        return;
+    }
+    o->flushed += o->buf_len;
+    o->buf_len = 0;
+}
+
+// Bytes past the limit: only the last OUTPUT_TAIL_RING of them stay
+static void ring_put(struct output *o, const char *data, size_t n) {
+    if (o->ring == NULL && (o->ring = malloc(OUTPUT_TAIL_RING)) == NULL) return;
+    uint64_t dropped = o->total - o->size - n;      // Before these
+    if (n > OUTPUT_TAIL_RING) {
+        dropped += n - OUTPUT_TAIL_RING;
+        data += n - OUTPUT_TAIL_RING;
+        n = OUTPUT_TAIL_RING;
+    }
+    size_t at = (size_t) (dropped % OUTPUT_TAIL_RING);
+    size_t first = n < OUTPUT_TAIL_RING - at ? n : OUTPUT_TAIL_RING - at;
+    memcpy(o->ring + at, data, first);
+    memcpy(o->ring, data + first, n - first);
+}
+
+static void append(struct output *o, const char *data, size_t n) {
+    o->total += n;
+    while (n > 0 && o->size < o->limit) {
+        if (o->buf_len == o->buf_size) {
+            if (o->buf_size < memory_max) {
+                size_t grow = o->buf_size == 0 ? INITIAL_BUF : o->buf_size * 2;
+                char *p = realloc(o->buf, grow < memory_max ? grow : memory_max);
+                if (p == NULL) break;
+                o->buf = p;
+                o->buf_size = grow < memory_max ? grow : memory_max;
+            } else {
+                flush(o);
+                continue;
+            }
+        }
+        size_t k = o->buf_size - o->buf_len;
+        if (k > n) k = n;
+        if (k > o->limit - o->size) k = (size_t) (o->limit - o->size);
+        memcpy(o->buf + o->buf_len, data, k);
+        o->buf_len += k;
+        o->size += k;
+        data += k;
+        n -= k;
+    }
+    if (n > 0) ring_put(o, data, n);
+}
+
+// Whatever the socket holds right now, up to `budget` bytes; false at EOF
+static bool drain(struct output *o, int fd, size_t budget) {
+    char chunk[65536];
+    while (budget > 0) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+        if (n == 0) return false;
+        append(o, chunk, (size_t) n);
+        budget = (size_t) n < budget ? budget - (size_t) n : 0;
+    }
+    return true;
+}
+
+// Reading end of a job's stream. Mongoose reads one buffer per loop
+// iteration; the rest of what is waiting is taken right after it.
+static void capture_handler(struct mg_connection *c, int ev, void *ev_data) {
+    (void) ev_data;
+    struct output *o = c->fn_data;
+    if (o == NULL) return;
+    if (ev == MG_EV_READ) {
+        append(o, (const char *) c->recv.buf, c->recv.len);
+        c->recv.len = 0;
+        if (!drain(o, (int) (size_t) c->fd, READ_BUDGET)) c->is_closing = 1;
+    } else if (ev == MG_EV_CLOSE) {
+        o->conn = NULL;
+    }
+}
+
+int output_attach(struct output *o) {
+    int sp[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sp) != 0) return -1;
+    int flags = fcntl(sp[0], F_GETFL);
+    fcntl(sp[0], F_SETFL, flags | O_NONBLOCK);
+    shutdown(sp[0], SHUT_WR);
+    shutdown(sp[1], SHUT_RD);
+    if ((o->conn = mg_wrapfd(mgr, sp[0], capture_handler, o)) == NULL) {
+        close(sp[0]);
+        close(sp[1]);
+        return -1;
+    }
+    mg_iobuf_resize(&o->conn->recv, 65536);
+    return sp[1];
+}
+
+void output_end(struct output *o) {
+    if (o == NULL || o->complete) return;
+    if (o->conn != NULL) {
+        // The job is gone and so is what it left running, bar processes
+        // that escaped its group: take what the socket buffer still holds
+        drain(o, (int) (size_t) o->conn->fd, 16 * READ_BUDGET);
+        o->conn->fn_data = NULL;
+        o->conn->is_closing = 1;
+        o->conn = NULL;
+    }
+    if (o->fd >= 0) {
+        flush(o);
+        free(o->buf);
+        o->buf = NULL;
+        o->buf_size = 0;
+    }
+    o->complete = true;
+    o->ended_ms = now_ms();
+}
+
+static void output_free(struct output *o) {
+    for (struct output **p = &outputs; *p != NULL; p = &(*p)->next) {
+        if (*p == o) {
+            *p = o->next;
+            break;
+        }
+    }
+    if (o->conn != NULL) {
+        o->conn->fn_data = NULL;
+        o->conn->is_closing = 1;
+    }
+    if (o->fd >= 0) {
+        close(o->fd);
+        unlink(o->path);
+    }
+    free(o->buf);
+    free(o->ring);
+    free(o);
+}
+
+// Forget kept outputs beyond NEXUS_OUTPUT_KEEP or older than NEXUS_OUTPUT_TTL
+static void expire(void) {
+    double now = now_ms();
+    int kept = 0;
+    for (struct output *o = outputs, *next; o != NULL; o = next) {
+        next = o->next;
+        if (o->refs > 0) continue;
+        if (++kept > keep_max || now - o->ended_ms > ttl_ms) output_free(o);
+    }
+}
+
+void output_release(struct output *o) {
+    if (o == NULL) return;
+    output_end(o);
+    if (--o->refs == 0 && !o->keep) output_free(o);
+    expire();
+}
+
+struct output *output_find(unsigned long id) {
+    expire();
+    for (struct output *o = outputs; o != NULL; o = o->next) {
+        if (o->id == id && o->keep) return o;
+    }
+    return NULL;
+}
+
+size_t output_read(const struct output *o, uint64_t offset, char *buf, size_t len) {
+    if (offset >= o->size) return 0;
+    if (len > o->size - offset) len = (size_t) (o->size - offset);
+    size_t done = 0;
+    // The spill file holds [0, flushed), the buffer [flushed, size)
+    while (done < len && offset < o->flushed) {
+        size_t want = len - done;
+        if (want > o->flushed - offset) want = (size_t) (o->flushed - offset);
+        ssize_t n = pread(o->fd, buf + done, want, (off_t) offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return done;
+        done += (size_t) n;
+        offset += (uint64_t) n;
+    }
+    if (done < len) {
+        memcpy(buf + done, o->buf + (offset - o->flushed), len - done);
+        done = len;
+    }
+    return done;
+}
+
+size_t output_tail(const struct output *o, char *buf, size_t len, uint64_t *offset) {
+    if (o->total == o->size) {
+        if (len > o->size) len = (size_t) o->size;
+        *offset = o->size - len;
+        return output_read(o, *offset, buf, len);
+    }
+    uint64_t dropped = o->total - o->size;
+    if (len > dropped) len = (size_t) dropped;
+    if (len > OUTPUT_TAIL_RING) len = OUTPUT_TAIL_RING;
+    if (o->ring == NULL) len = 0;
+    *offset = o->total - len;
+    size_t at = (size_t) ((dropped - len) % OUTPUT_TAIL_RING);
+    size_t first = len < OUTPUT_TAIL_RING - at ? len : OUTPUT_TAIL_RING - at;
+    if (len > 0) {
+        memcpy(buf, o->ring + at, first);
+        memcpy(buf + first, o->ring, len - first);
+    }
+    return len;
+}
+
+FILE *output_fopen(const struct output *o) {
+    if (o->fd >= 0) return fopen(o->path, "r");
+    // fmemopen() refuses empty buffers on some libcs
+    if (o->buf_len == 0) return fopen("/dev/null", "r");
+    return fmemopen(o->buf, o->buf_len, "r");
+}
@@ -0,0 +1,125 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "mongoose.h"
+
+// ============================================================================
+// NEXUS File Manager - Job Output
+// ============================================================================
+
+#define OUTPUT_PAGE_MAX (4 << 20)       // Bytes per output_read() page over the API
+#define OUTPUT_TAIL_RING (64 * 1024)    // Last bytes kept once the disk limit is hit
+
+/**
+ * What one job wrote to a stream, captured through a socket the event loop
+ * reads. The bytes stay in memory up to a threshold, then go to a per-job
+ * spill file, with the memory buffer batching the writes. Beyond the disk
+ * limit only the last OUTPUT_TAIL_RING bytes are kept, in a ring.
+ */
+struct output {
+    unsigned long id;           // Job id
+    struct mg_connection *conn; // Reading end while the job runs
+    char path[64];              // Spill file, created once the output outgrows memory
+    int fd;                     // Spill file, -1 before
+    char *buf;                  // Not spilled: all of it. Spilled: bytes not written yet
+    size_t buf_len, buf_size;
+    uint64_t flushed;           // Bytes in the spill file
+    uint64_t size;              // Bytes kept, from the start of the output
+    uint64_t limit;             // Bytes that may be kept; lowered when the disk fails
+    uint64_t total;             // Bytes the job wrote, kept or not
+    char *ring;                 // Last bytes past `limit`, NULL until there are any
+    bool complete;              // The job has ended and everything it wrote is in
+    bool keep;                  // Stays available after the job, for output_find()
+    int refs;
+    double ended_ms;
+    struct output *next;
+};
+
+/**
+ * Read the settings from the environment:
+ *   NEXUS_OUTPUT_MEMORY   bytes kept in memory before spilling to disk
+ *                         (default 256K)
+ *   NEXUS_OUTPUT_MAX      bytes kept per job, suffixes K/M/G allowed
+ *                         (default 4G); beyond it only the tail is kept
+ *   NEXUS_OUTPUT_KEEP     finished jobs whose output stays available
+ *                         (default 32)
+ *   NEXUS_OUTPUT_TTL      seconds a finished job's output stays available
+ *                         (default 600)
+ *
+ * @param mgr Event manager whose loop reads the jobs' output
+ */
+void output_init(struct mg_mgr *mgr);
+
+/**
+ * New, empty output for a job
+ *
+ * @param id Job id
+ * @param keep Keep it after the job ends, to be found by id
+ * @param kind "output" or "error", for the spill file name
+ * @return Output, or NULL without memory
+ */
+struct output *output_create(unsigned long id, bool keep, const char *kind);
+
+/**
+ * Start capturing: the returned descriptor is the job's end of the stream,
+ * for the child's stdout or stderr; the caller closes it after fork()
+ *
+ * @return File descriptor, or -1 on failure
+ */
+int output_attach(struct output *o);
+
+/**
+ * The job has ended: take in what is still buffered in the stream, stop
+ * reading it and flush the memory buffer to the spill file
+ */
+void output_end(struct output *o);
+
+/**
+ * Drop the job's reference. An output kept for later stays until it
+ * expires; any other is freed, with its spill file.
+ */
+void output_release(struct output *o);
+
+/**
+ * Output of a running or recently finished job
+ *
+ * @param id Job id
+ * @return Output, or NULL if there is none (any more)
+ */
+struct output *output_find(unsigned long id);
+
+/**
+ * Copy kept bytes from a byte offset
+ *
+ * @param o Output
+ * @param offset From the start of the output
+ * @param buf Destination
+ * @param len Bytes wanted
+ * @return Bytes copied, 0 at the end of what is kept
+ */
+size_t output_read(const struct output *o, uint64_t offset, char *buf, size_t len);
+
+/**
+ * Copy the last bytes the job wrote: from the kept output, or from the ring
+ * once bytes were dropped
+ *
+ * @param o Output
+ * @param buf Destination
+ * @param len Bytes wanted
+ * @param offset Set to the offset of the first byte copied
+ * @return Bytes copied
+ */
+size_t output_tail(const struct output *o, char *buf, size_t len, uint64_t *offset);
+
+/**
+ * Stream over a complete output, from the start; the caller fcloses it
+ *
+ * @return Stream, or NULL on failure
+ */
+FILE *output_fopen(const struct output *o);
+
+#endif // OUTPUT_H
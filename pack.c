@@ -0,0 +1,167 @@
+// ============================================================================
+// NEXUS File Manager - Web Asset Packer (build tool)
+// ============================================================================
+//
+// Packs the web interface into a C source file for Mongoose's packed
+// filesystem. For every input file it emits, under /web/:
+//   <name>       the original bytes
+//   <name>.gz    gzip -9 variant
+//   <name>.br    brotli (quality 11) variant
+//   <name>.etag  unquoted ETag base from a SHA-256 of the original bytes;
+//                the server adds a -br / -gz mark for the compressed ones
+//
+// Usage: ./pack index.html style.css app.js > packed_fs.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <brotli/encode.h>
+#include "mongoose.h"
+
+struct blob {
+    unsigned char *data;
+    size_t size;
+};
+
+static int read_file(const char *path, struct blob *out, time_t *mtime) {
+    FILE *fp = fopen(path, "rb");
+    struct stat st;
+    if (!fp || fstat(fileno(fp), &st) != 0) {
+        if (fp) fclose(fp);
+        return -1;
+    }
+    out->size = (size_t) st.st_size;
+    out->data = malloc(out->size + 1);
+    if (!out->data || fread(out->data, 1, out->size, fp) != out->size) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    *mtime = st.st_mtime;
+    return 0;
+}
+
+static int gzip_blob(const struct blob *in, struct blob *out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits 15 + 16 selects the gzip wrapper
+    if (deflateInit2(&zs, 9, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) return -1;
+    out->size = deflateBound(&zs, in->size) + 32;
+    out->data = malloc(out->size);
+    zs.next_in = in->data;
+    zs.avail_in = (uInt) in->size;
+    zs.next_out = out->data;
+    zs.avail_out = (uInt) out->size;
+    int rc = deflate(&zs, Z_FINISH);
+    out->size = zs.total_out;
+    deflateEnd(&zs);
+    return rc == Z_STREAM_END ? 0 : -1;
+}
+
+static int brotli_blob(const struct blob *in, struct blob *out) {
+    out->size = BrotliEncoderMaxCompressedSize(in->size);
+    if (out->size == 0) out->size = in->size + 1024;
+    out->data = malloc(out->size);
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                               in->size, in->data, &out->size, out->data)) {
+        return -1;
+    }
+    return 0;
+}
+
+static void emit_blob(int index, const struct blob *b) {
+    printf("static const unsigned char v%d[] = {", index);
+    for (size_t i = 0; i < b->size; i++) {
+        printf("%s%d,", i % 24 == 0 ? "\n  " : "", b->data[i]);
+    }
+    printf("\n  0  // NUL terminator, not counted in the size\n};\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s FILE... > packed_fs.c\n", argv[0]);
+        return 1;
+    }
+
+    // Four variants per input file
+    int nfiles = argc - 1, nvariants = nfiles * 4;
+    char (*names)[256] = calloc((size_t) nvariants, sizeof(*names));
+    size_t *sizes = calloc((size_t) nvariants, sizeof(*sizes));
+    time_t *mtimes = calloc((size_t) nvariants, sizeof(*mtimes));
+
+    printf("// Generated by pack.c from the web interface sources. Do not edit.\n");
+    printf("#include <stddef.h>\n#include <string.h>\n#include <time.h>\n\n");
+
+    for (int f = 0; f < nfiles; f++) {
+        const char *path = argv[f + 1];
+        const char *base = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+        struct blob raw, gz, br, etag;
+        time_t mtime;
+
+        if (read_file(path, &raw, &mtime) != 0) {
+            fprintf(stderr, "pack: cannot read %s\n", path);
+            return 1;
+        }
+        if (gzip_blob(&raw, &gz) != 0 || brotli_blob(&raw, &br) != 0) {
+            fprintf(stderr, "pack: cannot compress %s\n", path);
+            return 1;
+        }
+
+        uint8_t digest[32];
+        mg_sha256(digest, raw.data, raw.size);
+        // Bare opaque tag: the server quotes it and marks the coding (assets.c)
+        char tag[40];
+        snprintf(tag, sizeof(tag), "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
+                 digest[0], digest[1], digest[2], digest[3], digest[4], digest[5],
+                 digest[6], digest[7], digest[8], digest[9], digest[10], digest[11]);
+        etag.data = (unsigned char *) tag;
+        etag.size = strlen(tag);
+
+        const struct blob *variants[4] = {&raw, &gz, &br, &etag};
+        const char *suffixes[4] = {"", ".gz", ".br", ".etag"};
+        for (int v = 0; v < 4; v++) {
+            int i = f * 4 + v;
+            emit_blob(i, variants[v]);
+            snprintf(names[i], sizeof(names[i]), "/web/%s%s", base, suffixes[v]);
+            sizes[i] = variants[v]->size;
+            mtimes[i] = mtime;
+        }
+        fprintf(stderr, "pack: %-12s %7lu bytes, gzip %6lu, br %6lu\n", base,
+                (unsigned long) raw.size, (unsigned long) gz.size, (unsigned long) br.size);
+    }
+
+    printf("\nstatic const struct packed_file {\n"
+           "  const char *name;\n"
+           "  const unsigned char *data;\n"
+           "  size_t size;\n"
+           "  time_t mtime;\n"
+           "} packed_files[] = {\n");
+    for (int i = 0; i < nvariants; i++) {
+        printf("  {\"%s\", v%d, %lu, %lu},\n", names[i], i, (unsigned long) sizes[i],
+               (unsigned long) mtimes[i]);
+    }
+    printf("  {NULL, NULL, 0, 0}\n};\n\n");
+
+    printf("static int scmp(const char *a, const char *b) {\n"
+           "  while (*a && (*a == *b)) a++, b++;\n"
+           "  return *(const unsigned char *) a - *(const unsigned char *) b;\n"
+           "}\n\n"
+           "const char *mg_unlist(size_t no);\n"
+           "const char *mg_unlist(size_t no) {\n"
+           "  return packed_files[no].name;\n"
+           "}\n\n"
+           "const char *mg_unpack(const char *name, size_t *size, time_t *mtime);\n"
+           "const char *mg_unpack(const char *name, size_t *size, time_t *mtime) {\n"
+           "  const struct packed_file *p;\n"
+           "  for (p = packed_files; p->name != NULL; p++) {\n"
+           "    if (scmp(p->name, name) != 0) continue;\n"
+           "    if (size != NULL) *size = p->size;\n"
+           "    if (mtime != NULL) *mtime = p->mtime;\n"
+           "    return (const char *) p->data;\n"
+           "  }\n"
+           "  return NULL;\n"
+           "}\n");
+    return 0;
+}
@@ -0,0 +1,491 @@
+#define _GNU_SOURCE         // ptsname_r()
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "exec.h"
+#include "pty.h"
+
+/**
+ * One browser terminal: its WebSocket, the relay socket and the job
+ * running the relay. It is freed once the job has ended and the relay
+ * socket has been read to the end, so no output is lost.
+ */
+struct pty_session {
+    unsigned long id;
+    struct mg_connection *ws;       // NULL once closed
+    struct mg_connection *relay;    // NULL once closed
+    bool ended;                     // Job over, exit status below
+    enum exec_end end;
+    int exit_code;
+    struct pty_session *next;
+};
+
+static struct pty_session *sessions;
+static int nsessions;
+static int max_sessions = 64;
+static unsigned long next_id = 1;
+static char relay_exe[PATH_MAX];
+
+void pty_init(void) {
+    const char *env = getenv("NEXUS_PTY_MAX");
+    if (env != NULL && *env != '\0') max_sessions = atoi(env);
+    ssize_t n = readlink("/proc/self/exe", relay_exe, sizeof(relay_exe) - 1);
+    if (n <= 0) {
+        MG_ERROR(("pty: cannot find the server binary, interactive sessions disabled"));
+        max_sessions = 0;
+        return;
+    }
+    relay_exe[n] = '\0';
+}
+
+int pty_sessions(void) {
+    return nsessions;
+}
+
+static struct pty_session *session_by_id(unsigned long id) {
+    struct pty_session *s = sessions;
+    while (s != NULL && s->id != id) s = s->next;
+    return s;
+}
+
+static struct pty_session *session_by_ws(struct mg_connection *c) {
+    struct pty_session *s = sessions;
+    while (s != NULL && s->ws != c) s = s->next;
+    return s;
+}
+
+// Job over and every byte of output forwarded: tell the browser, free
+static void session_finish(struct pty_session *s) {
+    if (!s->ended || s->relay != NULL) return;
+    if (s->ws != NULL) {
+        const char *end = s->end == EXEC_TIMEOUT ? "timeout" :
+                          s->end == EXEC_CPU_TIMEOUT ? "cpu_timeout" :
+                          s->end == EXEC_CANCELLED ? "cancelled" : "exited";
+        mg_ws_printf(s->ws, WEBSOCKET_OP_TEXT, "{%m:%m,%m:%d,%m:%m}",
+                     MG_ESC("type"), MG_ESC("exit"), MG_ESC("exitCode"), s->exit_code,
+                     MG_ESC("end"), MG_ESC(end));
+        s->ws->is_full = false;
+        s->ws->is_draining = 1;
+    }
+    struct pty_session **pp = &sessions;
+    while (*pp != s) pp = &(*pp)->next;
+    *pp = s->next;
+    nsessions--;
+    MG_INFO(("pty %lu: closed, exit code %d", s->id, s->exit_code));
+    free(s);
+}
+
+static void session_done(struct exec_job *job) {
+    struct pty_session *s = session_by_id((unsigned long) (uintptr_t) job->data);
+    if (s == NULL) return;
+    s->ended = true;
+    s->end = job->end;
+    s->exit_code = job->stats.exit_code;
+    session_finish(s);
+}
+
+// ----------------------------------------------------------------------------
+// Server side: relay socket <-> WebSocket, with backpressure both ways
+// ----------------------------------------------------------------------------
+
+static void relay_handler(struct mg_connection *c, int ev, void *ev_data) {
+    struct pty_session *s = session_by_id((unsigned long) (uintptr_t) c->fn_data);
+    (void) ev_data;
+    if (s == NULL) return;
+    if (ev == MG_EV_READ) {
+        // Terminal output, forwarded as it arrives
+        if (s->ws != NULL) {
+            mg_ws_send(s->ws, c->recv.buf, c->recv.len, WEBSOCKET_OP_BINARY);
+            if (s->ws->send.len > PTY_HIGH_WATER) c->is_full = true;
+        }
+        c->recv.len = 0;
+    } else if (ev == MG_EV_POLL) {
+        // A slow browser stops the reads, and the relay, and the program
+        if (c->is_full && (s->ws == NULL || s->ws->send.len < PTY_LOW_WATER)) {
+            c->is_full = false;
+        }
+        // A program that does not read its input stops the browser's messages
+        if (s->ws != NULL && s->ws->is_full && c->send.len < PTY_LOW_WATER) {
+            s->ws->is_full = false;
+        }
+    } else if (ev == MG_EV_CLOSE) {
+        s->relay = NULL;
+        if (s->ws != NULL) s->ws->is_full = false;
+        session_finish(s);
+    }
+}
+
+// Queue one frame for the relay
+static void relay_frame(struct pty_session *s, char type, const void *buf, size_t len) {
+    if (s->relay == NULL) return;
+    const char *p = buf;
+    do {
+        size_t n = len > PTY_FRAME_MAX ? PTY_FRAME_MAX : len;
+        uint8_t hdr[3] = {(uint8_t) type, (uint8_t) (n >> 8), (uint8_t) n};
+        mg_send(s->relay, hdr, sizeof(hdr));
+        mg_send(s->relay, p, n);
+        p += n;
+        len -= n;
+    } while (len > 0);
+    if (s->ws != NULL && s->relay->send.len > PTY_HIGH_WATER) s->ws->is_full = true;
+}
+
+static void relay_resize(struct pty_session *s, long cols, long rows) {
+    if (cols < 1 || cols > 1000 || rows < 1 || rows > 1000) return;
+    uint8_t size[4] = {(uint8_t) (cols >> 8), (uint8_t) cols, (uint8_t) (rows >> 8), (uint8_t) rows};
+    relay_frame(s, PTY_FRAME_RESIZE, size, sizeof(size));
+}
+
+void pty_ws_message(struct mg_connection *c, struct mg_ws_message *wm) {
+    struct pty_session *s = session_by_ws(c);
+    if (s == NULL) return;
+    if ((wm->flags & 15) == WEBSOCKET_OP_BINARY) {
+        relay_frame(s, PTY_FRAME_DATA, wm->data.buf, wm->data.len);
+        return;
+    }
+    char *type = mg_json_get_str(wm->data, "$.type");
+    if (type != NULL && strcmp(type, "input") == 0) {
+        char *data = mg_json_get_str(wm->data, "$.data");
+        if (data != NULL) relay_frame(s, PTY_FRAME_DATA, data, strlen(data));
+        free(data);
+    } else if (type != NULL && strcmp(type, "resize") == 0) {
+        relay_resize(s, mg_json_get_long(wm->data, "$.cols", 0),
+                     mg_json_get_long(wm->data, "$.rows", 0));
+    }
+    free(type);
+}
+
+void pty_close(struct mg_connection *c) {
+    struct pty_session *s = session_by_ws(c);
+    if (s == NULL) return;
+    // The relay sees end of input and hangs up the terminal; the job is
+    // also stopped by exec_unsubscribe() when nobody is left watching
+    s->ws = NULL;
+    if (s->relay != NULL) s->relay->is_closing = 1;
+}
+
+static void put(char *buf, size_t size, size_t *len, const char *s, size_t n) {
+    if (*len < size) memcpy(buf + *len, s, *len + n < size ? n : size - *len);
+    *len += n;
+}
+
+// Append one single-quoted shell word; returns the length it needs
+static size_t quote_arg(char *buf, size_t size, size_t len, const char *s) {
+    put(buf, size, &len, " '", 2);
+    for (; *s != '\0'; s++) {
+        if (*s == '\'') put(buf, size, &len, "'\\''", 4);
+        else put(buf, size, &len, s, 1);
+    }
+    put(buf, size, &len, "'", 2);       // With the NUL
+    return len - 1;
+}
+
+bool pty_open(struct mg_connection *c, struct mg_http_message *hm, const char *command,
+              const char *name, int cols, int rows, const char *client, const char **error) {
+    if (nsessions >= max_sessions) {
+        *error = "Too many interactive sessions, try again later";
+        return false;
+    }
+    if (cols < 1 || cols > 1000) cols = 80;
+    if (rows < 1 || rows > 1000) rows = 24;
+
+    char relay[4096];
+    size_t len = (size_t) snprintf(relay, sizeof(relay), "'%s' " PTY_RELAY_FLAG " %d %d",
+                                   relay_exe, cols, rows);
+    if (quote_arg(relay, sizeof(relay), len, command) >= sizeof(relay)) {
+        *error = "Command too long";
+        return false;
+    }
+
+    int sp[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sp) != 0) {
+        *error = "Cannot create the session socket";
+        return false;
+    }
+    struct pty_session *s = calloc(1, sizeof(*s));
+    if (s != NULL) s->id = next_id++;
+    if (s == NULL || (s->relay = mg_wrapfd(c->mgr, sp[0], relay_handler,
+                                           (void *) (uintptr_t) s->id)) == NULL) {
+        free(s);
+        close(sp[0]);
+        close(sp[1]);
+        *error = "Out of memory";
+        return false;
+    }
+    fcntl(sp[0], F_SETFL, fcntl(sp[0], F_GETFL) | O_NONBLOCK);
+    s->ws = c;
+    s->next = sessions;
+    sessions = s;
+    nsessions++;
+
+    struct exec_request req = {
+        .command = relay,
+        .name = name,
+        .client = client,
+        .priority = EXEC_PRIO_RUN,
+        .stdio_fd = sp[1],
+        .interactive = true,
+        .done = session_done,
+        .data = (void *) (uintptr_t) s->id,
+    };
+    struct exec_job *job = exec_start(&req);
+    if (job == NULL) {
+        s->ws = NULL;
+        s->ended = true;
+        s->relay->is_closing = 1;
+        *error = "Out of memory";
+        return false;
+    }
+    exec_subscribe(job, c->id);
+    mg_ws_upgrade(c, hm, NULL);
+    MG_INFO(("pty %lu: %s on %dx%d, job %lu", s->id, name, cols, rows, job->id));
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Relay: owns the terminal, frames from the server on stdin, raw terminal
+// output on stdout
+// ----------------------------------------------------------------------------
+
+// The relay's own SIGTERM -> SIGKILL delay for the program, well inside
+// the server's EXEC_KILL_GRACE_MS for the relay
+#define RELAY_KILL_GRACE_MS 1000
+
+static volatile sig_atomic_t relay_signal;
+
+static void relay_on_signal(int sig) {
+    relay_signal = sig;
+}
+
+static double relay_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+/**
+ * Keystrokes the terminal has not taken yet: the master is nonblocking and
+ * its input queue fills up while the program does not read
+ */
+struct relay_pending {
+    uint8_t buf[PTY_FRAME_MAX];
+    size_t len;
+};
+
+// Apply the complete frames in buf, in order, while their keystrokes fit
+// in the pending queue; returns the bytes consumed
+static size_t relay_frames(int master, const uint8_t *buf, size_t len,
+                           struct relay_pending *out) {
+    size_t ofs = 0;
+    while (len - ofs >= 3) {
+        size_t n = ((size_t) buf[ofs + 1] << 8) | buf[ofs + 2];
+        if (len - ofs - 3 < n) break;
+        const uint8_t *p = buf + ofs + 3;
+        if (buf[ofs] == PTY_FRAME_DATA) {
+            if (out->len + n > sizeof(out->buf)) break;
+            memcpy(out->buf + out->len, p, n);
+            out->len += n;
+        } else if (buf[ofs] == PTY_FRAME_RESIZE && n == 4) {
+            struct winsize ws = {
+                .ws_col = (unsigned short) ((p[0] << 8) | p[1]),
+                .ws_row = (unsigned short) ((p[2] << 8) | p[3]),
+            };
+            ioctl(master, TIOCSWINSZ, &ws);     // The kernel sends SIGWINCH
+        }
+        ofs += 3 + n;
+    }
+    return ofs;
+}
+
+// Hand pending keystrokes to the terminal as far as it takes them. They are
+// dropped once no process has the terminal open.
+static void relay_input(int master, struct relay_pending *out) {
+    size_t done = 0;
+    while (done < out->len) {
+        ssize_t n = write(master, out->buf + done, out->len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) break;
+        if (n <= 0) {
+            done = out->len;
+            break;
+        }
+        done += (size_t) n;
+    }
+    memmove(out->buf, out->buf + done, out->len - done);
+    out->len -= done;
+}
+
+// Copy whatever the terminal has to stdout; false once it is hung up
+static bool relay_output(int master) {
+    char buf[16384];
+    for (;;) {
+        ssize_t n = read(master, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) return true;
+        if (n <= 0) return false;     // EIO: no process has the terminal open
+        if (!write_all(STDOUT_FILENO, buf, (size_t) n)) return false;
+    }
+}
+
+// Whether the program has exited; it is left to reap, so its process
+// group id cannot be reused meanwhile
+static bool relay_exited(pid_t pid) {
+    siginfo_t info;
+    memset(&info, 0, sizeof(info));
+    if (waitid(P_PID, (id_t) pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0) return errno != EINTR;
+    return info.si_pid != 0;
+}
+
+// Wait for the program to exit, SIGKILL once a SIGTERM it was sent is
+// RELAY_KILL_GRACE_MS old
+static void relay_wait(pid_t pid, double term_ms) {
+    for (;;) {
+        if (relay_signal != 0) {
+            kill(-pid, relay_signal);
+            if (relay_signal == SIGTERM && term_ms == 0) term_ms = relay_now_ms();
+            relay_signal = 0;
+        }
+        if (term_ms != 0 && relay_now_ms() - term_ms >= RELAY_KILL_GRACE_MS) {
+            kill(-pid, SIGKILL);
+            term_ms = 0;
+        }
+        if (relay_exited(pid)) return;
+        usleep(10000);
+    }
+}
+
+int pty_relay_main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: file_manager " PTY_RELAY_FLAG " <cols> <rows> <command>\n");
+        return 2;
+    }
+    struct winsize size = {.ws_col = (unsigned short) atoi(argv[0]),
+                           .ws_row = (unsigned short) atoi(argv[1])};
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    char slave[128];
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 ||
+        ptsname_r(master, slave, sizeof(slave)) != 0) {
+        perror("pty");
+        return 127;
+    }
+    ioctl(master, TIOCSWINSZ, &size);
+
+    pid_t relay = getpid();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 127;
+    }
+    if (pid == 0) {
+        // New session with the terminal as its controlling tty, so Ctrl-C
+        // and job control reach the program. That takes it out of the job's
+        // process group: die with the relay even if the relay is SIGKILLed.
+        setsid();
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != relay) _exit(127);
+        int fd = open(slave, O_RDWR);
+        if (fd < 0) _exit(127);
+        ioctl(fd, TIOCSCTTY, 0);
+        dup2(fd, STDIN_FILENO);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        if (fd > STDERR_FILENO) close(fd);
+        setenv("TERM", "xterm-256color", 1);
+        // A server started in the background ignores these; a terminal
+        // program expects Ctrl-C and Ctrl-\ to work
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        execl("/bin/sh", "sh", "-c", argv[2], (char *) NULL);
+        _exit(127);
+    }
+
+    // The server stops the relay with SIGTERM / SIGKILL; pass it on to the
+    // program's session, which is not in the relay's process group, and
+    // follow up with SIGKILL before the server's own
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = relay_on_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    // Frames stay in `in` while the pending queue is full, and the socket is
+    // not read while `in` is full: the server's queue then backs up
+    static uint8_t in[PTY_FRAME_MAX + 3];
+    static struct relay_pending pending;
+    size_t in_len = 0;
+    bool input_open = true;
+    bool exited = false;
+    double term_ms = 0;
+    for (;;) {
+        if (relay_signal != 0) {
+            kill(-pid, relay_signal);
+            if (relay_signal == SIGTERM && term_ms == 0) term_ms = relay_now_ms();
+            relay_signal = 0;
+        }
+        if (term_ms != 0 && relay_now_ms() - term_ms >= RELAY_KILL_GRACE_MS) break;
+        struct pollfd fds[2] = {
+            {.fd = master, .events = POLLIN | (pending.len > 0 ? POLLOUT : 0)},
+            {.fd = STDIN_FILENO, .events = input_open && in_len < sizeof(in) ? POLLIN : 0},
+        };
+        int r = poll(fds, 2, 100);
+        if (r < 0 && errno != EINTR) break;
+        if (r > 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) && !relay_output(master)) break;
+        if (r > 0 && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            ssize_t n = read(STDIN_FILENO, in + in_len, sizeof(in) - in_len);
+            if (n > 0) {
+                in_len += (size_t) n;
+            } else if (n == 0 || errno != EINTR) {
+                // The browser went away: hang up like a closed terminal window
+                input_open = false;
+                kill(-pid, SIGHUP);
+            }
+        }
+        // Queue what fits, then write as much as the terminal takes
+        size_t used = relay_frames(master, in, in_len, &pending);
+        memmove(in, in + used, in_len - used);
+        in_len -= used;
+        if (pending.len > 0) relay_input(master, &pending);
+
+        // The program may exit while something it started keeps the
+        // terminal open; stop at its exit once the output has drained
+        if (!exited) exited = relay_exited(pid);
+        if (exited && r == 0) break;
+    }
+    relay_output(master);
+    // Closing the master hangs up the terminal's session
+    close(master);
+    if (!exited) relay_wait(pid, term_ms);
+    // Whatever the program left in its process group goes with the relay
+    kill(-pid, SIGKILL);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return WEXITSTATUS(status);
+}
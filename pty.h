@@ -0,0 +1,77 @@
+#ifndef PTY_H
+#define PTY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "mongoose.h"
+
+// ============================================================================
+// NEXUS File Manager - Interactive Sessions
+// ============================================================================
+
+// The program runs on a pseudo-terminal owned by a relay, which is this
+// binary started as:
+//   file_manager --pty-relay <cols> <rows> <command>
+// The relay talks to the server over a socketpair on its stdin/stdout, so
+// the event loop watches a plain socket and never blocks on the terminal.
+#define PTY_RELAY_FLAG "--pty-relay"
+
+#define PTY_FRAME_DATA 'd'              // Keystrokes for the program
+#define PTY_FRAME_RESIZE 'r'            // cols, rows: big-endian uint16 each
+#define PTY_FRAME_MAX 65535             // Payload bytes per frame
+
+#define PTY_HIGH_WATER (256 * 1024)     // Bytes queued for a peer before reads pause
+#define PTY_LOW_WATER (64 * 1024)       // ... and resume
+
+/**
+ * Read the session settings from the environment:
+ *   NEXUS_PTY_MAX   concurrent sessions (default 64)
+ * The wall-clock limit of a session is NEXUS_PTY_TIMEOUT (exec.h).
+ */
+void pty_init(void);
+
+/**
+ * Start a program on a terminal and turn the connection into its
+ * WebSocket. Binary messages from the browser are keystrokes; text
+ * messages are JSON: {"type":"input","data":"..."} or
+ * {"type":"resize","cols":N,"rows":N}. Output comes back as binary
+ * messages, and {"type":"exit","exitCode":N,...} ends the session.
+ *
+ * @param c Connection of the upgrade request
+ * @param hm The request, with a Sec-WebSocket-Key header
+ * @param command Shell command to run
+ * @param name Program, for job listings
+ * @param cols Terminal width
+ * @param rows Terminal height
+ * @param client Fair-share key, for job listings
+ * @param error Set to a message when false is returned
+ * @return false if the session could not be started; nothing was sent then
+ */
+bool pty_open(struct mg_connection *c, struct mg_http_message *hm, const char *command,
+              const char *name, int cols, int rows, const char *client, const char **error);
+
+/**
+ * WebSocket message from a session's browser
+ */
+void pty_ws_message(struct mg_connection *c, struct mg_ws_message *wm);
+
+/**
+ * Connection closed: stop its session, if it has one
+ */
+void pty_close(struct mg_connection *c);
+
+/**
+ * Sessions open now
+ */
+int pty_sessions(void);
+
+/**
+ * Relay entry point: run a command on a new terminal
+ *
+ * @param argc Number of arguments
+ * @param argv cols, rows and the command
+ * @return The program's exit status, 128 + signal if it was killed
+ */
+int pty_relay_main(int argc, char **argv);
+
+#endif // PTY_H
@@ -0,0 +1,611 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "router.h"
+#include "api_handler.h"
+#include "arena.h"
+#include "assets.h"
+#include "compress.h"
+#include "json_body.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "trace.h"
+
+#define ROUTER_MAX_METHODS 4
+#define BODY_NONE 0
+#define BODY_SMALL (64 * 1024)                          // Commands and file names
+#define BODY_FILE (MG_MAX_RECV_SIZE - 64 * 1024)        // File contents, headers need room too
+
+// ----------------------------------------------------------------------------
+// Route handlers: decode what the route declared, then call api_handler.c
+// ----------------------------------------------------------------------------
+
+// Web interface, served from the copy packed into the binary
+static void route_static(struct mg_connection *c, struct route_request *req) {
+    struct mg_str uri = req->hm->uri;
+    char file[64];
+    if (uri.len <= 1) {
+        snprintf(file, sizeof(file), "index.html");
+    } else {
+        snprintf(file, sizeof(file), "%.*s", (int) uri.len - 1, uri.buf + 1);
+    }
+    assets_serve(c, req->hm, file);
+}
+
+static void route_list_files(struct mg_connection *c, struct route_request *req) {
+    handle_list_files(c, req->location);
+}
+
+static void route_view_file(struct mg_connection *c, struct route_request *req) {
+    handle_view_file(c, req->file, req->location);
+}
+
+static void route_file_exists(struct mg_connection *c, struct route_request *req) {
+    handle_file_exists(c, req->file, req->location);
+}
+
+static void route_browse(struct mg_connection *c, struct route_request *req) {
+    handle_browse_directories(c, req->location);
+}
+
+static void route_metrics(struct mg_connection *c, struct route_request *req) {
+    (void) req;
+    metrics_serve(c);
+}
+
+static void route_trace(struct mg_connection *c, struct route_request *req) {
+    (void) req;
+    trace_serve(c);
+}
+
+// {"sample": N}: trace one request in N, 0 turns tracing off
+static void route_trace_config(struct mg_connection *c, struct route_request *req) {
+    struct json_field fields[] = {{.name = "sample"}};
+    unsigned long every = 0;
+    if (json_body_parse(req->hm->body, fields, 1) != 0 || !fields[0].found ||
+        !mg_str_to_num(fields[0].raw, 10, &every, sizeof(every))) {
+        json_reply_error(c, 400, "Expected {\"sample\": N}");
+        return;
+    }
+    trace_set_sample((unsigned) every);
+
+    struct json_writer w;
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_int(&w, "sample", trace_sample());
+    jw_object_end(&w);
+    jw_end(&w);
+}
+
+// A string field the arena had no room for must not read as absent:
+// replies 500 and returns true if an allocation failed
+static bool scratch_failed(struct mg_connection *c, struct route_request *req) {
+    if (!req->scratch->failed) return false;
+    json_reply_error(c, 500, "Out of memory");
+    return true;
+}
+
+static void route_write_file(struct mg_connection *c, struct route_request *req, bool create) {
+    struct json_field fields[] = {
+        {.name = "filename"}, {.name = "content"}, {.name = "location"}
+    };
+    if (json_body_parse(req->hm->body, fields, 3) != 0) {
+        json_reply_error(c, 400, "Malformed JSON body");
+        return;
+    }
+    char *fn = json_field_str(&fields[0], req->scratch);
+    char *loc = json_field_str(&fields[2], req->scratch);
+    if (scratch_failed(c, req)) return;
+    if (create) {
+        handle_create_file(c, fn ? fn : "", &fields[1], loc ? loc : "");
+    } else {
+        handle_edit_file(c, fn ? fn : "", &fields[1], loc ? loc : "");
+    }
+}
+
+static void route_create_file(struct mg_connection *c, struct route_request *req) {
+    route_write_file(c, req, true);
+}
+
+static void route_edit_file(struct mg_connection *c, struct route_request *req) {
+    route_write_file(c, req, false);
+}
+
+static void route_delete_file(struct mg_connection *c, struct route_request *req) {
+    struct json_field fields[] = {{.name = "filename"}, {.name = "location"}};
+    if (json_body_parse(req->hm->body, fields, 2) != 0) {
+        json_reply_error(c, 400, "Malformed JSON body");
+        return;
+    }
+    char *fn = json_field_str(&fields[0], req->scratch);
+    char *loc = json_field_str(&fields[1], req->scratch);
+    if (scratch_failed(c, req)) return;
+    handle_delete_file(c, fn ? fn : "", loc ? loc : "");
+}
+
+// Execution queue turns are per browser session, else per peer address
+static void client_key(struct mg_connection *c, struct route_request *req, char *buf, size_t size) {
+    struct mg_str *session = mg_http_get_header(req->hm, "X-Nexus-Session");
+    if (session != NULL && session->len > 0) {
+        snprintf(buf, size, "session:%.*s", (int) session->len, session->buf);
+    } else {
+        mg_snprintf(buf, size, "%M", mg_print_ip, &c->rem);
+    }
+}
+
+static void route_execute(struct mg_connection *c, struct route_request *req) {
+    struct json_field fields[] = {
+        {.name = "filename"}, {.name = "action"}, {.name = "location"}, {.name = "timeout"},
+        {.name = "profile"}, {.name = "training"}
+    };
+    if (json_body_parse(req->hm->body, fields, 6) != 0) {
+        json_reply_error(c, 400, "Malformed JSON body");
+        return;
+    }
+    char *fn = json_field_str(&fields[0], req->scratch);
+    char *act = json_field_str(&fields[1], req->scratch);
+    char *loc = json_field_str(&fields[2], req->scratch);
+    double timeout = 0;
+    if (fields[3].found && !mg_json_get_num(fields[3].raw, "$", &timeout)) timeout = 0;
+    char *profile = json_field_str(&fields[4], req->scratch);
+    if (scratch_failed(c, req)) return;
+
+    // "training": [...], as sent
+    struct mg_str training = mg_str_n(NULL, 0);
+    if (fields[5].found && fields[5].raw.buf[0] == '[') training = fields[5].raw;
+    char client[64];
+    client_key(c, req, client, sizeof(client));
+    handle_execute_file(c, fn ? fn : "", act ? act : "run", loc ? loc : "", timeout, profile,
+                        training, client);
+}
+
+static void route_run_tests(struct mg_connection *c, struct route_request *req) {
+    struct json_field fields[] = {
+        {.name = "filename"}, {.name = "location"}, {.name = "ignoreWhitespace"}, {.name = "timeout"},
+        {.name = "profile"}, {.name = "cases"}
+    };
+    if (json_body_parse(req->hm->body, fields, 6) != 0 || !fields[5].found ||
+        fields[5].raw.buf[0] != '[') {
+        json_reply_error(c, 400, "Expected {\"filename\", \"cases\": [...]}");
+        return;
+    }
+    char *fn = json_field_str(&fields[0], req->scratch);
+    char *loc = json_field_str(&fields[1], req->scratch);
+    bool ignore_ws = fields[2].found && mg_strcmp(fields[2].raw, mg_str("true")) == 0;
+    double timeout = 0;
+    if (fields[3].found && !mg_json_get_num(fields[3].raw, "$", &timeout)) timeout = 0;
+    char client[64];
+    client_key(c, req, client, sizeof(client));
+    char *profile = json_field_str(&fields[4], req->scratch);
+    if (scratch_failed(c, req)) return;
+    handle_run_tests(c, fn ? fn : "", loc ? loc : "", fields[5].raw, ignore_ws, timeout, profile,
+                     client);
+}
+
+static void route_build(struct mg_connection *c, struct route_request *req) {
+    struct json_field fields[] = {{.name = "location"}, {.name = "action"}, {.name = "profile"}};
+    if (json_body_parse(req->hm->body, fields, 3) != 0) {
+        json_reply_error(c, 400, "Malformed JSON body");
+        return;
+    }
+    char *loc = json_field_str(&fields[0], req->scratch);
+    char *act = json_field_str(&fields[1], req->scratch);
+    char *profile = json_field_str(&fields[2], req->scratch);
+    if (scratch_failed(c, req)) return;
+    char client[64];
+    client_key(c, req, client, sizeof(client));
+    handle_build_project(c, loc ? loc : "", act ? act : "build", profile, client);
+}
+
+// Every file on its own: ?location=&profile=, answered as an NDJSON stream
+static void route_build_all(struct mg_connection *c, struct route_request *req) {
+    char profile[16] = "", client[64];
+    mg_http_get_var(&req->hm->query, "profile", profile, sizeof(profile));
+    client_key(c, req, client, sizeof(client));
+    handle_build_all(c, req->location, profile, client);
+}
+
+// Integer field of a body; `fallback` when absent or not a number
+static int body_int(const struct json_field *f, int fallback) {
+    double v;
+    return f->found && mg_json_get_num(f->raw, "$", &v) ? (int) v : fallback;
+}
+
+static void route_benchmark(struct mg_connection *c, struct route_request *req) {
+    struct json_field fields[] = {
+        {.name = "filename"}, {.name = "compare"}, {.name = "location"}, {.name = "runs"},
+        {.name = "warmup"}, {.name = "cpu"}, {.name = "input"}, {.name = "timeout"},
+        {.name = "profile"}
+    };
+    if (json_body_parse(req->hm->body, fields, 9) != 0) {
+        json_reply_error(c, 400, "Malformed JSON body");
+        return;
+    }
+    char *fn = json_field_str(&fields[0], req->scratch);
+    char *compare = json_field_str(&fields[1], req->scratch);
+    char *loc = json_field_str(&fields[2], req->scratch);
+    char *input = json_field_str(&fields[6], req->scratch);
+    double timeout = 0;
+    if (fields[7].found && !mg_json_get_num(fields[7].raw, "$", &timeout)) timeout = 0;
+    char *profile = json_field_str(&fields[8], req->scratch);
+    if (scratch_failed(c, req)) return;
+    char client[64];
+    client_key(c, req, client, sizeof(client));
+    handle_benchmark(c, fn ? fn : "", compare, loc ? loc : "", body_int(&fields[3], 10),
+                     body_int(&fields[4], 1), body_int(&fields[5], -1), input, timeout, profile,
+                     client);
+}
+
+// Interactive run: ?file=&location=&cols=&rows=&profile=, then a WebSocket
+static void route_terminal(struct mg_connection *c, struct route_request *req) {
+    char cols[8] = "", rows[8] = "", profile[16] = "", client[64];
+    mg_http_get_var(&req->hm->query, "cols", cols, sizeof(cols));
+    mg_http_get_var(&req->hm->query, "rows", rows, sizeof(rows));
+    mg_http_get_var(&req->hm->query, "profile", profile, sizeof(profile));
+    client_key(c, req, client, sizeof(client));
+    handle_open_terminal(c, req->hm, req->file, req->location, atoi(cols), atoi(rows), profile,
+                         client);
+}
+
+// Watch mode: ?file=&location=&profile=, then a WebSocket
+static void route_watch(struct mg_connection *c, struct route_request *req) {
+    char profile[16] = "", client[64];
+    mg_http_get_var(&req->hm->query, "profile", profile, sizeof(profile));
+    client_key(c, req, client, sizeof(client));
+    handle_watch(c, req->hm, req->file, req->location, profile, client);
+}
+
+static void route_cache_stats(struct mg_connection *c, struct route_request *req) {
+    (void) req;
+    handle_cache_stats(c);
+}
+
+static void route_list_jobs(struct mg_connection *c, struct route_request *req) {
+    (void) req;
+    handle_list_jobs(c);
+}
+
+// {"id": N} bodies of the job routes; replies 400 and returns false if absent
+static bool job_id(struct mg_connection *c, struct route_request *req, unsigned long *id) {
+    struct json_field fields[] = {{.name = "id"}};
+    if (json_body_parse(req->hm->body, fields, 1) != 0 || !fields[0].found ||
+        !mg_str_to_num(fields[0].raw, 10, id, sizeof(*id))) {
+        json_reply_error(c, 400, "Expected {\"id\": N}");
+        return false;
+    }
+    return true;
+}
+
+static void route_cancel_job(struct mg_connection *c, struct route_request *req) {
+    unsigned long id;
+    if (job_id(c, req, &id)) handle_cancel_job(c, id);
+}
+
+static void route_wait_job(struct mg_connection *c, struct route_request *req) {
+    unsigned long id;
+    if (job_id(c, req, &id)) handle_wait_job(c, id);
+}
+
+static void route_toolchains(struct mg_connection *c, struct route_request *req) {
+    (void) req;
+    handle_toolchains(c, false);
+}
+
+static void route_toolchains_refresh(struct mg_connection *c, struct route_request *req) {
+    (void) req;
+    handle_toolchains(c, true);
+}
+
+// Output page: ?id=&offset=&length=, or ?id=&length=&tail=1
+static void route_job_output(struct mg_connection *c, struct route_request *req) {
+    char id[24] = "", offset[24] = "", length[24] = "", tail[8] = "";
+    mg_http_get_var(&req->hm->query, "id", id, sizeof(id));
+    mg_http_get_var(&req->hm->query, "offset", offset, sizeof(offset));
+    mg_http_get_var(&req->hm->query, "length", length, sizeof(length));
+    mg_http_get_var(&req->hm->query, "tail", tail, sizeof(tail));
+    if (id[0] == '\0') {
+        json_reply_error(c, 400, "Expected ?id=N");
+        return;
+    }
+    handle_job_output(c, strtoul(id, NULL, 10), strtoull(offset, NULL, 10),
+                      length[0] != '\0' ? (size_t) strtoull(length, NULL, 10) : 65536,
+                      tail[0] != '\0' && strcmp(tail, "0") != 0);
+}
+
+// ----------------------------------------------------------------------------
+// Route table
+// ----------------------------------------------------------------------------
+
+static const struct route routes[] = {
+    {"GET",  "/",              route_static,      0,                                BODY_NONE},
+    {"GET",  "/style.css",     route_static,      0,                                BODY_NONE},
+    {"GET",  "/app.js",        route_static,      0,                                BODY_NONE},
+    {"GET",  "/api/files",     route_list_files,  ROUTE_Q_LOCATION,                 BODY_NONE},
+    {"GET",  "/api/view",      route_view_file,   ROUTE_Q_FILE | ROUTE_Q_LOCATION,  BODY_NONE},
+    {"GET",  "/api/exists",    route_file_exists, ROUTE_Q_FILE | ROUTE_Q_LOCATION,  BODY_NONE},
+    {"GET",  "/api/browse",    route_browse,      ROUTE_Q_PATH,                     BODY_NONE},
+    {"GET",  "/metrics",       route_metrics,     0,                                BODY_NONE},
+    {"GET",  "/api/trace",     route_trace,       0,                                BODY_NONE},
+    {"GET",  "/api/jobs",      route_list_jobs,   0,                                BODY_NONE},
+    {"GET",  "/api/jobs/output", route_job_output, 0,                               BODY_NONE},
+    {"GET",  "/api/cache",     route_cache_stats, 0,                                BODY_NONE},
+    {"GET",  "/api/toolchains", route_toolchains, 0,                                BODY_NONE},
+    {"GET",  "/api/pty",       route_terminal,    ROUTE_Q_FILE | ROUTE_Q_LOCATION | ROUTE_NO_HEAD,
+     BODY_NONE},
+    {"GET",  "/api/watch",     route_watch,       ROUTE_Q_FILE | ROUTE_Q_LOCATION | ROUTE_NO_HEAD,
+     BODY_NONE},
+    {"GET",  "/api/build-all", route_build_all,   ROUTE_Q_LOCATION | ROUTE_NO_HEAD, BODY_NONE},
+    {"POST", "/api/create",    route_create_file, 0,                                BODY_FILE},
+    {"POST", "/api/edit",      route_edit_file,   0,                                BODY_FILE},
+    {"POST", "/api/delete",    route_delete_file, 0,                                BODY_SMALL},
+    {"POST", "/api/execute",   route_execute,     0,                                BODY_SMALL},
+    {"POST", "/api/execute/tests", route_run_tests, 0,                              BODY_FILE},
+    {"POST", "/api/execute/bench", route_benchmark, 0,                              BODY_SMALL},
+    {"POST", "/api/build",     route_build,       0,                                BODY_SMALL},
+    {"POST", "/api/trace",     route_trace_config, 0,                               BODY_SMALL},
+    {"POST", "/api/toolchains/refresh", route_toolchains_refresh, 0,                BODY_SMALL},
+    {"POST", "/api/jobs/cancel", route_cancel_job, 0,                               BODY_SMALL},
+    {"POST", "/api/jobs/wait", route_wait_job,    0,                                BODY_SMALL},
+};
+
+#define ROUTE_COUNT (sizeof(routes) / sizeof(routes[0]))
+_Static_assert(ROUTE_COUNT < METRICS_MAX_ROUTES, "raise METRICS_MAX_ROUTES");
+
+// ----------------------------------------------------------------------------
+// Perfect hash over paths. The table above is fixed at compile time, so
+// router_init() only has to find a seed with no collisions; every lookup is
+// then one hash, one slot and one string compare regardless of route count.
+// ----------------------------------------------------------------------------
+
+struct route_slot {
+    const char *path;
+    size_t path_len;
+    const struct route *by_method[ROUTER_MAX_METHODS];
+    char allow[32];
+};
+
+static struct route_slot *slots;
+static uint32_t slot_mask;
+static uint32_t hash_seed;
+
+static uint32_t path_hash(const char *s, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) s[i];
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+static bool try_seed(struct route_slot *table, uint32_t mask, uint32_t seed) {
+    memset(table, 0, (mask + 1) * sizeof(*table));
+    for (size_t i = 0; i < ROUTE_COUNT; i++) {
+        size_t len = strlen(routes[i].path);
+        struct route_slot *s = &table[path_hash(routes[i].path, len, seed) & mask];
+        if (s->path != NULL && strcmp(s->path, routes[i].path) != 0) return false;
+        s->path = routes[i].path;
+        s->path_len = len;
+    }
+    return true;
+}
+
+void router_init(void) {
+    uint32_t size = 8;
+    while (size < ROUTE_COUNT * 2) size <<= 1;
+
+    while (slots == NULL) {
+        struct route_slot *table = calloc(size, sizeof(*table));
+        if (table == NULL) abort();
+        for (uint32_t seed = 0; seed < 100000; seed++) {
+            if (try_seed(table, size - 1, seed)) {
+                slots = table;
+                slot_mask = size - 1;
+                hash_seed = seed;
+                break;
+            }
+        }
+        if (slots == NULL) {
+            free(table);
+            size <<= 1;
+        }
+    }
+
+    for (size_t i = 0; i < ROUTE_COUNT; i++) {
+        size_t len = strlen(routes[i].path);
+        struct route_slot *s = &slots[path_hash(routes[i].path, len, hash_seed) & slot_mask];
+        for (int m = 0; m < ROUTER_MAX_METHODS; m++) {
+            if (s->by_method[m] == NULL) {
+                s->by_method[m] = &routes[i];
+                break;
+            }
+        }
+        size_t used = strlen(s->allow);
+        snprintf(s->allow + used, sizeof(s->allow) - used, "%s%s%s", used ? ", " : "",
+                 routes[i].method,
+                 strcmp(routes[i].method, "GET") == 0 && !(routes[i].params & ROUTE_NO_HEAD) ?
+                 ", HEAD" : "");
+    }
+    MG_DEBUG(("router: %d routes, %u slots, seed %u", (int) ROUTE_COUNT, slot_mask + 1, hash_seed));
+}
+
+size_t router_route_count(void) {
+    return ROUTE_COUNT;
+}
+
+const struct route *router_route(size_t i) {
+    return i < ROUTE_COUNT ? &routes[i] : NULL;
+}
+
+const struct route *router_lookup(struct mg_str method, struct mg_str path, const char **allow) {
+    const struct route_slot *s = &slots[path_hash(path.buf, path.len, hash_seed) & slot_mask];
+    if (allow) *allow = NULL;
+    if (s->path == NULL || s->path_len != path.len || memcmp(s->path, path.buf, path.len) != 0) {
+        return NULL;
+    }
+
+    bool head = mg_strcmp(method, mg_str("HEAD")) == 0;
+    if (head) method = mg_str("GET");
+    for (int m = 0; m < ROUTER_MAX_METHODS && s->by_method[m]; m++) {
+        const struct route *r = s->by_method[m];
+        if (mg_strcmp(method, mg_str(r->method)) == 0 && !(head && (r->params & ROUTE_NO_HEAD))) {
+            return r;
+        }
+    }
+    if (allow) *allow = s->allow;
+    return NULL;
+}
+
+// Status code of the response a handler queued at `ofs`, 0 if none
+static int queued_status(struct mg_connection *c, size_t ofs) {
+    const char *p = (const char *) c->send.buf + ofs;
+    if (c->send.len < ofs + 12 || memcmp(p, "HTTP/1.1 ", 9) != 0) return 0;
+    return (p[9] - '0') * 100 + (p[10] - '0') * 10 + (p[11] - '0');
+}
+
+static size_t route_index(const struct route *r) {
+    return r != NULL ? (size_t) (r - routes) : ROUTE_COUNT;
+}
+
+// Reply for requests that have no route. Returns true if it replied.
+static bool reject_unrouted(struct mg_connection *c, const struct route *r, const char *allow) {
+    if (r != NULL) return false;
+    if (allow != NULL) {
+        char hdr[64];
+        snprintf(hdr, sizeof(hdr), "Allow: %s\r\n", allow);
+        mg_http_reply(c, 405, hdr, "Method not allowed");
+    } else {
+        mg_http_reply(c, 404, "", "Not found");
+    }
+    return true;
+}
+
+bool router_check_headers(struct mg_connection *c, struct mg_http_message *hm) {
+    uint64_t start = metrics_now_us();
+    size_t ofs = c->send.len;
+    const char *allow;
+    const struct route *r = router_lookup(hm->method, hm->uri, &allow);
+    bool reject = reject_unrouted(c, r, allow);
+
+    if (!reject) {
+        struct mg_str *cl = mg_http_get_header(hm, "Content-Length");
+        unsigned long len = 0;
+        if (cl != NULL && mg_str_to_num(*cl, 10, &len, sizeof(len)) && len > r->max_body) {
+            json_reply_error(c, 413, "Request body too large");
+            reject = true;
+        }
+    }
+
+    if (reject) {
+        // Drop whatever body is still on its way and close after the reply
+        c->recv.len = 0;
+        c->is_draining = 1;
+        metrics_request(route_index(r), queued_status(c, ofs), hm->head.len, c->send.len - ofs,
+                        metrics_now_us() - start);
+    }
+    return reject;
+}
+
+// Run the handler of a matched route
+static void dispatch(struct mg_connection *c, const struct route *r, struct mg_http_message *hm) {
+    struct route_request req;
+    req.hm = hm;
+    req.scratch = request_arena(c);
+    if (req.scratch == NULL) {
+        json_reply_error(c, 500, "Out of memory");
+        return;
+    }
+    req.file[0] = req.location[0] = '\0';
+    request_state(c)->encoding = compress_negotiate(hm);
+    request_state(c)->head = mg_strcmp(hm->method, mg_str("HEAD")) == 0;
+
+    // Decode only the query variables this route declared
+    uint64_t span = trace_begin();
+    if (r->params & ROUTE_Q_FILE) {
+        mg_http_get_var(&hm->query, "file", req.file, sizeof(req.file));
+    }
+    if (r->params & ROUTE_Q_LOCATION) {
+        mg_http_get_var(&hm->query, "location", req.location, sizeof(req.location));
+    }
+    if (r->params & ROUTE_Q_PATH) {
+        mg_http_get_var(&hm->query, "path", req.location, sizeof(req.location));
+    }
+    trace_end("query", span);
+
+    r->fn(c, &req);
+}
+
+// Requests waiting for a job callback to reply: their status, size and
+// latency are only known then. Event loop thread only.
+struct pending_reply {
+    unsigned long conn_id;
+    size_t route;
+    size_t bytes_in;
+    uint64_t start;
+    struct pending_reply *next;
+};
+
+static struct pending_reply *pending;
+
+static void defer_metrics(struct mg_connection *c, size_t route, size_t bytes_in,
+                          uint64_t start) {
+    struct pending_reply *p = malloc(sizeof(*p));
+    if (p == NULL) {
+        // Count the request at least, without a status
+        metrics_request(route, 0, bytes_in, 0, metrics_now_us() - start);
+        return;
+    }
+    p->conn_id = c->id;
+    p->route = route;
+    p->bytes_in = bytes_in;
+    p->start = start;
+    p->next = pending;
+    pending = p;
+}
+
+// Unlink the pending entry of a connection, NULL if there is none
+static struct pending_reply *take_pending(struct mg_connection *c) {
+    for (struct pending_reply **pp = &pending; *pp != NULL; pp = &(*pp)->next) {
+        if ((*pp)->conn_id != c->id) continue;
+        struct pending_reply *p = *pp;
+        *pp = p->next;
+        return p;
+    }
+    return NULL;
+}
+
+void router_replied(struct mg_connection *c, int status, size_t bytes_out) {
+    struct pending_reply *p = take_pending(c);
+    if (p == NULL) return;
+    metrics_request(p->route, status, p->bytes_in, bytes_out, metrics_now_us() - p->start);
+    free(p);
+}
+
+void router_forget(struct mg_connection *c) {
+    free(take_pending(c));
+}
+
+void router_dispatch(struct mg_connection *c, struct mg_http_message *hm) {
+    uint64_t start = metrics_now_us();
+    size_t ofs = c->send.len;
+    trace_request_begin();
+    uint64_t request_span = trace_begin(), span = request_span;
+
+    const char *allow;
+    const struct route *r = router_lookup(hm->method, hm->uri, &allow);
+    trace_end("route", span);
+    if (!reject_unrouted(c, r, allow)) dispatch(c, r, hm);
+
+    trace_end(r != NULL ? r->path : "unmatched", request_span);
+    if (c->send.len > 0) request_state(c)->trace_send = trace_begin();
+    trace_request_end();
+
+    // Nothing queued: a job callback answers later (execute, build, tests...)
+    if (c->send.len == ofs && !c->is_closing) {
+        request_state(c)->deferred = true;
+        defer_metrics(c, route_index(r), hm->message.len, start);
+        return;
+    }
+    metrics_request(route_index(r), queued_status(c, ofs), hm->message.len, c->send.len - ofs,
+                    metrics_now_us() - start);
+}
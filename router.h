@@ -0,0 +1,112 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stddef.h>
+#include "mongoose.h"
+
+// ============================================================================
+// NEXUS File Manager - HTTP Route Table
+// ============================================================================
+
+struct arena;
+
+// Query parameters a route wants decoded before its handler runs
+#define ROUTE_Q_FILE     (1u << 0)   // ?file=
+#define ROUTE_Q_LOCATION (1u << 1)   // ?location=
+#define ROUTE_Q_PATH     (1u << 2)   // ?path= (stored in `location`)
+
+// GET routes whose reply is streamed or upgraded to a WebSocket have no
+// header-only form: HEAD is refused with 405
+#define ROUTE_NO_HEAD    (1u << 3)
+
+/**
+ * Everything a route handler gets besides the connection
+ */
+struct route_request {
+    struct mg_http_message *hm;
+    struct arena *scratch;     // Request arena, see request_arena()
+    char file[256];            // Filled only for ROUTE_Q_FILE
+    char location[1024];       // Filled only for ROUTE_Q_LOCATION / ROUTE_Q_PATH
+};
+
+typedef void (*route_fn)(struct mg_connection *c, struct route_request *req);
+
+/**
+ * Route descriptor: one entry per (method, path)
+ */
+struct route {
+    const char *method;        // "GET", "POST", ...
+    const char *path;          // Exact URI path
+    route_fn fn;
+    unsigned params;           // ROUTE_Q_* and ROUTE_NO_HEAD flags
+    size_t max_body;           // Largest accepted request body in bytes
+};
+
+/**
+ * Build the perfect-hash index over the static route table.
+ * Must be called once before the first lookup.
+ */
+void router_init(void);
+
+/**
+ * Number of routes in the table; route indices run from 0 to this - 1
+ */
+size_t router_route_count(void);
+
+/**
+ * Route by index, for reporting (e.g. metric labels)
+ *
+ * @param i Route index
+ * @return Route, or NULL if out of range
+ */
+const struct route *router_route(size_t i);
+
+/**
+ * Find the route for a request
+ *
+ * @param method HTTP method (HEAD is looked up as GET, unless ROUTE_NO_HEAD)
+ * @param path URI path
+ * @param allow Set to the methods the path does accept when the method
+ *              does not match (e.g. "GET, HEAD"), or NULL for unknown paths
+ * @return Route, or NULL
+ */
+const struct route *router_lookup(struct mg_str method, struct mg_str path, const char **allow);
+
+/**
+ * Reject requests early, once headers are in: unknown route, wrong
+ * method, or a Content-Length over the route's body limit.
+ * Call on MG_EV_HTTP_HDRS.
+ *
+ * @param c Mongoose connection
+ * @param hm Parsed request headers
+ * @return true if the request was rejected and the connection is draining
+ */
+bool router_check_headers(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * Route a complete request to its handler. Call on MG_EV_HTTP_MSG.
+ *
+ * @param c Mongoose connection
+ * @param hm Full HTTP request
+ */
+void router_dispatch(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * Record the metrics of a request whose handler left the reply to a job
+ * callback, now that the reply is queued
+ *
+ * @param c Mongoose connection
+ * @param status HTTP status code sent
+ * @param bytes_out Response size, headers included
+ */
+void router_replied(struct mg_connection *c, int status, size_t bytes_out);
+
+/**
+ * Drop the pending metrics of a connection that closed before its deferred
+ * reply was written. Call on MG_EV_CLOSE.
+ *
+ * @param c Mongoose connection
+ */
+void router_forget(struct mg_connection *c);
+
+#endif // ROUTER_H
@@ -4,7 +4,8 @@
 # =========================================
 
 APP_NAME="file_manager"
-PORT=8080
+PORT=${NEXUS_PORT:-8080}
+export NEXUS_PORT=$PORT
 URL="http://localhost:$PORT"
 
 # Colors
@@ -33,7 +34,9 @@ echo -e "${YELLOW}[1/4]${NC} ${WHITE}Compiling NEXUS...${NC}"
 echo ""
 
 if [ -f "api_handler.c" ] && [ -f "main.c" ]; then
-    gcc -o $APP_NAME main.c api_handler.c mongoose.c -lpthread -DENABLE_WEB_SERVER 2>&1 | \
+    # Web assets are packed into the binary
+    (gcc -o pack pack.c mongoose.c -lz -lbrotlienc && ./pack index.html style.css app.js > packed_fs.c) 2>&1 | sed "s/^/    ${BLUE}│${NC} /"
+    gcc -o $APP_NAME main.c api_handler.c arena.c json_writer.c json_body.c router.c assets.c compress.c metrics.c trace.c exec.c build.c objcache.c tests.c pty.c bench.c jvm.c tcc.c output.c toolchain.c watch.c mongoose.c packed_fs.c -lpthread -lz -lm -DENABLE_WEB_SERVER -DMG_ENABLE_PACKED_FS=1 2>&1 | \
         sed "s/^/    ${BLUE}│${NC} /"
 else
     gcc -o $APP_NAME main.c mongoose.c -lpthread -DENABLE_WEB_SERVER 2>&1 | \
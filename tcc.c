@@ -0,0 +1,110 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tcc.h"
+#include "mongoose.h"
+#ifdef NEXUS_TCC
+#include <libtcc.h>
+#endif
+
+extern char **environ;
+
+static bool enabled;
+static char wrapper[PATH_MAX + 32];
+
+void tcc_init(void) {
+#ifdef NEXUS_TCC
+    const char *s = getenv("NEXUS_TCC");
+    if (s != NULL && strcmp(s, "0") == 0) return;
+    char exe[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (n <= 0) return;
+    exe[n] = '\0';
+    snprintf(wrapper, sizeof(wrapper), "'%s' " TCC_RUN_FLAG, exe);
+    enabled = true;
+    MG_INFO(("tcc: in-memory C runs on (libtcc)"));
+#endif
+}
+
+// Append n bytes, counting what does not fit
+static void put(char *buf, size_t size, size_t *len, const char *s, size_t n) {
+    if (*len < size) memcpy(buf + *len, s, *len + n < size ? n : size - *len);
+    *len += n;
+}
+
+// Append one single-quoted shell word; returns the length it needs
+static size_t quote_arg(char *buf, size_t size, size_t len, const char *s) {
+    put(buf, size, &len, " '", 2);
+    for (; *s != '\0'; s++) {
+        if (*s == '\'') put(buf, size, &len, "'\\''", 4);
+        else put(buf, size, &len, s, 1);
+    }
+    put(buf, size, &len, "'", 2);       // With the NUL
+    return len - 1;
+}
+
+bool tcc_command(char *buf, size_t size, const char *src, const char *program,
+                 const char *fallback) {
+    if (!enabled) return false;
+    size_t len = 0;
+    put(buf, size, &len, wrapper, strlen(wrapper));
+    len = quote_arg(buf, size, len, src);
+    len = quote_arg(buf, size, len, program);
+    len = quote_arg(buf, size, len, fallback);
+    return len < size;
+}
+
+#ifdef NEXUS_TCC
+// Diagnostics are dropped: a source TinyCC rejects goes to gcc, whose
+// messages are the ones the user sees
+static void quiet(void *opaque, const char *msg) {
+    (void) opaque;
+    (void) msg;
+}
+
+// Compile src in memory and run its main(); false if TinyCC could not
+// build it, with nothing run
+static bool run_in_memory(const char *src, char *program, int *status) {
+    TCCState *s = tcc_new();
+    if (s == NULL) return false;
+    const char *lib = getenv("NEXUS_TCC_LIB");
+    if (lib != NULL && *lib) tcc_set_lib_path(s, lib);
+    tcc_set_error_func(s, NULL, quiet);
+    tcc_set_output_type(s, TCC_OUTPUT_MEMORY);
+    if (tcc_add_file(s, src) != 0 || tcc_add_library(s, "m") != 0) {
+        tcc_delete(s);
+        return false;
+    }
+#ifdef TCC_RELOCATE_AUTO
+    int relocated = tcc_relocate(s, TCC_RELOCATE_AUTO);
+#else
+    int relocated = tcc_relocate(s);
+#endif
+    int (*entry)(int, char **, char **) =
+        relocated == 0 ? (int (*)(int, char **, char **)) tcc_get_symbol(s, "main") : NULL;
+    if (entry == NULL) {
+        tcc_delete(s);
+        return false;
+    }
+    // The program's code lives in s, which stays until exit
+    char *args[] = {program, NULL};
+    *status = entry(1, args, environ);
+    return true;
+}
+#endif
+
+int tcc_run_main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <source> <program-name> <fallback-command>\n", TCC_RUN_FLAG);
+        return 2;
+    }
+#ifdef NEXUS_TCC
+    int status;
+    if (run_in_memory(argv[0], argv[1], &status)) return status;
+#endif
+    execl("/bin/sh", "sh", "-c", argv[2], (char *) NULL);
+    perror("sh");
+    return 127;
+}
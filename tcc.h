@@ -0,0 +1,52 @@
+#ifndef TCC_H
+#define TCC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// ============================================================================
+// NEXUS File Manager - Instant C Runs
+// ============================================================================
+
+// C runs under the "tcc" profile call back into this binary, which compiles
+// the source in memory with libtcc and calls its main() straight away, with
+// no compiler process, object file or link step:
+//   file_manager --tcc-run <source> <program-name> <fallback-command>
+// It runs inside the execution job, so the program gets the job's limits.
+// When TinyCC rejects the source the fallback (gcc, then the program) runs.
+// Only built with -DNEXUS_TCC -ltcc; otherwise the profile uses gcc.
+#define TCC_RUN_FLAG "--tcc-run"
+
+/**
+ * Read the settings from the environment:
+ *   NEXUS_TCC       0 turns the in-memory path off (default on when built
+ *                   with libtcc)
+ *   NEXUS_TCC_LIB   TinyCC's own directory (libtcc1.a, include/), when it
+ *                   is not where libtcc was configured to look
+ */
+void tcc_init(void);
+
+/**
+ * Command that compiles and runs a C source in memory, falling back to a
+ * gcc build and run
+ *
+ * @param buf Destination
+ * @param size Size of buf
+ * @param src C source
+ * @param program argv[0] of the program, normally the gcc build's output
+ * @param fallback Shell command to run when TinyCC cannot compile the source
+ * @return false if the in-memory path is unavailable or buf is too small
+ */
+bool tcc_command(char *buf, size_t size, const char *src, const char *program,
+                 const char *fallback);
+
+/**
+ * In-memory run entry point
+ *
+ * @param argc Number of arguments
+ * @param argv Source, program name and fallback command
+ * @return The program's exit status
+ */
+int tcc_run_main(int argc, char **argv);
+
+#endif // TCC_H
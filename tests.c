@@ -0,0 +1,296 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "metrics.h"
+#include "mongoose.h"
+#include "tests.h"
+
+static unsigned long next_id = 1;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+const char *tests_verdict_name(enum test_verdict v) {
+    switch (v) {
+        case TEST_PASSED: return "AC";
+        case TEST_WRONG_ANSWER: return "WA";
+        case TEST_RUNTIME_ERROR: return "RE";
+        case TEST_TIME_LIMIT: return "TLE";
+        case TEST_RAN: return "OK";
+        case TEST_PENDING: return "PENDING";
+        default: return "SKIPPED";
+    }
+}
+
+// Copy the start of an output; true if there was more
+static bool read_head(const struct output *o, char *buf, size_t size, size_t *len) {
+    *len = o != NULL ? output_read(o, 0, buf, size) : 0;
+    return o != NULL && o->total > *len;
+}
+
+// ----------------------------------------------------------------------------
+// Output comparison, streamed so large outputs cost no memory
+// ----------------------------------------------------------------------------
+
+static bool same_bytes(FILE *a, FILE *b) {
+    char x[8192], y[8192];
+    for (;;) {
+        size_t n = fread(x, 1, sizeof(x), a);
+        size_t m = fread(y, 1, n > 0 ? n : 1, b);
+        if (n != m || memcmp(x, y, n) != 0) return false;
+        if (n == 0) return true;
+    }
+}
+
+// Next whitespace-separated token into buf (truncated past size - 1)
+static bool next_token(FILE *fp, char *buf, size_t size, size_t *len) {
+    int ch;
+    while ((ch = fgetc(fp)) != EOF && isspace(ch)) {}
+    *len = 0;
+    if (ch == EOF) return false;
+    do {
+        if (*len < size - 1) buf[(*len)++] = (char) ch;
+    } while ((ch = fgetc(fp)) != EOF && !isspace(ch));
+    buf[*len] = '\0';
+    return true;
+}
+
+static bool same_tokens(FILE *a, FILE *b) {
+    char x[4096], y[4096];
+    size_t n, m;
+    for (;;) {
+        bool more_a = next_token(a, x, sizeof(x), &n);
+        bool more_b = next_token(b, y, sizeof(y), &m);
+        if (more_a != more_b) return false;
+        if (!more_a) return true;
+        if (n != m || memcmp(x, y, n) != 0) return false;
+    }
+}
+
+// Whether the case's stdout matches its expected output
+static bool output_matches(const struct test_case *tc, const struct output *o) {
+    if (o->total > o->size) return false;           // Past NEXUS_OUTPUT_MAX
+    FILE *out = output_fopen(o);
+    FILE *want = tc->expected_path[0] != '\0' ? fopen(tc->expected_path, "r")
+                                             : fmemopen(tc->expected, tc->expected_len, "r");
+    if (tc->expected_path[0] == '\0' && tc->expected_len == 0) {
+        // fmemopen() refuses empty buffers on some libcs
+        if (want != NULL) fclose(want);
+        want = fopen("/dev/null", "r");
+    }
+    bool same = out != NULL && want != NULL &&
+                (tc->run->ignore_whitespace ? same_tokens(out, want) : same_bytes(out, want));
+    if (out != NULL) fclose(out);
+    if (want != NULL) fclose(want);
+    return same;
+}
+
+// ----------------------------------------------------------------------------
+// Run
+// ----------------------------------------------------------------------------
+
+static void run_free(struct test_run *run) {
+    for (size_t i = 0; i < run->ncases; i++) {
+        struct test_case *tc = &run->cases[i];
+        if (tc->input_tmp) unlink(tc->input_path);
+        free(tc->expected);
+    }
+    free(run->cases);
+    free(run->run_command);
+    free(run);
+}
+
+static void run_finish(struct test_run *run) {
+    run->wall_ms = now_ms() - run->start_ms;
+    MG_INFO(("tests %lu %s: %lu/%lu passed, %.0f ms", run->id, run->name,
+             (unsigned long) run->passed, (unsigned long) run->ncases, run->wall_ms));
+    run->done(run);
+    run_free(run);
+}
+
+// Account for a finished job of this run
+static void job_ended(struct test_run *run, struct exec_job *job) {
+    run->pending--;
+    metrics_exec_queued(job->priority, (uint64_t) (job->stats.queue_ms * 1000));
+    if (job->end == EXEC_CANCELLED) run->cancelled = true;
+}
+
+static void case_done(struct exec_job *job) {
+    struct test_case *tc = job->data;
+    struct test_run *run = tc->run;
+    job_ended(run, job);
+    tc->end = job->end;
+    tc->stats = job->stats;
+    tc->output_truncated = read_head(job->output, tc->output, sizeof(tc->output),
+                                     &tc->output_len);
+    read_head(job->error, tc->error, sizeof(tc->error), &tc->error_len);
+
+    if (job->end == EXEC_TIMEOUT || job->end == EXEC_CPU_TIMEOUT) {
+        tc->verdict = TEST_TIME_LIMIT;
+    } else if (job->end != EXEC_EXITED) {
+        tc->verdict = TEST_SKIPPED;
+    } else if (job->stats.exit_code != 0) {
+        tc->verdict = TEST_RUNTIME_ERROR;
+    } else if (tc->expected == NULL && tc->expected_path[0] == '\0') {
+        tc->verdict = TEST_RAN;
+    } else {
+        tc->verdict = output_matches(tc, job->output) ? TEST_PASSED : TEST_WRONG_ANSWER;
+    }
+    if (tc->verdict == TEST_PASSED || tc->verdict == TEST_RAN) run->passed++;
+    if (run->pending == 0) run_finish(run);
+}
+
+// Queue every case; they take as many execution slots as are free
+static void start_cases(struct test_run *run) {
+    for (size_t i = 0; i < run->ncases; i++) {
+        struct test_case *tc = &run->cases[i];
+        struct exec_request req = {
+            .command = run->run_command,
+            .name = run->name,
+            .client = run->client,
+            .priority = EXEC_PRIO_RUN,
+            .timeout_s = run->timeout_s,
+            .input = tc->input_path[0] != '\0' ? tc->input_path : NULL,
+            .split_stderr = true,
+            .done = case_done,
+            .data = tc,
+        };
+        struct exec_job *job = exec_start(&req);
+        if (job == NULL) {
+            tc->verdict = TEST_SKIPPED;
+            continue;
+        }
+        exec_subscribe(job, run->conn_id);
+        run->pending++;
+    }
+    if (run->pending == 0) run_finish(run);
+}
+
+static void compile_done(struct exec_job *job) {
+    struct test_run *run = job->data;
+    job_ended(run, job);
+    size_t len;
+    read_head(job->output, run->compile_output, sizeof(run->compile_output) - 1, &len);
+    run->compile_output[len] = '\0';
+    run->compile_stats = job->stats;
+    if (job->end != EXEC_EXITED || job->stats.exit_code != 0) {
+        for (size_t i = 0; i < run->ncases; i++) run->cases[i].verdict = TEST_SKIPPED;
+        run_finish(run);
+        return;
+    }
+    run->compiled = true;
+    start_cases(run);
+}
+
+// Write inline stdin to a file the job can open
+static bool write_input(struct test_run *run, struct test_case *tc, size_t index,
+                        const struct test_spec *spec) {
+    snprintf(tc->input_path, sizeof(tc->input_path), "/tmp/nexus_input_%d_%lu_%lu.txt",
+             (int) getpid(), run->id, (unsigned long) index);
+    FILE *fp = fopen(tc->input_path, "w");
+    if (fp == NULL) return false;
+    tc->input_tmp = true;
+    bool ok = fwrite(spec->input, 1, spec->input_len, fp) == spec->input_len;
+    return fclose(fp) == 0 && ok;
+}
+
+bool tests_start(const struct test_request *req, const char **error) {
+    if (req->ncases == 0 || req->ncases > TESTS_MAX_CASES) {
+        *error = "Expected 1 to 256 test cases";
+        return false;
+    }
+    struct test_run *run = calloc(1, sizeof(*run));
+    if (run != NULL) {
+        run->cases = calloc(req->ncases, sizeof(*run->cases));
+        run->run_command = strdup(req->run);
+    }
+    if (run == NULL || run->cases == NULL || run->run_command == NULL) {
+        if (run != NULL) {
+            free(run->cases);
+            free(run->run_command);
+            free(run);
+        }
+        *error = "Out of memory";
+        return false;
+    }
+    run->id = next_id++;
+    snprintf(run->name, sizeof(run->name), "%s", req->name);
+    run->ignore_whitespace = req->ignore_whitespace;
+    run->timeout_s = req->timeout_s;
+    run->ncases = req->ncases;
+    run->start_ms = now_ms();
+    snprintf(run->client, sizeof(run->client), "%s", req->client != NULL ? req->client : "");
+    run->conn_id = req->conn_id;
+    run->done = req->done;
+    run->data = req->data;
+
+    for (size_t i = 0; i < req->ncases; i++) {
+        const struct test_spec *spec = &req->cases[i];
+        struct test_case *tc = &run->cases[i];
+        tc->run = run;
+        if (spec->name != NULL) snprintf(tc->name, sizeof(tc->name), "%s", spec->name);
+        else snprintf(tc->name, sizeof(tc->name), "#%lu", (unsigned long) i + 1);
+
+        struct stat st;
+        if (spec->input_file != NULL) {
+            if (stat(spec->input_file, &st) != 0 || !S_ISREG(st.st_mode)) {
+                *error = "Input file not found";
+                run_free(run);
+                return false;
+            }
+            snprintf(tc->input_path, sizeof(tc->input_path), "%s", spec->input_file);
+        } else if (spec->input != NULL && !write_input(run, tc, i, spec)) {
+            *error = "Cannot write the input file";
+            run_free(run);
+            return false;
+        }
+        if (spec->expected_file != NULL) {
+            if (stat(spec->expected_file, &st) != 0 || !S_ISREG(st.st_mode)) {
+                *error = "Expected output file not found";
+                run_free(run);
+                return false;
+            }
+            snprintf(tc->expected_path, sizeof(tc->expected_path), "%s", spec->expected_file);
+        } else if (spec->expected != NULL) {
+            tc->expected = malloc(spec->expected_len + 1);
+            if (tc->expected == NULL) {
+                *error = "Out of memory";
+                run_free(run);
+                return false;
+            }
+            memcpy(tc->expected, spec->expected, spec->expected_len);
+            tc->expected[spec->expected_len] = '\0';
+            tc->expected_len = spec->expected_len;
+        }
+    }
+
+    if (req->compile == NULL) {
+        run->compiled = true;
+        start_cases(run);
+        return true;
+    }
+    struct exec_request compile = {
+        .command = req->compile,
+        .name = req->name,
+        .client = run->client,
+        .priority = EXEC_PRIO_BUILD,
+        .done = compile_done,
+        .data = run,
+    };
+    struct exec_job *job = exec_start(&compile);
+    if (job == NULL) {
+        run_free(run);
+        *error = "Execution queue is full, try again later";
+        return false;
+    }
+    exec_subscribe(job, run->conn_id);
+    run->pending++;
+    return true;
+}
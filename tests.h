@@ -0,0 +1,124 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "exec.h"
+
+// ============================================================================
+// NEXUS File Manager - Test Runner
+// ============================================================================
+
+#define TESTS_MAX_CASES 256
+#define TESTS_OUTPUT_MAX 4096       // stdout / stderr kept per case for the reply
+#define TESTS_COMPILE_LOG_MAX 8192
+
+struct test_run;
+typedef void (*tests_done_fn)(struct test_run *run);
+
+/**
+ * Outcome of one case
+ */
+enum test_verdict {
+    TEST_PENDING,
+    TEST_PASSED,            // Output matches the expected output
+    TEST_WRONG_ANSWER,
+    TEST_RUNTIME_ERROR,     // Non-zero exit or killed by a signal
+    TEST_TIME_LIMIT,        // Wall-clock or CPU time limit
+    TEST_RAN,               // Exited 0, nothing to compare with
+    TEST_SKIPPED,           // Not run: compile error, cancelled, queue full
+};
+
+/**
+ * One case as given by the caller. Inline text and files are alternatives;
+ * the file wins when both are set.
+ */
+struct test_spec {
+    const char *name;               // Label, NULL for "#<n>"
+    const char *input;              // stdin text
+    size_t input_len;
+    const char *input_file;         // stdin file
+    const char *expected;           // Expected stdout, NULL for none
+    size_t expected_len;
+    const char *expected_file;
+};
+
+/**
+ * What to test, for tests_start()
+ */
+struct test_request {
+    const char *compile;            // Shell command run once first, NULL if none
+    const char *run;                // Shell command run per case
+    const char *name;               // Program, for job listings
+    const struct test_spec *cases;
+    size_t ncases;
+    bool ignore_whitespace;         // Compare whitespace-separated tokens
+    double timeout_s;               // Per case, 0 for the configured limit
+    const char *client;             // Fair-share key for the execution queue
+    unsigned long conn_id;          // Connection waiting; closing it cancels
+    tests_done_fn done;             // Called once every case is over
+    void *data;
+};
+
+struct test_case {
+    char name[128];
+    char input_path[1024];          // "" for /dev/null
+    bool input_tmp;                 // Written by the runner, removed at the end
+    char *expected;                 // Inline expected output, or NULL
+    size_t expected_len;
+    char expected_path[1024];       // Expected output file, or ""
+    enum test_verdict verdict;
+    enum exec_end end;
+    struct exec_stats stats;
+    char output[TESTS_OUTPUT_MAX];  // Start of stdout
+    size_t output_len;
+    bool output_truncated;
+    char error[TESTS_OUTPUT_MAX];   // Start of stderr
+    size_t error_len;
+    struct test_run *run;
+};
+
+/**
+ * A compile followed by parallel runs of every case
+ */
+struct test_run {
+    unsigned long id;
+    char *run_command;
+    char name[128];
+    bool ignore_whitespace;
+    double timeout_s;
+    struct test_case *cases;
+    size_t ncases;
+    size_t pending;
+    size_t passed;
+    bool compiled;                  // Compile step ran and succeeded (or none needed)
+    char compile_output[TESTS_COMPILE_LOG_MAX];
+    struct exec_stats compile_stats;
+    bool cancelled;
+    double start_ms;
+    double wall_ms;
+    char client[64];
+    unsigned long conn_id;
+    tests_done_fn done;
+    void *data;
+};
+
+/**
+ * Compile once, then run every case as its own job, in parallel up to the
+ * execution slots, each with its input on stdin. stdout is compared to the
+ * expected output byte for byte, or token by token with ignore_whitespace.
+ * `done` may be called before tests_start() returns when no case could be
+ * queued.
+ *
+ * @param req What to run
+ * @param error Set to a message when false is returned
+ * @return false if the run could not be started
+ */
+bool tests_start(const struct test_request *req, const char **error);
+
+/**
+ * Short name of a verdict: "AC", "WA", "RE", "TLE", "OK" or "SKIPPED"
+ */
+const char *tests_verdict_name(enum test_verdict v);
+
+#endif // TESTS_H
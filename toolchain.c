@@ -0,0 +1,541 @@
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "toolchain.h"
+#include "mongoose.h"
+
+// Built-in registry, in the config file's format. The handler sections'
+// commands are what the terminal menu runs; the web server builds its own.
+static const char defaults[] =
+    "[c]\n"
+    "ext = c\n"
+    "handler = c\n"
+    "compile = gcc -o {src}.out {src}\n"
+    "run = {src}.out\n"
+    "[cpp]\n"
+    "ext = cpp cc cxx\n"
+    "handler = c\n"
+    "compile = g++ -std=c++17 -o {src}.out {src}\n"
+    "run = {src}.out\n"
+    "[java]\n"
+    "ext = java\n"
+    "handler = java\n"
+    "compile = javac -d {dir} {src}\n"
+    "run = java -cp {dir} {name}\n"
+    "[kotlin]\n"
+    "ext = kt\n"
+    "handler = kotlin\n"
+    "compile = kotlinc {src} -include-runtime -d {src}.jar\n"
+    "run = java -jar {src}.jar\n"
+    "[rust]\n"
+    "ext = rs\n"
+    "handler = rust\n"
+    "compile = rustc -o {src}.out {src}\n"
+    "run = {src}.out\n"
+    "[go]\n"
+    "ext = go\n"
+    "compile = go build -o {stem} {src}\n"
+    "artifact = {stem}\n"
+    "run = {stem}\n"
+    "both = go run {src}\n"
+    "[swift]\n"
+    "ext = swift\n"
+    "compile = swiftc -o {stem} {src}\n"
+    "artifact = {stem}\n"
+    "run = {stem}\n"
+    "both = swift {src}\n"
+    "[typescript]\n"
+    "ext = ts\n"
+    "compile = tsc {src}\n"
+    "artifact = {stem}.js\n"
+    "run = node {stem}.js\n"
+    "both = ts-node {src}\n"
+    "[python]\n"
+    "ext = py\n"
+    "run = python3 {src}\n"
+    "[javascript]\n"
+    "ext = js\n"
+    "run = node {src}\n"
+    "[ruby]\n"
+    "ext = rb\n"
+    "run = ruby {src}\n"
+    "[php]\n"
+    "ext = php\n"
+    "run = php {src}\n"
+    "[perl]\n"
+    "ext = pl\n"
+    "run = perl {src}\n"
+    "[lua]\n"
+    "ext = lua\n"
+    "run = lua {src}\n"
+    "[r]\n"
+    "ext = r R\n"
+    "run = Rscript {src}\n"
+    "[dart]\n"
+    "ext = dart\n"
+    "run = dart {src}\n"
+    "[bash]\n"
+    "ext = sh bash\n"
+    "run = bash {src}\n"
+    "[zsh]\n"
+    "ext = zsh\n"
+    "run = zsh {src}\n"
+    "[fish]\n"
+    "ext = fish\n"
+    "run = fish {src}\n";
+
+static const char *handlers[] = {"c", "rust", "java", "kotlin"};
+static const char *action_keys[] = {"compile", "run", "both"};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct toolchain registry[TOOLCHAIN_MAX];
+static size_t count;
+static char config[PATH_MAX];       // "" without a config file
+
+// ----------------------------------------------------------------------------
+// Loading
+// ----------------------------------------------------------------------------
+
+static char *trim(char *s) {
+    while (isspace((unsigned char) *s)) s++;
+    size_t n = strlen(s);
+    while (n > 0 && isspace((unsigned char) s[n - 1])) s[--n] = '\0';
+    return s;
+}
+
+// Section by name; a section read again starts over
+static struct toolchain *section(const char *name) {
+    size_t i = 0;
+    while (i < count && strcmp(registry[i].name, name) != 0) i++;
+    if (i == TOOLCHAIN_MAX) return NULL;
+    if (i == count) count++;
+    memset(&registry[i], 0, sizeof(registry[i]));
+    snprintf(registry[i].name, sizeof(registry[i].name), "%s", name);
+    return &registry[i];
+}
+
+static void set_key(struct toolchain *tc, const char *key, char *value, const char *source,
+                    int line) {
+    if (strcmp(key, "ext") == 0) {
+        char *save = NULL;
+        tc->nexts = 0;
+        for (char *e = strtok_r(value, " \t", &save); e != NULL; e = strtok_r(NULL, " \t", &save)) {
+            if (tc->nexts == TOOLCHAIN_EXTS || strlen(e) >= sizeof(tc->exts[0])) {
+                MG_ERROR(("toolchain: %s:%d: too many or too long extensions", source, line));
+                break;
+            }
+            snprintf(tc->exts[tc->nexts++], sizeof(tc->exts[0]), "%s", *e == '.' ? e + 1 : e);
+        }
+        return;
+    }
+    if (strcmp(key, "handler") == 0) {
+        for (size_t i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++) {
+            if (strcmp(value, handlers[i]) == 0) {
+                snprintf(tc->handler, sizeof(tc->handler), "%s", value);
+                return;
+            }
+        }
+        MG_ERROR(("toolchain: %s:%d: unknown handler %s", source, line, value));
+        return;
+    }
+    if (strcmp(key, "artifact") == 0) {
+        if (strlen(value) >= TOOLCHAIN_TEMPLATE) {
+            MG_ERROR(("toolchain: %s:%d: artifact too long", source, line));
+        } else {
+            snprintf(tc->artifact, TOOLCHAIN_TEMPLATE, "%s", value);
+        }
+        return;
+    }
+    for (int a = 0; a < 3; a++) {
+        if (strcmp(key, action_keys[a]) != 0) continue;
+        if (strlen(value) >= TOOLCHAIN_TEMPLATE) {
+            MG_ERROR(("toolchain: %s:%d: command too long", source, line));
+        } else {
+            snprintf(tc->steps[a], TOOLCHAIN_TEMPLATE, "%s", value);
+        }
+        return;
+    }
+    MG_ERROR(("toolchain: %s:%d: unknown key %s", source, line, key));
+}
+
+static void parse(FILE *fp, const char *source) {
+    char buf[1024];
+    struct toolchain *tc = NULL;
+    for (int line = 1; fgets(buf, sizeof(buf), fp) != NULL; line++) {
+        char *s = trim(buf);
+        if (*s == '\0' || *s == '#') continue;
+        char *eq = strchr(s, '=');
+        if (*s == '[' && s[strlen(s) - 1] == ']') {
+            s[strlen(s) - 1] = '\0';
+            s = trim(s + 1);
+            if (*s == '\0' || strlen(s) >= sizeof(tc->name)) {
+                MG_ERROR(("toolchain: %s:%d: bad section name", source, line));
+                tc = NULL;
+            } else if ((tc = section(s)) == NULL) {
+                MG_ERROR(("toolchain: %s:%d: more than %d toolchains", source, line,
+                          TOOLCHAIN_MAX));
+            }
+        } else if (eq == NULL) {
+            MG_ERROR(("toolchain: %s:%d: expected key = value", source, line));
+        } else if (tc != NULL) {
+            *eq = '\0';
+            set_key(tc, trim(s), trim(eq + 1), source, line);
+        }
+    }
+}
+
+// Tools: the first word of every step that is not a placeholder
+static void find_tools(struct toolchain *tc) {
+    tc->ntools = 0;
+    for (int a = 0; a < 3; a++) {
+        char words[TOOLCHAIN_TEMPLATE], *save = NULL;
+        bool first = true;
+        snprintf(words, sizeof(words), "%s", tc->steps[a]);
+        for (char *w = strtok_r(words, " \t", &save); w != NULL; w = strtok_r(NULL, " \t", &save)) {
+            bool tool = first && strchr(w, '{') == NULL && strlen(w) < sizeof(tc->tools[0]);
+            first = strcmp(w, "&&") == 0;
+            for (int i = 0; tool && i < tc->ntools; i++) {
+                if (strcmp(tc->tools[i], w) == 0) tool = false;
+            }
+            if (tool && tc->ntools < TOOLCHAIN_TOOLS) {
+                snprintf(tc->tools[tc->ntools++], sizeof(tc->tools[0]), "%s", w);
+            }
+        }
+    }
+}
+
+static bool find_program(const char *name, char *buf, size_t size) {
+    if (strchr(name, '/') != NULL) {
+        snprintf(buf, size, "%s", name);
+        if (access(buf, X_OK) == 0) return true;
+        buf[0] = '\0';
+        return false;
+    }
+    const char *env = getenv("PATH");
+    char dirs[4096];
+    snprintf(dirs, sizeof(dirs), "%s", env != NULL ? env : "/usr/bin:/bin");
+    char *save = NULL;
+    for (char *d = strtok_r(dirs, ":", &save); d != NULL; d = strtok_r(NULL, ":", &save)) {
+        snprintf(buf, size, "%s/%s", d, name);
+        if (access(buf, X_OK) == 0) return true;
+    }
+    buf[0] = '\0';
+    return false;
+}
+
+// Reset to the built-in table, apply the config file and probe; lock held
+static bool load(void) {
+    count = 0;
+    FILE *fp = fmemopen((void *) defaults, sizeof(defaults) - 1, "r");
+    if (fp != NULL) {
+        parse(fp, "built-in");
+        fclose(fp);
+    }
+    bool ok = true;
+    if (config[0] != '\0') {
+        if ((fp = fopen(config, "r")) != NULL) {
+            parse(fp, config);
+            fclose(fp);
+        } else {
+            MG_ERROR(("toolchain: cannot read %s", config));
+            ok = false;
+        }
+    }
+
+    char missing[512] = "";
+    size_t available = 0;
+    for (size_t i = 0; i < count; i++) {
+        struct toolchain *tc = &registry[i];
+        find_tools(tc);
+        tc->available = tc->nexts > 0;
+        for (int t = 0; t < tc->ntools; t++) {
+            if (!find_program(tc->tools[t], tc->paths[t], sizeof(tc->paths[t]))) {
+                tc->available = false;
+                size_t n = strlen(missing);
+                snprintf(missing + n, sizeof(missing) - n, " %s", tc->tools[t]);
+            }
+        }
+        if (tc->available) available++;
+    }
+    MG_INFO(("toolchain: %lu of %lu languages available%s%s", (unsigned long) available,
+             (unsigned long) count, missing[0] ? ", missing:" : "", missing));
+    return ok;
+}
+
+void toolchain_init(void) {
+    const char *env = getenv("NEXUS_TOOLCHAINS");
+    if (env != NULL && *env != '\0') {
+        snprintf(config, sizeof(config), "%s", env);
+    } else {
+        char exe[PATH_MAX];
+        ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+        char *slash = n > 0 ? (exe[n] = '\0', strrchr(exe, '/')) : NULL;
+        if (slash != NULL) {
+            *slash = '\0';
+            int n = snprintf(config, sizeof(config), "%s/toolchains.conf", exe);
+            if (n < 0 || (size_t) n >= sizeof(config) || access(config, F_OK) != 0) {
+                config[0] = '\0';
+            }
+        }
+    }
+    pthread_mutex_lock(&lock);
+    load();
+    pthread_mutex_unlock(&lock);
+}
+
+bool toolchain_reload(void) {
+    pthread_mutex_lock(&lock);
+    bool ok = load();
+    pthread_mutex_unlock(&lock);
+    return ok;
+}
+
+bool toolchain_get(const char *ext, struct toolchain *out) {
+    bool found = false;
+    pthread_mutex_lock(&lock);
+    for (size_t i = 0; i < count && !found; i++) {
+        for (int e = 0; e < registry[i].nexts && !found; e++) {
+            if (strcmp(registry[i].exts[e], ext) == 0) {
+                *out = registry[i];
+                found = true;
+            }
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return found;
+}
+
+bool toolchain_at(size_t i, struct toolchain *out) {
+    pthread_mutex_lock(&lock);
+    bool found = i < count;
+    if (found) *out = registry[i];
+    pthread_mutex_unlock(&lock);
+    return found;
+}
+
+const char *toolchain_tool(const struct toolchain *tc, const char *name) {
+    for (int i = 0; i < tc->ntools; i++) {
+        if (strcmp(tc->tools[i], name) == 0 && tc->paths[i][0] != '\0') return tc->paths[i];
+    }
+    return name;
+}
+
+bool toolchain_has(const struct toolchain *tc, enum toolchain_action action) {
+    return tc->steps[action][0] != '\0';
+}
+
+// ----------------------------------------------------------------------------
+// Commands
+// ----------------------------------------------------------------------------
+
+struct vars {
+    const char *src, *dir, *stem, *name, *file;
+};
+
+// Append n bytes, counting what does not fit
+static void put(char *buf, size_t size, size_t *len, const char *s, size_t n) {
+    if (*len < size) memcpy(buf + *len, s, *len + n < size ? n : size - *len);
+    *len += n;
+}
+
+// Append a word, single-quoted unless it is plain
+static void put_word(char *buf, size_t size, size_t *len, const char *w) {
+    bool plain = *w != '\0';
+    for (const char *p = w; *p != '\0' && plain; p++) {
+        plain = isalnum((unsigned char) *p) || strchr("_./:+,=@%-", *p) != NULL;
+    }
+    if (*len > 0) put(buf, size, len, " ", 1);
+    if (plain) {
+        put(buf, size, len, w, strlen(w));
+        return;
+    }
+    put(buf, size, len, "'", 1);
+    for (; *w != '\0'; w++) {
+        if (*w == '\'') put(buf, size, len, "'\\''", 4);
+        else put(buf, size, len, w, 1);
+    }
+    put(buf, size, len, "'", 1);
+}
+
+static const char *var(const struct vars *v, const char *name, size_t n) {
+    if (n == 3 && memcmp(name, "src", 3) == 0) return v->src;
+    if (n == 3 && memcmp(name, "dir", 3) == 0) return v->dir;
+    if (n == 4 && memcmp(name, "stem", 4) == 0) return v->stem;
+    if (n == 4 && memcmp(name, "name", 4) == 0) return v->name;
+    if (n == 4 && memcmp(name, "file", 4) == 0) return v->file;
+    return NULL;
+}
+
+// Where expand() puts the words of a command: a shell command line, or
+// argument vectors with a NULL after each step
+struct words {
+    char *buf;
+    size_t size, len;
+    char **argv;                // NULL for a command line
+    int max, argc;
+};
+
+// One word, or the end of a step (NULL)
+static void emit(struct words *out, const char *w) {
+    if (out->argv == NULL) {
+        if (w == NULL) put(out->buf, out->size, &out->len, " &&", 3);
+        else put_word(out->buf, out->size, &out->len, w);
+        return;
+    }
+    if (out->argc < out->max) {
+        out->argv[out->argc] = NULL;
+        if (w != NULL && out->len < out->size) out->argv[out->argc] = out->buf + out->len;
+    }
+    out->argc++;
+    if (w != NULL) put(out->buf, out->size, &out->len, w, strlen(w) + 1);
+}
+
+// One template into out, after what is there already
+static void expand(const struct toolchain *tc, const char *tmpl, const struct vars *v,
+                   struct words *out) {
+    char words[TOOLCHAIN_TEMPLATE], *save = NULL;
+    bool first = true;
+    snprintf(words, sizeof(words), "%s", tmpl);
+    for (char *w = strtok_r(words, " \t", &save); w != NULL; w = strtok_r(NULL, " \t", &save)) {
+        if (strcmp(w, "&&") == 0) {
+            emit(out, NULL);
+            first = true;
+            continue;
+        }
+        char word[PATH_MAX * 2];
+        size_t n = 0;
+        for (const char *p = w; *p != '\0'; p++) {
+            const char *end = *p == '{' ? strchr(p, '}') : NULL;
+            const char *value = end != NULL ? var(v, p + 1, (size_t) (end - p - 1)) : NULL;
+            if (value != NULL) {
+                put(word, sizeof(word), &n, value, strlen(value));
+                p = end;
+            } else {
+                put(word, sizeof(word), &n, p, 1);
+            }
+        }
+        word[n < sizeof(word) ? n : sizeof(word) - 1] = '\0';
+        emit(out, first ? toolchain_tool(tc, word) : word);
+        first = false;
+    }
+}
+
+// What an action runs: its own command, or compile then run for "both".
+// A missing compile or run command falls back to the other one.
+static int templates(const struct toolchain *tc, enum toolchain_action action,
+                     const char *steps[2]) {
+    const char *compile = tc->steps[TOOLCHAIN_COMPILE], *run = tc->steps[TOOLCHAIN_RUN];
+    if (*run == '\0') run = tc->steps[TOOLCHAIN_BOTH][0] ? tc->steps[TOOLCHAIN_BOTH] : compile;
+    if (*compile == '\0') compile = run;
+    steps[0] = action == TOOLCHAIN_COMPILE ? compile : run;
+    if (action != TOOLCHAIN_BOTH) return 1;
+    if (tc->steps[TOOLCHAIN_BOTH][0] != '\0') {
+        steps[0] = tc->steps[TOOLCHAIN_BOTH];
+        return 1;
+    }
+    steps[0] = compile;
+    steps[1] = run;
+    return compile != run ? 2 : 1;
+}
+
+const char *toolchain_missing(const struct toolchain *tc, enum toolchain_action action) {
+    const char *steps[2];
+    int n = templates(tc, action, steps);
+    for (int i = 0; i < n; i++) {
+        char words[TOOLCHAIN_TEMPLATE], *save = NULL;
+        bool first = true;
+        snprintf(words, sizeof(words), "%s", steps[i]);
+        for (char *w = strtok_r(words, " \t", &save); w != NULL; w = strtok_r(NULL, " \t", &save)) {
+            for (int t = 0; first && t < tc->ntools; t++) {
+                if (strcmp(tc->tools[t], w) == 0 && tc->paths[t][0] == '\0') return tc->tools[t];
+            }
+            first = strcmp(w, "&&") == 0;
+        }
+    }
+    return NULL;
+}
+
+// Placeholder values for a source file
+struct file_vars {
+    char src[PATH_MAX], stem[PATH_MAX], name[256];
+    struct vars v;
+};
+
+static void file_vars(struct file_vars *fv, const char *location, const char *filename) {
+    bool here = location == NULL || location[0] == '\0';
+    if (here && filename[0] == '/') snprintf(fv->src, sizeof(fv->src), "%s", filename);
+    else snprintf(fv->src, sizeof(fv->src), "%s/%s", here ? "." : location, filename);
+    snprintf(fv->stem, sizeof(fv->stem), "%s", fv->src);
+    snprintf(fv->name, sizeof(fv->name), "%s", filename);
+    char *dot = strrchr(fv->name, '.');
+    if (dot != NULL && dot != fv->name) {
+        *dot = '\0';
+        fv->stem[strlen(fv->stem) - strlen(dot + 1) - 1] = '\0';
+    }
+    fv->v = (struct vars) {fv->src, here ? "." : location, fv->stem, fv->name, filename};
+}
+
+bool toolchain_command(const struct toolchain *tc, enum toolchain_action action,
+                       const char *location, const char *filename, char *buf, size_t size) {
+    struct file_vars fv;
+    file_vars(&fv, location, filename);
+
+    const char *steps[2];
+    int n = templates(tc, action, steps);
+    struct words out = {buf, size, 0, NULL, 0, 0};
+    for (int i = 0; i < n; i++) {
+        if (i > 0) emit(&out, NULL);
+        expand(tc, steps[i], &fv.v, &out);
+    }
+    put(buf, size, &out.len, "", 1);
+    return out.len <= size;
+}
+
+bool toolchain_argv(const struct toolchain *tc, enum toolchain_action action,
+                    const char *location, const char *filename, char *buf, size_t size,
+                    char **argv, int max) {
+    struct file_vars fv;
+    file_vars(&fv, location, filename);
+
+    const char *steps[2];
+    int n = templates(tc, action, steps);
+    struct words out = {buf, size, 0, argv, max, 0};
+    for (int i = 0; i < n; i++) {
+        if (i > 0) emit(&out, NULL);
+        expand(tc, steps[i], &fv.v, &out);
+    }
+    emit(&out, NULL);
+    emit(&out, NULL);
+    return out.len <= size && out.argc <= max;
+}
+
+bool toolchain_quote(const char *word, char *buf, size_t size) {
+    size_t len = 0;
+    put_word(buf, size, &len, word);
+    put(buf, size, &len, "", 1);
+    return len <= size;
+}
+
+bool toolchain_artifact(const struct toolchain *tc, const char *location, const char *filename,
+                        char *buf, size_t size) {
+    if (tc->artifact[0] == '\0') return false;
+    struct file_vars fv;
+    file_vars(&fv, location, filename);
+    size_t len = 0;
+    for (const char *p = tc->artifact; *p != '\0'; p++) {
+        const char *end = *p == '{' ? strchr(p, '}') : NULL;
+        const char *value = end != NULL ? var(&fv.v, p + 1, (size_t) (end - p - 1)) : NULL;
+        if (value != NULL) {
+            put(buf, size, &len, value, strlen(value));
+            p = end;
+        } else {
+            put(buf, size, &len, p, 1);
+        }
+    }
+    put(buf, size, &len, "", 1);
+    return len <= size;
+}
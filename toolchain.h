@@ -0,0 +1,165 @@
+#ifndef TOOLCHAIN_H
+#define TOOLCHAIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// ============================================================================
+// NEXUS File Manager - Language Toolchains
+// ============================================================================
+
+// Which program builds and runs each file type comes from a registry: the
+// built-in table below, overridden section by section by a config file.
+//
+//   [python]                   Language, one section each
+//   ext = py                   Extensions, case-sensitive
+//   run = python3 {src}        Command per action: compile, run, both
+//
+// Placeholders: {src} the source path, {dir} its directory, {stem} the path
+// without the extension, {name} the file name without it, {file} the file
+// name. "&&" chains steps. An action without a command falls back to run,
+// and "both" defaults to "compile && run". "artifact = {stem}" names what
+// compile writes, so batch builds can tell an up-to-date file.
+//
+// The first word of each step is a tool. Tools are looked up on PATH once,
+// at startup and on toolchain_reload(), and replaced by their absolute
+// paths, so a missing compiler is reported before anything runs and a
+// single-step command needs no shell (exec.c runs it directly).
+//
+//   handler = c | rust | java | kotlin
+// builds the commands in api_handler.c instead (profiles, object cache,
+// warm JVM); the section's tools are still probed and used by path.
+
+#define TOOLCHAIN_MAX 40
+#define TOOLCHAIN_EXTS 6
+#define TOOLCHAIN_TOOLS 4
+#define TOOLCHAIN_TEMPLATE 256
+
+enum toolchain_action {
+    TOOLCHAIN_COMPILE,
+    TOOLCHAIN_RUN,
+    TOOLCHAIN_BOTH,
+};
+
+struct toolchain {
+    char name[24];
+    char exts[TOOLCHAIN_EXTS][12];
+    int nexts;
+    char handler[12];                           // "" for template commands
+    char steps[3][TOOLCHAIN_TEMPLATE];          // By action; "" when not given
+    char artifact[TOOLCHAIN_TEMPLATE];          // Compile output; "" when not given
+    char tools[TOOLCHAIN_TOOLS][32];            // Programs the steps start
+    char paths[TOOLCHAIN_TOOLS][256];           // Absolute paths, "" when missing
+    int ntools;
+    bool available;                             // Every tool was found
+};
+
+/**
+ * Load the registry and probe its tools. Settings from the environment:
+ *   NEXUS_TOOLCHAINS   config file (default: toolchains.conf next to the
+ *                      server binary, if there is one)
+ */
+void toolchain_init(void);
+
+/**
+ * Re-read the config file and probe every tool again, e.g. after
+ * installing a compiler
+ *
+ * @return false if the config file could not be read; the built-in table
+ *         is used then
+ */
+bool toolchain_reload(void);
+
+/**
+ * Copy the toolchain for a file type
+ *
+ * @param ext Extension without the dot
+ * @param out Destination
+ * @return false if no toolchain handles the extension
+ */
+bool toolchain_get(const char *ext, struct toolchain *out);
+
+/**
+ * Copy the i-th toolchain, for listings
+ *
+ * @return false past the last one
+ */
+bool toolchain_at(size_t i, struct toolchain *out);
+
+/**
+ * Absolute path of a tool, or its bare name if the toolchain has no such
+ * tool or it was not found
+ */
+const char *toolchain_tool(const struct toolchain *tc, const char *name);
+
+/**
+ * Whether an action has a command of its own (compile: is the language
+ * built before it runs)
+ */
+bool toolchain_has(const struct toolchain *tc, enum toolchain_action action);
+
+/**
+ * Tool an action needs that was not found
+ *
+ * @return Tool name, or NULL when the action can run
+ */
+const char *toolchain_missing(const struct toolchain *tc, enum toolchain_action action);
+
+/**
+ * Command line for an action on a source file, with tools replaced by
+ * their paths and substituted values quoted for the shell
+ *
+ * @param tc Toolchain, not a handler one
+ * @param action What to do
+ * @param location Directory of the file, "" for the current one
+ * @param filename File name
+ * @param buf Destination
+ * @param size Size of buf
+ * @return false if it does not fit
+ */
+bool toolchain_command(const struct toolchain *tc, enum toolchain_action action,
+                       const char *location, const char *filename, char *buf, size_t size);
+
+/**
+ * The same command as argument vectors, to run step by step without a
+ * shell: each step's words end with a NULL, and an empty step ends the list
+ *
+ * @param tc Toolchain, not a handler one
+ * @param action What to do
+ * @param location Directory of the file, "" for the current one
+ * @param filename File name
+ * @param buf Storage for the words
+ * @param size Size of buf
+ * @param argv Destination for the word pointers
+ * @param max Entries in argv
+ * @return false if it does not fit
+ */
+bool toolchain_argv(const struct toolchain *tc, enum toolchain_action action,
+                    const char *location, const char *filename, char *buf, size_t size,
+                    char **argv, int max);
+
+/**
+ * Quote a word for the shell like toolchain_command() does: as it is when
+ * plain, else in single quotes
+ *
+ * @param word Word
+ * @param buf Destination
+ * @param size Size of buf
+ * @return false if it does not fit
+ */
+bool toolchain_quote(const char *word, char *buf, size_t size);
+
+/**
+ * Path of what the compile command writes for a source file, unquoted
+ *
+ * @param tc Toolchain, not a handler one
+ * @param location Directory of the file, "" for the current one
+ * @param filename File name
+ * @param buf Destination
+ * @param size Size of buf
+ * @return false if the toolchain names no artifact or it does not fit
+ */
+bool toolchain_artifact(const struct toolchain *tc, const char *location, const char *filename,
+                        char *buf, size_t size);
+
+#endif // TOOLCHAIN_H
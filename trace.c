@@ -0,0 +1,162 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.h"
+#include "json_writer.h"
+
+#define RING_MASK (TRACE_RING_SIZE - 1)
+
+_Static_assert((TRACE_RING_SIZE & RING_MASK) == 0, "TRACE_RING_SIZE must be a power of two");
+
+struct trace_event {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t dur_ns;
+};
+
+/**
+ * Single-writer ring. The owning thread fills a slot, then publishes it by
+ * advancing `head` with release order; readers never block it. A reader
+ * that raced with the writer drops the slots that were overwritten while it
+ * was copying.
+ */
+struct trace_ring {
+    struct trace_event events[TRACE_RING_SIZE];
+    uint64_t head;              // Total events ever written
+    long tid;
+    struct trace_ring *next;
+};
+
+static struct trace_ring *rings;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned sample_every = TRACE_DEFAULT_SAMPLE;
+static uint64_t epoch_ns;
+
+static __thread struct trace_ring *local;
+static __thread unsigned request_count;
+static __thread bool sampled;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+void trace_init(void) {
+    const char *env = getenv("NEXUS_TRACE_SAMPLE");
+    if (env != NULL && *env != '\0') trace_set_sample((unsigned) strtoul(env, NULL, 10));
+    epoch_ns = now_ns();
+    MG_INFO(("tracing: 1 request in %u", trace_sample()));
+}
+
+void trace_set_sample(unsigned every) {
+    __atomic_store_n(&sample_every, every, __ATOMIC_RELAXED);
+}
+
+unsigned trace_sample(void) {
+    return __atomic_load_n(&sample_every, __ATOMIC_RELAXED);
+}
+
+bool trace_request_begin(void) {
+    unsigned every = trace_sample();
+    sampled = every != 0 && ++request_count % every == 0;
+    return sampled;
+}
+
+void trace_request_end(void) {
+    sampled = false;
+}
+
+uint64_t trace_begin(void) {
+    return sampled ? now_ns() : 0;
+}
+
+static struct trace_ring *ring(void) {
+    if (local != NULL) return local;
+    local = calloc(1, sizeof(*local));
+    if (local == NULL) return NULL;
+    local->tid = (long) syscall(SYS_gettid);
+    pthread_mutex_lock(&rings_lock);
+    local->next = rings;
+    rings = local;
+    pthread_mutex_unlock(&rings_lock);
+    return local;
+}
+
+void trace_end(const char *name, uint64_t start) {
+    if (start == 0) return;
+    struct trace_ring *r = ring();
+    if (r == NULL) return;
+
+    uint64_t head = r->head;
+    struct trace_event *e = &r->events[head & RING_MASK];
+    __atomic_store_n(&e->name, name, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->start_ns, start, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->dur_ns, now_ns() - start, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Copy the valid tail of a ring. Returns the number of events in `out`.
+static size_t snapshot(struct trace_ring *r, struct trace_event *out) {
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+    for (uint64_t i = first; i < head; i++) {
+        struct trace_event *e = &r->events[i & RING_MASK];
+        out[i - first].name = __atomic_load_n(&e->name, __ATOMIC_RELAXED);
+        out[i - first].start_ns = __atomic_load_n(&e->start_ns, __ATOMIC_RELAXED);
+        out[i - first].dur_ns = __atomic_load_n(&e->dur_ns, __ATOMIC_RELAXED);
+    }
+
+    // Slots the writer reused while we copied are not trustworthy
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t now = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    uint64_t overwritten = now > TRACE_RING_SIZE ? now - TRACE_RING_SIZE : 0;
+    if (overwritten <= first) return (size_t) (head - first);
+    if (overwritten >= head) return 0;
+    size_t skip = (size_t) (overwritten - first);
+    memmove(out, out + skip, (size_t) (head - overwritten) * sizeof(*out));
+    return (size_t) (head - overwritten);
+}
+
+void trace_serve(struct mg_connection *c) {
+    struct trace_event *buf = malloc(TRACE_RING_SIZE * sizeof(*buf));
+    if (buf == NULL) {
+        json_reply_error(c, 500, "Memory allocation failed");
+        return;
+    }
+
+    struct json_writer w;
+    long pid = (long) getpid();
+    jw_begin(&w, c, 200);
+    jw_object_begin(&w);
+    jw_kv_str(&w, "displayTimeUnit", "ms");
+    jw_kv_int(&w, "sampleEvery", trace_sample());
+    jw_key(&w, "traceEvents");
+    jw_array_begin(&w);
+
+    pthread_mutex_lock(&rings_lock);
+    for (struct trace_ring *r = rings; r != NULL; r = r->next) {
+        size_t n = snapshot(r, buf);
+        for (size_t i = 0; i < n; i++) {
+            // Complete events ("X"), timestamps in microseconds since startup
+            jw_object_begin(&w);
+            jw_kv_str(&w, "name", buf[i].name);
+            jw_kv_str(&w, "ph", "X");
+            jw_kv_int(&w, "ts", (long long) ((buf[i].start_ns - epoch_ns) / 1000));
+            jw_kv_double(&w, "dur", (double) buf[i].dur_ns / 1000.0);
+            jw_kv_int(&w, "pid", pid);
+            jw_kv_int(&w, "tid", r->tid);
+            jw_object_end(&w);
+        }
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    jw_array_end(&w);
+    jw_object_end(&w);
+    jw_end(&w);
+    free(buf);
+}
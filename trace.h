@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mongoose.h"
+
+// ============================================================================
+// NEXUS File Manager - Request Tracing
+// ============================================================================
+
+// Spans kept per thread; older ones are overwritten. Must be a power of two.
+#define TRACE_RING_SIZE 8192
+
+// Default sampling: trace one request in this many (0 disables tracing).
+// Overridden by the NEXUS_TRACE_SAMPLE environment variable.
+#define TRACE_DEFAULT_SAMPLE 64
+
+/**
+ * Read the sampling rate from the environment. Call once at startup.
+ */
+void trace_init(void);
+
+/**
+ * Change the sampling rate at runtime
+ *
+ * @param every Trace one request in `every`; 1 traces all, 0 none
+ */
+void trace_set_sample(unsigned every);
+
+/**
+ * Current sampling rate, see trace_set_sample()
+ */
+unsigned trace_sample(void);
+
+/**
+ * Decide whether the request now starting on this thread is traced.
+ * Spans opened by this thread are only recorded while it is.
+ *
+ * @return true if the request is sampled
+ */
+bool trace_request_begin(void);
+
+/**
+ * End of the current request on this thread; stops recording spans
+ */
+void trace_request_end(void);
+
+/**
+ * Open a span
+ *
+ * @return Start timestamp, or 0 if the current request is not sampled
+ */
+uint64_t trace_begin(void);
+
+/**
+ * Close a span and record it in the calling thread's ring.
+ * Does nothing for a start of 0, so unsampled requests cost one branch.
+ *
+ * @param name Span name; must be a string literal or otherwise static
+ * @param start Value returned by trace_begin()
+ */
+void trace_end(const char *name, uint64_t start);
+
+/**
+ * Reply with every thread's recorded spans in the Chrome trace-event
+ * format (load in chrome://tracing or ui.perfetto.dev)
+ *
+ * @param c Mongoose connection
+ */
+void trace_serve(struct mg_connection *c);
+
+#endif // TRACE_H
@@ -0,0 +1,495 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include "watch.h"
+#include "exec.h"
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+// A watched directory, shared by every file in it
+struct watch_dir {
+    int wd;
+    int refs;
+    char path[PATH_MAX];
+    struct watch_dir *next;
+};
+
+struct watch {
+    unsigned long id;
+    char *files[WATCH_MAX_FILES];       // Real paths, the source first
+    int wds[WATCH_MAX_FILES];           // Their directories' watches
+    int nfiles;
+    char *build, *run;
+    bool headers;
+    char name[128];
+    char client[64];
+    unsigned char digest[32];           // Content of the last good build
+    unsigned char pending[32];          // Content the running job started from
+    bool built;                         // digest is valid
+    bool rebuild;                       // The running job builds
+    bool dirty;                         // Saved since the job started
+    bool again;                         // Start over once the stale job ends
+    unsigned long job_id;               // 0 when idle
+    unsigned long subscribers[WATCH_MAX_SUBSCRIBERS];  // Connection ids
+    int nsubscribers;
+    struct watch *next;
+};
+
+static struct mg_mgr *mgr;
+static int debounce_ms = 25;
+static int max_watches = 32;
+static int inotify_fd = -1;
+static int event_fds[2] = {-1, -1};     // Thread -> event loop
+static struct watch_dir *dirs;
+static struct watch *watches;
+static int nwatches;
+static unsigned long next_id = 1;
+
+void watch_init(struct mg_mgr *m) {
+    const char *env;
+    mgr = m;
+    if ((env = getenv("NEXUS_WATCH_DEBOUNCE")) != NULL && *env != '\0') debounce_ms = atoi(env);
+    if ((env = getenv("NEXUS_WATCH_MAX")) != NULL && atoi(env) > 0) max_watches = atoi(env);
+    if (debounce_ms < 0) debounce_ms = 0;
+}
+
+// ----------------------------------------------------------------------------
+// inotify: a thread blocks on it and forwards the events to the loop, then
+// a marker once nothing has changed for debounce_ms
+// ----------------------------------------------------------------------------
+
+static bool send_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+static void *watch_thread(void *arg) {
+    (void) arg;
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd p = {.fd = inotify_fd, .events = POLLIN};
+    struct inotify_event quiet = {.wd = -1};
+    int timeout = -1;
+    for (;;) {
+        int r = poll(&p, 1, timeout);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) break;
+        if (r == 0) {
+            if (!send_all(event_fds[1], &quiet, sizeof(quiet))) break;
+            timeout = -1;
+            continue;
+        }
+        ssize_t n = read(inotify_fd, buf, sizeof(buf));
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n <= 0 || !send_all(event_fds[1], buf, (size_t) n)) break;
+        timeout = debounce_ms;
+    }
+    MG_ERROR(("watch: event thread stopped: %s", strerror(errno)));
+    return NULL;
+}
+
+static void trigger(struct watch *w);
+
+static void on_event(const struct inotify_event *e, const char *name) {
+    if (e->wd == -1 && (e->mask & IN_Q_OVERFLOW)) {
+        // Events were lost: anything may have changed
+        for (struct watch *w = watches; w != NULL; w = w->next) w->dirty = true;
+        return;
+    }
+    if (e->wd == -1) {
+        // Quiet again: one rebuild per burst of saves
+        for (struct watch *w = watches, *next; w != NULL; w = next) {
+            next = w->next;
+            if (w->dirty) trigger(w);
+        }
+        return;
+    }
+    struct watch_dir *d = dirs;
+    while (d != NULL && d->wd != e->wd) d = d->next;
+    if (d == NULL || name[0] == '\0') return;
+    char path[PATH_MAX * 2];
+    snprintf(path, sizeof(path), "%s/%s", d->path, name);
+    for (struct watch *w = watches; w != NULL; w = w->next) {
+        for (int i = 0; i < w->nfiles && !w->dirty; i++) {
+            if (w->wds[i] == e->wd && strcmp(w->files[i], path) == 0) w->dirty = true;
+        }
+    }
+}
+
+// Events arrive whole or in pieces; only whole ones are taken
+static void events_handler(struct mg_connection *c, int ev, void *ev_data) {
+    (void) ev_data;
+    if (ev != MG_EV_READ) return;
+    size_t ofs = 0;
+    while (c->recv.len - ofs >= sizeof(struct inotify_event)) {
+        struct inotify_event e;
+        memcpy(&e, c->recv.buf + ofs, sizeof(e));
+        size_t size = sizeof(e) + e.len;
+        if (c->recv.len - ofs < size) break;
+        char name[NAME_MAX + 1];
+        snprintf(name, sizeof(name), "%.*s", (int) e.len, (const char *) c->recv.buf + ofs + sizeof(e));
+        on_event(&e, name);
+        ofs += size;
+    }
+    mg_iobuf_del(&c->recv, 0, ofs);
+}
+
+// inotify and its thread, the first time a file is watched
+static bool start(void) {
+    if (inotify_fd >= 0) return true;
+    pthread_t thread;
+    if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        MG_ERROR(("watch: inotify: %s", strerror(errno)));
+        return false;
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, event_fds) != 0 ||
+        mg_wrapfd(mgr, event_fds[0], events_handler, NULL) == NULL ||
+        pthread_create(&thread, NULL, watch_thread, NULL) != 0) {
+        MG_ERROR(("watch: cannot start the event thread"));
+        close(inotify_fd);
+        inotify_fd = -1;
+        return false;
+    }
+    fcntl(event_fds[0], F_SETFL, fcntl(event_fds[0], F_GETFL) | O_NONBLOCK);
+    pthread_detach(thread);
+    MG_INFO(("watch: inotify up, %d ms debounce", debounce_ms));
+    return true;
+}
+
+// Watch the directory of a file; returns the watch descriptor or -1
+static int dir_add(const char *file) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", file);
+    char *slash = strrchr(path, '/');
+    if (slash == NULL) return -1;
+    *slash = '\0';
+    if (slash == path) snprintf(path, sizeof(path), "/");
+    int wd = inotify_add_watch(inotify_fd, path, WATCH_EVENTS);
+    if (wd < 0) return -1;
+    struct watch_dir *d = dirs;
+    while (d != NULL && d->wd != wd) d = d->next;
+    if (d == NULL) {
+        if ((d = calloc(1, sizeof(*d))) == NULL) return -1;
+        d->wd = wd;
+        snprintf(d->path, sizeof(d->path), "%s", slash == path ? "" : path);
+        d->next = dirs;
+        dirs = d;
+    }
+    d->refs++;
+    return wd;
+}
+
+static void dir_release(int wd) {
+    for (struct watch_dir **p = &dirs; *p != NULL; p = &(*p)->next) {
+        struct watch_dir *d = *p;
+        if (d->wd != wd) continue;
+        if (--d->refs == 0) {
+            inotify_rm_watch(inotify_fd, wd);
+            *p = d->next;
+            free(d);
+        }
+        return;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Files and their content
+// ----------------------------------------------------------------------------
+
+// Headers pulled in with #include "...", found next to the including file,
+// added to files[] breadth first; returns the new count
+static int scan_includes(char **files, int n) {
+    for (int i = 0; i < n && n < WATCH_MAX_FILES; i++) {
+        FILE *fp = fopen(files[i], "r");
+        if (fp == NULL) continue;
+        char line[1024], dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s", files[i]);
+        *strrchr(dir, '/') = '\0';
+        while (n < WATCH_MAX_FILES && fgets(line, sizeof(line), fp) != NULL) {
+            char *p = line + strspn(line, " \t");
+            if (*p++ != '#') continue;
+            p += strspn(p, " \t");
+            if (strncmp(p, "include", 7) != 0) continue;
+            p += 7;
+            p += strspn(p, " \t");
+            char *end = *p == '"' ? strchr(p + 1, '"') : NULL;
+            if (end == NULL) continue;
+            *end = '\0';
+            char path[PATH_MAX * 2], real[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", p[1] == '/' ? "" : dir, p + 1);
+            if (realpath(path, real) == NULL) continue;
+            bool known = false;
+            for (int j = 0; j < n && !known; j++) known = strcmp(files[j], real) == 0;
+            if (!known && (files[n] = strdup(real)) != NULL) n++;
+        }
+        fclose(fp);
+    }
+    return n;
+}
+
+// Re-read the headers and move the directory watches along; true if the
+// file list changed
+static bool update_files(struct watch *w) {
+    char *files[WATCH_MAX_FILES] = {w->files[0]};
+    int n = 1;
+    if (w->headers) n = scan_includes(files, n);
+    bool same = n == w->nfiles;
+    for (int i = 1; i < n && same; i++) same = strcmp(files[i], w->files[i]) == 0;
+    if (same && w->wds[0] >= 0) {
+        for (int i = 1; i < n; i++) free(files[i]);
+        return false;
+    }
+    int wds[WATCH_MAX_FILES];
+    for (int i = 0; i < n; i++) wds[i] = dir_add(files[i]);
+    for (int i = 0; i < w->nfiles; i++) {
+        if (w->wds[i] >= 0) dir_release(w->wds[i]);
+        if (i > 0) free(w->files[i]);
+    }
+    memcpy(w->files, files, sizeof(files));
+    memcpy(w->wds, wds, sizeof(wds));
+    w->nfiles = n;
+    return true;
+}
+
+// SHA-256 over every watched file's name and content
+static void digest(const struct watch *w, unsigned char out[32]) {
+    mg_sha256_ctx ctx;
+    mg_sha256_init(&ctx);
+    for (int i = 0; i < w->nfiles; i++) {
+        mg_sha256_update(&ctx, (const unsigned char *) w->files[i], strlen(w->files[i]) + 1);
+        int fd = open(w->files[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        unsigned char buf[16384];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) mg_sha256_update(&ctx, buf, (size_t) n);
+        close(fd);
+    }
+    mg_sha256_final(out, &ctx);
+}
+
+// ----------------------------------------------------------------------------
+// Runs
+// ----------------------------------------------------------------------------
+
+// Send a message to every subscriber and free it
+static void broadcast(struct watch *w, char *msg) {
+    if (msg == NULL) return;
+    for (struct mg_connection *c = mgr->conns; c != NULL; c = c->next) {
+        for (int i = 0; i < w->nsubscribers; i++) {
+            if (w->subscribers[i] == c->id && !c->is_closing) {
+                mg_ws_send(c, msg, strlen(msg), WEBSOCKET_OP_TEXT);
+            }
+        }
+    }
+    free(msg);
+}
+
+static char *files_message(const struct watch *w) {
+    char *msg = mg_mprintf("{%m:%m,%m:[", MG_ESC("type"), MG_ESC("watching"), MG_ESC("files"));
+    for (int i = 0; i < w->nfiles && msg != NULL; i++) {
+        char *next = mg_mprintf("%s%s%m", msg, i > 0 ? "," : "", MG_ESC(w->files[i]));
+        free(msg);
+        msg = next;
+    }
+    char *done = msg != NULL ? mg_mprintf("%s]}", msg) : NULL;
+    free(msg);
+    return done;
+}
+
+static struct watch *watch_by_id(unsigned long id) {
+    struct watch *w = watches;
+    while (w != NULL && w->id != id) w = w->next;
+    return w;
+}
+
+static void watch_done(struct exec_job *job) {
+    struct watch *w = watch_by_id((unsigned long) (uintptr_t) job->data);
+    if (w == NULL) return;                  // Nobody watches any more
+    if (w->job_id == job->id) w->job_id = 0;
+    if (w->again && job->end == EXEC_CANCELLED) {
+        w->again = false;
+        trigger(w);
+        return;
+    }
+    bool ok = job->end == EXEC_EXITED && job->stats.exit_code == 0;
+    if (w->rebuild) {
+        // A failed run means a rebuild next time too, whatever failed
+        w->built = ok;
+        memcpy(w->digest, w->pending, sizeof(w->digest));
+    }
+    char *output = malloc(WATCH_OUTPUT_MAX + 1);
+    size_t n = output != NULL ? output_read(job->output, 0, output, WATCH_OUTPUT_MAX) : 0;
+    if (output != NULL) output[n] = '\0';
+    broadcast(w, mg_mprintf("{%m:%m,%m:%lu,%m:%s,%m:%s,%m:%d,%m:%m,%m:%llu,%m:%s,%m:%g}",
+                            MG_ESC("type"), MG_ESC("result"),
+                            MG_ESC("jobId"), job->id,
+                            MG_ESC("success"), ok ? "true" : "false",
+                            MG_ESC("rebuild"), w->rebuild ? "true" : "false",
+                            MG_ESC("exitCode"), job->stats.exit_code,
+                            MG_ESC("output"), mg_print_esc, (int) n, output != NULL ? output : "",
+                            MG_ESC("outputBytes"), (unsigned long long) job->output->total,
+                            MG_ESC("outputTruncated"), job->output->total > n ? "true" : "false",
+                            MG_ESC("wallMs"), job->stats.wall_ms));
+    free(output);
+    if (w->dirty) trigger(w);               // Saved again while it ran
+}
+
+// Start a run for the files as they are now, replacing a stale one
+static void trigger(struct watch *w) {
+    w->dirty = false;
+    struct exec_job *job = w->job_id != 0 ? exec_find(w->job_id) : NULL;
+    if (job != NULL) {
+        w->again = true;
+        broadcast(w, mg_mprintf("{%m:%m,%m:%lu}", MG_ESC("type"), MG_ESC("stale"),
+                                MG_ESC("jobId"), job->id));
+        exec_stop(job, EXEC_CANCELLED);
+        return;
+    }
+    if (update_files(w)) broadcast(w, files_message(w));
+    digest(w, w->pending);
+    w->rebuild = w->run == NULL || !w->built || memcmp(w->pending, w->digest, 32) != 0;
+    struct exec_request req = {
+        .command = w->rebuild ? w->build : w->run,
+        .name = w->name,
+        .client = w->client,
+        .priority = w->rebuild && w->run != NULL ? EXEC_PRIO_BUILD : EXEC_PRIO_RUN,
+        .done = watch_done,
+        .data = (void *) (uintptr_t) w->id,
+    };
+    if ((job = exec_start(&req)) == NULL) {
+        broadcast(w, mg_mprintf("{%m:%m,%m:%m}", MG_ESC("type"), MG_ESC("error"),
+                                MG_ESC("error"), MG_ESC("Execution queue is full")));
+        return;
+    }
+    for (int i = 0; i < w->nsubscribers; i++) exec_subscribe(job, w->subscribers[i]);
+    w->job_id = job->id;
+    broadcast(w, mg_mprintf("{%m:%m,%m:%lu,%m:%s}", MG_ESC("type"), MG_ESC("start"),
+                            MG_ESC("jobId"), job->id,
+                            MG_ESC("rebuild"), w->rebuild ? "true" : "false"));
+}
+
+static void watch_free(struct watch *w) {
+    for (struct watch **p = &watches; *p != NULL; p = &(*p)->next) {
+        if (*p == w) {
+            *p = w->next;
+            break;
+        }
+    }
+    for (int i = 0; i < w->nfiles; i++) {
+        if (w->wds[i] >= 0) dir_release(w->wds[i]);
+        free(w->files[i]);
+    }
+    if (w->nfiles == 0) free(w->files[0]);
+    free(w->build);
+    free(w->run);
+    free(w);
+    nwatches--;
+}
+
+bool watch_open(struct mg_connection *c, struct mg_http_message *hm,
+                const struct watch_request *req, const char **error) {
+    char real[PATH_MAX];
+    if (realpath(req->path, real) == NULL) {
+        *error = "File not found";
+        return false;
+    }
+    if (!start()) {
+        *error = "Cannot watch files on this server";
+        return false;
+    }
+    // Subscribers of the same file and commands share one watch
+    struct watch *w = watches;
+    while (w != NULL && (strcmp(w->files[0], real) != 0 || strcmp(w->build, req->build) != 0)) {
+        w = w->next;
+    }
+    bool fresh = w == NULL;
+    if (fresh && nwatches >= max_watches) {
+        *error = "Too many files watched, try again later";
+        return false;
+    }
+    if (fresh) {
+        if ((w = calloc(1, sizeof(*w))) == NULL ||
+            (w->files[0] = strdup(real)) == NULL || (w->build = strdup(req->build)) == NULL ||
+            (req->run != NULL && (w->run = strdup(req->run)) == NULL)) {
+            if (w != NULL) {
+                free(w->files[0]);
+                free(w->build);
+                free(w);
+            }
+            *error = "Out of memory";
+            return false;
+        }
+        w->id = next_id++;
+        w->wds[0] = -1;
+        w->headers = req->headers;
+        snprintf(w->name, sizeof(w->name), "%s", req->name);
+        snprintf(w->client, sizeof(w->client), "%s", req->client);
+        w->next = watches;
+        watches = w;
+        nwatches++;
+    } else if (w->nsubscribers == WATCH_MAX_SUBSCRIBERS) {
+        *error = "Too many subscribers for this file";
+        return false;
+    }
+    w->subscribers[w->nsubscribers++] = c->id;
+    mg_ws_upgrade(c, hm, NULL);
+    if (fresh) update_files(w);
+    char *files = files_message(w);
+    if (files != NULL) mg_ws_send(c, files, strlen(files), WEBSOCKET_OP_TEXT);
+    free(files);
+    struct exec_job *job = w->job_id != 0 ? exec_find(w->job_id) : NULL;
+    if (fresh) {
+        trigger(w);
+    } else if (job != NULL) {
+        exec_subscribe(job, c->id);
+    }
+    MG_INFO(("watch %lu: %s, %d files, %d subscribers", w->id, w->files[0], w->nfiles,
+             w->nsubscribers));
+    return true;
+}
+
+static struct watch *watch_by_conn(unsigned long conn_id, int *index) {
+    for (struct watch *w = watches; w != NULL; w = w->next) {
+        for (int i = 0; i < w->nsubscribers; i++) {
+            if (w->subscribers[i] == conn_id) {
+                *index = i;
+                return w;
+            }
+        }
+    }
+    return NULL;
+}
+
+void watch_ws_message(struct mg_connection *c, struct mg_ws_message *wm) {
+    int i;
+    struct watch *w = watch_by_conn(c->id, &i);
+    if (w == NULL) return;
+    char *type = mg_json_get_str(wm->data, "$.type");
+    if (type != NULL && strcmp(type, "run") == 0) trigger(w);
+    free(type);
+}
+
+void watch_close(struct mg_connection *c) {
+    int i;
+    struct watch *w = watch_by_conn(c->id, &i);
+    if (w == NULL) return;
+    w->subscribers[i] = w->subscribers[--w->nsubscribers];
+    if (w->nsubscribers == 0) {
+        MG_INFO(("watch %lu: %s, no subscribers left", w->id, w->files[0]));
+        watch_free(w);
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+#include "mongoose.h"
+
+// ============================================================================
+// NEXUS File Manager - Watch Mode
+// ============================================================================
+
+// A watch rebuilds and reruns a source file each time it is saved, and
+// streams the results to every WebSocket subscribed to it. inotify watches
+// the directories of the source and, for C and C++, of the headers it
+// includes with #include "...": editors that save through a rename are
+// seen too. A thread turns the inotify descriptor into a socket for the
+// event loop and holds events back until the files have been quiet for the
+// debounce interval, so one save is one rebuild.
+//
+// Messages to the browser, as JSON text:
+//   {"type":"watching","files":[...]}          What is watched, on changes
+//   {"type":"start","jobId":N,"rebuild":B}     A run started; rebuild is
+//                                              false when the content has
+//                                              not changed since the last
+//                                              good build, which is reused
+//   {"type":"stale","jobId":N}                 A newer save stopped it
+//   {"type":"result","jobId":N,"success":B,"exitCode":N,"output":"...",
+//    "outputBytes":N,"wallMs":N,...}           It ended
+// {"type":"run"} from the browser runs it again without a save.
+
+#define WATCH_MAX_FILES 32              // Source plus headers
+#define WATCH_MAX_SUBSCRIBERS 8
+#define WATCH_OUTPUT_MAX 65536          // Output bytes per result message
+
+/**
+ * What to watch and how to rebuild it
+ */
+struct watch_request {
+    const char *path;           // Source file
+    const char *build;          // Command that builds and runs it
+    const char *run;            // Command that runs the last build, NULL when
+                                // the language has no build step
+    bool headers;               // Follow #include "..." (C and C++)
+    const char *name;           // For job listings
+    const char *client;         // Fair-share key
+};
+
+/**
+ * Read the settings from the environment:
+ *   NEXUS_WATCH_DEBOUNCE   quiet milliseconds after a change before the
+ *                          rebuild starts (default 25)
+ *   NEXUS_WATCH_MAX        files watched at once (default 32)
+ *
+ * @param mgr Event manager whose loop runs the watches
+ */
+void watch_init(struct mg_mgr *mgr);
+
+/**
+ * Subscribe the connection to a file's watch, creating it if it is new,
+ * and turn the connection into a WebSocket. A new watch builds and runs
+ * the file straight away.
+ *
+ * @param c Connection of the upgrade request
+ * @param hm The request, with a Sec-WebSocket-Key header
+ * @param req What to watch; copied
+ * @param error Set to a message when false is returned
+ * @return false if the watch could not be started; nothing was sent then
+ */
+bool watch_open(struct mg_connection *c, struct mg_http_message *hm,
+                const struct watch_request *req, const char **error);
+
+/**
+ * WebSocket message from a subscriber
+ */
+void watch_ws_message(struct mg_connection *c, struct mg_ws_message *wm);
+
+/**
+ * Connection closed: drop its subscription; a watch nobody follows ends
+ */
+void watch_close(struct mg_connection *c);
+
+#endif // WATCH_H